@@ -0,0 +1,507 @@
+/**
+Stream time bitstream patching. Bytes are parsed against the ECP5 command set as they pass, patched
+bytes are only allowed in command operands & uncompressed frame data. Crc runs over the original &
+the patched bytes, the original is checked at every crc so the parse is known to be in step.
+*/
+#include "bitstream_patch.h"
+#include <string.h>
+
+
+/** ECP5 bitstream commands, operands follow the 3 param bytes.
+*/
+enum FEcpCommands
+{
+	ECP_CMD_LSC_RESET_CRC = 0x3B,
+	ECP_CMD_VERIFY_ID = 0xE2,
+	ECP_CMD_LSC_WRITE_COMP_DIC = 0x02,
+	ECP_CMD_LSC_PROG_CNTRL0 = 0x22,
+	ECP_CMD_LSC_INIT_ADDRESS = 0x46,
+	ECP_CMD_LSC_WRITE_ADDRESS = 0xB4,
+	ECP_CMD_LSC_PROG_INCR_RTI = 0x82,
+	ECP_CMD_LSC_PROG_INCR_CMP = 0xB8,
+	ECP_CMD_LSC_EBR_ADDRESS = 0xF6,
+	ECP_CMD_LSC_EBR_WRITE = 0xB2,
+	ECP_CMD_ISC_PROGRAM_USERCODE = 0xC2,
+	ECP_CMD_ISC_PROGRAM_DONE = 0x5E,
+	ECP_CMD_NOOP = 0xFF,
+};
+
+#define ECP_PARAM_CRC 0x80			// Crc check follows
+#define ECP_PARAM_CRC_AT_END 0x40	// One check after the last frame
+#define ECP_PARAM_DUMMY_MASK 0x0F	// Dummy bytes after each frame
+#define ECP_EBR_FRAME_SZ 9
+
+
+enum FPatchState
+{
+	PSTATE_Preamble = 0,		// Comment & 0xBDB3 preamble
+	PSTATE_Cmd,
+	PSTATE_Params,
+	PSTATE_Data,				// Command operand
+	PSTATE_Frame,
+	PSTATE_FrameCmp,
+	PSTATE_Crc,
+	PSTATE_Dummy,
+	PSTATE_Done,				// After ISC_PROGRAM_DONE
+};
+
+enum FCodeState
+{
+	CODE_Start = 0,
+	CODE_One,					// Read 1, next bit picks a 4 or 8 bit operand
+	CODE_Bits,
+};
+
+
+/** Frame sizes per device, uncompressed frames are byte padded & compressed frames decode to 64 bit
+* padded frames, one code per byte.
+*/
+struct FFrameSize
+{
+	uint32_t deviceId;
+	uint16_t frameSz;
+	uint16_t frameCodes;
+};
+
+static const struct FFrameSize frameSizes[] = {
+	{ 0x01111043, 74, 80 },		// LFE5U-12 & 25
+	{ 0x01112043, 106, 112 },	// LFE5U-45
+	{ 0x01113043, 142, 144 },	// LFE5U-85
+};
+
+
+/** Patch stream state.
+*/
+struct FPatchStream
+{
+	int isActive;
+	int error;
+	const uint8_t* next;		// Next list entry, list end when equal to end
+	const uint8_t* end;
+	uint32_t patchOffset;		// Current patch
+	uint32_t patchLen;
+	const uint8_t* patchData;	// 0 when no patch left
+	uint32_t offset;			// Stream position
+	uint8_t state;
+	uint8_t opcode;
+	uint8_t params[3];
+	uint8_t paramCnt;
+	uint8_t lastByte;
+	uint32_t remain;			// Bytes left in operand, frame or dummy
+	uint32_t frameCnt;			// Frames left
+	uint32_t deviceId;
+	uint16_t frameSz;
+	uint16_t frameCodes;
+	uint16_t codesLeft;			// Compressed frame codes left
+	uint8_t codeState;
+	uint8_t codeBits;
+	uint16_t crcIn;				// Crc of original bytes
+	uint16_t crcOut;			// Crc of patched bytes, valid when isDirty
+	uint8_t isDirty;			// A patch changed a byte since the last crc check
+};
+
+
+// Globals
+static uint8_t patchList[PATCH_LIST_SZ];
+static uint32_t patchListSz = 0;
+static uint32_t patchListEnd = 0;		// Bitstream offset after the last patch
+static struct FPatchStream patch;
+
+
+static uint16_t crc16_update( uint16_t crc, uint8_t b )
+{
+	crc ^= b << 8;
+	for(int i=0;i<8;i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ PATCH_CRC_POLY : (crc << 1);
+	return crc;
+}
+
+
+static void next_patch( void )
+{
+	if(patch.next >= patch.end)
+	{
+		patch.patchData = 0;
+		return;
+	}
+
+	struct FBitstreamPatch* entry = (struct FBitstreamPatch*)patch.next;
+	patch.patchOffset = entry->offset;
+	patch.patchLen = entry->len;
+	patch.patchData = patch.next + sizeof(struct FBitstreamPatch);
+	patch.next = patch.patchData + entry->len;
+}
+
+
+int patch_set_list( const uint8_t* list, uint32_t sz, int patchCnt )
+{
+	patchListSz = 0;
+	if(sz > PATCH_LIST_SZ)
+		return FPATCH_ERROR_List;
+
+	// Entries must fill the list exactly, sorted & not overlapping
+	uint32_t pos = 0;
+	uint32_t lastEnd = 0;
+	for(int i=0;i<patchCnt;i++)
+	{
+		if(pos + sizeof(struct FBitstreamPatch) > sz)
+			return FPATCH_ERROR_List;
+
+		struct FBitstreamPatch* entry = (struct FBitstreamPatch*)(list + pos);
+		if(!entry->len || entry->offset < lastEnd)
+			return FPATCH_ERROR_List;
+
+		lastEnd = entry->offset + entry->len;
+		pos += sizeof(struct FBitstreamPatch) + entry->len;
+	}
+	if(pos != sz)
+		return FPATCH_ERROR_List;
+
+	memcpy( patchList, list, sz );
+	patchListSz = sz;
+	patchListEnd = lastEnd;
+	return FPATCH_ERROR_None;
+}
+
+
+void patch_clear_list( void )
+{
+	patchListSz = 0;
+}
+
+
+int patch_begin( uint32_t bitStreamSz )
+{
+	memset( &patch, 0, sizeof(struct FPatchStream) );
+	patch.next = patchList;
+	patch.end = patchList + patchListSz;
+	patchListSz = 0;
+
+	next_patch();
+	if(!patch.patchData)
+		return 0;
+	
+	if(patchListEnd > bitStreamSz)
+	{
+		patch.error = FPATCH_ERROR_Range;
+		return 0;
+	}
+
+	patch.isActive = 1;
+	return 1;
+}
+
+
+int patch_is_active( void )
+{
+	return patch.isActive;
+}
+
+
+/** Start next config frame.
+*/
+static void start_frame( void )
+{
+	patch.state = patch.opcode == ECP_CMD_LSC_PROG_INCR_CMP ? PSTATE_FrameCmp : PSTATE_Frame;
+	patch.remain = patch.frameSz;
+	patch.codesLeft = patch.frameCodes;
+	patch.codeState = CODE_Start;
+}
+
+
+/** Operand, frame, crc or dummy bytes finished, pick the next state.
+*/
+static void end_field( void )
+{
+	int isCrc = patch.params[0] & ECP_PARAM_CRC;
+
+	// Command operand then optional crc
+	if(patch.opcode != ECP_CMD_LSC_PROG_INCR_RTI && patch.opcode != ECP_CMD_LSC_PROG_INCR_CMP)
+	{
+		if(isCrc && patch.state != PSTATE_Crc)
+		{
+			patch.state = PSTATE_Crc;
+			patch.remain = 2;
+			return;
+		}
+		patch.state = patch.opcode == ECP_CMD_ISC_PROGRAM_DONE ? PSTATE_Done : PSTATE_Cmd;
+		return;
+	}
+
+	// Frames, data then crc then dummy bytes
+	if((patch.state == PSTATE_Frame || patch.state == PSTATE_FrameCmp) && isCrc &&
+		(!(patch.params[0] & ECP_PARAM_CRC_AT_END) || patch.frameCnt == 1))
+	{
+		patch.state = PSTATE_Crc;
+		patch.remain = 2;
+		return;
+	}
+	if(patch.state != PSTATE_Dummy)
+	{
+		patch.state = PSTATE_Dummy;
+		patch.remain = patch.params[0] & ECP_PARAM_DUMMY_MASK;
+		if(patch.remain)
+			return;
+	}
+	if(--patch.frameCnt == 0)
+	{
+		patch.state = PSTATE_Cmd;
+		return;
+	}
+	start_frame();
+}
+
+
+/** Params read, size the command operand.
+*/
+static int begin_command( void )
+{
+	uint32_t cnt = (patch.params[1] << 8) | patch.params[2];
+
+	patch.state = PSTATE_Data;
+	switch(patch.opcode)
+	{
+		case ECP_CMD_LSC_RESET_CRC:
+			patch.crcIn = 0;
+			patch.isDirty = 0;
+			patch.state = PSTATE_Cmd;
+			return 1;
+		case ECP_CMD_VERIFY_ID:
+		case ECP_CMD_LSC_PROG_CNTRL0:
+		case ECP_CMD_LSC_WRITE_ADDRESS:
+		case ECP_CMD_LSC_EBR_ADDRESS:
+		case ECP_CMD_ISC_PROGRAM_USERCODE:
+			patch.remain = 4;
+			return 1;
+		case ECP_CMD_LSC_WRITE_COMP_DIC:
+			patch.remain = 8;
+			return 1;
+		case ECP_CMD_LSC_EBR_WRITE:
+			patch.remain = cnt * ECP_EBR_FRAME_SZ;
+			break;
+		case ECP_CMD_LSC_INIT_ADDRESS:
+		case ECP_CMD_ISC_PROGRAM_DONE:
+			patch.remain = 0;
+			break;
+		case ECP_CMD_LSC_PROG_INCR_RTI:
+		case ECP_CMD_LSC_PROG_INCR_CMP:
+			if(!patch.frameSz)
+				return 0;
+			if(!cnt)
+			{
+				patch.state = PSTATE_Cmd;
+				return 1;
+			}
+			patch.frameCnt = cnt;
+			start_frame();
+			return 1;
+		default:
+			return 0;
+	}
+
+	if(!patch.remain)
+		end_field();
+	return 1;
+}
+
+
+/** Walk compressed frame codes, 0 is a zero byte, 100/101 take 3 bits & 11 a literal byte.
+@return 1 when the frame ends in this byte, the remaining bits are padding.
+*/
+static int walk_codes( uint8_t b )
+{
+	// Zero bytes are 8 zero codes
+	if(patch.codeState == CODE_Start && b == 0 && patch.codesLeft >= 8)
+	{
+		patch.codesLeft -= 8;
+		return patch.codesLeft == 0;
+	}
+
+	for(int bit=7;bit>=0;bit--)
+	{
+		int v = (b >> bit) & 1;
+		switch(patch.codeState)
+		{
+			case CODE_Start:
+				if(!v)
+					patch.codesLeft--;
+				else
+					patch.codeState = CODE_One;
+				break;
+			case CODE_One:
+				patch.codeBits = v ? 8 : 4;
+				patch.codeState = CODE_Bits;
+				break;
+			case CODE_Bits:
+				if(--patch.codeBits == 0)
+				{
+					patch.codeState = CODE_Start;
+					patch.codesLeft--;
+				}
+				break;
+		}
+		if(!patch.codesLeft)
+			return 1;
+	}
+	return 0;
+}
+
+
+/** Advance parse by one byte.
+@param uint8_t b   Original byte.
+@param uint8_t* out   Patched byte, crc bytes are rewritten here.
+@param int isPatched   Byte is covered by a patch.
+@return FPatchError.
+*/
+static int patch_byte( uint8_t b, uint8_t* out, int isPatched )
+{
+	uint8_t o = *out;
+	int isCrc = 1;
+	int canPatch = 0;
+
+	switch(patch.state)
+	{
+		case PSTATE_Preamble:
+			isCrc = 0;
+			if(patch.lastByte == 0xBD && b == 0xB3)
+				patch.state = PSTATE_Cmd;
+			patch.lastByte = b;
+			break;
+		case PSTATE_Cmd:
+			if(b == ECP_CMD_NOOP)
+			{
+				isCrc = 0;
+				break;
+			}
+			patch.opcode = b;
+			patch.paramCnt = 0;
+			patch.state = PSTATE_Params;
+			break;
+		case PSTATE_Params:
+			patch.params[patch.paramCnt++] = b;
+			break;
+		case PSTATE_Data:
+			canPatch = 1;
+			if(patch.opcode == ECP_CMD_VERIFY_ID)
+				patch.deviceId = (patch.deviceId << 8) | b;
+			break;
+		case PSTATE_Frame:
+		case PSTATE_Dummy:
+			canPatch = patch.state == PSTATE_Frame;
+			break;
+		case PSTATE_FrameCmp:
+			break;
+		case PSTATE_Crc:
+			isCrc = 0;
+			if(b != (uint8_t)(patch.remain == 2 ? patch.crcIn >> 8 : patch.crcIn))
+				return FPATCH_ERROR_Parse;
+			if(patch.isDirty)
+				o = patch.remain == 2 ? patch.crcOut >> 8 : patch.crcOut;
+			break;
+		case PSTATE_Done:
+			isCrc = 0;
+			break;
+	}
+
+	if(isPatched && !canPatch)
+		return FPATCH_ERROR_Region;
+
+	if(isCrc)
+	{
+		if(o != b && !patch.isDirty)
+		{
+			patch.isDirty = 1;
+			patch.crcOut = patch.crcIn;
+		}
+		patch.crcIn = crc16_update( patch.crcIn, b );
+		if(patch.isDirty)
+			patch.crcOut = crc16_update( patch.crcOut, o );
+	}
+	*out = o;
+
+	// Field ends
+	switch(patch.state)
+	{
+		case PSTATE_Params:
+			if(patch.paramCnt == 3 && !begin_command())
+				return FPATCH_ERROR_Parse;
+			break;
+		case PSTATE_Data:
+			if(--patch.remain == 0)
+			{
+				// Frame size from VERIFY_ID
+				if(patch.opcode == ECP_CMD_VERIFY_ID)
+				{
+					for(int i=0;i<sizeof(frameSizes) / sizeof(struct FFrameSize);i++)
+					{
+						if(frameSizes[i].deviceId == (patch.deviceId & 0x0FFFFFFF))
+						{
+							patch.frameSz = frameSizes[i].frameSz;
+							patch.frameCodes = frameSizes[i].frameCodes;
+						}
+					}
+				}
+				end_field();
+			}
+			break;
+		case PSTATE_Frame:
+		case PSTATE_Dummy:
+			if(--patch.remain == 0)
+				end_field();
+			break;
+		case PSTATE_FrameCmp:
+			if(walk_codes( b ))
+				end_field();
+			break;
+		case PSTATE_Crc:
+			if(--patch.remain == 0)
+			{
+				patch.crcIn = 0;
+				patch.isDirty = 0;
+				end_field();
+			}
+			break;
+		default:
+			break;
+	}
+	return FPATCH_ERROR_None;
+}
+
+
+int patch_block( uint8_t* data, uint32_t len )
+{
+	for(uint32_t i=0;i<len && patch.isActive;i++, patch.offset++)
+	{
+		uint8_t b = data[i];
+		int isPatched = 0;
+		if(patch.patchData && patch.offset >= patch.patchOffset)
+		{
+			data[i] = patch.patchData[patch.offset - patch.patchOffset];
+			isPatched = 1;
+			if(patch.offset + 1 == patch.patchOffset + patch.patchLen)
+				next_patch();
+		}
+
+		patch.error = patch_byte( b, &data[i], isPatched );
+		if(patch.error)
+		{
+			patch.isActive = 0;
+			return 0;
+		}
+
+		// Everything written, rest of the stream passes through
+		if(!patch.patchData && !patch.isDirty)
+			patch.isActive = 0;
+	}
+	return 1;
+}
+
+
+int patch_end( void )
+{
+	// Stream ended with a crc still to write
+	if(!patch.error && patch.isActive)
+		patch.error = FPATCH_ERROR_Parse;
+	patch.isActive = 0;
+	return patch.error;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include "fabric_bootloader.h"
+
+/** Stream time patching of ECP5 bitstreams. A patch list replaces bytes at bitstream offsets, e.g. the
+* USERCODE operand or EBR init data, as blocks stream to the FPGA. The command stream is parsed on the
+* way through so each CRC16 check covering a patched byte is recomputed, every check is also verified
+* against the original data so a stream that isn't understood is rejected instead of being corrupted.
+* Compressed config frames are walked to find their end but can't be patched on the device.
+*/
+#define PATCH_LIST_SZ 1024				// Patch list bytes, entries & data
+#define PATCH_CRC_POLY 0x8005
+
+
+/** Patch list entry, len replacement bytes follow. Entries are sorted by offset & don't overlap.
+*/
+struct FPACKSTRUCT FBitstreamPatch
+{
+	uint32_t offset;			// Bitstream byte offset
+	uint16_t len;
+};
+
+
+enum FPatchError
+{
+	FPATCH_ERROR_None = 0,
+	FPATCH_ERROR_List = 1,		// Bad patch list
+	FPATCH_ERROR_Region = 2,	// Patch outside command operands or uncompressed frame data
+	FPATCH_ERROR_Parse = 3,		// Unknown command or original crc check failed
+	FPATCH_ERROR_Range = 4,		// Patch past end of bitstream
+};
+
+
+/** Set patch list used by the next patch_begin.
+@param uint8_t* list   Packed FBitstreamPatch entries & data.
+@param uint32_t sz   Size of list.
+@param int patchCnt   Entries in list.
+@return FPatchError.
+*/
+int patch_set_list( const uint8_t* list, uint32_t sz, int patchCnt );
+
+
+/** Drop patch list.
+*/
+void patch_clear_list( void );
+
+
+/** Start patching a bitstream, the list is consumed & cleared.
+@param uint32_t bitStreamSz   Total size, every patch must fall inside.
+@return 1 if there are patches to apply, 0 when none or on error, see patch_end.
+*/
+int patch_begin( uint32_t bitStreamSz );
+
+
+/** Still rewriting bytes, once all patches & their crc checks are written blocks pass through as is.
+*/
+int patch_is_active( void );
+
+
+/** Patch next block of the bitstream in place.
+@param uint8_t* data   Block data.
+@param uint32_t len   Size of block.
+@return 1 on success, 0 on error.
+*/
+int patch_block( uint8_t* data, uint32_t len );
+
+
+/** End patching.
+@return FPatchError, FPATCH_ERROR_None when every patch & crc was written.
+*/
+int patch_end( void );
@@ -0,0 +1,650 @@
+/**
+Content addressed bitstream store in flash. Blocks are keyed by hash and written once, image records
+reference them by slot. Reference counts are rebuilt from the records on startup so there are no
+counters in flash to keep in sync after a power loss.
+*/
+#include "bitstream_store.h"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "flash_ops.h"
+
+
+/** Block slot index, kept in RAM.
+*/
+struct FBlockIndex
+{
+	uint32_t keyPrefix;		// First 4 key bytes, full key is compared in flash
+	uint16_t refCnt;		// References from image records & the image being saved
+	uint8_t isValid;		// Slot holds a block
+	uint8_t isPinned;		// Reported as stored to the host, kept until the save ends
+};
+
+
+/** Image being saved.
+*/
+struct FImageWriter
+{
+	int isOpen;
+	uint32_t blockCnt;
+	uint32_t bitStreamSz;
+	uint32_t nextBlockId;	// Blocks are added in order
+	int crc;
+	struct sha256_ctx hashCtx;
+	uint16_t blockSlots[FLASH_MAX_IMAGE_BLOCKS];
+};
+
+
+// Globals
+static struct FBlockIndex blockIndex[FLASH_BLOCK_SLOT_CNT];
+static struct FImageWriter imageWriter;
+static uint8_t slotBuffer[FLASH_BLOCK_SLOT_SZ];
+static uint32_t imageLastUse[FLASH_IMAGE_SLOT_CNT];	// Save or use seq, 0 when no record
+static uint32_t lastSeq = 0;
+static int useEntryCnt = 0;							// Entries in LRU log sector
+
+
+static struct FBitstreamBlockHeader* block_header( int slot )
+{
+	return (struct FBitstreamBlockHeader*)(XIP_BASE + FLASH_BLOCK_TO_SECTOR(slot));
+}
+
+
+static struct FBitstreamImageRecord* image_record( int imageId )
+{
+	struct FBitstreamImageRecord* image = (struct FBitstreamImageRecord*)(XIP_BASE + FLASH_IMAGE_TO_SECTOR(imageId));
+	if(image->magic != FLASH_IMAGE_MAGIC || image->blockCnt > FLASH_MAX_IMAGE_BLOCKS)
+		return 0;
+	return image;
+}
+
+
+static int image_id( struct FBitstreamImageRecord* image )
+{
+	return ((uintptr_t)image - (XIP_BASE + FLASH_TARGET_OFFSET)) / FLASH_SECTOR_SIZE;
+}
+
+
+static const uint16_t* image_block_slots( struct FBitstreamImageRecord* image )
+{
+	return (const uint16_t*)((const uint8_t*)image + FLASH_PAGE_SIZE);
+}
+
+
+static uint8_t block_crc( const uint8_t* data, uint32_t size )
+{
+	int crc = 0;
+	for(int i=0;i<size;i++)
+		crc += data[i];
+	return crc & 0xff;
+}
+
+
+/** Recount references from every record plus the blocks already added to the image being saved.
+*/
+static void count_refs( void )
+{
+	for(int i=0;i<FLASH_BLOCK_SLOT_CNT;i++)
+		blockIndex[i].refCnt = 0;
+
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		struct FBitstreamImageRecord* image = image_record( imageId );
+		if(!image)
+			continue;
+		const uint16_t* slots = image_block_slots( image );
+		for(int i=0;i<image->blockCnt;i++)
+		{
+			if(slots[i] < FLASH_BLOCK_SLOT_CNT)
+				blockIndex[slots[i]].refCnt++;
+		}
+	}
+
+	if(imageWriter.isOpen)
+	{
+		for(int i=0;i<imageWriter.nextBlockId;i++)
+			blockIndex[imageWriter.blockSlots[i]].refCnt++;
+	}
+}
+
+
+/** Pick a slot with no references. Erased slots first, unreferenced blocks are kept as long as
+* possible as later uploads can still dedup against them. Pinned slots may still be sent by key.
+*/
+static int alloc_slot( void )
+{
+	for(int pass=0;pass<2;pass++)
+	{
+		for(int i=0;i<FLASH_BLOCK_SLOT_CNT;i++)
+		{
+			if(blockIndex[i].refCnt == 0 && !blockIndex[i].isPinned && (pass == 1 || !blockIndex[i].isValid))
+				return i;
+		}
+	}
+	return -1;
+}
+
+
+/** Unpin every slot, called when a save starts or ends.
+*/
+static void unpin_blocks( void )
+{
+	for(int i=0;i<FLASH_BLOCK_SLOT_CNT;i++)
+		blockIndex[i].isPinned = 0;
+}
+
+
+/** Most recently used image record, the startup image, or -1.
+*/
+static int mru_image( void )
+{
+	struct FBitstreamImageRecord* image = store_find_image( 0 );
+	return image ? image_id( image ) : -1;
+}
+
+
+/** Least recently used image record or -1. Never the startup image, it is only replaced once
+* the image being saved is committed.
+*/
+static int lru_image( void )
+{
+	int mruId = mru_image();
+	int lruId = -1;
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		if(imageId != mruId && image_record( imageId ) && (lruId < 0 || imageLastUse[imageId] < imageLastUse[lruId]))
+			lruId = imageId;
+	}
+	return lruId;
+}
+
+
+/** Erase LRU log & write its header with entries, used to start & compact the log.
+*/
+static int write_lru_log( const struct FImageUseEntry* entries, int entryCnt )
+{
+	struct FImageUseLogHeader header;
+	header.magic = FLASH_LRU_MAGIC;
+	header.reserved = 0xffffffff;
+	
+	flash_ops_erase( FLASH_LRU_OFFSET, FLASH_SECTOR_SIZE );
+	
+	memset( slotBuffer, 0xff, FLASH_PAGE_SIZE );
+	memcpy( slotBuffer, &header, sizeof(struct FImageUseLogHeader) );
+	if(entryCnt)
+		memcpy( slotBuffer + sizeof(struct FImageUseLogHeader), entries, entryCnt * sizeof(struct FImageUseEntry) );
+	flash_ops_program( FLASH_LRU_OFFSET, slotBuffer, FLASH_PAGE_SIZE );
+	
+	useEntryCnt = entryCnt;
+	return memcmp( (uint8_t*)(XIP_BASE + FLASH_LRU_OFFSET), slotBuffer, sizeof(struct FImageUseLogHeader) + entryCnt * sizeof(struct FImageUseEntry) ) == 0;
+}
+
+
+/** Rebuild last use of each record from the record saveSeq & the LRU log.
+*/
+static void load_lru( void )
+{
+	lastSeq = 0;
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		struct FBitstreamImageRecord* image = image_record( imageId );
+		imageLastUse[imageId] = image ? image->saveSeq : 0;
+		if(imageLastUse[imageId] > lastSeq)
+			lastSeq = imageLastUse[imageId];
+	}
+
+	// Start a new log over anything else in the sector
+	struct FImageUseLogHeader* header = (struct FImageUseLogHeader*)(XIP_BASE + FLASH_LRU_OFFSET);
+	if(header->magic != FLASH_LRU_MAGIC)
+	{
+		write_lru_log( 0, 0 );
+		return;
+	}
+
+	// Entries are appended in order, first erased entry ends the log
+	struct FImageUseEntry* entries = (struct FImageUseEntry*)(XIP_BASE + FLASH_LRU_OFFSET + sizeof(struct FImageUseLogHeader));
+	for(useEntryCnt=0;useEntryCnt<FLASH_LRU_ENTRY_CNT;useEntryCnt++)
+	{
+		struct FImageUseEntry* entry = &entries[useEntryCnt];
+		if(entry->saveSeq == 0xffffffff)
+			break;
+
+		for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+		{
+			struct FBitstreamImageRecord* image = image_record( imageId );
+			if(image && image->saveSeq == entry->saveSeq && entry->useSeq > imageLastUse[imageId])
+				imageLastUse[imageId] = entry->useSeq;
+		}
+		if(entry->useSeq > lastSeq)
+			lastSeq = entry->useSeq;
+	}
+}
+
+
+/** Erase the least recently used image record to free its blocks, the startup image is kept.
+*/
+static int evict_lru_image( void )
+{
+	int lruId = lru_image();
+	if(lruId < 0)
+		return 0;
+
+	flash_ops_erase( FLASH_IMAGE_TO_SECTOR(lruId), FLASH_SECTOR_SIZE );
+
+	imageLastUse[lruId] = 0;
+	count_refs();
+	return 1;
+}
+
+
+/** Write block with header to slot & read back.
+*/
+static int write_block_slot( int slot, const uint8_t* data, uint32_t size, const uint8_t* key )
+{
+	struct FBitstreamBlockHeader header;
+	header.magic = FLASH_BLOCK_MAGIC;
+	header.blockSz = size;
+	header.blockCrc = block_crc( data, size );
+	header.reserved = 0xff;
+	memcpy( header.blockKey, key, FLASH_BLOCK_KEY_SIZE );
+
+	// Only program pages holding data
+	uint32_t programSz = (sizeof(struct FBitstreamBlockHeader) + size + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+	memset( slotBuffer, 0xff, programSz );
+	memcpy( slotBuffer, &header, sizeof(struct FBitstreamBlockHeader) );
+	memcpy( slotBuffer + sizeof(struct FBitstreamBlockHeader), data, size );
+
+	// erase slot to 0xFF
+	blockIndex[slot].isValid = 0;
+	flash_ops_erase( FLASH_BLOCK_TO_SECTOR(slot), FLASH_BLOCK_SLOT_SZ );
+
+	flash_ops_program( FLASH_BLOCK_TO_SECTOR(slot), slotBuffer, programSz );
+
+	// Readback from flash, ensure not worn down ( no wear leveling is done so more than possible )
+	if( memcmp( block_header( slot ), slotBuffer, sizeof(struct FBitstreamBlockHeader) + size ) != 0 )
+		return 0;
+
+	blockIndex[slot].isValid = 1;
+	memcpy( &blockIndex[slot].keyPrefix, key, sizeof(uint32_t) );
+	return 1;
+}
+
+
+/** Write image record, block table first & header page last.
+*/
+static int write_image_record( int imageId, struct FBitstreamImageRecord* image, const uint16_t* slots )
+{
+	uint32_t offset = FLASH_IMAGE_TO_SECTOR(imageId);
+	uint32_t tableSz = image->blockCnt * sizeof(uint16_t);
+	uint32_t programSz = (tableSz + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+
+	flash_ops_erase( offset, FLASH_SECTOR_SIZE );
+
+	if(programSz)
+	{
+		memset( slotBuffer, 0xff, programSz );
+		memcpy( slotBuffer, slots, tableSz );
+		flash_ops_program( offset + FLASH_PAGE_SIZE, slotBuffer, programSz );
+
+		if( memcmp( (uint8_t*)(XIP_BASE + offset + FLASH_PAGE_SIZE), slots, tableSz ) != 0 )
+			return 0;
+	}
+
+	memset( slotBuffer, 0xff, FLASH_PAGE_SIZE );
+	memcpy( slotBuffer, image, sizeof(struct FBitstreamImageRecord) );
+	flash_ops_program( offset, slotBuffer, FLASH_PAGE_SIZE );
+
+	return memcmp( (uint8_t*)(XIP_BASE + offset), image, sizeof(struct FBitstreamImageRecord) ) == 0;
+}
+
+
+/** Add stored block to the image being saved.
+*/
+static void image_add_slot( int slot, const uint8_t* data, uint32_t size )
+{
+	for(int i=0;i<size;i++)
+		imageWriter.crc += data[i];
+	sha256_update( &imageWriter.hashCtx, data, size );
+
+	imageWriter.blockSlots[imageWriter.nextBlockId++] = slot;
+	blockIndex[slot].refCnt++;
+}
+
+
+void store_init( void )
+{
+	for(int i=0;i<FLASH_BLOCK_SLOT_CNT;i++)
+	{
+		struct FBitstreamBlockHeader* header = block_header( i );
+		blockIndex[i].isValid = header->magic == FLASH_BLOCK_MAGIC && header->blockSz + sizeof(struct FBitstreamBlockHeader) <= FLASH_BLOCK_SLOT_SZ;
+		memcpy( &blockIndex[i].keyPrefix, header->blockKey, sizeof(uint32_t) );
+	}
+
+	imageWriter.isOpen = 0;
+	count_refs();
+	load_lru();
+}
+
+
+void store_block_key( const uint8_t* data, uint32_t size, uint8_t* key )
+{
+	uint8_t hash[SHA256_HASH_SIZE];
+	struct sha256_ctx hashCtx;
+	sha256_init( &hashCtx );
+	sha256_update( &hashCtx, data, size );
+	sha256_final( &hashCtx, hash );
+	memcpy( key, hash, FLASH_BLOCK_KEY_SIZE );
+}
+
+
+struct FBitstreamImageRecord* store_find_image( const uint8_t* bitStreamHash )
+{
+	struct FBitstreamImageRecord* found = 0;
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		struct FBitstreamImageRecord* image = image_record( imageId );
+		if(!image)
+			continue;
+
+		if(bitStreamHash)
+		{
+			if(memcmp( image->bitStreamHash, bitStreamHash, SHA256_HASH_SIZE ) == 0)
+				return image;
+		}
+		else if(!found || imageLastUse[imageId] > imageLastUse[image_id( found )])
+		{
+			found = image;
+		}
+	}
+	return found;
+}
+
+
+int store_list_images( struct FBitstreamImageRecord** images )
+{
+	int imageCnt = 0;
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		struct FBitstreamImageRecord* image = image_record( imageId );
+		if(!image)
+			continue;
+
+		// Insert by last use, newest first
+		int i = imageCnt++;
+		for(;i>0 && imageLastUse[image_id( images[i-1] )] < imageLastUse[imageId];i--)
+			images[i] = images[i-1];
+		images[i] = image;
+	}
+	return imageCnt;
+}
+
+
+int store_touch_image( struct FBitstreamImageRecord* image )
+{
+	int imageId = image_id( image );
+	if(imageLastUse[imageId] == lastSeq)
+		return 1; // Already most recent
+
+	// Compact full log down to 1 entry per record
+	if(useEntryCnt >= FLASH_LRU_ENTRY_CNT)
+	{
+		struct FImageUseEntry entries[FLASH_IMAGE_SLOT_CNT];
+		int entryCnt = 0;
+		for(int i=0;i<FLASH_IMAGE_SLOT_CNT;i++)
+		{
+			struct FBitstreamImageRecord* prev = image_record( i );
+			if(!prev)
+				continue;
+			entries[entryCnt].saveSeq = prev->saveSeq;
+			entries[entryCnt].useSeq = imageLastUse[i];
+			entryCnt++;
+		}
+		
+		if(!write_lru_log( entries, entryCnt ))
+			return 0;
+	}
+
+	// Append entry, rest of the page is left 0xff so existing entries are untouched
+	struct FImageUseEntry entry;
+	entry.saveSeq = image->saveSeq;
+	entry.useSeq = lastSeq + 1;
+	
+	uint32_t entryOffset = sizeof(struct FImageUseLogHeader) + useEntryCnt * sizeof(struct FImageUseEntry);
+	uint32_t pageOffset = entryOffset & ~(FLASH_PAGE_SIZE - 1);
+	memset( slotBuffer, 0xff, FLASH_PAGE_SIZE );
+	memcpy( slotBuffer + (entryOffset - pageOffset), &entry, sizeof(struct FImageUseEntry) );
+	
+	flash_ops_program( FLASH_LRU_OFFSET + pageOffset, slotBuffer, FLASH_PAGE_SIZE );
+	
+	if(memcmp( (uint8_t*)(XIP_BASE + FLASH_LRU_OFFSET + entryOffset), &entry, sizeof(struct FImageUseEntry) ) != 0)
+		return 0;
+	
+	useEntryCnt++;
+	lastSeq = entry.useSeq;
+	imageLastUse[imageId] = entry.useSeq;
+	return 1;
+}
+
+
+int store_verify_image( struct FBitstreamImageRecord* image )
+{
+	if(!image)
+		return 0;
+
+	int crc = 0;
+	uint32_t bitStreamSz = 0;
+	struct sha256_ctx hashCtx;
+	sha256_init( &hashCtx );
+
+	const uint16_t* slots = image_block_slots( image );
+	for(int i=0;i<image->blockCnt;i++)
+	{
+		uint32_t size;
+		const uint8_t* data = store_block_data( slots[i], &size );
+		if(!data || block_crc( data, size ) != block_header( slots[i] )->blockCrc)
+			return 0;
+
+		for(int j=0;j<size;j++)
+			crc += data[j];
+		sha256_update( &hashCtx, data, size );
+		bitStreamSz += size;
+	}
+
+	if((crc & 0xff) != image->crc || bitStreamSz != image->bitStreamSz)
+		return 0;
+
+	uint8_t hash[SHA256_HASH_SIZE];
+	sha256_final( &hashCtx, hash );
+	return memcmp( hash, image->bitStreamHash, SHA256_HASH_SIZE ) == 0;
+}
+
+
+const uint8_t* store_image_block( struct FBitstreamImageRecord* image, int blockId, uint32_t* size )
+{
+	if(!image || blockId >= image->blockCnt)
+		return 0;
+	return store_block_data( image_block_slots( image )[blockId], size );
+}
+
+
+int store_find_block( const uint8_t* key )
+{
+	uint32_t keyPrefix;
+	memcpy( &keyPrefix, key, sizeof(uint32_t) );
+
+	for(int i=0;i<FLASH_BLOCK_SLOT_CNT;i++)
+	{
+		if(blockIndex[i].isValid && blockIndex[i].keyPrefix == keyPrefix &&
+			memcmp( block_header( i )->blockKey, key, FLASH_BLOCK_KEY_SIZE ) == 0)
+			return i;
+	}
+	return -1;
+}
+
+
+const uint8_t* store_block_data( int slot, uint32_t* size )
+{
+	if(slot < 0 || slot >= FLASH_BLOCK_SLOT_CNT || !blockIndex[slot].isValid)
+		return 0;
+
+	struct FBitstreamBlockHeader* header = block_header( slot );
+	*size = header->blockSz;
+	return (const uint8_t*)header + sizeof(struct FBitstreamBlockHeader);
+}
+
+
+int store_begin_image( uint32_t blockCnt, uint32_t bitStreamSz )
+{
+	imageWriter.isOpen = 0;
+	if(blockCnt > FLASH_MAX_IMAGE_BLOCKS)
+		return 0;
+
+	imageWriter.blockCnt = blockCnt;
+	imageWriter.bitStreamSz = bitStreamSz;
+	imageWriter.nextBlockId = 0;
+	imageWriter.crc = 0;
+	sha256_init( &imageWriter.hashCtx );
+	imageWriter.isOpen = 1;
+
+	// Drop references & pins from any unfinished save
+	unpin_blocks();
+	count_refs();
+	return 1;
+}
+
+
+int store_add_block( int blockId, const uint8_t* data, uint32_t size )
+{
+	if(!imageWriter.isOpen || blockId != imageWriter.nextBlockId || blockId >= imageWriter.blockCnt)
+		return 0;
+	if(size + sizeof(struct FBitstreamBlockHeader) > FLASH_BLOCK_SLOT_SZ)
+		return 0;
+
+	// Reuse identical block, else store it in a free slot
+	uint8_t key[FLASH_BLOCK_KEY_SIZE];
+	store_block_key( data, size, key );
+	int slot = store_find_block( key );
+	if(slot < 0)
+	{
+		while((slot = alloc_slot()) < 0)
+		{
+			if(!evict_lru_image())
+				return 0; // Full
+		}
+
+		if(!write_block_slot( slot, data, size, key ))
+			return 0;
+	}
+
+	image_add_slot( slot, data, size );
+	return 1;
+}
+
+
+int store_add_block_slot( int blockId, int slot )
+{
+	if(!imageWriter.isOpen || blockId != imageWriter.nextBlockId || blockId >= imageWriter.blockCnt)
+		return 0;
+
+	uint32_t size;
+	const uint8_t* data = store_block_data( slot, &size );
+	if(!data)
+		return 0;
+
+	image_add_slot( slot, data, size );
+	return 1;
+}
+
+
+int store_pin_block( int slot )
+{
+	if(!imageWriter.isOpen || slot < 0 || slot >= FLASH_BLOCK_SLOT_CNT || !blockIndex[slot].isValid)
+		return 0;
+
+	blockIndex[slot].isPinned = 1;
+	return 1;
+}
+
+
+int store_commit_image( uint32_t programOnStartup )
+{
+	if(!imageWriter.isOpen || imageWriter.nextBlockId != imageWriter.blockCnt)
+		return 0;
+	imageWriter.isOpen = 0;
+	unpin_blocks();
+
+	struct FBitstreamImageRecord image;
+	image.magic = FLASH_IMAGE_MAGIC;
+	image.saveSeq = lastSeq + 1;
+	image.programOnStartup = programOnStartup;
+	image.blockCnt = imageWriter.blockCnt;
+	image.bitStreamSz = imageWriter.bitStreamSz;
+	image.crc = imageWriter.crc & 0xff;
+	sha256_final( &imageWriter.hashCtx, image.bitStreamHash );
+
+	// Replace record of the same image, else use a free record or the least recently used. The
+	// startup image is only erased once the new record is written, a power loss keeps one of them.
+	int mruId = mru_image();
+	int sameId = -1;
+	int freeId = -1;
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		struct FBitstreamImageRecord* prev = image_record( imageId );
+		if(!prev)
+		{
+			if(freeId < 0)
+				freeId = imageId;
+			continue;
+		}
+
+		if(memcmp( prev->bitStreamHash, image.bitStreamHash, SHA256_HASH_SIZE ) == 0)
+			sameId = imageId;
+	}
+
+	int imageId = freeId;
+	if(imageId < 0)
+		imageId = (sameId >= 0 && sameId != mruId) ? sameId : lru_image();
+	if(imageId < 0)
+		imageId = sameId >= 0 ? sameId : mruId; // Single record store
+	if(imageId < 0)
+	{
+		count_refs();
+		return 0;
+	}
+	
+	int result = write_image_record( imageId, &image, imageWriter.blockSlots );
+
+	lastSeq = image.saveSeq;
+	imageLastUse[imageId] = result ? image.saveSeq : 0;
+	
+	// Drop the old copy of the same image once the new one is in
+	if(result && sameId >= 0 && sameId != imageId)
+	{
+		flash_ops_erase( FLASH_IMAGE_TO_SECTOR(sameId), FLASH_SECTOR_SIZE );
+		imageLastUse[sameId] = 0;
+	}
+	
+	count_refs();
+	return result;
+}
+
+
+int store_clear( void )
+{
+	imageWriter.isOpen = 0;
+	unpin_blocks();
+
+	for(int imageId=0;imageId<FLASH_IMAGE_SLOT_CNT;imageId++)
+	{
+		if(!image_record( imageId ))
+			continue;
+
+		flash_ops_erase( FLASH_IMAGE_TO_SECTOR(imageId), FLASH_SECTOR_SIZE );
+		imageLastUse[imageId] = 0;
+	}
+
+	// Uses of the erased records are dropped with them
+	int isLogReset = write_lru_log( 0, 0 );
+
+	count_refs();
+	return isLogReset && store_find_image( 0 ) == 0;
+}
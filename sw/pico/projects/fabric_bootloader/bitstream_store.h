@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stdint.h>
+#include "hardware/flash.h"
+#include "fabric_bootloader.h"
+#include "sha256.h"
+
+/** Flash store layout 1MB storage( 4096 * 256 ), 2MB on RP2350 with 16KB block slots.
+* Image record sectors come first, then the LRU use log sector & fixed size block slots. Blocks are
+* keyed by hash & stored once, each image record is a table of block slots so identical blocks are
+* shared. Records act as a cache, saving into a full store replaces the least recently used image.
+*/
+#if PICO_RP2350
+#define FLASH_MAX_SECTOR 512
+#define FLASH_BLOCK_SLOT_SZ (4 * FLASH_SECTOR_SIZE)
+#else
+#define FLASH_MAX_SECTOR 256
+#define FLASH_BLOCK_SLOT_SZ FLASH_SECTOR_SIZE
+#endif
+#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES - (FLASH_SECTOR_SIZE * FLASH_MAX_SECTOR ))
+#define FLASH_IMAGE_SLOT_CNT FABRIC_MAX_IMAGES	// Image records, 1 per sector
+#define FLASH_IMAGE_TO_SECTOR(imageId) (FLASH_TARGET_OFFSET + ((imageId) * FLASH_SECTOR_SIZE))
+#define FLASH_LRU_OFFSET (FLASH_TARGET_OFFSET + (FLASH_IMAGE_SLOT_CNT * FLASH_SECTOR_SIZE))
+#define FLASH_LRU_ENTRY_CNT ((FLASH_SECTOR_SIZE - sizeof(struct FImageUseLogHeader)) / sizeof(struct FImageUseEntry))
+#define FLASH_BLOCK_OFFSET (FLASH_LRU_OFFSET + FLASH_SECTOR_SIZE)
+#define FLASH_BLOCK_SLOT_CNT ((FLASH_MAX_SECTOR - FLASH_IMAGE_SLOT_CNT - 1) * FLASH_SECTOR_SIZE / FLASH_BLOCK_SLOT_SZ)
+#define FLASH_BLOCK_TO_SECTOR(slot) (FLASH_BLOCK_OFFSET + ((slot) * FLASH_BLOCK_SLOT_SZ))
+#define FLASH_MAX_IMAGE_BLOCKS ((FLASH_SECTOR_SIZE - FLASH_PAGE_SIZE) / 2) // Block table fills the record sector after page0
+#define FLASH_IMAGE_MAGIC 0x5a256e10
+#define FLASH_BLOCK_MAGIC 0xb10c5a25
+#define FLASH_LRU_MAGIC 0x10625a25
+#define FLASH_BLOCK_KEY_SIZE FABRIC_BLOCK_KEY_SIZE
+#define FLASH_SCRATCH_OFFSET (FLASH_TARGET_OFFSET - FLASH_SECTOR_SIZE)	// Reserved for the self test perf flash write, regions below are laid out from it
+
+
+_Static_assert( FLASH_TARGET_OFFSET % FLASH_SECTOR_SIZE == 0 && FLASH_SCRATCH_OFFSET + FLASH_SECTOR_SIZE == FLASH_TARGET_OFFSET, "scratch sector must sit right below the flash store" );
+
+
+/** Image record, header in page0 & uint16_t block slot table from page1. Page0 is programmed last
+* so a record only becomes valid once its table is in flash.
+*/
+struct FPACKSTRUCT FBitstreamImageRecord
+{
+	uint32_t magic;				// FLASH_IMAGE_MAGIC when valid
+	uint32_t saveSeq;			// Increments every save, newest record is the startup image
+	uint32_t programOnStartup;	// programOnStartup
+	uint32_t blockCnt;			// Entries in block table
+	uint32_t bitStreamSz;		// Total size
+	uint8_t crc;				// Additive crc of whole bitstream
+	uint8_t bitStreamHash[SHA256_HASH_SIZE];	// sha256 of whole bitstream
+};
+
+
+/** Block slot header, block data follows. Sized so a full FABRIC_MAX_BLOCK_SZ block fits the slot.
+*/
+struct FPACKSTRUCT FBitstreamBlockHeader
+{
+	uint32_t magic;				// FLASH_BLOCK_MAGIC when valid
+	uint16_t blockSz;
+	uint8_t blockCrc;
+	uint8_t reserved;
+	uint8_t blockKey[FLASH_BLOCK_KEY_SIZE];	// sha256 of block data, truncated
+};
+
+/** LRU log sector header, entries follow. A sector without the magic is erased before use, it may
+* hold data from an older flash layout.
+*/
+struct FPACKSTRUCT FImageUseLogHeader
+{
+	uint32_t magic;				// FLASH_LRU_MAGIC when valid
+	uint32_t reserved;
+};
+
+/** LRU log entry, appended each time an image is used & compacted when the sector fills. Entries
+* name the record by its saveSeq so uses of a replaced record are ignored.
+*/
+struct FPACKSTRUCT FImageUseEntry
+{
+	uint32_t saveSeq;			// Record used
+	uint32_t useSeq;			// Shares the saveSeq counter, highest is most recent
+};
+
+
+_Static_assert( FABRIC_MAX_BLOCK_SZ + sizeof(struct FBitstreamBlockHeader) <= FLASH_BLOCK_SLOT_SZ, "block slot too small" );
+
+
+/** Scan flash, rebuild block index & reference counts. Called on startup.
+*/
+void store_init( void );
+
+
+/** Compute block key.
+@param uint8_t* data   Block data.
+@param uint32_t size   Size of data.
+@param uint8_t* key   Output key, FLASH_BLOCK_KEY_SIZE bytes.
+*/
+void store_block_key( const uint8_t* data, uint32_t size, uint8_t* key );
+
+
+/** Find image record.
+@param uint8_t* bitStreamHash 	Image hash or 0 for the startup image, the most recently used.
+@return Record in flash or 0 if not found.
+*/
+struct FBitstreamImageRecord* store_find_image( const uint8_t* bitStreamHash );
+
+
+/** List stored images, most recently used first.
+@param FBitstreamImageRecord** images 	Output records, FLASH_IMAGE_SLOT_CNT entries.
+@return Number of images.
+*/
+int store_list_images( struct FBitstreamImageRecord** images );
+
+
+/** Mark image as most recently used.
+@param FBitstreamImageRecord* image 	Record used.
+@return 1 on success.
+*/
+int store_touch_image( struct FBitstreamImageRecord* image );
+
+
+/** Check every block of an image against its crc & the image hash.
+@param FBitstreamImageRecord* image 	Record to verify.
+@return 1 if valid.
+*/
+int store_verify_image( struct FBitstreamImageRecord* image );
+
+
+/** Get block of an image.
+@param FBitstreamImageRecord* image 	Record.
+@param int blockId   Block index in image.
+@param uint32_t* size   Output block size.
+@return Block data in flash or 0.
+*/
+const uint8_t* store_image_block( struct FBitstreamImageRecord* image, int blockId, uint32_t* size );
+
+
+/** Find stored block by key.
+@param uint8_t* key   FLASH_BLOCK_KEY_SIZE key.
+@return Block slot or -1.
+*/
+int store_find_block( const uint8_t* key );
+
+
+/** Get stored block data.
+@param int slot   Block slot.
+@param uint32_t* size   Output block size.
+@return Block data in flash or 0 if slot isn't valid.
+*/
+const uint8_t* store_block_data( int slot, uint32_t* size );
+
+
+/** Start saving an image, blocks are added with store_add_block or store_add_block_slot.
+@param uint32_t blockCnt   Blocks in image.
+@param uint32_t bitStreamSz   Total size.
+@return 1 if the image fits a record.
+*/
+int store_begin_image( uint32_t blockCnt, uint32_t bitStreamSz );
+
+
+/** Add block data to the image being saved, stored only if no identical block exists.
+@param int blockId   Block index in image.
+@param uint8_t* data   Block data.
+@param uint32_t size   Size of data.
+@return 1 on success, 0 if flash is full or failed to write.
+*/
+int store_add_block( int blockId, const uint8_t* data, uint32_t size );
+
+
+/** Add an already stored block to the image being saved.
+@param int blockId   Block index in image.
+@param int slot   Block slot from store_find_block.
+@return 1 on success.
+*/
+int store_add_block_slot( int blockId, int slot );
+
+
+/** Pin a stored block for the image being saved, it isn't reused for new blocks until the save
+ends so keys reported to the host stay valid.
+@param int slot   Block slot from store_find_block.
+@return 1 if pinned.
+*/
+int store_pin_block( int slot );
+
+
+/** Write record for the image being saved, replaces any record with the same hash, else a free record
+or the least recently used. The startup image is only replaced after the new record is written.
+@param uint32_t programOnStartup   Program on startup flag.
+@return 1 on success.
+*/
+int store_commit_image( uint32_t programOnStartup );
+
+
+/** Erase all image records & the LRU log, stored blocks stay available for dedup until reused.
+@return 1 on success.
+*/
+int store_clear( void );
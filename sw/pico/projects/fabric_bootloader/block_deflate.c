@@ -0,0 +1,180 @@
+/**
+Block deflate, see block_deflate.h. Codes are from the fixed huffman tables of RFC 1951, huffman
+codes go out msb first so they are bit reversed into the lsb first bit writer.
+*/
+#include "block_deflate.h"
+#include <string.h>
+#include "miniz.h"
+
+
+/** Bit writer over the output buffer.
+*/
+struct FBitWriter
+{
+	uint8_t* out;
+	uint8_t* end;
+	uint32_t bits;
+	int bitCnt;
+	int isFull;
+};
+
+
+static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+
+// Globals
+static uint16_t hashHead[1 << DEFLATE_HASH_BITS];	// Last position + 1 per hash, 0 when empty
+
+
+static void put_bits( struct FBitWriter* writer, uint32_t value, int cnt )
+{
+	if(writer->isFull)
+		return;
+	writer->bits |= value << writer->bitCnt;
+	writer->bitCnt += cnt;
+	while(writer->bitCnt >= 8)
+	{
+		if(writer->out >= writer->end)
+		{
+			writer->isFull = 1;
+			return;
+		}
+		*writer->out++ = writer->bits & 0xff;
+		writer->bits >>= 8;
+		writer->bitCnt -= 8;
+	}
+}
+
+
+static void put_code( struct FBitWriter* writer, uint32_t code, int cnt )
+{
+	uint32_t reversed = 0;
+	for(int i=0;i<cnt;i++)
+		reversed |= ((code >> i) & 1) << (cnt - 1 - i);
+	put_bits( writer, reversed, cnt );
+}
+
+
+/** Fixed huffman literal/length symbol.
+*/
+static void put_symbol( struct FBitWriter* writer, int symbol )
+{
+	if(symbol < 144)
+		put_code( writer, 0x30 + symbol, 8 );
+	else if(symbol < 256)
+		put_code( writer, 0x190 + (symbol - 144), 9 );
+	else if(symbol < 280)
+		put_code( writer, symbol - 256, 7 );
+	else
+		put_code( writer, 0xC0 + (symbol - 280), 8 );
+}
+
+
+/** Length & distance pair, fixed distance codes are 5 bits.
+*/
+static void put_match( struct FBitWriter* writer, int length, int dist )
+{
+	int code = 28;
+	while(lengthBase[code] > length)
+		code--;
+	put_symbol( writer, 257 + code );
+	if(lengthExtra[code])
+		put_bits( writer, length - lengthBase[code], lengthExtra[code] );
+
+	code = 29;
+	while(distBase[code] > dist)
+		code--;
+	put_code( writer, code, 5 );
+	if(distExtra[code])
+		put_bits( writer, dist - distBase[code], distExtra[code] );
+}
+
+
+static uint32_t hash3( const uint8_t* p )
+{
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+
+uint32_t block_deflate( uint8_t* dst, uint32_t dstSz, const uint8_t* src, uint32_t srcSz )
+{
+	struct FBitWriter writer = { dst, dst + dstSz, 0, 0, 0 };
+	if(srcSz > DEFLATE_MAX_BLOCK_SZ)
+		return 0;
+	memset( hashHead, 0, sizeof(hashHead) );
+
+	// zlib header, deflate 32K window, no dictionary
+	put_bits( &writer, 0x78, 8 );
+	put_bits( &writer, 0x01, 8 );
+
+	// Final block, fixed huffman
+	put_bits( &writer, 1, 1 );
+	put_bits( &writer, 1, 2 );
+
+	uint32_t i = 0;
+	while(i < srcSz && !writer.isFull)
+	{
+		uint32_t length = 0;
+		uint32_t dist = 0;
+		if(i + DEFLATE_MIN_MATCH <= srcSz)
+		{
+			// Runs match the previous byte, anything else the last position with the same hash
+			uint32_t h = hash3( src + i );
+			uint32_t candidates[2] = { i > 0 ? i : 0, hashHead[h] };
+			hashHead[h] = i + 1;
+
+			for(int c=0;c<2;c++)
+			{
+				if(!candidates[c])
+					continue;
+				uint32_t pos = candidates[c] - 1;
+				if(i - pos > DEFLATE_WINDOW_SZ)
+					continue;
+				uint32_t len = 0;
+				while(i + len < srcSz && len < DEFLATE_MAX_MATCH && src[pos + len] == src[i + len])
+					len++;
+				if(len > length)
+				{
+					length = len;
+					dist = i - pos;
+				}
+			}
+		}
+
+		if(length >= DEFLATE_MIN_MATCH)
+		{
+			put_match( &writer, length, dist );
+
+			// Index positions inside the match so later repeats find them
+			for(uint32_t j=i+1;j<i+length && j+DEFLATE_MIN_MATCH<=srcSz;j++)
+				hashHead[hash3( src + j )] = j + 1;
+			i += length;
+		}
+		else
+		{
+			put_symbol( &writer, src[i] );
+			i++;
+		}
+	}
+
+	// End of block & pad to byte
+	put_symbol( &writer, 256 );
+	put_bits( &writer, 0, (8 - writer.bitCnt) & 7 );
+
+	// Adler32 big endian
+	uint32_t adler = mz_adler32( MZ_ADLER32_INIT, src, srcSz );
+	for(int shift=24;shift>=0;shift-=8)
+		put_bits( &writer, (adler >> shift) & 0xff, 8 );
+
+	if(writer.isFull)
+		return 0;
+	return writer.out - dst;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/** Small zlib encoder for readback. Greedy LZ77 over a single hash table of last positions, coded in
+* one fixed huffman block. Far weaker than tdefl but needs only the hash table in RAM where tdefl
+* needs well over 100KB, output is a normal zlib stream any inflater takes.
+*/
+#define DEFLATE_HASH_BITS 12
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_WINDOW_SZ 32768			// Farthest distance code 29 reaches, older positions are skipped
+#define DEFLATE_MAX_BLOCK_SZ 0xfffe		// Positions are kept as uint16_t
+
+
+/** Compress block to a zlib stream.
+@param uint8_t* dst   Output buffer.
+@param uint32_t dstSz   Size of dst.
+@param uint8_t* src   Block data, up to DEFLATE_MAX_BLOCK_SZ.
+@param uint32_t srcSz   Size of src.
+@return Compressed size, 0 when it doesn't fit dst.
+*/
+uint32_t block_deflate( uint8_t* dst, uint32_t dstSz, const uint8_t* src, uint32_t srcSz );
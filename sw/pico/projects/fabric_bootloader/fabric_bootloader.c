@@ -6,6 +6,7 @@ A Debug port can be enabled by setting ENABLE_DEBUG_LOG preprocessor as the USB
 */
 #include "fabric_bootloader.h"
 #include <stdio.h>
+#include <stddef.h>
 #include "pico/stdlib.h"
 #include "pico/unique_id.h"
 #include "hardware/clocks.h"
@@ -13,6 +14,14 @@ A Debug port can be enabled by setting ENABLE_DEBUG_LOG preprocessor as the USB
 #include "hardware/uart.h"
 #include "hardware/sync.h"
 #include "miniz.h"
+#include "perf_reference_block.h"
+#include "selftest_bitstream.h"
+#include "bitstream_store.h"
+#include "bitstream_patch.h"
+#include "flash_ops.h"
+#include "block_deflate.h"
+#include "self_update.h"
+#include "flash_emu.h"
 
 
 /** Debug uart
@@ -29,19 +38,27 @@ const uint LED_PIN = PICO_DEFAULT_LED_PIN;
 #endif
 	
 	
-/** Flash page setup 1MB storage( 4096 * 256 )
+/** Self test perf, writes the FLASH_SCRATCH_OFFSET sector.
 */
-#define FLASH_MAX_SECTOR 256
-#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES - (FLASH_SECTOR_SIZE * FLASH_MAX_SECTOR ))
-#define FLASH_MAGIC_0 0xf1f0de0e
-#define FLASH_MAX_BLOCK_CNT 2048
-#define FLASH_BLOCK_TO_SECTOR(blockId) (FLASH_TARGET_OFFSET + ((blockId+1) * FLASH_SECTOR_SIZE) + (0 * FLASH_PAGE_SIZE))
+#define PERF_XIP_READ_SZ (64 * 1024)
 
 
 // Globals
 static char tmp[64];
-uint8_t requestPacket[4090];
-uint8_t uncompressedData[4090];
+uint8_t requestPacket[FABRIC_PACKET_SZ];
+uint8_t uncompressedData[FABRIC_BLOCK_BUFFER_CNT][FABRIC_PACKET_SZ];
+int blockBufferId = 0;
+struct FProgramBlock_Response programError;
+tinfl_decompressor inflateState;
+uint8_t configuredHash[SHA256_HASH_SIZE];	// Image last programmed into the FPGA
+int isConfigured = 0;
+uint8_t batchPacket[FABRIC_PACKET_SZ];		// FCMD_Batch being run, requestPacket is reused by sub commands
+int batchSz = 0;
+int batchOffset = 0;						// Next sub command in batchPacket
+int batchCmdLeft = 0;
+uint8_t batchResponse[FABRIC_PACKET_SZ];	// FBatch_Response & collected responses
+int batchResponseSz = 0;
+int isBatching = 0;
 	
 static void debugLog(const char* msg)
 {
@@ -76,6 +93,23 @@ uint8_t crc8_block(  uint8_t* data, uint16_t sz )
 }
 
 
+/** Inflate zlib block with the static decoder, no heap is touched while programming. Output buffer
+* holds the whole block so the decoder needs no separate 32KB dictionary.
+*/
+int inflate_block( uint8_t* dst, uint32_t* dstLen, const uint8_t* src, uint32_t srcLen )
+{
+	size_t inSz = srcLen;
+	size_t outSz = *dstLen;
+	
+	tinfl_init( &inflateState );
+	tinfl_status status = tinfl_decompress( &inflateState, src, &inSz, dst, dst, &outSz, 
+		TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF ); // adler32 checked with zlib header
+	
+	*dstLen = outSz;
+	return status == TINFL_STATUS_DONE;
+}
+
+
 /** Write single byte to uart
 */
 void write_byte( uint8_t value )
@@ -85,6 +119,37 @@ void write_byte( uint8_t value )
 }
 
 
+/** Collect a sub command response into the batch reply, a failed response ends the batch.
+*/
+void batch_write_response( const uint8_t* data, uint16_t sz )
+{
+	struct FBatch_Response* response = (struct FBatch_Response*)batchResponse;
+	if(batchResponseSz + sizeof(uint16_t) + sz > sizeof(batchResponse))
+	{
+		response->errorCode = FBATCH_ERROR_OVERFLOW;
+		batchCmdLeft = 0;
+		return;
+	}
+	
+	batchResponse[batchResponseSz++] = (sz >> 0) & 0xff;
+	batchResponse[batchResponseSz++] = (sz >> 8) & 0xff;
+	memcpy( batchResponse + batchResponseSz, data, sz );
+	batchResponseSz += sz;
+	response->cmdCnt++;
+	
+	// Responses lead with errorCode except query device & echo
+	const struct FGeneric_Response* subResponse = (const struct FGeneric_Response*)data;
+	int isFailed = sz < sizeof(struct FPayloadHeader) || subResponse->header.cmd == FCMD_ErrorCmd;
+	if(!isFailed && subResponse->header.cmd != FCMD_QueryDevice && subResponse->header.cmd != FCMD_Echo)
+		isFailed = sz < sizeof(struct FGeneric_Response) || subResponse->errorCode != 0;
+	if(isFailed)
+	{
+		response->errorCode = FBATCH_ERROR_CMD;
+		batchCmdLeft = 0;
+	}
+}
+
+
 /* Write block to uart
 */
 void writeBlock( uint8_t* data, uint16_t sz)
@@ -92,6 +157,13 @@ void writeBlock( uint8_t* data, uint16_t sz)
 #ifdef DEBUG_LOW_LEVEL_PROTOCOL
 	DEBUG_PRINT("writeBlock[%X]: %d\r\n", data, sz);
 #endif
+	
+	// Sub command of a batch, reply is sent once the batch ends
+	if(isBatching)
+	{
+		batch_write_response( data, sz );
+		return;
+	}
 		
 	uint16_t packet_sz = sz + 1;
 	int crc = 0;
@@ -109,11 +181,10 @@ void writeBlock( uint8_t* data, uint16_t sz)
 #ifdef DEBUG_LOW_LEVEL_PROTOCOL		
 		DEBUG_PRINT("WriteByte[%d]: %d\r\n", i, data[i]);
 #endif
-		
-		write_byte(data[i]);	
-		
-		tight_loop_contents();
 	}
+	
+	// Payload in one write, stdio usb packs it into full usb packets
+	fwrite(data, 1, sz, stdout );
 				
     crc = crc & 0xff;
 
@@ -125,6 +196,44 @@ void writeBlock( uint8_t* data, uint16_t sz)
 }
 
 
+/** Copy next batch sub command into data, sends the batch reply once all have run or one failed.
+@return Sub command size, 0 when the batch has ended.
+*/
+int batch_next_command( uint8_t* data )
+{
+	struct FBatch_Response* response = (struct FBatch_Response*)batchResponse;
+	if(batchCmdLeft > 0)
+	{
+		uint16_t sz = 0;
+		if(batchOffset + sizeof(uint16_t) <= batchSz)
+			sz = batchPacket[batchOffset] | (batchPacket[batchOffset + 1] << 8);
+		
+		// Nested batches & reboots never return, readback replies more than once
+		const struct FPayloadHeader* header = (const struct FPayloadHeader*)(batchPacket + batchOffset + sizeof(uint16_t));
+		if(sz < sizeof(struct FPayloadHeader) || batchOffset + sizeof(uint16_t) + sz > batchSz ||
+			header->cmd == FCMD_Batch || header->cmd == FCMD_RebootProgrammer || header->cmd == FCMD_ReadImage ||
+			header->cmd == FCMD_UpdateCommit)
+		{
+			response->errorCode = FBATCH_ERROR_FORMAT;
+		}
+		else
+		{
+			memcpy( data, header, sz );
+			batchOffset += sizeof(uint16_t) + sz;
+			batchCmdLeft--;
+			return sz;
+		}
+	}
+	
+	DEBUG_PRINT("FCMD_Batch done cmdCnt: %d, errorCode: %d\r\n", response->cmdCnt, response->errorCode );
+	
+	isBatching = 0;
+	batchCmdLeft = 0;
+	writeBlock( batchResponse, batchResponseSz );
+	return 0;
+}
+
+
 /** Read block from uart.
 */
 int readBlock( uint8_t* data, int maxSz )
@@ -229,223 +338,42 @@ int readBlock( uint8_t* data, int maxSz )
 }
 
 
-/** find_bitstream_info_flash
-*/
-struct FBitstreamFlashInfo* find_bitstream_info_flash(  )
-{
-	int pageId = 0;
-	uint8_t * addr = XIP_BASE + FLASH_TARGET_OFFSET + (pageId * FLASH_PAGE_SIZE);
-	struct FBitstreamFlashInfo* info = (struct FBitstreamFlashInfo*)addr;
-	if(info->magic0 == FLASH_MAGIC_0)
-	{
-		return info;
-	}
-	return 0;
-}
-
-
-/** Write bitstream info
-*/
-int write_bitstream_info_flash( struct FBitstreamFlashInfo* info )
-{
-	int pageId = 0;
-	
-	// See if data is the same to avoid writing
-	uint8_t * addr = XIP_BASE + FLASH_TARGET_OFFSET + (pageId * FLASH_PAGE_SIZE);
-	struct FBitstreamFlashInfo* info_on_flash = (struct FBitstreamFlashInfo*)addr;
-	if( memcmp(info_on_flash, info,  sizeof(struct FBitstreamFlashInfo) ) == 0)
-	{		
-		return 1; // Same
-	}
-	
-	// erase sector to 0xFF
-	uint32_t ints = save_and_disable_interrupts();
-	flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);		
-	restore_interrupts (ints);
-
-	// write info to page0 in sector ( no wear leveling )
-	ints = save_and_disable_interrupts();
-	uint8_t buff[FLASH_PAGE_SIZE];
-	memset(buff, 0xff, FLASH_PAGE_SIZE); // Set to 0xff
-	memcpy(buff, info, sizeof(struct FBitstreamFlashInfo) );
-	flash_range_program(FLASH_TARGET_OFFSET + (pageId*FLASH_PAGE_SIZE), (uint8_t *)buff, FLASH_PAGE_SIZE);
-	restore_interrupts (ints);
-	
-	// Readback from flash, ensure not worn down ( no wear leveling is done so more than possible )
-	addr = XIP_BASE + FLASH_TARGET_OFFSET + (pageId * FLASH_PAGE_SIZE);
-	info_on_flash = (struct FBitstreamFlashInfo*)addr;
-	if( memcmp(info_on_flash, info,  sizeof(struct FBitstreamFlashInfo) ) != 0)
-	{		
-		return 0;	
-	}
-	
-	return 1;
-}
-
-
-/** write bitstream block, allocated 1 per sector for simplicity. VERY wasteful and assumes this
-is a dedicated storage chip for bitstreams.
-*/
-int write_bitstream_block_flash( int blockId, uint8_t* data, uint32_t size, int* crc )
+void auto_end_program_cycle( struct FPGA_config_t* config )
 {
-	if(size + sizeof(struct FBitstreamBlockInfo) > FLASH_SECTOR_SIZE)
-	{
-		DEBUG_PRINT("size %d > FLASH_SECTOR_SIZE %d\r\n", size, FLASH_SECTOR_SIZE);
-		return 0;
-	}
-
-	// add to crc
-	int blockCrc = 0;
-	for(int i=0;i<size;i++)
-	{
-		blockCrc += data[i]; // Local block cfc
-		*crc = *crc + data[i]; // Complete bitstream crc ( written at end )
-	}
-	
-	blockCrc = blockCrc & 0xff;
+	// End program
+	fpga_write_bitstream_end( config );
 	
-	// erase sector to 0xFF
-	uint32_t ints = save_and_disable_interrupts();
-	flash_range_erase(FLASH_BLOCK_TO_SECTOR(blockId), FLASH_SECTOR_SIZE);		
-	restore_interrupts (ints);
+	// Disable config mode
+	fpga_isc_disable( config );
 
-	// write info to page0 in sector ( no wear leveling )
-	ints = save_and_disable_interrupts();
-	uint8_t buff[FLASH_SECTOR_SIZE];
-	memset( buff, 0xff, FLASH_SECTOR_SIZE); // Set to 0xff
-	
-	struct FBitstreamBlockInfo blockInfo;
-	blockInfo.blockId = blockId;
-	blockInfo.blockSz = size;
-	blockInfo.blockCrc = blockCrc;	
-	memcpy( buff, &blockInfo, sizeof(struct FBitstreamBlockInfo) );	
-	
-	memcpy( buff + sizeof(struct FBitstreamBlockInfo), data, size );
-	
-	flash_range_program(FLASH_BLOCK_TO_SECTOR(blockId), (uint8_t *)buff, FLASH_SECTOR_SIZE);
-	restore_interrupts (ints);
-		
-	// Readback info
-	uint8_t * addr = XIP_BASE + FLASH_BLOCK_TO_SECTOR(blockId);
-	struct FBitstreamBlockInfo* block_info_on_flash = (struct FBitstreamBlockInfo*)addr;
-	if( memcmp( block_info_on_flash, &blockInfo, sizeof(struct FBitstreamBlockInfo) ) != 0 )
-	{		
-		DEBUG_PRINT("memcmp FBitstreamBlockInfo failed to block %d\r\n", blockId); 
-		return 0;	
-	}
-	
-	// Readback from flash, ensure not worn down ( no wear leveling is done so more than possible )	
-	if( memcmp( addr + sizeof(struct FBitstreamBlockInfo), data, size ) != 0 )
-	{		
-		DEBUG_PRINT("memcmp bit data failed to block %d, size: %d\r\n", blockId, size );
-		return 0;	
-	}
-	
-	return 1;
+	fpga_wait_configured( config );
 }
 
 
-/** Verify bitstream in flash storage.
+/** Auto program bitstream from flash storage if valid, bitStreamHash picks the image or 0 for the
+startup image.
 */
-int verify_bitstream_flash( struct FBitstreamFlashInfo* info )
-{
-	if(!info)
-		return 0;
-	
-	// Validate header
-	if(info->blockCnt > FLASH_MAX_BLOCK_CNT)
-	{		
-		DEBUG_PRINT("info->blockCnt %d > FLASH_MAX_BLOCK_CNT %d\r\n", info->blockCnt, FLASH_MAX_BLOCK_CNT);		
-		return 0;
-	}
-	if(info->crc + 1 != info->bitStreamCrc1)
-	{
-		DEBUG_PRINT("info->crc %d + 1 != info->bitStreamCrc1 %d\r\n", info->crc, info->bitStreamCrc1); 	
-		return 0;
-	}
-	if(info->crc + 2 != info->bitStreamCrc2)
-	{
-		DEBUG_PRINT("info->crc %d + 2 != info->bitStreamCrc2 %d\r\n", info->crc, info->bitStreamCrc2); 		
-		return 0;
-	}	
-	
-	// Validate each block
-	int crc = 0;
-	for(int i=0;i<info->blockCnt;i++)
-	{
-		int pageId = 0; // Always use page0 in sector, no wear leveling
-		int blockId = i;
-		uint8_t * addr = XIP_BASE + FLASH_BLOCK_TO_SECTOR(blockId);
-		
-		struct FBitstreamBlockInfo* blockInfo = (struct FBitstreamBlockInfo*)addr;
-		if(blockInfo->blockSz > FLASH_SECTOR_SIZE)
-		{
-			DEBUG_PRINT( "blockInfo[%d]->blockSz %d > FLASH_SECTOR_SIZE %d\r\n", blockId, blockInfo->blockSz , FLASH_SECTOR_SIZE); 
-			return 0;
-		}
-		if(blockInfo->blockId != blockId)
-		{
-			DEBUG_PRINT( "blockInfo[%d]->blockId %d != blockId %d\r\n", blockId, blockInfo->blockId, blockId); 
-			return 0;
-		}
-		
-		// Offset to data from block hdead
-		addr += sizeof(struct FBitstreamBlockInfo);
-		
-		// Calc block & total crc
-		int blockCrc = 0;
-		for(int i=0;i<blockInfo->blockSz;i++)
-		{
-			crc += addr[i];		
-			blockCrc += addr[i];		
-		}
-
-		blockCrc = blockCrc & 0xff;		
-		
-		if(blockInfo->blockCrc != blockCrc)
-		{
-			DEBUG_PRINT("blockInfo[%d]->blockCrc %d != blockCrcd %d\r\n", blockId, blockInfo->blockCrc, blockCrc); 
-			
-			return 0;
-		}
-		
-		DEBUG_PRINT( "Verified Block[%d] sz: %d, crc: %d\r\n", blockId, blockInfo->blockSz, blockInfo->blockCrc );
-	}
-
-	// Validate final crc
-	crc = crc & 0xff;
-	
-	if( crc != info->crc )
-	{		
-		DEBUG_PRINT(tmp, "crc %d != info->crc %d\r\n", crc, info->crc ); 		
-		return 0;				
-	}
-	
-	return 1;
-}
-
-
-/** Auto program bitstream from flash storage if valid.
-*/
-int auto_program_bitstream_flash( struct FPGA_config_t* config, int forceIfValid ) {
+int auto_program_bitstream_flash( struct FPGA_config_t* config, int forceIfValid, const uint8_t* bitStreamHash ) {
     
 	DEBUG_PRINT("auto_program_bitstream_flash %d\r\n", forceIfValid); 
 	
-	struct FBitstreamFlashInfo* prev_info = find_bitstream_info_flash( );
-	if(!prev_info)
+	struct FBitstreamImageRecord* image = store_find_image( bitStreamHash );
+	if(!image)
 	{
 		DEBUG_PRINT("[Not found] auto_program_bitstream_flash\r\n");
 		return 0;
 	}
 		
-	DEBUG_PRINT("[FoundBitstream] blockCnt: %d, bitStreamSz: %d\r\n", prev_info->blockCnt, prev_info->bitStreamSz );
+	DEBUG_PRINT("[FoundBitstream] blockCnt: %d, bitStreamSz: %d\r\n", image->blockCnt, image->bitStreamSz );
 	
-	int isValid = verify_bitstream_flash( prev_info );
+	// Verify reads every block, this runs while the FPGA is still in its init/reset window
+	// as spi access below waits for the device to become ready.
+	int isValid = store_verify_image( image );
 	
-	DEBUG_PRINT("verify_bitstream_flash isValid: %d\r\n", isValid); 
+	DEBUG_PRINT("store_verify_image isValid: %d\r\n", isValid); 
 	
 	int isBusy = 0;	
-	if( isValid && (prev_info->programOnStartup || forceIfValid) )
+	if( isValid && (image->programOnStartup || forceIfValid) )
 	{		
 		DEBUG_PRINT("Writing bitstream\r\n"); 
 
@@ -457,42 +385,40 @@ int auto_program_bitstream_flash( struct FPGA_config_t* config, int forceIfValid
 			return 0;
 		}
 		
+		// Patch list from FCMD_SetPatches applies to this run only
+		int isPatching = patch_begin( image->bitStreamSz );
+		if(!isPatching && patch_end() != FPATCH_ERROR_None)
+		{
+			DEBUG_PRINT("[Abort] patch list past end of bitstream\r\n");
+			return 0;
+		}
+		
 		// Begin fpga program
 		fpga_isc_enable( config );
 		fpga_write_bitstream_begin( config );
 	
-		// Block loop
-		int crc = 0;
-		for(int i=0;i<prev_info->blockCnt;i++)
+		// Block loop, blocks already checked by store_verify_image so stream straight from flash
+		for(int i=0;i<image->blockCnt;i++)
 		{
-			int pageId = 0; // Always use page0 in sector, no wear leveling
-			int blockId = i + 1;
-			uint8_t * addr = XIP_BASE + FLASH_TARGET_OFFSET + (blockId * FLASH_SECTOR_SIZE) + (pageId * FLASH_PAGE_SIZE);	
-			
-			struct FBitstreamBlockInfo* blockInfo = (struct FBitstreamBlockInfo*)addr;
-			if(blockInfo->blockSz > FLASH_SECTOR_SIZE)
-			{		
-				return 0;
-			}
+			uint32_t blockSz;
+			const uint8_t* blockData = store_image_block( image, i, &blockSz );
 			
-			addr += sizeof(struct FBitstreamBlockInfo);
-			
-			int blockCrc = 0;
-			for(int i=0;i<blockInfo->blockSz;i++)
+			// Blocks still being patched are rewritten in RAM
+			if(patch_is_active())
 			{
-				crc += addr[i];		
-				blockCrc += addr[i];		
-			}
-
-			blockCrc = blockCrc & 0xff;		
-			
-			if(blockInfo->blockCrc != blockCrc)
-			{
-				return 0;
+				memcpy( uncompressedData[0], blockData, blockSz );
+				if(!patch_block( uncompressedData[0], blockSz ))
+				{
+					DEBUG_PRINT("[Abort] patch error: %d, block: %d\r\n", patch_end(), i);
+					auto_end_program_cycle( config );
+					isConfigured = 0;
+					return 0;
+				}
+				blockData = uncompressedData[0];
 			}
 			
 			// Write block to fpga
-			fpga_write_bitstream_block( config, addr, blockInfo->blockSz );			
+			fpga_write_bitstream_block( config, (uint8_t*)blockData, blockSz );			
 		}
 		
 		// End program
@@ -501,9 +427,26 @@ int auto_program_bitstream_flash( struct FPGA_config_t* config, int forceIfValid
 		// Disable config mode
 		fpga_isc_disable( config );
 
-		// Check complete
-		isBusy = fpga_poll_busy( config );
+		// Check complete, sleeps until DONE or the busy poll state machine interrupts
+		isBusy = !fpga_wait_configured( config );
 		DEBUG_PRINT("auto_program_bitstream_flash isBusy: %d\r\n", isBusy);
+		if(isBusy)
+		{
+			// DONE never rose, the FPGA holds no design & the image isn't marked used
+			DEBUG_PRINT("[FAILED] not configured\r\n");
+			patch_end();
+			isConfigured = 0;
+			return 0;
+		}
+		
+		// Patched designs differ from the stored image
+		isConfigured = !isPatching;
+		memcpy( configuredHash, image->bitStreamHash, SHA256_HASH_SIZE );
+		if(patch_end() != FPATCH_ERROR_None)
+		{
+			DEBUG_PRINT("[FAILED] patch list not fully applied\r\n");
+			return 0;
+		}
 			
 		return 1;
 	}
@@ -512,16 +455,173 @@ int auto_program_bitstream_flash( struct FPGA_config_t* config, int forceIfValid
 }
 
 
-void auto_end_program_cycle( struct FPGA_config_t* config )
+/** Configure the built in self test design, blocks are inflated straight from its flash section.
+*/
+int run_selftest_configure( struct FPGA_config_t* config, struct FSelfTestConfigure_Response* result )
 {
-	// End program
-	fpga_write_bitstream_end( config );
+	uint64_t t0 = time_us_64();
 	
-	// Disable config mode
+	result->fpgaDeviceId = fpga_read_id( config );
+	if(fpga_poll_busy( config ))
+	{
+		result->failedStage = FSTAGE_Complete;
+		return 0;
+	}
+	
+	fpga_isc_enable( config );
+	fpga_write_bitstream_begin( config );
+	
+	// Blocks are uint16_t compressed size, uint16_t block size then zlib data
+	int offset = 0;
+	while(offset + 4 <= selftest_bitstream_size)
+	{
+		uint16_t compressedSz = selftest_bitstream[offset] | (selftest_bitstream[offset + 1] << 8);
+		uint16_t blockSz = selftest_bitstream[offset + 2] | (selftest_bitstream[offset + 3] << 8);
+		offset += 4;
+		
+		uint8_t* blockData = uncompressedData[0];
+		uint32_t uncomp_len = FABRIC_PACKET_SZ;
+		if(!inflate_block( blockData, &uncomp_len, &selftest_bitstream[offset], compressedSz ) || uncomp_len != blockSz)
+		{
+			DEBUG_PRINT("[Error] self test decompress failed at %d\r\n", offset);
+			result->failedStage = FSTAGE_Inflate;
+			auto_end_program_cycle( config );
+			return 0;
+		}
+		offset += compressedSz;
+		
+		fpga_write_bitstream_block( config, blockData, uncomp_len );
+		result->bitStreamSz += uncomp_len;
+	}
+	
+	fpga_write_bitstream_end( config );
 	fpga_isc_disable( config );
+	result->configureUs = time_us_64() - t0;
+	
+	int isDone = fpga_wait_configured( config );
+	result->totalUs = time_us_64() - t0;
+	result->fpgaStatus = fpga_read_status( config );
+	
+	DEBUG_PRINT("selftest configure done: %d, status: %X, %dus\r\n", isDone, result->fpgaStatus, result->totalUs);
+	
+	if(!isDone || !(result->fpgaStatus & FPGA_STATUS_DONE) || (result->fpgaStatus & FPGA_STATUS_FAIL))
+	{
+		result->failedStage = FSTAGE_Complete;
+		return 0;
+	}
+	return 1;
+}
 
-	sleep_ms(100);
-							
+
+/** Benchmark each pipeline stage, inflate, spi, flash & xip.
+*/
+int run_selftest_perf( struct FPGA_config_t* config, struct FSelfTestPerf_Response* result )
+{
+	uint64_t t0;
+	
+	result->sysClockHz = clock_get_hz(clk_sys);
+
+	// Inflate reference block, same format as FCMD_ProgramBlock payload
+	uint8_t* blockData = uncompressedData[0];
+	uint32_t uncomp_len = FABRIC_PACKET_SZ;
+	t0 = time_us_64();
+	int isInflated = inflate_block( blockData, &uncomp_len, &perf_reference_block[2], perf_reference_block_size - 2 );
+	result->inflateUs = time_us_64() - t0;
+	result->inflateBytes = uncomp_len;
+	if( !isInflated )
+	{
+		DEBUG_PRINT("[Error] perf decompress failed\r\n");
+		return 0;
+	}
+	
+	// Spi burst, csn is left high so the FPGA ignores the data
+	fpga_wait_ready( config );
+	result->spiClockHz = fpga_get_spi_baudrate( config );
+	t0 = time_us_64();
+	fpga_write_bitstream_block( config, blockData, uncomp_len );
+	result->spiUs = time_us_64() - t0;
+	result->spiBytes = uncomp_len;
+	
+	// Erase scratch sector
+	t0 = time_us_64();
+	flash_ops_erase( FLASH_SCRATCH_OFFSET, FLASH_SECTOR_SIZE );
+	result->flashEraseUs = time_us_64() - t0;
+	
+	// Program scratch sector page at a time
+	uint8_t buff[FLASH_PAGE_SIZE];
+	memcpy(buff, blockData, FLASH_PAGE_SIZE);
+	t0 = time_us_64();
+	for(int i=0;i<FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;i++)
+		flash_ops_program( FLASH_SCRATCH_OFFSET + (i * FLASH_PAGE_SIZE), buff, FLASH_PAGE_SIZE );
+	result->flashProgramUs = time_us_64() - t0;
+	result->flashBytes = FLASH_SECTOR_SIZE;
+	
+	// Read bitstream storage bypassing the xip cache
+	const volatile uint32_t* addr = (const volatile uint32_t*)(XIP_NOCACHE_NOALLOC_BASE + FLASH_TARGET_OFFSET);
+	uint32_t sum = 0;
+	t0 = time_us_64();
+	for(int i=0;i<PERF_XIP_READ_SZ / sizeof(uint32_t);i++)
+		sum += addr[i];
+	result->xipUs = time_us_64() - t0;
+	result->xipBytes = PERF_XIP_READ_SZ;
+	
+	DEBUG_PRINT("perf: %d, %d, %d, %d, %d (%X)\r\n", result->inflateUs, result->spiUs, result->flashEraseUs, result->flashProgramUs, result->xipUs, sum);
+	
+	return 1;
+}
+
+
+/** Latch first programming error, later errors are dropped so the host sees the root cause.
+*/
+void latch_program_error( uint16_t blockId, uint8_t stage )
+{
+	if(programError.errorCode)
+		return;
+	programError.errorCode = 1;
+	programError.failedBlockId = blockId;
+	programError.failedStage = stage;
+}
+
+
+/** Ack a program block/complete request with the latched error state.
+*/
+void write_program_response( struct FPayloadHeader* requestHeader, int isErrorCmd )
+{
+	struct FProgramBlock_Response response = programError;
+	response.header = *requestHeader;
+	if(isErrorCmd)
+		response.header.cmd = FCMD_ErrorCmd;
+	writeBlock( (uint8_t*)&response, sizeof(struct FProgramBlock_Response));
+}
+
+
+/** Device info for FCMD_QueryDevice & the FCMD_DeviceStartup frame.
+*/
+void get_device_info( struct FQueryDevicePacket_Response* response, struct FPGA_config_t* config )
+{
+	// Get device id
+	pico_unique_board_id_t* device_id = (pico_unique_board_id_t*)response->progDeviceId;
+	pico_get_unique_board_id(device_id);
+
+	// read device id, the design owns the spi pins while flash is emulated so the last id is reported
+	static uint32_t deviceId = 0;
+	if(flash_emu_state() == FPGA_EMU_Off)
+		deviceId = fpga_read_id( config );
+	response->deviceState = 0;
+	switch(deviceId & 0x0FFFFFFF)
+	{
+		//case FPGA_DEVID_LFE5U_12:
+		case FPGA_DEVID_LFE5U_25:
+		//case FPGA_DEVID_LFE5U_45:
+		case FPGA_DEVID_LFE5U_85:
+			response->deviceState = 1;
+			break;
+	};
+	response->fpgaDeviceId = deviceId;
+	response->maxBlockSz = FABRIC_MAX_BLOCK_SZ;
+	response->maxPacketSz = FABRIC_PACKET_SZ;
+	response->features = FFEATURE_EARLY_ACK | FFEATURE_BLOCK_STORE | FFEATURE_IMAGE_CACHE | FFEATURE_IMAGE_LIST | FFEATURE_BATCH | FFEATURE_SELFTEST | FFEATURE_PATCH | FFEATURE_FLASH_STATUS;
+	response->featuresExt = FFEATURE_EXT_READBACK | FFEATURE_EXT_SELF_UPDATE | FFEATURE_EXT_FLASH_EMU;
 }
 
 
@@ -551,32 +651,43 @@ int main() {
 	// init device
 	struct FPGA_config_t config;
 	fpga_init_config( &config, BOARD_ANY );
+	flash_emu_init( &config );
 
 	// auto program on startup
-	auto_program_bitstream_flash( &config, 0 );	
+	store_init();
+	auto_program_bitstream_flash( &config, 0, 0 );	
 	
 	uint8_t isBusy ;
 	int isProgramming = 0;
 	int isSavingToFlash = 0;
-	int flashCrc = 0;
-	struct FBitstreamFlashInfo flashInfo;
+	int isEarlyAck = 0;
 
 	// Send startup error code & flash led	
 	gpio_put(LED_PIN, 1);
 	sleep_ms(200);
 	gpio_put(LED_PIN, 0);
 	
-	struct FGeneric_Response response;
-	response.header.cmd = FCMD_DeviceStartup;
-	response.header.counter = 1;
-	response.errorCode = 0;
-	writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));	
-	
+	// Startup frame goes out once the host opens the port, output before that is dropped
+	int isHostConnected = 0;
+
     while (1)
 	{
+		// Sent on each port open so a host reattaching after a reboot needs no probe
+		int isConnected = stdio_usb_connected();
+		if(isConnected && !isHostConnected && !isProgramming && !isBatching)
+		{
+			struct FQueryDevicePacket_Response response;
+			response.header.cmd = FCMD_DeviceStartup;
+			response.header.counter = 1;
+			get_device_info( &response, &config );
+			writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+		}
+		isHostConnected = isConnected;
+
 		//gpio_put(LED_PIN, isProgramming);		
 		
-		int sz = readBlock( requestPacket, sizeof(requestPacket) );
+		// Batch sub commands run through the same dispatch as frames
+		int sz = isBatching ? batch_next_command( requestPacket ) : readBlock( requestPacket, sizeof(requestPacket) );
 		if(sz >= sizeof(struct FPayloadHeader))
 		{			
 			struct FPayloadHeader* requestHeader = ((struct FPayloadHeader*)requestPacket);
@@ -600,7 +711,7 @@ int main() {
 						response.header = *requestHeader;
 						response.header.cmd = FCMD_ErrorCmd;
 						response.errorCode = 1; // Unkown cmd			
-						writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
 						break;
 					}
 					
@@ -613,26 +724,9 @@ int main() {
 					
 					struct FQueryDevicePacket_Response response;
 					response.header = *requestHeader;
-											
-					// Get device id
-					pico_unique_board_id_t* device_id = (pico_unique_board_id_t*)response.progDeviceId;
-					pico_get_unique_board_id(device_id);
-
-					// read device id
-					uint32_t deviceId = fpga_read_id( &config );					
-					response.deviceState = 0;
-					switch(deviceId & 0x0FFFFFFF)
-					{
-						//case FPGA_DEVID_LFE5U_12:			
-						case FPGA_DEVID_LFE5U_25:					
-						//case FPGA_DEVID_LFE5U_45:					
-						case FPGA_DEVID_LFE5U_85:					
-							response.deviceState = 1;
-							break;							
-					};
-					response.fpgaDeviceId = deviceId;							
-
-					DEBUG_PRINT("FCMD_QueryDevice[%d]: deviceId: %d, progDeviceId: %X%X%X%X%X%X%X%X\r\n", requestHeader->counter, deviceId,
+					get_device_info( &response, &config );
+
+					DEBUG_PRINT("FCMD_QueryDevice[%d]: deviceId: %d, progDeviceId: %X%X%X%X%X%X%X%X\r\n", requestHeader->counter, response.fpgaDeviceId,
 						response.progDeviceId[0], response.progDeviceId[1], response.progDeviceId[2], response.progDeviceId[3],
 						response.progDeviceId[4], response.progDeviceId[5], response.progDeviceId[6], response.progDeviceId[7]
 					);
@@ -642,13 +736,13 @@ int main() {
 				}
 				case FCMD_ProgramDevice:
 				{
-					if(sz < sizeof(struct FProgramDevicePacket))
+					if(sz < offsetof(struct FProgramDevicePacket, flags))
 					{
 						struct FGeneric_Response response;
 						response.header = *requestHeader;
 						response.header.cmd = FCMD_ErrorCmd;
 						response.errorCode = 1; // Unknown cmd			
-						writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
 						break;
 					}
 					
@@ -661,16 +755,24 @@ int main() {
 						(int)requestData->bitstreamCrc
 						);
 					
-					// Init save info
-					isSavingToFlash = requestData->saveToFlash;
+					// Optional flags, clear latched errors from last run
+					isEarlyAck = (sz >= sizeof(struct FProgramDevicePacket)) && (requestData->flags & FPROGRAM_FLAG_EARLY_ACK);
+					memset( &programError, 0, sizeof(struct FProgramBlock_Response) );
+					
+					// Design unknown until a saved upload commits
+					isConfigured = 0;
 					
-					flashInfo.magic0 = FLASH_MAGIC_0;
-					flashInfo.programOnStartup = 1; // TODO: give option, writing should assume load. Future use for button trigger
-					flashInfo.blockCnt = requestData->blockCount;
-					flashInfo.bitStreamSz = requestData->totalSize;
+					// Uploads arrive already patched
+					patch_clear_list();
 					
-					// clear crc
-					flashCrc = 0;
+					// Init save, blocks are added to the store as they stream
+					isSavingToFlash = requestData->saveToFlash;
+					if(isSavingToFlash && !store_begin_image( requestData->blockCount, requestData->totalSize ))
+					{
+						DEBUG_PRINT("[FAILED] store_begin_image blockCount: %d\r\n", requestData->blockCount);
+						isSavingToFlash = 0;
+						latch_program_error( 0, FSTAGE_Flash );
+					}
 					
 					isBusy = fpga_poll_busy( &config );
 					DEBUG_PRINT("isBusy: %d\r\n", isBusy);
@@ -685,8 +787,9 @@ int main() {
 						isProgramming = 1;
 					}							
 					struct FGeneric_Response response;
+					response.header = *requestHeader;
 					response.errorCode = (!isBusy) ? 0 : 1;					
-					writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));												
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));												
 					break;
 				}
 				case FCMD_ProgramBlock:
@@ -697,7 +800,7 @@ int main() {
 						response.header = *requestHeader;
 						response.header.cmd = FCMD_ErrorCmd;
 						response.errorCode = 1; // Unknown cmd			
-						writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
 						break;
 					}
 					
@@ -710,22 +813,35 @@ int main() {
 							requestData->blockCrc
 						);
 					
+					// Early ack, frame passed crc so host can send the next block while this one is processed
+					if(isEarlyAck)
+					{
+						write_program_response( requestHeader, 0 );
+						
+						// Skip rest of bitstream once failed, error is reported on every ack
+						if(programError.errorCode)
+							break;
+					}
+					
 					// Get ptr to data
 					uint8_t* bitStreamBlock = requestPacket + sizeof(struct FQueryProgramBlock);
 					
+					// Next decode buffer, single buffer waits for spi to release it
+					uint8_t* blockData = uncompressedData[blockBufferId];
+					blockBufferId = (blockBufferId + 1) % FABRIC_BLOCK_BUFFER_CNT;
+					if(FABRIC_BLOCK_BUFFER_CNT < 2)
+						fpga_write_bitstream_wait( &config );
+					
 					// Decompress data
 					//uint16_t raw_sz = bitStreamBlock[0] << 8 | bitStreamBlock[1]; // Used for allocation, as this is all fixed ignoring these values.
-					uLong uncomp_len = sizeof(uncompressedData);
-					int cmp_status = uncompress( (unsigned char *)&uncompressedData, &uncomp_len, &bitStreamBlock[2], requestData->compressedBlockSz );
-					if( cmp_status != Z_OK)
+					uint32_t uncomp_len = FABRIC_PACKET_SZ;
+					if( !inflate_block( blockData, &uncomp_len, &bitStreamBlock[2], requestData->compressedBlockSz ) )
 					{
 						DEBUG_PRINT("[Error] Decompress failed\r\n");
 						
-						struct FGeneric_Response response;
-						response.header = *requestHeader;
-						response.header.cmd = FCMD_ErrorCmd;
-						response.errorCode = 1; // Unknown cmd			
-						writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+						latch_program_error( requestData->blockId, FSTAGE_Inflate );
+						if(!isEarlyAck)
+							write_program_response( requestHeader, 1 );
 						break;
 					}
 					
@@ -733,11 +849,9 @@ int main() {
 					{
 						DEBUG_PRINT("[Error]uncomp_len %d != requestData->blockSz %d\r\n", uncomp_len, requestData->blockSz );
 						
-						struct FGeneric_Response response;
-						response.header = *requestHeader;
-						response.header.cmd = FCMD_ErrorCmd;
-						response.errorCode = 1; // Unknown cmd			
-						writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+						latch_program_error( requestData->blockId, FSTAGE_BlockSize );
+						if(!isEarlyAck)
+							write_program_response( requestHeader, 1 );
 						break;						
 					}
 					
@@ -745,7 +859,7 @@ int main() {
 					int crc = 0;
 					for( int i=0;i<requestData->blockSz;i++)
 					{
-						crc += uncompressedData[i];
+						crc += blockData[i];
 					}					
 					crc = crc & 0xff;
 					
@@ -753,38 +867,127 @@ int main() {
 					{
 						DEBUG_PRINT("[Error]blockCrc %d != requestData->blockCrc %d\r\n", crc, requestData->blockCrc  );
 						
-						struct FGeneric_Response response;
-						response.header = *requestHeader;
-						response.header.cmd = FCMD_ErrorCmd;
-						response.errorCode = 1; // Unknown cmd			
-						writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+						latch_program_error( requestData->blockId, FSTAGE_BlockCrc );
+						if(!isEarlyAck)
+							write_program_response( requestHeader, 1 );
 						break;						
 					}
 					
-					// Write block to fpga
-					fpga_write_bitstream_block( &config, uncompressedData, requestData->blockSz );
+					// Write block to fpga, DMA streams it while the ack & flash save run
+					fpga_write_bitstream_block_async( &config, blockData, requestData->blockSz );
 					
-					struct FGeneric_Response response;
-					response.header = *requestHeader;
-					response.errorCode = 0; // OK
-					writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+					if(!isEarlyAck)
+						write_program_response( requestHeader, 0 );
 					
-					// Save block to flash
+					// Save block to flash, identical blocks already stored are only referenced
 					if(isSavingToFlash)
 					{
-						DEBUG_PRINT( "write_bitstream_block_flash blockId %d, blockCrc: %d\r\n", requestData->blockId, crc8_block( uncompressedData, uncomp_len ) ); 
+						DEBUG_PRINT( "store_add_block blockId %d, blockCrc: %d\r\n", requestData->blockId, crc8_block( blockData, uncomp_len ) ); 
 						
-						if(!write_bitstream_block_flash( requestData->blockId, uncompressedData, uncomp_len, &flashCrc ))
+						if(!store_add_block( requestData->blockId, blockData, uncomp_len ))
 						{
-							DEBUG_PRINT("[FAILED] write_bitstream_block_flash %d failed to write\r\n", requestData->blockId);
+							DEBUG_PRINT("[FAILED] store_add_block %d failed to write\r\n", requestData->blockId);
 							
-							// Clear save flag
+							// Clear save flag, reported on the next ack & complete
 							isSavingToFlash = 0;
+							latch_program_error( requestData->blockId, FSTAGE_Flash );
 						}
 					}
 						
 					break;
 				}
+				case FCMD_ProgramBlockRef:
+				{
+					if(sz < sizeof(struct FProgramBlockRef))
+					{
+						struct FGeneric_Response response;
+						response.header = *requestHeader;
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1; // Unknown cmd			
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+						break;
+					}
+					
+					struct FProgramBlockRef* requestData = ((struct FProgramBlockRef*)requestPacket);
+					
+					DEBUG_PRINT("FCMD_ProgramBlockRef: blockId: %d, blockSz: %d\r\n", requestData->blockId, requestData->blockSz );
+					
+					if(isEarlyAck)
+					{
+						write_program_response( requestHeader, 0 );
+						if(programError.errorCode)
+							break;
+					}
+					
+					// Block must already be in flash & match what the host expects
+					uint32_t blockSz = 0;
+					int slot = store_find_block( requestData->blockKey );
+					const uint8_t* blockData = store_block_data( slot, &blockSz );
+					int stage = FSTAGE_None;
+					if(!blockData)
+						stage = FSTAGE_BlockRef;
+					else if(blockSz != requestData->blockSz)
+						stage = FSTAGE_BlockSize;
+					else if(crc8_block( (uint8_t*)blockData, blockSz ) != requestData->blockCrc)
+						stage = FSTAGE_BlockCrc;
+					
+					if(stage != FSTAGE_None)
+					{
+						DEBUG_PRINT("[Error] block ref %d failed stage %d\r\n", requestData->blockId, stage );
+						
+						latch_program_error( requestData->blockId, stage );
+						if(!isEarlyAck)
+							write_program_response( requestHeader, 1 );
+						break;
+					}
+					
+					// Write block straight from flash, blocking as flash writes can't run while DMA reads XIP
+					fpga_write_bitstream_block( &config, (uint8_t*)blockData, blockSz );
+					
+					if(!isEarlyAck)
+						write_program_response( requestHeader, 0 );
+					
+					if(isSavingToFlash && !store_add_block_slot( requestData->blockId, slot ))
+					{
+						DEBUG_PRINT("[FAILED] store_add_block_slot %d\r\n", requestData->blockId);
+						isSavingToFlash = 0;
+						latch_program_error( requestData->blockId, FSTAGE_Flash );
+					}
+					break;
+				}
+				case FCMD_QueryBlockKeys:
+				{
+					struct FQueryBlockKeys* requestData = ((struct FQueryBlockKeys*)requestPacket);
+					
+					struct FQueryBlockKeys_Response response;
+					memset(&response, 0, sizeof( struct FQueryBlockKeys_Response ) );
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FQueryBlockKeys) || requestData->keyCnt > FABRIC_MAX_QUERY_KEYS || 
+						sz < sizeof(struct FQueryBlockKeys) + requestData->keyCnt * FABRIC_BLOCK_KEY_SIZE)
+					{
+						response.errorCode = 1;
+					}
+					else
+					{
+						// Set bit for each key already in flash, pinned while saving so the host can still ref it
+						uint8_t* keys = requestPacket + sizeof(struct FQueryBlockKeys);
+						response.keyCnt = requestData->keyCnt;
+						for(int i=0;i<requestData->keyCnt;i++)
+						{
+							int slot = store_find_block( keys + (i * FABRIC_BLOCK_KEY_SIZE) );
+							if(slot < 0)
+								continue;
+							
+							if(isSavingToFlash)
+								store_pin_block( slot );
+							response.isStored[i / 8] |= 1 << (i % 8);
+						}
+					}
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FQueryBlockKeys_Response));
+					break;
+				}
 				case FCMD_ProgramComplete:
 				{					
 					DEBUG_PRINT("FCMD_ProgramComplete\r\n"	);
@@ -795,31 +998,34 @@ int main() {
 					// Disable config mode
 					fpga_isc_disable( &config );
 
-					// Check complete
-					isBusy = fpga_poll_busy( &config );
+					// Check complete, sleeps until DONE or the busy poll state machine interrupts
+					isBusy = !fpga_wait_configured( &config );
 					DEBUG_PRINT("FCMD_ProgramComplete isBusy: %d\r\n", isBusy);
-					
-					struct FGeneric_Response response;
-					response.header = *requestHeader;
-					response.errorCode = (!isBusy) ? 0 : 1;
-					writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));	
+					if(isBusy)
+						latch_program_error( 0xffff, FSTAGE_Complete );
 					
 					// Commit flash if success
-					if( isSavingToFlash && response.errorCode == 0 )
+					if( isSavingToFlash && programError.errorCode == 0 )
 					{
-						flashCrc = flashCrc & 0xff;
-						
-						DEBUG_PRINT("write_bitstream_info_flash\r\n");						
-						flashInfo.crc = flashCrc;
-						flashInfo.bitStreamCrc1 = flashInfo.crc + 1;
-						flashInfo.bitStreamCrc2 = flashInfo.crc + 2;
-						if(!write_bitstream_info_flash( &flashInfo ))
+						DEBUG_PRINT("store_commit_image\r\n");						
+						if(!store_commit_image( 1 )) // TODO: give option, writing should assume load. Future use for button trigger
+						{
+							DEBUG_PRINT("[FAILED] Image record failed to write\r\n");
+							latch_program_error( 0xffff, FSTAGE_Flash );
+						}
+						else
 						{
-							DEBUG_PRINT("[FAILED] Info failed to write\r\n");
+							// Committed record is the most recently used
+							memcpy( configuredHash, store_find_image( 0 )->bitStreamHash, SHA256_HASH_SIZE );
+							isConfigured = 1;
 						}
 					}
+					
+					// Report any error latched while streaming
+					write_program_response( requestHeader, 0 );
 	
 					isProgramming = 0;
+					isEarlyAck = 0;
 					break;
 				}		
 				case FCMD_QueryBitstreamFlash:
@@ -838,20 +1044,21 @@ int main() {
 					response.header = *requestHeader;
 					response.errorCode = 1;	 // Default error
 					
-					// Read info from flash
-					struct FBitstreamFlashInfo* info = find_bitstream_info_flash( );					
-					if(info)
+					// Read startup image from flash
+					struct FBitstreamImageRecord* image = store_find_image( 0 );					
+					if(image)
 					{						
 						// Verify bitstream
-						int isValid = verify_bitstream_flash( info );
+						int isValid = store_verify_image( image );
 						if(isValid)
 						{
 							// Fill out flash info
 							response.errorCode = 0;	
-							response.programOnStartup = info->programOnStartup;	
-							response.blockCnt = info->blockCnt;	
-							response.bitStreamSz = info->bitStreamSz;	
-							response.crc = info->crc;	
+							response.programOnStartup = image->programOnStartup;	
+							response.blockCnt = image->blockCnt;	
+							response.bitStreamSz = image->bitStreamSz;	
+							response.crc = image->crc;	
+							memcpy( response.bitStreamHash, image->bitStreamHash, SHA256_HASH_SIZE );
 						}							
 					}
 					
@@ -871,15 +1078,99 @@ int main() {
 					DEBUG_PRINT("FCMD_ProgramBitstreamFromFlash\r\n" );
 					
 					// Run startup program with force options
-					int result = auto_program_bitstream_flash( &config, 1 );
+					int result = auto_program_bitstream_flash( &config, 1, 0 );
 					
 					struct FGeneric_Response response;
 					response.header = *requestHeader;
 					response.errorCode = result == 0;
-					writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));	
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));	
 					
 					break;
 				}	
+				case FCMD_ConfigureImage:
+				{
+					// Force end
+					if(isProgramming)
+					{
+						auto_end_program_cycle( &config );
+						isProgramming = 0;
+					}
+					
+					struct FConfigureImage_Response response;
+					memset(&response, 0, sizeof( struct FConfigureImage_Response ) );
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FConfigureImage))
+					{
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1;
+						writeBlock( (uint8_t*)&response, sizeof(struct FConfigureImage_Response));
+						break;
+					}
+					
+					struct FConfigureImage* requestData = ((struct FConfigureImage*)requestPacket);
+					
+					// Hit programs straight from flash & marks the image most recently used
+					struct FBitstreamImageRecord* image = store_find_image( requestData->bitStreamHash );
+					if(image)
+					{
+						response.isResident = 1;
+						if(auto_program_bitstream_flash( &config, 1, requestData->bitStreamHash ))
+							store_touch_image( image );
+						else
+							response.errorCode = 1;
+					}
+					
+					DEBUG_PRINT("FCMD_ConfigureImage isResident: %d, errorCode: %d\r\n", response.isResident, response.errorCode );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FConfigureImage_Response));
+					break;
+				}
+				case FCMD_QueryImages:
+				{
+					struct FQueryImages_Response response;
+					memset(&response, 0, sizeof( struct FQueryImages_Response ) );
+					response.header = *requestHeader;
+					
+					response.isConfigured = isConfigured;
+					if(isConfigured)
+						memcpy( response.configuredHash, configuredHash, SHA256_HASH_SIZE );
+					
+					// Record hashes, most recently used first
+					struct FBitstreamImageRecord* images[FLASH_IMAGE_SLOT_CNT];
+					response.imageCnt = store_list_images( images );
+					for(int i=0;i<response.imageCnt;i++)
+						memcpy( response.imageHashes[i], images[i]->bitStreamHash, SHA256_HASH_SIZE );
+					
+					DEBUG_PRINT("FCMD_QueryImages imageCnt: %d, isConfigured: %d\r\n", response.imageCnt, response.isConfigured );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FQueryImages_Response));
+					break;
+				}
+				case FCMD_Batch:
+				{
+					struct FBatch_Response* response = (struct FBatch_Response*)batchResponse;
+					memset( response, 0, sizeof(struct FBatch_Response) );
+					response->header = *requestHeader;
+					batchResponseSz = sizeof(struct FBatch_Response);
+					
+					if(sz < sizeof(struct FBatchPacket))
+					{
+						response->errorCode = FBATCH_ERROR_FORMAT;
+						writeBlock( batchResponse, batchResponseSz );
+						break;
+					}
+					
+					// Sub commands are read from the copy, responses collect until the batch ends
+					memcpy( batchPacket, requestPacket, sz );
+					batchSz = sz;
+					batchOffset = sizeof(struct FBatchPacket);
+					batchCmdLeft = ((struct FBatchPacket*)batchPacket)->cmdCnt;
+					isBatching = 1;
+					
+					DEBUG_PRINT("FCMD_Batch cmdCnt: %d\r\n", batchCmdLeft );
+					break;
+				}
 				case FCMD_ClearBitstreamFlash:
 				{
 					// Force end
@@ -891,25 +1182,337 @@ int main() {
 					
 					DEBUG_PRINT("FCMD_ClearBitstreamFlash\r\n" );
 
-					// Clear info
-					DEBUG_PRINT("zeroing flash header\r\n");						
-					memset(&flashInfo, 0, sizeof(struct FBitstreamFlashInfo) );					
-					
-					// Erase
+					// Erase image records
 					struct FGeneric_Response response;
 					response.header = *requestHeader;
 					response.errorCode = 0;
 					
-					if(!write_bitstream_info_flash( &flashInfo ))
+					if(!store_clear())
 					{
-						DEBUG_PRINT("[FAILED] Info failed to write\r\n");
+						DEBUG_PRINT("[FAILED] Image records failed to erase\r\n");
 						response.errorCode = 1;
 					}
 					
-					writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));	
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));	
 
 					break;
 				}
+				case FCMD_SelfTestPerf:
+				{
+					// Force end
+					if(isProgramming)
+					{
+						auto_end_program_cycle( &config );
+						isProgramming = 0;
+					}
+					
+					DEBUG_PRINT("FCMD_SelfTestPerf\r\n" );
+					
+					struct FSelfTestPerf_Response response;
+					memset(&response, 0, sizeof( struct FSelfTestPerf_Response ) );
+					response.header = *requestHeader;
+					response.errorCode = run_selftest_perf( &config, &response ) == 0;
+					writeBlock( (uint8_t*)&response, sizeof(struct FSelfTestPerf_Response));
+					
+					break;
+				}
+				case FCMD_SelfTestConfigure:
+				{
+					// Force end
+					if(isProgramming)
+					{
+						auto_end_program_cycle( &config );
+						isProgramming = 0;
+					}
+					
+					struct FSelfTestConfigure_Response response;
+					memset(&response, 0, sizeof( struct FSelfTestConfigure_Response ) );
+					response.header = *requestHeader;
+					response.errorCode = !run_selftest_configure( &config, &response );
+					
+					// Stored images untouched but no longer configured
+					isConfigured = 0;
+					
+					DEBUG_PRINT("FCMD_SelfTestConfigure errorCode: %d, totalUs: %d\r\n", response.errorCode, response.totalUs );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FSelfTestConfigure_Response));
+					break;
+				}
+				case FCMD_SetPatches:
+				{
+					struct FGeneric_Response response;
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FSetPatchesPacket))
+					{
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1;
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+						break;
+					}
+					
+					struct FSetPatchesPacket* requestData = ((struct FSetPatchesPacket*)requestPacket);
+					response.errorCode = patch_set_list( requestPacket + sizeof(struct FSetPatchesPacket), sz - sizeof(struct FSetPatchesPacket), requestData->patchCnt );
+					
+					DEBUG_PRINT("FCMD_SetPatches patchCnt: %d, errorCode: %d\r\n", requestData->patchCnt, response.errorCode );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+					break;
+				}
+				case FCMD_QueryFlashStatus:
+				{
+					const struct FFlashOpStats* stats = flash_ops_stats();
+					
+					struct FQueryFlashStatus_Response response;
+					response.header = *requestHeader;
+					response.errorCode = 0;
+					response.isIrqSafe = FLASH_OPS_IRQ_SAFE;
+					response.opCnt = stats->opCnt;
+					response.chunkCnt = stats->chunkCnt;
+					response.eraseBytes = stats->eraseBytes;
+					response.programBytes = stats->programBytes;
+					response.maxChunkUs = stats->maxChunkUs;
+					response.maxIrqOffUs = stats->maxIrqOffUs;
+					response.opBytes = stats->opBytes;
+					response.opDoneBytes = stats->opDoneBytes;
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FQueryFlashStatus_Response));
+					break;
+				}
+				case FCMD_ReadImage:
+				{
+					struct FReadImage_Response* response = (struct FReadImage_Response*)uncompressedData[0];
+					memset(response, 0, sizeof( struct FReadImage_Response ) );
+					response->header = *requestHeader;
+					
+					if(sz < sizeof(struct FReadImage))
+					{
+						response->header.cmd = FCMD_ErrorCmd;
+						response->errorCode = 1;
+						writeBlock( (uint8_t*)response, sizeof(struct FReadImage_Response));
+						break;
+					}
+					
+					// Force end, responses are built in the decode buffer
+					if(isProgramming)
+					{
+						auto_end_program_cycle( &config );
+						isProgramming = 0;
+					}
+					
+					struct FReadImage* requestData = ((struct FReadImage*)requestPacket);
+					
+					// Zero hash reads the startup image
+					int isStartup = 1;
+					for(int i=0;i<SHA256_HASH_SIZE;i++)
+						isStartup &= requestData->bitStreamHash[i] == 0;
+					struct FBitstreamImageRecord* image = store_find_image( isStartup ? 0 : requestData->bitStreamHash );
+					
+					if(!image)
+						response->errorCode = FREAD_ERROR_NotFound;
+					else if(requestData->firstBlockId >= image->blockCnt)
+						response->errorCode = FREAD_ERROR_Range;
+					if(response->errorCode)
+					{
+						writeBlock( (uint8_t*)response, sizeof(struct FReadImage_Response));
+						break;
+					}
+					
+					response->blockCnt = image->blockCnt;
+					response->bitStreamSz = image->bitStreamSz;
+					
+					// Window of frames back to back, the host reads them without further requests
+					uint8_t* data = uncompressedData[0] + sizeof(struct FReadImage_Response);
+					for(int blockId=requestData->firstBlockId;blockId<image->blockCnt && blockId<requestData->firstBlockId + requestData->blockCnt;blockId++)
+					{
+						uint32_t blockSz = 0;
+						const uint8_t* blockData = store_image_block( image, blockId, &blockSz );
+						response->blockId = blockId;
+						if(!blockData || blockSz > FABRIC_MAX_BLOCK_SZ)
+						{
+							response->errorCode = FREAD_ERROR_Block;
+							response->dataSz = 0;
+							writeBlock( (uint8_t*)response, sizeof(struct FReadImage_Response));
+							break;
+						}
+						
+						// Compressed only when it comes out smaller than the stored block
+						response->blockSz = blockSz;
+						response->blockCrc = crc8_block( (uint8_t*)blockData, blockSz );
+						response->dataSz = 0;
+						if(requestData->flags & FREAD_FLAG_COMPRESS)
+							response->dataSz = block_deflate( data, blockSz - 1, blockData, blockSz );
+						response->isCompressed = response->dataSz != 0;
+						if(!response->isCompressed)
+						{
+							memcpy( data, blockData, blockSz );
+							response->dataSz = blockSz;
+						}
+						
+						writeBlock( (uint8_t*)response, sizeof(struct FReadImage_Response) + response->dataSz);
+					}
+					
+					DEBUG_PRINT("FCMD_ReadImage firstBlockId: %d, blockCnt: %d, errorCode: %d\r\n", requestData->firstBlockId, requestData->blockCnt, response->errorCode );
+					break;
+				}
+				case FCMD_UpdateBegin:
+				{
+					struct FUpdateBegin_Response response;
+					memset( &response, 0, sizeof(response) );
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FUpdateBegin))
+					{
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1;
+						writeBlock( (uint8_t*)&response, sizeof(struct FUpdateBegin_Response));
+						break;
+					}
+					
+					// Force end, blocks share the decoder
+					if(isProgramming)
+					{
+						auto_end_program_cycle( &config );
+						isProgramming = 0;
+					}
+					
+					struct FUpdateBegin* requestData = ((struct FUpdateBegin*)requestPacket);
+					response.errorCode = update_begin( requestData->imageSz, requestData->imageHash );
+					response.runningSz = update_running_size();
+					update_running_hash( response.runningHash );
+					response.maxImageSz = UPDATE_MAX_IMAGE_SZ;
+					response.blockSz = UPDATE_BLOCK_SZ;
+					response.dictSz = UPDATE_DICT_SZ;
+					
+					DEBUG_PRINT("FCMD_UpdateBegin imageSz: %d, runningSz: %d, errorCode: %d\r\n", requestData->imageSz, response.runningSz, response.errorCode );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FUpdateBegin_Response));
+					break;
+				}
+				case FCMD_UpdateBlock:
+				{
+					struct FGeneric_Response response;
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FUpdateBlock))
+					{
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1;
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+						break;
+					}
+					
+					struct FUpdateBlock* requestData = ((struct FUpdateBlock*)requestPacket);
+					response.errorCode = update_write_block( &inflateState, requestData, sz - sizeof(struct FUpdateBlock) );
+					
+					if(response.errorCode)
+						DEBUG_PRINT("FCMD_UpdateBlock offset: %d, errorCode: %d\r\n", requestData->offset, response.errorCode );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+					break;
+				}
+				case FCMD_UpdateCommit:
+				{
+					struct FGeneric_Response response;
+					response.header = *requestHeader;
+					response.errorCode = update_commit();
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+					
+					DEBUG_PRINT("FCMD_UpdateCommit errorCode: %d\r\n", response.errorCode );
+					
+					// Let the ack reach the host, the swap reboots without returning
+					if(response.errorCode == 0)
+					{
+						stdio_flush();
+						sleep_ms( 100 );
+						flash_emu_stop();
+						update_swap();
+					}
+					break;
+				}
+				case FCMD_FlashEmuWrite:
+				{
+					struct FGeneric_Response response;
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FFlashEmuWrite))
+					{
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1;
+						writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+						break;
+					}
+					
+					// Force end, blocks share the decode buffer
+					if(isProgramming)
+					{
+						auto_end_program_cycle( &config );
+						isProgramming = 0;
+					}
+					
+					struct FFlashEmuWrite* requestData = ((struct FFlashEmuWrite*)requestPacket);
+					uint8_t* blockData = uncompressedData[0];
+					uint32_t uncomp_len = FABRIC_PACKET_SZ;
+					if(requestData->compressedBlockSz > sz - sizeof(struct FFlashEmuWrite) ||
+						!inflate_block( blockData, &uncomp_len, requestPacket + sizeof(struct FFlashEmuWrite), requestData->compressedBlockSz ) ||
+						uncomp_len != requestData->blockSz || crc8_block( blockData, uncomp_len ) != requestData->blockCrc)
+						response.errorCode = FFLASHEMU_ERROR_Inflate;
+					else
+						response.errorCode = flash_emu_write( requestData->offset, blockData, uncomp_len );
+					
+					if(response.errorCode)
+						DEBUG_PRINT("FCMD_FlashEmuWrite offset: %d, errorCode: %d\r\n", requestData->offset, response.errorCode );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
+					break;
+				}
+				case FCMD_FlashEmu:
+				{
+					struct FFlashEmu_Response response;
+					memset( &response, 0, sizeof(response) );
+					response.header = *requestHeader;
+					
+					if(sz < sizeof(struct FFlashEmu))
+					{
+						response.header.cmd = FCMD_ErrorCmd;
+						response.errorCode = 1;
+						writeBlock( (uint8_t*)&response, sizeof(struct FFlashEmu_Response));
+						break;
+					}
+					
+					struct FFlashEmu* requestData = ((struct FFlashEmu*)requestPacket);
+					if(requestData->imageSz > FLASH_EMU_SZ)
+						response.errorCode = FFLASHEMU_ERROR_Size;
+					else if(requestData->mode == FFLASHEMU_MODE_Start)
+					{
+						// Serves the design that is configured now, an upload in flight ends first
+						if(isProgramming)
+						{
+							auto_end_program_cycle( &config );
+							isProgramming = 0;
+						}
+						response.errorCode = flash_emu_start( requestData->imageSz, requestData->imageHash );
+					}
+					else if(requestData->mode == FFLASHEMU_MODE_Stop)
+						flash_emu_stop();
+					
+					// Start already hashed the region on success
+					if(response.errorCode == 0 && requestData->mode == FFLASHEMU_MODE_Start)
+						memcpy( response.imageHash, requestData->imageHash, SHA256_HASH_SIZE );
+					else if(requestData->imageSz <= FLASH_EMU_SZ)
+						flash_emu_hash( requestData->imageSz, response.imageHash );
+					
+					response.state = flash_emu_state();
+					response.flashOffset = FLASH_EMU_OFFSET;
+					response.regionSz = FLASH_EMU_SZ;
+					response.blockSz = FLASH_EMU_BLOCK_SZ;
+					response.readCnt = flash_emu_read_count();
+					
+					DEBUG_PRINT("FCMD_FlashEmu mode: %d, state: %d, errorCode: %d\r\n", requestData->mode, response.state, response.errorCode );
+					
+					writeBlock( (uint8_t*)&response, sizeof(struct FFlashEmu_Response));
+					break;
+				}
 				case FCMD_RebootProgrammer:
 				{
 					// Abuse the watchdog
@@ -924,7 +1527,7 @@ int main() {
 					struct FGeneric_Response response;
 					response.header = *requestHeader;
 					response.errorCode = 1; // Unkoqn cmd			
-					writeBlock( (uint8_t*)&response, sizeof(struct FQueryDevicePacket_Response));
+					writeBlock( (uint8_t*)&response, sizeof(struct FGeneric_Response));
 				}
 			}
 
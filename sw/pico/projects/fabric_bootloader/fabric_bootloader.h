@@ -2,15 +2,33 @@
 
 #include <stdint.h>
 #include "../libfabric/libfabric.h"
+#include "sha256.h"
 
 /** Config
 */
 #define ENABLE_DEBUG_LOG 0
 
+
+/** Capacities, chosen from the target chip at compile time. RP2350 has twice the SRAM so takes
+* 4x larger blocks and decodes the next block while the previous one streams to spi over DMA.
+*/
+#if PICO_RP2350
+#define FABRIC_MAX_BLOCK_SZ (16384 - 32)	// Largest uncompressed block, reported to host
+#define FABRIC_PACKET_SZ (16384 + 26)		// Request buffer, worst case compressed block + headers
+#define FABRIC_BLOCK_BUFFER_CNT 2			// Decompressed block buffers
+#else
+#define FABRIC_MAX_BLOCK_SZ (4096 - 32)
+#define FABRIC_PACKET_SZ 4090
+#define FABRIC_BLOCK_BUFFER_CNT 1
+#endif
+
 /** Constants
 */
 #define FPACKSTRUCT  __attribute__((__packed__)) 
 #define FPacketHeaderMagic 0x1b
+#define FABRIC_BLOCK_KEY_SIZE 24		// Block key, leading bytes of sha256 of block data
+#define FABRIC_MAX_QUERY_KEYS 128		// Keys per FCMD_QueryBlockKeys
+#define FABRIC_MAX_IMAGES 8				// Image records in the flash store
 
 
 /** Serial commands
@@ -26,11 +44,71 @@ enum FabricCommands
 	FCMD_ProgramBitstreamFromFlash = 0x06,// Program bitstream stored in flash
 	FCMD_ClearBitstreamFlash = 0x07, // Clear bitstream flash on boot
 	FCMD_RebootProgrammer = 0x08,  	// Reboot programmer device
-	FCMD_DeviceStartup = 0xfe,  	// [non-disaptched] Sent on device startup
+	FCMD_SelfTestPerf = 0x09,		// Benchmark inflate, spi, flash & xip stages
+	FCMD_QueryBlockKeys = 0x0A,		// Which blocks are already stored in flash
+	FCMD_ProgramBlockRef = 0x0B,	// Bitstream block already stored in flash, sent by key
+	FCMD_ConfigureImage = 0x0C,		// Program image from flash by hash, reports a miss when not stored
+	FCMD_QueryImages = 0x0D,		// Hashes of stored images & the image the FPGA is configured with
+	FCMD_Batch = 0x0E,				// Run sub commands in order, all responses in one reply
+	FCMD_SelfTestConfigure = 0x0F,	// Configure the self test design built into the bootloader
+	FCMD_SetPatches = 0x10,			// Patch list applied to the next program from flash
+	FCMD_QueryFlashStatus = 0x11,	// Flash erase & program counters, stalls & progress
+	FCMD_ReadImage = 0x12,			// Read back a window of stored image blocks, one response frame each
+	FCMD_UpdateBegin = 0x13,		// Start staging a new bootloader image
+	FCMD_UpdateBlock = 0x14,		// Next block of the staged bootloader image
+	FCMD_UpdateCommit = 0x15,		// Verify the staged bootloader, swap it in & reboot
+	FCMD_FlashEmuWrite = 0x16,		// Block of the emulated spi flash image
+	FCMD_FlashEmu = 0x17,			// Start, stop or query the spi flash emulator
+	FCMD_DeviceStartup = 0xfe,  	// [non-disaptched] Sent when the host opens the port, FQueryDevicePacket_Response data
 	FCMD_ErrorCmd = 0xff,			// Bad cmd
 };
 
 
+/** Feature flags reported in FQueryDevicePacket_Response.
+*/
+#define FFEATURE_EARLY_ACK 0x01			// FPROGRAM_FLAG_EARLY_ACK supported, block acks are FProgramBlock_Response
+#define FFEATURE_BLOCK_STORE 0x02		// FCMD_QueryBlockKeys & FCMD_ProgramBlockRef supported
+#define FFEATURE_IMAGE_CACHE 0x04		// FCMD_ConfigureImage supported, saves replace the least recently used image
+#define FFEATURE_IMAGE_LIST 0x08		// FCMD_QueryImages supported
+#define FFEATURE_BATCH 0x10				// FCMD_Batch supported
+#define FFEATURE_SELFTEST 0x20			// FCMD_SelfTestConfigure supported
+#define FFEATURE_PATCH 0x40				// FCMD_SetPatches supported
+#define FFEATURE_FLASH_STATUS 0x80		// FCMD_QueryFlashStatus supported, flash writes are chunked so usb stays serviced
+
+
+/** Feature flags reported in FQueryDevicePacket_Response featuresExt.
+*/
+#define FFEATURE_EXT_READBACK 0x01		// FCMD_ReadImage supported
+#define FFEATURE_EXT_SELF_UPDATE 0x02	// FCMD_UpdateBegin, FCMD_UpdateBlock & FCMD_UpdateCommit supported
+#define FFEATURE_EXT_FLASH_EMU 0x04		// FCMD_FlashEmuWrite & FCMD_FlashEmu supported
+
+
+/** FBatch_Response error codes.
+*/
+#define FBATCH_ERROR_CMD 1				// Sub command failed, its response is the last one
+#define FBATCH_ERROR_FORMAT 2			// Bad sub command size or command not allowed in a batch
+#define FBATCH_ERROR_OVERFLOW 3			// Responses don't fit the reply
+
+
+/** FProgramDevicePacket flags.
+*/
+#define FPROGRAM_FLAG_EARLY_ACK 0x01	// Ack blocks once received, processing errors are latched & reported on later acks
+
+
+/** Stage a programming error was latched in.
+*/
+enum FProgramStage
+{
+	FSTAGE_None = 0,
+	FSTAGE_Inflate = 1,			// Block failed to decompress
+	FSTAGE_BlockSize = 2,		// Decompressed size != blockSz
+	FSTAGE_BlockCrc = 3,		// Decompressed crc != blockCrc
+	FSTAGE_Flash = 4,			// Saving block to flash failed
+	FSTAGE_Complete = 5,		// FPGA busy after bitstream end
+	FSTAGE_BlockRef = 6,		// Referenced block not in flash
+};
+
+
 /** Header for data payload, contains cmd & counters.
 */
 struct FPACKSTRUCT FPayloadHeader
@@ -67,6 +145,10 @@ struct FPACKSTRUCT FQueryDevicePacket_Response
 	uint8_t deviceState;		// Device state eg. in user mode or ready.
 	uint32_t fpgaDeviceId;		// FPGA device ID eg. DEVID_LFE5U_12	0x21111043
 	uint8_t progDeviceId[8];	// Programmer uid
+	uint16_t maxBlockSz;		// Largest uncompressed block accepted by FCMD_ProgramBlock
+	uint16_t maxPacketSz;		// Largest request packet
+	uint8_t features;			// FFEATURE_ flags
+	uint8_t featuresExt;		// FFEATURE_EXT_ flags
 };
 
 
@@ -79,6 +161,7 @@ struct FPACKSTRUCT FProgramDevicePacket
 	uint32_t totalSize; 	// Total size
 	uint32_t blockCount; 	// Number of blocks going to send
 	uint16_t bitstreamCrc; 	// crc16 of bitstream data
+	uint8_t flags;			// FPROGRAM_FLAG_ options, optional older hosts don't send it
 };
 
 
@@ -94,27 +177,250 @@ struct FPACKSTRUCT FQueryProgramBlock
 };
 
 
-/** Flash bitstream info, uses lots of magic codes as flash state can be random data.
+/** FCMD_ProgramBlockRef Packet data, block is read from flash instead of sent.
 */
-struct FPACKSTRUCT FBitstreamFlashInfo
+struct FPACKSTRUCT FProgramBlockRef
 {
-	uint32_t magic0;	 		// Write magic code to determin if flash has ever been writen
-	uint32_t programOnStartup;	// programOnStartup
-	uint32_t blockCnt;			// Total blocks used
+	struct FPayloadHeader header;
+	uint16_t blockId;
+	uint16_t blockSz;
+	uint8_t blockCrc;
+	uint8_t blockKey[FABRIC_BLOCK_KEY_SIZE];
+};
+
+
+/** FCMD_Batch Packet data, cmdCnt sub commands follow. Each is a uint16_t size then the payload,
+* FPayloadHeader & command data, as it would be sent in its own frame.
+*/
+struct FPACKSTRUCT FBatchPacket
+{
+	struct FPayloadHeader header;
+	uint8_t cmdCnt;
+};
+
+
+/** FCMD_Batch response, cmdCnt responses follow in the same uint16_t size & payload layout. Runs stop
+* at the first failed sub command.
+*/
+struct FPACKSTRUCT FBatch_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;			// FBATCH_ERROR_ code
+	uint8_t cmdCnt;				// Sub commands run
+};
+
+
+/** FCMD_SetPatches Packet data, patchCnt FBitstreamPatch entries & their data follow. Applies once to
+* the next image programmed from flash, FCMD_ProgramDevice drops it as uploads are patched by the host.
+*/
+struct FPACKSTRUCT FSetPatchesPacket
+{
+	struct FPayloadHeader header;
+	uint8_t patchCnt;
+};
+
+
+/** FCMD_QueryBlockKeys Packet data, keyCnt keys follow.
+*/
+struct FPACKSTRUCT FQueryBlockKeys
+{
+	struct FPayloadHeader header;
+	uint16_t keyCnt;
+};
+
+
+/** FCMD_QueryBlockKeys response.
+*/
+struct FPACKSTRUCT FQueryBlockKeys_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;
+	uint16_t keyCnt;
+	uint8_t isStored[FABRIC_MAX_QUERY_KEYS / 8];	// Bit per key, set when block is in flash
+};
+
+
+/** FCMD_ConfigureImage Packet data.
+*/
+struct FPACKSTRUCT FConfigureImage
+{
+	struct FPayloadHeader header;
+	uint8_t bitStreamHash[SHA256_HASH_SIZE];	// sha256 of whole bitstream
+};
+
+
+/** FCMD_ConfigureImage response. On a miss the host uploads the image with saveToFlash set, which
+* stores it in place of the least recently used image.
+*/
+struct FPACKSTRUCT FConfigureImage_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;			// Non zero if a stored image failed to program
+	uint8_t isResident;			// Image is stored in flash
+};
+
+
+/** FCMD_ReadImage Packet data. Blocks firstBlockId onwards are sent back to back, one
+* FReadImage_Response frame each, so a window costs one round trip.
+*/
+struct FPACKSTRUCT FReadImage
+{
+	struct FPayloadHeader header;
+	uint8_t bitStreamHash[SHA256_HASH_SIZE];	// Image to read, zero for the startup image
+	uint16_t firstBlockId;
+	uint16_t blockCnt;			// Window size, cut short at the end of the image
+	uint8_t flags;				// FREAD_FLAG_ flags
+};
+
+#define FREAD_FLAG_COMPRESS 0x01		// Deflate blocks on the device, blocks that don't shrink are sent as stored
+
+#define FREAD_ERROR_NotFound 1			// No stored image with the hash
+#define FREAD_ERROR_Range 2				// firstBlockId past the last block
+#define FREAD_ERROR_Block 3				// Stored block missing or failed its crc
+
+
+/** FCMD_ReadImage response, dataSz bytes of block data follow. Data is a zlib stream when isCompressed
+* is set, else the stored block. An error ends the window.
+*/
+struct FPACKSTRUCT FReadImage_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;			// FREAD_ERROR_
+	uint16_t blockId;
+	uint16_t blockCnt;			// Blocks in image
 	uint32_t bitStreamSz;		// Total size
-	uint8_t crc; 				// write crc multiple times as flash will contain random data
-	uint8_t bitStreamCrc1; 		// crc0+1 when valid
-	uint8_t bitStreamCrc2; 		// crc0+2 when valid
+	uint16_t blockSz;			// Uncompressed block size
+	uint8_t blockCrc;			// Additive crc of uncompressed block
+	uint8_t isCompressed;
+	uint16_t dataSz;
 };
 
+_Static_assert( sizeof(struct FReadImage_Response) + FABRIC_MAX_BLOCK_SZ <= FABRIC_PACKET_SZ, "readback frame too large" );
+
 
-/** Flash bitstream info, uses lots of magic codes as flash state can be random data.
+/** FCMD_UpdateBegin Packet data, blocks from offset 0 follow in FCMD_UpdateBlock.
 */
-struct FPACKSTRUCT FBitstreamBlockInfo
+struct FPACKSTRUCT FUpdateBegin
 {
-	uint32_t blockId;
-	uint32_t blockSz;
-	uint8_t blockCrc;
+	struct FPayloadHeader header;
+	uint32_t imageSz;			// Flash image size, multiple of the flash page
+	uint8_t imageHash[SHA256_HASH_SIZE];	// sha256 of the image, checked by FCMD_UpdateCommit
+};
+
+
+/** FCMD_UpdateBegin response, describes the running image delta blocks are taken against.
+*/
+struct FPACKSTRUCT FUpdateBegin_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;			// FUPDATE_ERROR_
+	uint32_t runningSz;			// Running image size
+	uint8_t runningHash[SHA256_HASH_SIZE];	// sha256 of the running image
+	uint32_t maxImageSz;		// Staging region size
+	uint16_t blockSz;			// Uncompressed bytes per block, the last one may be short
+	uint16_t dictSz;			// Largest delta dictionary
+};
+
+
+/** FCMD_UpdateBlock Packet data, compressedSz bytes of raw deflate data follow. With dictSz set the
+* data is deflated against that many bytes of the running image from dictOffset as preset dictionary.
+*/
+struct FPACKSTRUCT FUpdateBlock
+{
+	struct FPayloadHeader header;
+	uint32_t offset;			// Image offset, blocks are sent in order
+	uint16_t blockSz;
+	uint16_t compressedSz;
+	uint32_t dictOffset;		// Running image offset of the dictionary
+	uint16_t dictSz;			// 0 for a block deflated on its own
+};
+
+#define FUPDATE_ERROR_Size 1			// Image too large, unaligned or running image unknown
+#define FUPDATE_ERROR_Order 2			// Block out of order, past the image or no update begun
+#define FUPDATE_ERROR_Inflate 3			// Block failed to decompress to blockSz
+#define FUPDATE_ERROR_Dict 4			// Dictionary outside the running image or too large
+#define FUPDATE_ERROR_Flash 5			// Staging region failed to program
+#define FUPDATE_ERROR_Hash 6			// Staged image incomplete or its sha256 differs
+#define FUPDATE_ERROR_Image 7			// Staged image won't boot, RP2040 boot2 crc is wrong
+
+
+/** FCMD_FlashEmuWrite Packet data, compressedBlockSz bytes of zlib data follow.
+*/
+struct FPACKSTRUCT FFlashEmuWrite
+{
+	struct FPayloadHeader header;
+	uint32_t offset;			// Region offset, multiple of the emulator block size
+	uint16_t blockSz;
+	uint16_t compressedBlockSz;
+	uint8_t blockCrc;			// Additive crc of uncompressed block
+};
+
+
+/** FCMD_FlashEmu modes.
+*/
+#define FFLASHEMU_MODE_Query 0			// Report state & hash imageSz bytes of the region
+#define FFLASHEMU_MODE_Start 1			// Serve reads once the region matches imageHash
+#define FFLASHEMU_MODE_Stop 2			// Stop serving, the design keeps the pins until next programmed
+
+
+/** FCMD_FlashEmu Packet data.
+*/
+struct FPACKSTRUCT FFlashEmu
+{
+	struct FPayloadHeader header;
+	uint8_t mode;				// FFLASHEMU_MODE_
+	uint32_t imageSz;			// Bytes of the region hashed, 0 starts unchecked
+	uint8_t imageHash[SHA256_HASH_SIZE];
+};
+
+
+/** FCMD_FlashEmu response. Design addresses are Pico flash offsets, the image starts at flashOffset.
+*/
+struct FPACKSTRUCT FFlashEmu_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;			// FFLASHEMU_ERROR_
+	uint8_t state;				// FPGAFlashEmuState
+	uint32_t flashOffset;		// Region offset in Pico flash
+	uint32_t regionSz;
+	uint16_t blockSz;			// FCMD_FlashEmuWrite block size
+	uint32_t readCnt;			// Reads answered since started
+	uint8_t imageHash[SHA256_HASH_SIZE];	// sha256 of imageSz bytes of the region
+};
+
+
+/** FCMD_FlashEmuWrite & FCMD_FlashEmu error codes.
+*/
+#define FFLASHEMU_ERROR_Size 1			// Block or image outside the region, or unaligned
+#define FFLASHEMU_ERROR_Inflate 2		// Block failed to decompress to blockSz or crc differs
+#define FFLASHEMU_ERROR_Flash 3			// Region failed to program
+#define FFLASHEMU_ERROR_Hash 4			// Region doesn't hold the image to serve
+#define FFLASHEMU_ERROR_Resources 5		// No pio1 state machine or DMA channel free
+
+
+/** FCMD_QueryImages response, stored images most recently used first. configuredHash is zero when
+* the FPGA holds an unsaved upload or nothing known.
+*/
+struct FPACKSTRUCT FQueryImages_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;
+	uint8_t isConfigured;		// configuredHash is valid
+	uint8_t configuredHash[SHA256_HASH_SIZE];	// Image last programmed into the FPGA
+	uint8_t imageCnt;			// Entries in imageHashes
+	uint8_t imageHashes[FABRIC_MAX_IMAGES][SHA256_HASH_SIZE];
+};
+
+
+/** FCMD_ProgramBlock & FCMD_ProgramComplete response. In early-ack mode errorCode is the first
+* error latched by any earlier block, failedBlockId & failedStage say where it happened.
+*/
+struct FPACKSTRUCT FProgramBlock_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;
+	uint16_t failedBlockId;		// First block that failed
+	uint8_t failedStage;		// FProgramStage of failure
 };
 
 
@@ -128,4 +434,67 @@ struct FPACKSTRUCT FQueryBitstreamFlash_Response
 	uint32_t blockCnt;			// Total blocks used
 	uint32_t bitStreamSz;		// Total size
 	uint8_t crc; 				// write crc multiple times as flash will contain random data	
+	uint8_t bitStreamHash[SHA256_HASH_SIZE];	// sha256 of whole bitstream, zero if not stored
 };
+
+
+/** FCMD_SelfTestPerf response, each stage reports bytes processed & time taken.
+*/
+struct FPACKSTRUCT FSelfTestPerf_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;
+	uint32_t sysClockHz;		// Core clock during test
+	uint32_t inflateBytes;		// Decompressed size of reference block
+	uint32_t inflateUs;			// Time to decompress reference block
+	uint32_t spiClockHz;		// Current FPGA spi clock
+	uint32_t spiBytes;			// Bytes written in spi burst
+	uint32_t spiUs;				// Time to write spi burst
+	uint32_t flashBytes;		// Scratch sector size
+	uint32_t flashEraseUs;		// Time to erase scratch sector
+	uint32_t flashProgramUs;	// Time to program scratch sector
+	uint32_t xipBytes;			// Bytes read over uncached XIP
+	uint32_t xipUs;				// Time to read over uncached XIP
+};
+
+
+/** FCMD_QueryFlashStatus response. Erases run a sector & programs a page per chunk, isIrqSafe is set
+* when chunks run with interrupts enabled so usb is serviced during them, else maxIrqOffUs bounds the
+* longest usb stall.
+*/
+struct FPACKSTRUCT FQueryFlashStatus_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;
+	uint8_t isIrqSafe;
+	uint32_t opCnt;				// Erase & program calls since boot
+	uint32_t chunkCnt;
+	uint32_t eraseBytes;
+	uint32_t programBytes;
+	uint32_t maxChunkUs;		// Longest single chunk
+	uint32_t maxIrqOffUs;		// Longest time interrupts were disabled
+	uint32_t opBytes;			// Size of running or last operation
+	uint32_t opDoneBytes;		// Bytes of it completed
+};
+
+
+/** FPGA status register bits, LSC_READ_STATUS.
+*/
+#define FPGA_STATUS_DONE (1 << 8)
+#define FPGA_STATUS_FAIL (1 << 13)
+
+
+/** FCMD_SelfTestConfigure response. errorCode is zero when the design configured with DONE set & no
+* fail flag, the flash image store is left untouched.
+*/
+struct FPACKSTRUCT FSelfTestConfigure_Response
+{
+	struct FPayloadHeader header;
+	uint32_t errorCode;
+	uint8_t failedStage;		// FProgramStage of failure
+	uint32_t fpgaDeviceId;
+	uint32_t fpgaStatus;		// Status register after configure
+	uint32_t bitStreamSz;		// Uncompressed size of the self test design
+	uint32_t configureUs;		// Inflate & spi write time
+	uint32_t totalUs;			// Including completion wait
+};
\ No newline at end of file
@@ -0,0 +1,101 @@
+/**
+Emulated SPI flash region, see flash_emu.h. Reads are answered by libfabric's PIO & DMA path straight
+out of XIP, this side only owns the region, its writes & pausing the emulator around flash writes.
+*/
+#include "flash_emu.h"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "flash_ops.h"
+
+
+// Globals
+static struct FPGA_config_t* emuConfig = 0;
+
+
+void flash_emu_init( struct FPGA_config_t* config )
+{
+	emuConfig = config;
+}
+
+
+int flash_emu_write( uint32_t offset, uint8_t* data, uint32_t size )
+{
+	if(offset % FLASH_EMU_BLOCK_SZ || size == 0 || size > FLASH_EMU_BLOCK_SZ || offset + size > FLASH_EMU_SZ)
+		return FFLASHEMU_ERROR_Size;
+
+	// New image, reads stay off until the host starts serving it
+	flash_emu_stop();
+
+	uint32_t programSz = (size + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+	memset( data + size, 0xff, programSz - size );
+	if(offset % FLASH_SECTOR_SIZE == 0)
+		flash_ops_erase( FLASH_EMU_OFFSET + offset, FLASH_SECTOR_SIZE );
+	flash_ops_program( FLASH_EMU_OFFSET + offset, data, programSz );
+
+	if(memcmp( (const uint8_t*)(XIP_BASE + FLASH_EMU_OFFSET + offset), data, size ) != 0)
+		return FFLASHEMU_ERROR_Flash;
+	return 0;
+}
+
+
+void flash_emu_hash( uint32_t size, uint8_t* hash )
+{
+	struct sha256_ctx hashCtx;
+	sha256_init( &hashCtx );
+	sha256_update( &hashCtx, (const uint8_t*)(XIP_BASE + FLASH_EMU_OFFSET), size );
+	sha256_final( &hashCtx, hash );
+}
+
+
+int flash_emu_start( uint32_t imageSz, const uint8_t* imageHash )
+{
+	if(imageSz > FLASH_EMU_SZ)
+		return FFLASHEMU_ERROR_Size;
+
+	if(imageSz)
+	{
+		uint8_t hash[SHA256_HASH_SIZE];
+		flash_emu_hash( imageSz, hash );
+		if(memcmp( hash, imageHash, SHA256_HASH_SIZE ) != 0)
+			return FFLASHEMU_ERROR_Hash;
+	}
+
+	if(!emuConfig || !fpga_flash_emu_start( emuConfig ))
+		return FFLASHEMU_ERROR_Resources;
+	return 0;
+}
+
+
+void flash_emu_stop( void )
+{
+	if(emuConfig)
+		fpga_flash_emu_stop( emuConfig );
+}
+
+
+int flash_emu_state( void )
+{
+	return emuConfig ? emuConfig->emu_state : FPGA_EMU_Off;
+}
+
+
+uint32_t flash_emu_read_count( void )
+{
+	return emuConfig ? fpga_flash_emu_read_count( emuConfig ) : 0;
+}
+
+
+int flash_emu_suspend( void )
+{
+	if(flash_emu_state() != FPGA_EMU_Serving)
+		return 0;
+	fpga_flash_emu_stop( emuConfig );
+	return 1;
+}
+
+
+void flash_emu_resume( int isServing )
+{
+	if(isServing)
+		fpga_flash_emu_start( emuConfig );
+}
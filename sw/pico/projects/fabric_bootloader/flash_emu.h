@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include "hardware/flash.h"
+#include "fabric_bootloader.h"
+#include "self_update.h"
+
+/** Emulated SPI flash for soft cores in the configured design. The host writes an image into a region
+* of Pico flash & the design reads it back over the config port, see fpga_flash_emu_start. Design
+* addresses are Pico flash offsets so soft cores boot from FLASH_EMU_OFFSET, the same as an image placed
+* after the bitstream in a config flash. The region sits below the update staging region, aligned to
+* its size so the offset stays a round number.
+*/
+#if PICO_RP2350
+#define FLASH_EMU_SZ (512 * 1024)
+#define FLASH_EMU_BLOCK_SZ 4096
+#else
+#define FLASH_EMU_SZ (256 * 1024)
+#define FLASH_EMU_BLOCK_SZ 2048
+#endif
+#define FLASH_EMU_OFFSET ((UPDATE_STAGING_OFFSET - FLASH_EMU_SZ) & ~(FLASH_EMU_SZ - 1))
+
+
+_Static_assert( FLASH_EMU_OFFSET >= UPDATE_MAX_IMAGE_SZ, "emulated flash overlaps the bootloader image" );
+_Static_assert( FLASH_EMU_OFFSET + FLASH_EMU_SZ <= UPDATE_STAGING_OFFSET, "emulated flash overlaps update staging" );
+_Static_assert( FLASH_SECTOR_SIZE % FLASH_EMU_BLOCK_SZ == 0 && FLASH_EMU_BLOCK_SZ % FLASH_PAGE_SIZE == 0, "emulated flash blocks must tile flash sectors" );
+_Static_assert( FLASH_EMU_BLOCK_SZ <= FABRIC_MAX_BLOCK_SZ, "emulated flash block doesn't fit the block buffer" );
+
+
+/** Remember the FPGA config the emulator serves on.
+@param FPGA_config_t config   Bootloader FPGA config.
+*/
+void flash_emu_init( struct FPGA_config_t* config );
+
+
+/** Write a block of the emulated flash image, the first block of each sector erases it. Stops serving.
+@param uint32_t offset   Offset in the region, multiple of FLASH_EMU_BLOCK_SZ.
+@param uint8_t* data   Block data in SRAM with room to pad it to a page.
+@param uint32_t size   Bytes, up to FLASH_EMU_BLOCK_SZ.
+@return FFLASHEMU_ERROR_ code, 0 on success.
+*/
+int flash_emu_write( uint32_t offset, uint8_t* data, uint32_t size );
+
+
+/** sha256 of the start of the region.
+@param uint32_t size   Bytes hashed, up to FLASH_EMU_SZ.
+@param uint8_t* hash   Output, SHA256_HASH_SIZE bytes.
+*/
+void flash_emu_hash( uint32_t size, uint8_t* hash );
+
+
+/** Start answering the design's reads.
+@param uint32_t imageSz   Bytes checked against imageHash first, 0 to serve the region unchecked.
+@param uint8_t* imageHash   sha256 the region has to start with.
+@return FFLASHEMU_ERROR_ code, 0 when serving.
+*/
+int flash_emu_start( uint32_t imageSz, const uint8_t* imageHash );
+
+
+/** Stop answering reads, the design keeps the pins until the Pico next programs it.
+*/
+void flash_emu_stop( void );
+
+
+/** Serving state.
+@return FPGAFlashEmuState, anything but FPGA_EMU_Off means the design owns the spi pins.
+*/
+int flash_emu_state( void );
+
+
+/** Reads answered since the last start.
+*/
+uint32_t flash_emu_read_count( void );
+
+
+/** Pause serving while flash is written, XIP is down meanwhile.
+@return 1 when it was serving, pass to flash_emu_resume.
+*/
+int flash_emu_suspend( void );
+
+
+/** Serve again after flash_emu_suspend.
+@param int isServing   flash_emu_suspend result.
+*/
+void flash_emu_resume( int isServing );
@@ -0,0 +1,107 @@
+/**
+Chunked flash erase & program. The SDK calls run with XIP disabled, so anything fetched from flash
+while a chunk runs would fault. Each chunk either masks interrupts or, in copy_to_ram builds where
+no handler touches XIP, leaves them enabled & only parks the other core. The flash emulator's DMA
+reads XIP too, so it is paused for the whole operation.
+*/
+#include "flash_ops.h"
+#include "flash_emu.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#if LIB_PICO_MULTICORE
+#include "pico/multicore.h"
+#endif
+
+
+// Globals
+static struct FFlashOpStats flashStats;
+
+
+/** Park the other core in SRAM while XIP is down, only once it has registered as a lockout victim.
+*/
+static int lockout_begin( void )
+{
+#if LIB_PICO_MULTICORE
+	if(multicore_lockout_victim_is_initialized( get_core_num() ^ 1 ))
+	{
+		multicore_lockout_start_blocking();
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+
+static void lockout_end( int isLocked )
+{
+#if LIB_PICO_MULTICORE
+	if(isLocked)
+		multicore_lockout_end_blocking();
+#endif
+}
+
+
+/** Run one chunk, erase when data is 0.
+*/
+static void run_chunk( uint32_t offset, const uint8_t* data, uint32_t size )
+{
+	int isLocked = lockout_begin();
+#if !FLASH_OPS_IRQ_SAFE
+	uint32_t ints = save_and_disable_interrupts();
+#endif
+	uint64_t t0 = time_us_64();
+
+	if(data)
+		flash_range_program( offset, data, size );
+	else
+		flash_range_erase( offset, size );
+
+	uint32_t chunkUs = time_us_64() - t0;
+#if !FLASH_OPS_IRQ_SAFE
+	restore_interrupts( ints );
+	if(chunkUs > flashStats.maxIrqOffUs)
+		flashStats.maxIrqOffUs = chunkUs;
+#endif
+	lockout_end( isLocked );
+
+	if(chunkUs > flashStats.maxChunkUs)
+		flashStats.maxChunkUs = chunkUs;
+	flashStats.chunkCnt++;
+	flashStats.opDoneBytes += size;
+}
+
+
+void flash_ops_erase( uint32_t offset, uint32_t size )
+{
+	int isServing = flash_emu_suspend();
+	flashStats.opCnt++;
+	flashStats.opBytes = size;
+	flashStats.opDoneBytes = 0;
+
+	for(uint32_t i=0;i<size;i+=FLASH_OPS_ERASE_CHUNK)
+		run_chunk( offset + i, 0, FLASH_OPS_ERASE_CHUNK );
+
+	flashStats.eraseBytes += size;
+	flash_emu_resume( isServing );
+}
+
+
+void flash_ops_program( uint32_t offset, const uint8_t* data, uint32_t size )
+{
+	int isServing = flash_emu_suspend();
+	flashStats.opCnt++;
+	flashStats.opBytes = size;
+	flashStats.opDoneBytes = 0;
+
+	for(uint32_t i=0;i<size;i+=FLASH_OPS_PROGRAM_CHUNK)
+		run_chunk( offset + i, data + i, FLASH_OPS_PROGRAM_CHUNK );
+
+	flashStats.programBytes += size;
+	flash_emu_resume( isServing );
+}
+
+
+const struct FFlashOpStats* flash_ops_stats( void )
+{
+	return &flashStats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include "hardware/flash.h"
+
+/** Flash erase & program that keep USB serviced. Operations are split into sector erases & page
+* programs, interrupts are restored between chunks so the USB IRQ runs at least once per chunk.
+* With the copy_to_ram binary the USB IRQ path & its buffers are already in SRAM, chunks then run
+* with interrupts enabled & only the other core is locked out of XIP.
+*/
+#if PICO_COPY_TO_RAM
+#define FLASH_OPS_IRQ_SAFE 1
+#else
+#define FLASH_OPS_IRQ_SAFE 0
+#endif
+#define FLASH_OPS_ERASE_CHUNK FLASH_SECTOR_SIZE
+#define FLASH_OPS_PROGRAM_CHUNK FLASH_PAGE_SIZE
+
+
+/** Counters since boot & progress of the running or last operation.
+*/
+struct FFlashOpStats
+{
+	uint32_t opCnt;				// Erase & program calls
+	uint32_t chunkCnt;
+	uint32_t eraseBytes;
+	uint32_t programBytes;
+	uint32_t maxChunkUs;		// Longest single chunk
+	uint32_t maxIrqOffUs;		// Longest time interrupts were disabled, 0 when irq safe
+	uint32_t opBytes;			// Size of running or last operation
+	uint32_t opDoneBytes;		// Bytes of it completed
+};
+
+
+/** Erase flash range, chunk at a time.
+@param uint32_t offset   Flash offset, sector aligned.
+@param uint32_t size   Bytes, multiple of FLASH_SECTOR_SIZE.
+*/
+void flash_ops_erase( uint32_t offset, uint32_t size );
+
+
+/** Program erased flash range, chunk at a time.
+@param uint32_t offset   Flash offset, page aligned.
+@param uint8_t* data   Data in SRAM, never XIP flash.
+@param uint32_t size   Bytes, multiple of FLASH_PAGE_SIZE.
+*/
+void flash_ops_program( uint32_t offset, const uint8_t* data, uint32_t size );
+
+
+/** Operation counters & progress.
+*/
+const struct FFlashOpStats* flash_ops_stats( void );
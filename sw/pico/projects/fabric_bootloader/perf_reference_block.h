@@ -0,0 +1,253 @@
+#include <pico/platform.h>
+uint8_t __in_flash() perf_reference_block[] = {
+15, 224, 120, 218, 141, 87, 
+123, 80, 147, 87, 22, 63, 97, 129, 
+18, 140, 16, 65, 4, 20, 49, 225, 
+21, 80, 180, 193, 64, 55, 176, 74, 
+19, 16, 68, 45, 196, 118, 161, 128, 
+130, 11, 10, 13, 186, 91, 247, 67, 
+81, 73, 6, 218, 203, 39, 80, 129, 
+160, 188, 68, 208, 12, 155, 66, 87, 
+195, 99, 109, 237, 106, 235, 176, 
+125, 68, 161, 14, 107, 17, 106, 137, 
+187, 162, 29, 13, 144, 178, 248, 
+152, 41, 248, 150, 117, 103, 55, 
+238, 206, 122, 207, 55, 99, 102, 
+247, 251, 239, 252, 190, 123, 126, 
+247, 222, 115, 239, 249, 157, 115, 
+111, 253, 19, 254, 251, 73, 116, 64, 
+142, 62, 55, 91, 158, 91, 73, 144, 
+153, 210, 177, 127, 93, 176, 229, 
+150, 152, 14, 9, 12, 2, 198, 68, 
+205, 72, 159, 47, 96, 114, 9, 181, 
+61, 26, 65, 185, 152, 154, 14, 57, 
+234, 59, 212, 114, 81, 92, 15, 165, 
+22, 12, 78, 253, 95, 191, 56, 134, 
+39, 64, 247, 11, 203, 129, 63, 149, 
+194, 50, 199, 243, 49, 32, 76, 129, 
+154, 239, 17, 48, 99, 148, 0, 57, 
+69, 1, 7, 254, 200, 112, 168, 215, 
+174, 23, 0, 111, 181, 80, 85, 4, 
+247, 22, 208, 41, 170, 249, 99, 189, 
+26, 242, 139, 116, 204, 202, 22, 
+231, 194, 179, 175, 48, 203, 119, 
+67, 208, 248, 37, 102, 73, 19, 192, 
+196, 85, 202, 82, 163, 180, 122, 
+167, 64, 199, 125, 188, 148, 158, 
+74, 6, 214, 215, 99, 150, 63, 155, 
+38, 34, 49, 73, 10, 129, 245, 115, 
+41, 137, 50, 198, 149, 164, 119, 
+113, 22, 178, 231, 7, 82, 184, 145, 
+187, 52, 67, 91, 206, 163, 183, 241, 
+60, 151, 156, 247, 140, 220, 133, 
+209, 189, 156, 185, 203, 89, 70, 
+125, 152, 227, 168, 21, 233, 53, 87, 
+57, 72, 201, 14, 254, 36, 196, 141, 
+252, 143, 81, 26, 27, 98, 69, 139, 
+140, 141, 62, 48, 4, 198, 47, 232, 
+62, 86, 49, 170, 53, 240, 125, 9, 
+117, 114, 172, 83, 29, 92, 39, 239, 
+124, 194, 165, 17, 195, 179, 143, 
+17, 205, 106, 91, 188, 182, 110, 
+226, 176, 4, 129, 135, 134, 195, 
+226, 39, 35, 171, 157, 56, 44, 69, 
+97, 68, 149, 132, 88, 108, 94, 210, 
+199, 94, 148, 229, 252, 90, 195, 
+116, 150, 25, 62, 159, 70, 94, 121, 
+108, 241, 248, 12, 72, 191, 230, 16, 
+237, 94, 3, 1, 1, 20, 113, 119, 96, 
+67, 37, 240, 214, 16, 30, 115, 85, 
+187, 215, 83, 158, 255, 10, 157, 
+205, 81, 116, 175, 128, 78, 37, 132, 
+106, 26, 4, 72, 174, 95, 39, 16, 
+181, 204, 167, 192, 188, 1, 56, 38, 
+65, 230, 71, 176, 155, 206, 7, 137, 
+13, 162, 62, 58, 25, 47, 95, 150, 
+177, 5, 58, 233, 9, 66, 91, 156, 
+112, 57, 75, 255, 183, 50, 217, 137, 
+105, 171, 50, 83, 45, 103, 223, 163, 
+96, 215, 47, 35, 71, 206, 40, 248, 
+235, 95, 158, 59, 188, 252, 168, 
+177, 132, 70, 82, 224, 76, 127, 251, 
+17, 88, 246, 13, 53, 87, 26, 199, 
+97, 228, 26, 250, 157, 174, 20, 38, 
+127, 66, 237, 212, 56, 104, 223, 78, 
+77, 54, 33, 198, 75, 70, 220, 133, 
+47, 159, 238, 223, 71, 108, 209, 
+107, 238, 96, 68, 60, 165, 134, 155, 
+151, 208, 145, 50, 42, 119, 5, 156, 
+45, 193, 55, 53, 217, 185, 136, 12, 
+211, 179, 225, 197, 70, 213, 13, 
+251, 123, 202, 79, 104, 41, 20, 36, 
+76, 49, 107, 32, 228, 83, 14, 81, 
+5, 49, 75, 209, 249, 253, 124, 
+190, 185, 52, 227, 90, 65, 33, 141, 
+6, 239, 93, 161, 170, 162, 80, 70, 
+216, 15, 40, 84, 178, 233, 80, 119, 
+229, 222, 216, 208, 217, 68, 234, 
+42, 232, 118, 189, 173, 237, 156, 
+188, 120, 2, 220, 254, 142, 22, 102, 
+253, 140, 129, 125, 97, 212, 245, 
+246, 182, 94, 247, 238, 74, 229, 
+109, 168, 76, 160, 17, 200, 149, 
+141, 69, 191, 113, 159, 204, 63, 73, 
+29, 93, 2, 217, 98, 139, 222, 112, 
+26, 33, 19, 231, 213, 7, 249, 166, 
+45, 220, 180, 42, 182, 88, 97, 167, 
+39, 218, 129, 247, 226, 239, 74, 
+51, 44, 51, 138, 71, 95, 225, 113, 
+231, 213, 29, 98, 189, 117, 39, 90, 
+110, 13, 59, 165, 253, 120, 171, 91, 
+53, 179, 171, 28, 121, 167, 219, 
+188, 179, 126, 93, 255, 80, 81, 246, 
+55, 228, 238, 163, 155, 237, 247, 
+35, 105, 63, 224, 75, 99, 156, 61, 
+107, 245, 15, 149, 209, 104, 242, 
+94, 143, 112, 124, 58, 8, 105, 31, 
+114, 215, 119, 199, 216, 183, 6, 
+137, 151, 107, 111, 231, 140, 200, 
+123, 4, 229, 222, 128, 90, 202, 16, 
+175, 108, 142, 182, 38, 198, 193, 
+162, 115, 28, 158, 209, 96, 227, 79, 
+55, 95, 32, 98, 29, 97, 75, 76, 80, 
+127, 20, 75, 231, 143, 145, 182, 
+220, 243, 165, 97, 117, 244, 80, 
+213, 230, 69, 189, 121, 128, 240, 
+169, 56, 58, 250, 232, 30, 40, 207, 
+121, 146, 147, 123, 94, 64, 1, 117, 
+132, 213, 108, 131, 226, 167, 116, 
+62, 183, 120, 223, 224, 253, 117, 
+192, 118, 114, 183, 34, 109, 53, 
+253, 230, 10, 186, 5, 105, 163, 237, 
+219, 189, 73, 5, 149, 90, 240, 245, 
+206, 133, 55, 232, 230, 120, 121, 
+105, 163, 85, 170, 227, 36, 200, 
+140, 115, 48, 51, 49, 205, 188, 210, 
+144, 99, 160, 110, 41, 23, 131, 97, 
+239, 14, 196, 188, 165, 162, 33, 92, 
+225, 55, 78, 17, 81, 175, 84, 68, 
+213, 26, 72, 115, 206, 149, 215, 80, 
+253, 36, 78, 221, 118, 170, 29, 40, 
+154, 32, 125, 207, 75, 138, 245, 75, 
+77, 69, 29, 12, 35, 249, 112, 33, 
+163, 70, 59, 213, 214, 22, 144, 96, 
+150, 17, 107, 237, 87, 81, 94, 170, 
+110, 169, 180, 117, 16, 13, 152, 8, 
+252, 8, 166, 104, 87, 224, 224, 228, 
+163, 10, 139, 99, 178, 213, 40, 69, 
+167, 85, 126, 158, 228, 39, 111, 
+164, 231, 13, 161, 16, 249, 35, 34, 
+153, 110, 175, 33, 239, 203, 80, 90, 
+68, 12, 72, 62, 148, 175, 168, 65, 
+55, 106, 122, 155, 92, 111, 57, 
+113, 15, 145, 212, 169, 22, 43, 42, 
+204, 156, 165, 156, 5, 17, 18, 110, 
+23, 35, 171, 245, 130, 246, 58, 
+234, 227, 202, 127, 124, 64, 2, 23, 
+36, 28, 150, 132, 17, 18, 243, 152, 
+115, 83, 109, 200, 123, 143, 113, 
+190, 247, 171, 219, 93, 201, 215, 
+203, 177, 54, 13, 72, 46, 237, 212, 
+107, 157, 49, 212, 255, 228, 247, 
+35, 164, 52, 135, 46, 122, 109, 
+108, 160, 163, 101, 92, 143, 195, 
+169, 106, 81, 202, 175, 232, 208, 
+89, 53, 240, 77, 225, 139, 144, 
+253, 77, 132, 175, 201, 226, 135, 
+93, 130, 88, 141, 34, 51, 145, 67, 
+210, 149, 4, 150, 7, 200, 169, 174, 
+229, 219, 139, 118, 57, 159, 83, 
+244, 50, 167, 118, 114, 24, 66, 97, 
+243, 102, 123, 61, 151, 164, 217, 
+86, 251, 151, 32, 181, 118, 243, 
+168, 42, 90, 209, 87, 213, 150, 83, 
+122, 151, 67, 210, 158, 215, 42, 
+114, 152, 181, 35, 250, 110, 115, 
+22, 230, 233, 66, 152, 137, 35, 28, 
+158, 211, 45, 167, 125, 77, 170, 
+101, 212, 199, 89, 0, 14, 168, 142, 
+46, 244, 15, 251, 4, 250, 170, 233, 
+113, 8, 194, 118, 187, 236, 18, 253, 
+3, 245, 83, 209, 130, 149, 138, 
+144, 10, 58, 194, 33, 37, 62, 233, 
+178, 8, 86, 161, 14, 66, 113, 66, 0, 
+55, 231, 98, 101, 139, 154, 62, 
+163, 88, 242, 136, 34, 126, 130, 62, 
+67, 57, 184, 211, 27, 198, 59, 28, 
+111, 222, 30, 222, 184, 84, 159, 
+167, 198, 106, 112, 248, 6, 108, 66, 
+114, 200, 155, 239, 1, 149, 71, 240, 
+128, 219, 79, 34, 103, 167, 86, 108, 
+69, 121, 187, 30, 142, 204, 67, 
+183, 223, 185, 177, 18, 238, 54, 
+161, 210, 26, 122, 143, 196, 140, 
+226, 180, 23, 166, 210, 46, 5, 202, 
+142, 23, 101, 53, 47, 145, 63, 253, 
+45, 133, 196, 159, 69, 195, 131, 
+13, 56, 242, 235, 206, 229, 201, 
+136, 41, 2, 67, 137, 44, 19, 114, 1, 
+151, 74, 103, 47, 17, 228, 174, 166, 
+34, 185, 224, 84, 146, 135, 82, 
+254, 138, 18, 39, 76, 217, 96, 34, 
+180, 208, 166, 153, 183, 208, 201, 
+127, 174, 226, 78, 23, 74, 6, 155, 
+151, 73, 87, 75, 125, 230, 204, 36, 
+39, 84, 21, 198, 134, 202, 240, 
+205, 159, 96, 151, 206, 35, 25, 199, 
+144, 68, 110, 170, 214, 125, 112, 5, 
+246, 81, 141, 226, 93, 222, 173, 73, 
+169, 143, 15, 208, 95, 203, 66, 165, 
+186, 217, 200, 50, 167, 46, 163, 82, 
+181, 111, 174, 57, 103, 114, 1, 240, 
+165, 40, 243, 23, 219, 36, 104, 107, 
+52, 78, 208, 130, 6, 165, 252, 126, 
+50, 222, 125, 89, 237, 152, 140, 
+28, 51, 226, 65, 249, 89, 23, 226, 
+87, 89, 100, 217, 156, 66, 248, 
+135, 138, 220, 88, 195, 254, 22, 
+110, 91, 187, 92, 255, 215, 235, 
+232, 146, 126, 219, 120, 81, 61, 25, 
+227, 223, 243, 232, 22, 199, 213, 
+172, 238, 136, 120, 168, 200, 196, 
+25, 96, 221, 127, 218, 150, 106, 
+169, 1, 248, 162, 25, 134, 107, 109, 
+141, 192, 16, 237, 237, 97, 82, 218, 
+28, 213, 52, 44, 47, 196, 41, 60, 
+161, 42, 39, 225, 111, 98, 42, 38, 
+233, 46, 252, 233, 125, 234, 181, 
+217, 246, 4, 128, 119, 42, 41, 208, 
+49, 239, 80, 131, 173, 103, 250, 
+11, 238, 220, 39, 186, 122, 118, 
+148, 116, 49, 63, 163, 173, 152, 88, 
+168, 10, 18, 14, 192, 13, 212, 149, 
+87, 187, 185, 245, 28, 103, 62, 
+167, 205, 178, 163, 147, 176, 32, 
+195, 234, 73, 178, 223, 162, 144, 
+80, 181, 80, 75, 6, 82, 105, 1, 21, 
+170, 170, 130, 203, 193, 227, 29, 
+28, 170, 70, 215, 182, 27, 138, 
+163, 121, 24, 10, 24, 84, 195, 24, 
+125, 230, 241, 78, 142, 188, 214, 
+223, 54, 93, 209, 71, 167, 15, 233, 
+221, 120, 230, 93, 58, 160, 52, 70, 
+224, 17, 14, 27, 190, 228, 20, 207, 
+181, 226, 212, 214, 38, 203, 179, 
+120, 36, 157, 111, 251, 182, 192, 
+156, 67, 184, 124, 30, 12, 174, 126, 
+85, 17, 130, 58, 124, 225, 6, 159, 
+250, 237, 40, 211, 4, 181, 162, 178, 
+79, 81, 91, 13, 58, 84, 232, 22, 1, 
+44, 235, 176, 243, 148, 20, 246, 
+131, 76, 106, 239, 57, 202, 41, 151, 
+118, 159, 163, 182, 80, 4, 218, 74, 
+167, 131, 253, 210, 9, 181, 175, 
+175, 132, 72, 92, 58, 173, 170, 120, 
+3, 252, 142, 35, 169, 69, 154, 75, 
+162, 30, 180, 69, 73, 59, 223, 244, 
+234, 117, 196, 49, 190, 177, 233, 
+161, 23, 135, 163, 71, 2, 192, 233, 
+105, 108, 47, 174, 63, 110, 65, 20, 
+67, 34, 253, 175, 254, 83, 148, 
+254, 5, 151, 89, 176, 121
+};
+int perf_reference_block_size = sizeof(perf_reference_block);
@@ -0,0 +1,179 @@
+/**
+Bootloader self update, see self_update.h. Blocks are inflated behind their dictionary in one buffer so
+deflate back references reach into it, the same non wrapping output buffer trick inflate_block uses.
+*/
+#include "self_update.h"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "flash_ops.h"
+#include "flash_emu.h"
+
+#define BOOT2_SZ 256
+
+
+extern char __flash_binary_end;
+
+
+/** Update being staged.
+*/
+struct FUpdateState
+{
+	int isActive;
+	int isCommitted;
+	uint32_t imageSz;
+	uint32_t nextOffset;		// Blocks arrive in order
+	uint8_t imageHash[SHA256_HASH_SIZE];
+};
+
+
+// Globals
+static struct FUpdateState update;
+static uint8_t updateBuffer[UPDATE_DICT_SZ + UPDATE_BLOCK_SZ];	// Dictionary then block, also the sector copy buffer
+_Static_assert( sizeof(updateBuffer) >= FLASH_SECTOR_SIZE, "swap copies whole sectors through the update buffer" );
+
+
+uint32_t update_running_size( void )
+{
+	return (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+}
+
+
+void update_running_hash( uint8_t* hash )
+{
+	struct sha256_ctx hashCtx;
+	sha256_init( &hashCtx );
+	sha256_update( &hashCtx, (const uint8_t*)XIP_BASE, update_running_size() );
+	sha256_final( &hashCtx, hash );
+}
+
+
+int update_begin( uint32_t imageSz, const uint8_t* imageHash )
+{
+	memset( &update, 0, sizeof(update) );
+	if(imageSz == 0 || imageSz > UPDATE_MAX_IMAGE_SZ || imageSz % FLASH_PAGE_SIZE || update_running_size() > UPDATE_MAX_IMAGE_SZ)
+		return FUPDATE_ERROR_Size;
+
+	update.isActive = 1;
+	update.imageSz = imageSz;
+	memcpy( update.imageHash, imageHash, SHA256_HASH_SIZE );
+	return 0;
+}
+
+
+int update_write_block( tinfl_decompressor* inflater, const struct FUpdateBlock* request, uint32_t dataSz )
+{
+	if(!update.isActive || request->offset != update.nextOffset || request->blockSz == 0 || request->blockSz > UPDATE_BLOCK_SZ ||
+		request->offset + request->blockSz > update.imageSz || request->compressedSz > dataSz)
+		return FUPDATE_ERROR_Order;
+	if(request->dictSz > UPDATE_DICT_SZ || request->dictOffset + request->dictSz > update_running_size())
+		return FUPDATE_ERROR_Dict;
+
+	// Dictionary sits right before the output so back references land in it
+	uint8_t* out = updateBuffer + request->dictSz;
+	memcpy( updateBuffer, (const uint8_t*)(XIP_BASE + request->dictOffset), request->dictSz );
+
+	size_t inSz = request->compressedSz;
+	size_t outSz = UPDATE_BLOCK_SZ;
+	tinfl_init( inflater );
+	tinfl_status status = tinfl_decompress( inflater, (const uint8_t*)(request + 1), &inSz, updateBuffer, out, &outSz,
+		TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF );
+	if(status != TINFL_STATUS_DONE || outSz != request->blockSz)
+		return FUPDATE_ERROR_Inflate;
+
+	// Blocks tile sectors, the first block of each erases it. Short last block is padded to the page
+	uint32_t offset = UPDATE_STAGING_OFFSET + request->offset;
+	uint32_t programSz = (outSz + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+	memset( out + outSz, 0xff, programSz - outSz );
+	if(request->offset % FLASH_SECTOR_SIZE == 0)
+		flash_ops_erase( offset, FLASH_SECTOR_SIZE );
+	flash_ops_program( offset, out, programSz );
+	if(memcmp( (const uint8_t*)(XIP_BASE + offset), out, outSz ) != 0)
+	{
+		update.isActive = 0;
+		return FUPDATE_ERROR_Flash;
+	}
+
+	update.nextOffset += request->blockSz;
+	return 0;
+}
+
+
+/** Boot rom check of the RP2040 second stage boot loader, crc32 without reflection or final xor.
+*/
+static int is_boot2_valid( const uint8_t* image )
+{
+#if PICO_RP2350
+	return 1;
+#else
+	uint32_t crc = 0xffffffff;
+	for(int i=0;i<BOOT2_SZ-4;i++)
+	{
+		crc ^= (uint32_t)image[i] << 24;
+		for(int j=0;j<8;j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+	}
+	uint32_t expected = image[252] | (image[253] << 8) | (image[254] << 16) | ((uint32_t)image[255] << 24);
+	return crc == expected;
+#endif
+}
+
+
+int update_commit( void )
+{
+	update.isCommitted = 0;
+	if(!update.isActive || update.nextOffset != update.imageSz)
+		return FUPDATE_ERROR_Hash;
+
+	const uint8_t* staged = (const uint8_t*)(XIP_BASE + UPDATE_STAGING_OFFSET);
+	uint8_t hash[SHA256_HASH_SIZE];
+	struct sha256_ctx hashCtx;
+	sha256_init( &hashCtx );
+	sha256_update( &hashCtx, staged, update.imageSz );
+	sha256_final( &hashCtx, hash );
+	if(memcmp( hash, update.imageHash, SHA256_HASH_SIZE ) != 0)
+		return FUPDATE_ERROR_Hash;
+
+	if(!is_boot2_valid( staged ))
+		return FUPDATE_ERROR_Image;
+
+	update.isCommitted = 1;
+	return 0;
+}
+
+
+/** Copy staged sector to the image, no flash fetches so this runs while XIP is down between steps.
+*/
+static void __no_inline_not_in_flash_func(swap_sector)( uint32_t sector, int isErase )
+{
+	const volatile uint8_t* src = (const volatile uint8_t*)(XIP_BASE + UPDATE_STAGING_OFFSET + sector * FLASH_SECTOR_SIZE);
+	for(int i=0;i<FLASH_SECTOR_SIZE;i++)
+		updateBuffer[i] = src[i];
+	if(isErase)
+		flash_range_erase( sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE );
+	flash_range_program( sector * FLASH_SECTOR_SIZE, updateBuffer, FLASH_SECTOR_SIZE );
+}
+
+
+void __no_inline_not_in_flash_func(update_swap)( void )
+{
+	if(!update.isCommitted)
+		return;
+
+	// Emulator DMA reads XIP, which is down from the first erase, stop it while flash code can still run
+	flash_emu_stop();
+	
+	// Running image is gone from here on, nothing may return to flash code
+	save_and_disable_interrupts();
+	uint32_t sectorCnt = (update.imageSz + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+
+	flash_range_erase( 0, FLASH_SECTOR_SIZE );
+	for(uint32_t sector=1;sector<sectorCnt;sector++)
+		swap_sector( sector, 1 );
+	swap_sector( 0, 0 );
+
+	// Reset through AIRCR like FCMD_RebootProgrammer
+	*((volatile uint32_t*)(PPB_BASE + 0x0ED0C)) = 0x5FA0004;
+	while(1)
+		;
+}
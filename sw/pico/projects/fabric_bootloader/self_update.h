@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include "hardware/flash.h"
+#include "fabric_bootloader.h"
+#include "bitstream_store.h"
+#include "miniz.h"
+
+/** In band bootloader update. A new image streams in raw deflate blocks into a staging region below the
+* flash store, each block optionally deflated against a preset dictionary cut from the running image so
+* small changes send little more than the difference. The staged image is checked against its sha256,
+* then copied over the running one from RAM & the board reboots into it.
+*/
+#if PICO_RP2350
+#define UPDATE_MAX_IMAGE_SZ (512 * 1024)	// copy_to_ram images have to fit SRAM anyway
+#define UPDATE_BLOCK_SZ 4096
+#define UPDATE_DICT_SZ (32 * 1024)			// Deflate window
+#else
+#define UPDATE_MAX_IMAGE_SZ (256 * 1024)
+#define UPDATE_BLOCK_SZ 2048
+#define UPDATE_DICT_SZ (8 * 1024)
+#endif
+#define UPDATE_STAGING_OFFSET (FLASH_SCRATCH_OFFSET - UPDATE_MAX_IMAGE_SZ)	// Below the perf test scratch sector
+
+
+_Static_assert( UPDATE_STAGING_OFFSET % FLASH_SECTOR_SIZE == 0 && UPDATE_STAGING_OFFSET + UPDATE_MAX_IMAGE_SZ <= FLASH_SCRATCH_OFFSET, "update staging overlaps the scratch sector" );
+_Static_assert( UPDATE_STAGING_OFFSET >= UPDATE_MAX_IMAGE_SZ, "update staging overlaps the bootloader image" );
+_Static_assert( FLASH_SECTOR_SIZE % UPDATE_BLOCK_SZ == 0 && UPDATE_BLOCK_SZ % FLASH_PAGE_SIZE == 0, "update blocks must tile flash sectors" );
+_Static_assert( UPDATE_BLOCK_SZ + sizeof(struct FUpdateBlock) + 16 <= FABRIC_PACKET_SZ, "update block doesn't fit a request" );
+
+
+/** Size of the running bootloader image in flash.
+*/
+uint32_t update_running_size( void );
+
+
+/** sha256 of the running bootloader image.
+@param uint8_t* hash   Output, SHA256_HASH_SIZE bytes.
+*/
+void update_running_hash( uint8_t* hash );
+
+
+/** Start staging a new image, drops any image staged before.
+@param uint32_t imageSz   Image size, multiple of FLASH_PAGE_SIZE.
+@param uint8_t* imageHash   sha256 the staged image has to match.
+@return FUPDATE_ERROR_ code, 0 on success.
+*/
+int update_begin( uint32_t imageSz, const uint8_t* imageHash );
+
+
+/** Inflate & stage the next block.
+@param tinfl_decompressor* inflater   Decoder state, shared with bitstream programming.
+@param FUpdateBlock* request   Block header, raw deflate data follows.
+@param uint32_t dataSz   Bytes of deflate data after the header.
+@return FUPDATE_ERROR_ code, 0 on success.
+*/
+int update_write_block( tinfl_decompressor* inflater, const struct FUpdateBlock* request, uint32_t dataSz );
+
+
+/** Check the staged image is complete & matches its hash.
+@return FUPDATE_ERROR_ code, the image can be swapped in when 0.
+*/
+int update_commit( void );
+
+
+/** Copy the committed image over the running one & reboot, runs from RAM with interrupts off.
+* The first sector is erased first & written last, an interrupted copy leaves no valid image so
+* the boot rom drops to BOOTSEL instead of running a partial one.
+*/
+void update_swap( void );
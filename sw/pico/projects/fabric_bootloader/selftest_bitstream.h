@@ -0,0 +1,749 @@
+#include <pico/platform.h>
+uint8_t __in_flash("selftest_bitstream") selftest_bitstream[] = {
+126, 0, 224, 15, 120, 218, 251, 
+207, 16, 144, 88, 84, 98, 165, 224, 
+227, 230, 106, 26, 170, 107, 104, 
+228, 166, 107, 230, 236, 232, 228, 
+238, 104, 100, 106, 198, 240, 255, 
+255, 255, 189, 155, 129, 196, 127, 
+107, 6, 6, 134, 71, 64, 172, 40, 40, 
+224, 172, 4, 164, 29, 128, 216, 13, 
+136, 153, 128, 216, 149, 185, 49, 
+52, 160, 131, 85, 98, 199, 68, 217, 
+46, 6, 56, 96, 54, 254, 143, 224, 
+156, 121, 49, 202, 25, 229, 140, 
+114, 70, 57, 163, 156, 81, 206, 40, 
+103, 148, 51, 202, 25, 229, 140, 
+114, 70, 57, 163, 156, 81, 14, 213, 
+57, 76, 1, 112, 158, 139, 62, 26, 
+111, 196, 5, 9, 0, 247, 50, 76, 245, 
+50, 0, 224, 15, 120, 218, 237, 212, 
+49, 17, 0, 32, 16, 3, 193, 224, 23, 
+103, 111, 5, 33, 184, 128, 14, 15, 
+63, 108, 186, 109, 83, 92, 146, 
+181, 79, 222, 0, 0, 160, 57, 70, 
+102, 121, 4, 0, 64, 98, 1, 224, 59, 
+92, 104, 18, 75, 209, 52, 0, 224, 
+15, 120, 218, 237, 212, 49, 17, 0, 
+32, 16, 3, 193, 224, 23, 103, 88, 
+65, 8, 46, 248, 10, 7, 52, 63, 179, 
+233, 182, 75, 117, 201, 219, 62, 55, 
+237, 48, 50, 87, 195, 219, 0, 0, 18, 
+11, 0, 0, 0, 0, 127, 81, 1, 8, 73, 
+30, 53, 0, 224, 15, 120, 218, 237, 
+212, 49, 17, 0, 32, 16, 3, 193, 224, 
+23, 103, 88, 65, 8, 46, 248, 14, 
+15, 204, 111, 186, 109, 83, 92, 
+146, 236, 115, 243, 214, 19, 35, 
+115, 181, 63, 1, 0, 64, 98, 1, 0, 
+36, 22, 0, 254, 69, 1, 229, 203, 
+73, 78, 52, 0, 224, 15, 120, 218, 
+237, 212, 49, 17, 0, 32, 12, 4, 193, 
+224, 55, 206, 176, 130, 144, 184, 
+72, 58, 12, 48, 67, 181, 223, 109, 
+251, 197, 85, 199, 221, 41, 120, 
+197, 138, 220, 30, 1, 0, 144, 88, 0, 
+0, 137, 5, 128, 223, 24, 116, 28, 
+74, 105, 53, 0, 224, 15, 120, 218, 
+237, 212, 161, 17, 0, 32, 16, 3, 
+193, 208, 47, 157, 209, 10, 133, 
+208, 5, 63, 131, 64, 35, 17, 123, 
+110, 109, 68, 146, 211, 92, 59, 55, 
+248, 0, 45, 125, 88, 4, 0, 192, 197, 
+2, 0, 0, 0, 60, 162, 0, 69, 155, 
+73, 30, 71, 0, 224, 15, 120, 218, 
+99, 56, 243, 226, 63, 3, 28, 140, 
+114, 134, 29, 135, 145, 33, 103, 
+245, 104, 136, 12, 37, 14, 83, 0, 
+156, 231, 162, 63, 26, 34, 163, 28, 
+242, 211, 11, 45, 147, 210, 0, 89, 
+59, 90, 206, 142, 38, 212, 209, 
+132, 58, 202, 25, 77, 193, 163, 69, 
+237, 104, 218, 28, 77, 168, 163, 28, 
+188, 28, 0, 47, 54, 53, 240, 75, 0, 
+224, 15, 120, 218, 59, 243, 226, 63, 
+3, 28, 156, 25, 66, 28, 166, 0, 
+56, 207, 69, 159, 104, 169, 161, 
+106, 237, 96, 229, 48, 50, 228, 172, 
+30, 33, 94, 29, 77, 168, 163, 156, 
+209, 20, 60, 154, 130, 71, 139, 218, 
+209, 132, 58, 154, 80, 71, 57, 163, 
+41, 120, 180, 168, 29, 77, 168, 
+144, 100, 65, 60, 111, 176, 219, 53, 
+220, 56, 0, 55, 127, 43, 171, 81, 0, 
+224, 15, 120, 218, 99, 96, 128, 129, 
+51, 47, 254, 51, 140, 114, 80, 57, 
+76, 1, 112, 158, 139, 62, 209, 82, 
+148, 219, 68, 63, 123, 135, 4, 135, 
+145, 33, 103, 245, 104, 122, 36, 59, 
+253, 16, 157, 182, 6, 161, 93, 163, 
+156, 209, 84, 60, 154, 138, 71, 139, 
+220, 209, 196, 58, 154, 88, 71, 57, 
+3, 217, 196, 29, 77, 196, 163, 
+156, 209, 2, 119, 168, 165, 85, 0, 
+120, 182, 23, 241, 72, 0, 224, 15, 
+120, 218, 99, 96, 128, 130, 51, 47, 
+254, 51, 48, 140, 114, 6, 158, 195, 
+20, 0, 231, 185, 232, 147, 192, 27, 
+236, 118, 13, 61, 14, 35, 67, 206, 
+234, 209, 36, 57, 154, 88, 71, 57, 
+163, 169, 120, 52, 21, 143, 22, 185, 
+163, 137, 117, 52, 177, 142, 114, 
+70, 83, 241, 104, 145, 59, 154, 88, 
+135, 74, 98, 5, 0, 177, 9, 16, 230, 
+64, 0, 224, 15, 120, 218, 59, 243, 
+226, 63, 3, 28, 156, 25, 229, 140, 
+96, 14, 83, 0, 156, 231, 162, 79, 
+2, 111, 176, 219, 53, 244, 56, 
+140, 12, 57, 171, 71, 147, 228, 40, 
+103, 148, 51, 202, 25, 229, 140, 22, 
+177, 163, 156, 81, 206, 40, 103, 
+148, 51, 90, 196, 142, 114, 72, 228, 
+0, 0, 53, 220, 65, 10, 50, 0, 224, 
+15, 120, 218, 237, 212, 49, 1, 0, 
+32, 12, 3, 193, 224, 23, 103, 181, 
+130, 16, 92, 192, 134, 136, 114, 
+217, 110, 205, 240, 73, 214, 62, 
+121, 3, 128, 46, 24, 153, 229, 17, 
+0, 0, 137, 5, 0, 128, 95, 112, 1, 
+43, 115, 75, 209, 52, 0, 224, 15, 
+120, 218, 237, 212, 33, 1, 0, 32, 
+16, 4, 193, 163, 47, 205, 190, 10, 
+65, 104, 1, 10, 243, 9, 16, 115, 
+110, 236, 137, 77, 222, 214, 62, 1, 
+0, 232, 24, 153, 229, 17, 0, 0, 
+137, 5, 0, 144, 216, 223, 113, 1, 
+201, 252, 72, 130, 197, 1, 224, 15, 
+120, 218, 99, 96, 0, 130, 51, 47, 
+254, 51, 192, 193, 40, 103, 148, 51, 
+202, 25, 229, 208, 132, 195, 200, 
+144, 179, 122, 52, 68, 70, 57, 163, 
+156, 81, 206, 40, 135, 88, 206, 12, 
+16, 211, 3, 136, 243, 51, 168, 164, 
+16, 2, 92, 24, 62, 173, 197, 197, 
+195, 173, 107, 150, 2, 67, 226, 22, 
+4, 247, 224, 10, 134, 171, 137, 
+196, 232, 155, 38, 192, 112, 208, 
+133, 86, 33, 213, 42, 98, 196, 32, 
+118, 25, 206, 103, 212, 228, 49, 
+108, 120, 87, 129, 224, 27, 48, 156, 
+218, 143, 80, 221, 114, 131, 161, 
+64, 129, 24, 99, 165, 217, 120, 24, 
+186, 155, 176, 75, 50, 74, 180, 25, 
+104, 155, 226, 208, 120, 176, 129, 
+65, 21, 17, 42, 140, 42, 45, 10, 
+42, 169, 8, 217, 9, 110, 12, 91, 
+45, 145, 184, 12, 93, 139, 112, 
+241, 4, 25, 122, 86, 32, 120, 147, 
+4, 166, 28, 202, 193, 37, 137, 
+207, 152, 73, 10, 51, 146, 92, 136, 
+83, 138, 143, 119, 4, 232, 45, 85, 
+92, 146, 68, 70, 85, 71, 11, 131, 
+197, 85, 28, 114, 2, 13, 157, 43, 
+72, 54, 80, 232, 16, 195, 114, 105, 
+42, 166, 37, 97, 23, 134, 205, 172, 
+8, 46, 139, 113, 67, 179, 62, 78, 
+219, 240, 89, 206, 97, 161, 121, 64, 
+67, 6, 41, 217, 57, 90, 44, 219, 
+137, 36, 173, 206, 80, 113, 7, 39, 
+23, 77, 177, 135, 163, 197, 74, 79, 
+4, 183, 45, 136, 243, 192, 118, 
+109, 4, 191, 193, 209, 66, 237, 21, 
+78, 179, 118, 57, 113, 30, 96, 75, 
+194, 41, 237, 229, 104, 161, 153, 
+68, 172, 187, 88, 30, 124, 120, 65, 
+28, 143, 195, 54, 96, 169, 61, 156, 
+203, 196, 249, 194, 95, 70, 184, 
+193, 192, 11, 145, 43, 108, 50, 31, 
+55, 175, 154, 83, 117, 18, 85, 228, 
+42, 67, 117, 59, 178, 200, 5, 63, 
+6, 193, 111, 168, 198, 200, 173, 
+152, 183, 19, 143, 193, 64, 17, 229, 
+6, 6, 29, 37, 20, 37, 34, 12, 151, 
+163, 241, 235, 41, 225, 81, 43, 184, 
+168, 128, 34, 34, 145, 194, 16, 43, 
+134, 44, 226, 215, 192, 176, 218, 
+21, 197, 162, 67, 233, 12, 95, 143, 
+34, 137, 124, 124, 100, 161, 206, 
+144, 57, 17, 175, 99, 4, 24, 212, 
+244, 81, 248, 126, 12, 221, 151, 
+112, 11, 48, 166, 154, 118, 51, 48, 
+33, 165, 50, 113, 21, 134, 207, 
+193, 72, 5, 126, 164, 111, 210, 129, 
+24, 126, 132, 250, 169, 5, 177, 
+238, 139, 229, 18, 39, 250, 149, 3, 
+0, 195, 71, 61, 234, 107, 7, 224, 
+15, 120, 218, 141, 87, 123, 80, 
+147, 87, 22, 63, 97, 129, 18, 140, 
+16, 65, 4, 20, 49, 225, 21, 80, 
+180, 193, 64, 55, 176, 74, 19, 16, 
+68, 45, 196, 118, 161, 128, 130, 
+11, 10, 13, 186, 91, 247, 67, 81, 
+73, 6, 218, 203, 39, 80, 129, 160, 
+188, 68, 208, 12, 155, 66, 87, 195, 
+99, 109, 237, 106, 235, 176, 125, 
+68, 161, 14, 107, 17, 106, 137, 
+187, 162, 29, 13, 144, 178, 248, 
+152, 41, 248, 150, 117, 103, 55, 
+238, 206, 122, 207, 55, 99, 102, 
+247, 251, 239, 252, 190, 123, 126, 
+247, 222, 115, 239, 249, 157, 115, 
+111, 253, 19, 254, 251, 73, 116, 64, 
+142, 62, 55, 91, 158, 91, 73, 144, 
+153, 210, 177, 127, 93, 176, 229, 
+150, 152, 14, 9, 12, 2, 198, 68, 
+205, 72, 159, 47, 96, 114, 9, 181, 
+61, 26, 65, 185, 152, 154, 14, 57, 
+234, 59, 212, 114, 81, 92, 15, 165, 
+22, 12, 78, 253, 95, 191, 56, 134, 
+39, 64, 247, 11, 203, 129, 63, 149, 
+194, 50, 199, 243, 49, 32, 76, 129, 
+154, 239, 17, 48, 99, 148, 0, 57, 
+69, 1, 7, 254, 200, 112, 168, 215, 
+174, 23, 0, 111, 181, 80, 85, 4, 
+247, 22, 208, 41, 170, 249, 99, 189, 
+26, 242, 139, 116, 204, 202, 22, 
+231, 194, 179, 175, 48, 203, 119, 
+67, 208, 248, 37, 102, 73, 19, 192, 
+196, 85, 202, 82, 163, 180, 122, 
+167, 64, 199, 125, 188, 148, 158, 
+74, 6, 214, 215, 99, 150, 63, 155, 
+38, 34, 49, 73, 10, 129, 245, 115, 
+41, 137, 50, 198, 149, 164, 119, 
+113, 22, 178, 231, 7, 82, 184, 145, 
+187, 52, 67, 91, 206, 163, 183, 241, 
+60, 151, 156, 247, 140, 220, 133, 
+209, 189, 156, 185, 203, 89, 70, 
+125, 152, 227, 168, 21, 233, 53, 87, 
+57, 72, 201, 14, 254, 36, 196, 141, 
+252, 143, 81, 26, 27, 98, 69, 139, 
+140, 141, 62, 48, 4, 198, 47, 232, 
+62, 86, 49, 170, 53, 240, 125, 9, 
+117, 114, 172, 83, 29, 92, 39, 239, 
+124, 194, 165, 17, 195, 179, 143, 
+17, 205, 106, 91, 188, 182, 110, 
+226, 176, 4, 129, 135, 134, 195, 
+226, 39, 35, 171, 157, 56, 44, 69, 
+97, 68, 149, 132, 88, 108, 94, 210, 
+199, 94, 148, 229, 252, 90, 195, 
+116, 150, 25, 62, 159, 70, 94, 121, 
+108, 241, 248, 12, 72, 191, 230, 16, 
+237, 94, 3, 1, 1, 20, 113, 119, 96, 
+67, 37, 240, 214, 16, 30, 115, 85, 
+187, 215, 83, 158, 255, 10, 157, 
+205, 81, 116, 175, 128, 78, 37, 132, 
+106, 26, 4, 72, 174, 95, 39, 16, 
+181, 204, 167, 192, 188, 1, 56, 38, 
+65, 230, 71, 176, 155, 206, 7, 137, 
+13, 162, 62, 58, 25, 47, 95, 150, 
+177, 5, 58, 233, 9, 66, 91, 156, 
+112, 57, 75, 255, 183, 50, 217, 137, 
+105, 171, 50, 83, 45, 103, 223, 163, 
+96, 215, 47, 35, 71, 206, 40, 248, 
+235, 95, 158, 59, 188, 252, 168, 
+177, 132, 70, 82, 224, 76, 127, 251, 
+17, 88, 246, 13, 53, 87, 26, 199, 
+97, 228, 26, 250, 157, 174, 20, 38, 
+127, 66, 237, 212, 56, 104, 223, 78, 
+77, 54, 33, 198, 75, 70, 220, 133, 
+47, 159, 238, 223, 71, 108, 209, 
+107, 238, 96, 68, 60, 165, 134, 155, 
+151, 208, 145, 50, 42, 119, 5, 156, 
+45, 193, 55, 53, 217, 185, 136, 12, 
+211, 179, 225, 197, 70, 213, 13, 
+251, 123, 202, 79, 104, 41, 20, 36, 
+76, 49, 107, 32, 228, 83, 14, 81, 
+5, 49, 75, 209, 249, 253, 124, 
+190, 185, 52, 227, 90, 65, 33, 141, 
+6, 239, 93, 161, 170, 162, 80, 70, 
+216, 15, 40, 84, 178, 233, 80, 119, 
+229, 222, 216, 208, 217, 68, 234, 
+42, 232, 118, 189, 173, 237, 156, 
+188, 120, 2, 220, 254, 142, 22, 102, 
+253, 140, 129, 125, 97, 212, 245, 
+246, 182, 94, 247, 238, 74, 229, 
+109, 168, 76, 160, 17, 200, 149, 
+141, 69, 191, 113, 159, 204, 63, 73, 
+29, 93, 2, 217, 98, 139, 222, 112, 
+26, 33, 19, 231, 213, 7, 249, 166, 
+45, 220, 180, 42, 182, 88, 97, 167, 
+39, 218, 129, 247, 226, 239, 74, 
+51, 44, 51, 138, 71, 95, 225, 113, 
+231, 213, 29, 98, 189, 117, 39, 90, 
+110, 13, 59, 165, 253, 120, 171, 91, 
+53, 179, 171, 28, 121, 167, 219, 
+188, 179, 126, 93, 255, 80, 81, 246, 
+55, 228, 238, 163, 155, 237, 247, 
+35, 105, 63, 224, 75, 99, 156, 61, 
+107, 245, 15, 149, 209, 104, 242, 
+94, 143, 112, 124, 58, 8, 105, 31, 
+114, 215, 119, 199, 216, 183, 6, 
+137, 151, 107, 111, 231, 140, 200, 
+123, 4, 229, 222, 128, 90, 202, 16, 
+175, 108, 142, 182, 38, 198, 193, 
+162, 115, 28, 158, 209, 96, 227, 79, 
+55, 95, 32, 98, 29, 97, 75, 76, 80, 
+127, 20, 75, 231, 143, 145, 182, 
+220, 243, 165, 97, 117, 244, 80, 
+213, 230, 69, 189, 121, 128, 240, 
+169, 56, 58, 250, 232, 30, 40, 207, 
+121, 146, 147, 123, 94, 64, 1, 117, 
+132, 213, 108, 131, 226, 167, 116, 
+62, 183, 120, 223, 224, 253, 117, 
+192, 118, 114, 183, 34, 109, 53, 
+253, 230, 10, 186, 5, 105, 163, 237, 
+219, 189, 73, 5, 149, 90, 240, 245, 
+206, 133, 55, 232, 230, 120, 121, 
+105, 163, 85, 170, 227, 36, 200, 
+140, 115, 48, 51, 49, 205, 188, 210, 
+144, 99, 160, 110, 41, 23, 131, 97, 
+239, 14, 196, 188, 165, 162, 33, 92, 
+225, 55, 78, 17, 81, 175, 84, 68, 
+213, 26, 72, 115, 206, 149, 215, 80, 
+253, 36, 78, 221, 118, 170, 29, 40, 
+154, 32, 125, 207, 75, 138, 245, 75, 
+77, 69, 29, 12, 35, 249, 112, 33, 
+163, 70, 59, 213, 214, 22, 144, 96, 
+150, 17, 107, 237, 87, 81, 94, 170, 
+110, 169, 180, 117, 16, 13, 152, 8, 
+252, 8, 166, 104, 87, 224, 224, 228, 
+163, 10, 139, 99, 178, 213, 40, 69, 
+167, 85, 126, 158, 228, 39, 111, 
+164, 231, 13, 161, 16, 249, 35, 34, 
+153, 110, 175, 33, 239, 203, 80, 90, 
+68, 12, 72, 62, 148, 175, 168, 65, 
+55, 106, 122, 155, 92, 111, 57, 
+113, 15, 145, 212, 169, 22, 43, 42, 
+204, 156, 165, 156, 5, 17, 18, 110, 
+23, 35, 171, 245, 130, 246, 58, 
+234, 227, 202, 127, 124, 64, 2, 23, 
+36, 28, 150, 132, 17, 18, 243, 152, 
+115, 83, 109, 200, 123, 143, 113, 
+190, 247, 171, 219, 93, 201, 215, 
+203, 177, 54, 13, 72, 46, 237, 212, 
+107, 157, 49, 212, 255, 228, 247, 
+35, 164, 52, 135, 46, 122, 109, 
+108, 160, 163, 101, 92, 143, 195, 
+169, 106, 81, 202, 175, 232, 208, 
+89, 53, 240, 77, 225, 139, 144, 
+253, 77, 132, 175, 201, 226, 135, 
+93, 130, 88, 141, 34, 51, 145, 67, 
+210, 149, 4, 150, 7, 200, 169, 174, 
+229, 219, 139, 118, 57, 159, 83, 
+244, 50, 167, 118, 114, 24, 66, 97, 
+243, 102, 123, 61, 151, 164, 217, 
+86, 251, 151, 32, 181, 118, 243, 
+168, 42, 90, 209, 87, 213, 150, 83, 
+122, 151, 67, 210, 158, 215, 42, 
+114, 152, 181, 35, 250, 110, 115, 
+22, 230, 233, 66, 152, 137, 35, 28, 
+158, 211, 45, 167, 125, 77, 170, 
+101, 212, 199, 89, 0, 14, 168, 142, 
+46, 244, 15, 251, 4, 250, 170, 233, 
+113, 8, 194, 118, 187, 236, 18, 253, 
+3, 245, 83, 209, 130, 149, 138, 
+144, 10, 58, 194, 33, 37, 62, 233, 
+178, 8, 86, 161, 14, 66, 113, 66, 0, 
+55, 231, 98, 101, 139, 154, 62, 
+163, 88, 242, 136, 34, 126, 130, 62, 
+67, 57, 184, 211, 27, 198, 59, 28, 
+111, 222, 30, 222, 184, 84, 159, 
+167, 198, 106, 112, 248, 6, 108, 66, 
+114, 200, 155, 239, 1, 149, 71, 240, 
+128, 219, 79, 34, 103, 167, 86, 108, 
+69, 121, 187, 30, 142, 204, 67, 
+183, 223, 185, 177, 18, 238, 54, 
+161, 210, 26, 122, 143, 196, 140, 
+226, 180, 23, 166, 210, 46, 5, 202, 
+142, 23, 101, 53, 47, 145, 63, 253, 
+45, 133, 196, 159, 69, 195, 131, 
+13, 56, 242, 235, 206, 229, 201, 
+136, 41, 2, 67, 137, 44, 19, 114, 1, 
+151, 74, 103, 47, 17, 228, 174, 166, 
+34, 185, 224, 84, 146, 135, 82, 
+254, 138, 18, 39, 76, 217, 96, 34, 
+180, 208, 166, 153, 183, 208, 201, 
+127, 174, 226, 78, 23, 74, 6, 155, 
+151, 73, 87, 75, 125, 230, 204, 36, 
+39, 84, 21, 198, 134, 202, 240, 
+205, 159, 96, 151, 206, 35, 25, 199, 
+144, 68, 110, 170, 214, 125, 112, 5, 
+246, 81, 141, 226, 93, 222, 173, 73, 
+169, 143, 15, 208, 95, 203, 66, 165, 
+186, 217, 200, 50, 167, 46, 163, 82, 
+181, 111, 174, 57, 103, 114, 1, 240, 
+165, 40, 243, 23, 219, 36, 104, 107, 
+52, 78, 208, 130, 6, 165, 252, 126, 
+50, 222, 125, 89, 237, 152, 140, 
+28, 51, 226, 65, 249, 89, 23, 226, 
+87, 89, 100, 217, 156, 66, 248, 
+135, 138, 220, 88, 195, 254, 22, 
+110, 91, 187, 92, 255, 215, 235, 
+232, 146, 126, 219, 120, 81, 61, 25, 
+227, 223, 243, 232, 22, 199, 213, 
+172, 238, 136, 120, 168, 200, 196, 
+25, 96, 221, 127, 218, 150, 106, 
+169, 1, 248, 162, 25, 134, 107, 109, 
+141, 192, 16, 237, 237, 97, 82, 218, 
+28, 213, 52, 44, 47, 196, 41, 60, 
+161, 42, 39, 225, 111, 98, 42, 38, 
+233, 46, 252, 233, 125, 234, 181, 
+217, 246, 4, 128, 119, 42, 41, 208, 
+49, 239, 80, 131, 173, 103, 250, 
+11, 238, 220, 39, 186, 122, 118, 
+148, 116, 49, 63, 163, 173, 152, 88, 
+168, 10, 18, 14, 192, 13, 212, 149, 
+87, 187, 185, 245, 28, 103, 62, 
+167, 205, 178, 163, 147, 176, 32, 
+195, 234, 73, 178, 223, 162, 144, 
+80, 181, 80, 75, 6, 82, 105, 1, 21, 
+170, 170, 130, 203, 193, 227, 29, 
+28, 170, 70, 215, 182, 27, 138, 
+163, 121, 24, 10, 24, 84, 195, 24, 
+125, 230, 241, 78, 142, 188, 214, 
+223, 54, 93, 209, 71, 167, 15, 233, 
+221, 120, 230, 93, 58, 160, 52, 70, 
+224, 17, 14, 27, 190, 228, 20, 207, 
+181, 226, 212, 214, 38, 203, 179, 
+120, 36, 157, 111, 251, 182, 192, 
+156, 67, 184, 124, 30, 12, 174, 126, 
+85, 17, 130, 58, 124, 225, 6, 159, 
+250, 237, 40, 211, 4, 181, 162, 178, 
+79, 81, 91, 13, 58, 84, 232, 22, 1, 
+44, 235, 176, 243, 148, 20, 246, 
+131, 76, 106, 239, 57, 202, 41, 151, 
+118, 159, 163, 182, 80, 4, 218, 74, 
+167, 131, 253, 210, 9, 181, 175, 
+175, 132, 72, 92, 58, 173, 170, 120, 
+3, 252, 142, 35, 169, 69, 154, 75, 
+162, 30, 180, 69, 73, 59, 223, 244, 
+234, 117, 196, 49, 190, 177, 233, 
+161, 23, 135, 163, 71, 2, 192, 233, 
+105, 108, 47, 174, 63, 110, 65, 20, 
+67, 34, 253, 175, 254, 83, 148, 
+254, 5, 151, 89, 176, 121, 106, 6, 
+224, 15, 120, 218, 221, 87, 121, 80, 
+83, 103, 16, 95, 50, 104, 9, 82, 
+110, 41, 34, 96, 144, 200, 41, 136, 
+92, 19, 16, 152, 199, 101, 16, 148, 
+163, 2, 10, 131, 202, 81, 68, 129, 
+234, 227, 170, 66, 209, 62, 162, 80, 
+228, 18, 16, 45, 196, 212, 166, 72, 
+37, 130, 162, 3, 120, 140, 213, 49, 
+30, 12, 180, 67, 11, 8, 88, 176, 
+58, 134, 104, 37, 226, 129, 20, 
+171, 216, 78, 181, 113, 166, 227, 
+183, 105, 139, 163, 211, 153, 254, 
+209, 252, 183, 191, 183, 191, 223, 
+219, 221, 111, 191, 221, 23, 0, 229, 
+175, 220, 231, 56, 156, 238, 123, 1, 
+127, 254, 88, 236, 219, 97, 229, 
+151, 120, 177, 95, 34, 68, 17, 38, 
+138, 27, 130, 47, 162, 95, 65, 234, 
+106, 222, 186, 97, 78, 38, 123, 94, 
+1, 74, 21, 143, 116, 153, 115, 2, 
+33, 205, 96, 43, 14, 209, 241, 149, 
+4, 200, 189, 149, 105, 232, 203, 
+155, 90, 134, 117, 23, 11, 83, 160, 
+206, 18, 35, 130, 124, 57, 91, 122, 
+165, 157, 64, 234, 116, 84, 89, 63, 
+79, 247, 58, 14, 80, 144, 199, 57, 
+16, 159, 29, 67, 160, 151, 68, 218, 
+227, 55, 18, 142, 175, 44, 66, 93, 
+246, 187, 63, 86, 46, 160, 160, 161, 
+232, 21, 160, 230, 173, 195, 42, 73, 
+1, 251, 119, 144, 200, 76, 26, 
+158, 102, 32, 13, 111, 195, 239, 65, 
+190, 89, 37, 186, 60, 54, 85, 174, 
+139, 68, 148, 73, 230, 50, 41, 40, 
+39, 53, 31, 26, 130, 244, 137, 8, 
+117, 149, 35, 106, 173, 198, 26, 93, 
+217, 71, 228, 186, 250, 199, 137, 
+200, 133, 240, 83, 171, 47, 110, 
+229, 212, 173, 37, 94, 80, 31, 222, 
+179, 23, 147, 130, 5, 180, 149, 59, 
+1, 180, 75, 118, 181, 11, 57, 10, 
+136, 113, 37, 111, 130, 110, 5, 209, 
+212, 43, 225, 22, 255, 234, 73, 236, 
+122, 78, 136, 205, 230, 139, 196, 
+217, 155, 21, 206, 253, 154, 152, 
+214, 92, 120, 132, 14, 147, 170, 
+133, 79, 114, 8, 185, 165, 63, 86, 
+56, 14, 81, 233, 196, 225, 128, 
+171, 88, 104, 77, 28, 170, 232, 92, 
+127, 191, 49, 103, 91, 169, 192, 
+129, 128, 77, 43, 221, 237, 87, 228, 
+137, 61, 86, 16, 154, 122, 124, 214, 
+61, 236, 224, 218, 254, 67, 83, 
+104, 28, 17, 130, 68, 103, 134, 53, 
+64, 204, 207, 59, 186, 153, 23, 
+229, 196, 230, 53, 83, 239, 239, 67, 
+97, 214, 192, 42, 18, 38, 184, 196, 
+21, 121, 109, 167, 31, 156, 34, 
+200, 2, 104, 111, 198, 85, 12, 89, 
+106, 201, 227, 235, 97, 36, 33, 220, 
+151, 39, 224, 144, 152, 124, 220, 
+22, 102, 135, 66, 137, 24, 149, 58, 
+73, 171, 55, 18, 2, 199, 81, 71, 
+86, 84, 23, 91, 67, 122, 34, 97, 
+177, 116, 162, 139, 29, 96, 145, 54, 
+106, 12, 163, 30, 10, 120, 70, 132, 
+164, 179, 82, 107, 32, 161, 51, 109, 
+16, 204, 90, 144, 82, 213, 148, 
+233, 101, 35, 198, 69, 138, 138, 18, 
+40, 153, 50, 126, 120, 112, 44, 
+212, 44, 146, 128, 131, 89, 107, 
+102, 206, 46, 207, 153, 19, 126, 51, 
+138, 144, 103, 37, 157, 12, 141, 7, 
+43, 62, 66, 38, 98, 206, 106, 109, 
+137, 248, 133, 58, 20, 64, 106, 144, 
+224, 150, 165, 27, 10, 18, 11, 162, 
+22, 165, 75, 215, 248, 242, 250, 
+215, 161, 28, 253, 138, 189, 53, 57, 
+183, 161, 213, 29, 101, 96, 28, 54, 
+35, 192, 128, 137, 68, 93, 167, 
+243, 158, 89, 239, 135, 163, 57, 
+243, 12, 247, 76, 97, 110, 105, 174, 
+99, 34, 91, 42, 218, 142, 176, 102, 
+225, 88, 238, 242, 180, 230, 177, 
+70, 24, 233, 195, 124, 211, 129, 
+148, 206, 156, 121, 174, 19, 250, 
+248, 12, 118, 72, 235, 217, 210, 
+148, 103, 228, 213, 201, 158, 187, 
+125, 43, 134, 199, 152, 9, 114, 5, 
+160, 234, 66, 68, 182, 44, 253, 27, 
+196, 187, 181, 35, 66, 12, 227, 223, 
+169, 92, 79, 79, 139, 203, 210, 210, 
+58, 124, 133, 77, 215, 105, 192, 
+71, 115, 145, 142, 183, 178, 26, 
+252, 147, 88, 71, 144, 191, 62, 104, 
+20, 206, 108, 193, 74, 81, 1, 156, 
+86, 50, 238, 160, 212, 247, 210, 
+226, 253, 141, 112, 77, 140, 132, 
+126, 234, 75, 151, 221, 233, 192, 
+66, 5, 1, 28, 113, 32, 2, 38, 14, 
+39, 55, 113, 110, 142, 16, 68, 83, 
+178, 219, 112, 131, 27, 76, 22, 168, 
+52, 101, 197, 136, 11, 83, 84, 75, 
+210, 223, 230, 25, 216, 93, 242, 
+168, 145, 212, 72, 141, 203, 174, 
+236, 2, 245, 163, 184, 66, 90, 146, 
+251, 192, 146, 227, 43, 24, 195, 
+183, 212, 137, 170, 10, 45, 56, 75, 
+98, 180, 27, 225, 113, 82, 27, 177, 
+114, 197, 87, 43, 182, 136, 77, 28, 
+9, 196, 1, 59, 68, 176, 245, 55, 
+158, 111, 254, 207, 35, 69, 213, 
+160, 32, 181, 5, 141, 15, 224, 73, 
+166, 179, 166, 215, 192, 134, 178, 
+14, 202, 115, 41, 189, 242, 26, 64, 
+91, 83, 16, 16, 95, 115, 158, 240, 
+203, 170, 107, 169, 40, 11, 188, 23, 
+42, 114, 109, 68, 75, 58, 209, 20, 
+244, 170, 12, 5, 51, 124, 216, 138, 
+42, 75, 125, 112, 76, 64, 34, 221, 
+182, 240, 196, 69, 101, 251, 205, 
+167, 141, 182, 162, 108, 170, 217, 
+210, 133, 115, 85, 150, 161, 149, 
+22, 100, 178, 144, 68, 11, 92, 46, 
+84, 81, 224, 186, 48, 19, 154, 36, 
+12, 139, 151, 97, 204, 118, 87, 
+209, 224, 26, 48, 109, 182, 175, 67, 
+52, 37, 97, 113, 6, 204, 193, 96, 
+236, 19, 42, 160, 15, 37, 171, 144, 
+28, 250, 153, 182, 234, 183, 19, 
+254, 27, 2, 214, 29, 28, 209, 205, 
+23, 36, 94, 175, 141, 183, 25, 112, 
+223, 136, 230, 84, 145, 141, 232, 
+170, 151, 170, 4, 103, 178, 22, 23, 
+233, 238, 29, 240, 75, 195, 18, 147, 
+179, 152, 138, 229, 72, 98, 231, 46, 
+169, 222, 85, 44, 193, 45, 116, 106, 
+125, 48, 109, 157, 213, 188, 50, 
+123, 14, 83, 48, 233, 71, 40, 26, 
+13, 246, 251, 5, 112, 207, 92, 69, 
+4, 204, 23, 162, 22, 209, 47, 80, 
+151, 61, 221, 129, 128, 82, 19, 97, 
+164, 169, 147, 34, 18, 237, 32, 113, 
+6, 137, 19, 76, 184, 210, 12, 87, 
+180, 38, 253, 132, 145, 226, 77, 
+114, 20, 149, 5, 60, 36, 139, 81, 
+77, 205, 71, 192, 140, 162, 169, 
+68, 245, 182, 82, 215, 109, 208, 
+244, 166, 79, 84, 167, 50, 171, 146, 
+209, 166, 204, 63, 40, 222, 9, 10, 
+1, 241, 217, 235, 63, 100, 53, 
+226, 44, 126, 194, 198, 67, 127, 
+117, 63, 101, 78, 17, 150, 94, 180, 
+40, 110, 61, 222, 148, 113, 11, 
+100, 122, 215, 208, 92, 227, 50, 
+217, 27, 80, 88, 242, 187, 122, 65, 
+208, 87, 141, 54, 165, 205, 32, 19, 
+63, 76, 236, 216, 110, 11, 216, 
+110, 72, 236, 130, 125, 217, 102, 
+70, 199, 120, 252, 32, 2, 57, 23, 
+85, 194, 182, 79, 113, 113, 147, 
+237, 83, 128, 25, 199, 136, 159, 
+178, 1, 241, 119, 201, 68, 131, 205, 
+40, 232, 162, 245, 229, 99, 11, 
+144, 124, 6, 29, 251, 166, 250, 98, 
+184, 31, 65, 28, 76, 216, 202, 109, 
+234, 255, 20, 139, 158, 204, 179, 
+19, 69, 145, 53, 161, 38, 151, 11, 
+75, 205, 135, 22, 65, 219, 98, 172, 
+163, 95, 204, 129, 254, 53, 196, 
+235, 131, 216, 178, 199, 153, 62, 
+146, 36, 54, 58, 237, 99, 38, 10, 
+87, 131, 38, 240, 252, 12, 181, 
+209, 62, 38, 24, 205, 228, 89, 78, 
+55, 146, 134, 234, 223, 13, 47, 80, 
+224, 37, 161, 156, 52, 114, 55, 149, 
+149, 84, 88, 175, 1, 214, 41, 56, 
+211, 218, 37, 177, 78, 117, 208, 30, 
+132, 176, 103, 197, 214, 157, 14, 
+34, 71, 1, 222, 242, 166, 3, 121, 
+218, 105, 203, 38, 168, 123, 167, 
+80, 12, 155, 52, 143, 92, 164, 207, 
+183, 160, 30, 160, 215, 240, 109, 
+77, 135, 35, 101, 143, 81, 105, 
+198, 70, 78, 252, 108, 28, 249, 92, 
+98, 98, 143, 250, 175, 130, 46, 63, 
+131, 74, 51, 210, 150, 175, 119, 
+142, 2, 52, 92, 188, 50, 122, 230, 
+249, 122, 201, 242, 66, 8, 212, 181, 
+180, 35, 161, 130, 62, 141, 62, 32, 
+188, 210, 237, 230, 108, 173, 148, 
+136, 240, 5, 125, 36, 124, 6, 15, 
+209, 87, 158, 143, 190, 194, 178, 
+137, 222, 53, 134, 124, 178, 190, 
+13, 227, 173, 109, 198, 137, 56, 
+122, 140, 194, 146, 66, 68, 50, 150, 
+31, 111, 144, 181, 116, 32, 159, 
+205, 118, 135, 71, 33, 254, 28, 66, 
+18, 120, 31, 15, 35, 138, 97, 141, 
+200, 236, 250, 244, 131, 254, 175, 
+254, 201, 110, 165, 192, 66, 131, 
+129, 21, 224, 44, 133, 104, 141, 
+233, 29, 246, 250, 247, 210, 167, 
+67, 236, 192, 172, 11, 213, 177, 
+12, 24, 33, 190, 80, 226, 81, 125, 
+126, 34, 60, 55, 33, 24, 4, 3, 43, 
+143, 48, 248, 213, 55, 140, 163, 7, 
+137, 173, 193, 12, 75, 166, 179, 
+222, 108, 199, 129, 30, 148, 73, 
+222, 254, 209, 27, 26, 225, 80, 114, 
+244, 223, 41, 188, 161, 33, 130, 
+250, 250, 105, 254, 117, 0, 164, 
+158, 255, 79, 98, 248, 31, 24, 26, 
+210, 213, 246, 111, 255, 232, 53, 
+122, 212, 143, 54, 127, 125, 244, 7, 
+245, 88, 152, 200, 130, 0, 224, 15, 
+120, 218, 99, 96, 128, 128, 51, 47, 
+254, 51, 192, 1, 113, 28, 14, 135, 
+219, 26, 68, 73, 5, 56, 49, 40, 89, 
+145, 108, 60, 197, 156, 101, 27, 24, 
+152, 250, 144, 220, 212, 112, 115, 
+5, 78, 73, 178, 124, 73, 14, 71, 
+176, 129, 127, 245, 112, 230, 145, 
+21, 12, 40, 82, 18, 225, 1, 12, 
+213, 23, 112, 41, 21, 185, 198, 112, 
+63, 153, 254, 105, 137, 98, 142, 
+192, 49, 134, 253, 198, 84, 85, 56, 
+202, 25, 229, 140, 114, 134, 50, 
+167, 203, 129, 65, 225, 19, 85, 21, 
+82, 151, 195, 200, 144, 179, 122, 
+52, 198, 70, 57, 163, 156, 81, 206, 
+40, 103, 180, 136, 29, 229, 12, 61, 
+14, 0, 71, 179, 57, 161, 68, 0, 
+224, 15, 120, 218, 99, 96, 96, 96, 
+56, 243, 226, 63, 3, 28, 140, 114, 
+70, 57, 35, 138, 195, 200, 144, 
+179, 122, 52, 68, 70, 57, 163, 156, 
+81, 206, 40, 103, 68, 23, 177, 156, 
+64, 28, 183, 98, 52, 238, 70, 57, 
+163, 156, 81, 206, 104, 25, 59, 210, 
+131, 212, 226, 141, 5, 53, 213, 13, 
+4, 7, 0, 54, 45, 71, 47, 102, 0, 
+224, 15, 120, 218, 99, 96, 56, 243, 
+226, 63, 3, 28, 140, 114, 200, 226, 
+8, 48, 112, 173, 198, 197, 27, 13, 
+159, 145, 196, 97, 100, 200, 25, 
+141, 251, 81, 206, 40, 103, 148, 51, 
+202, 25, 45, 98, 71, 57, 131, 45, 
+241, 88, 188, 177, 160, 204, 4, 38, 
+134, 52, 210, 147, 31, 147, 195, 
+115, 13, 92, 188, 209, 104, 25, 32, 
+14, 147, 65, 26, 55, 125, 10, 41, 
+124, 60, 90, 150, 135, 196, 218, 
+196, 40, 145, 243, 155, 12, 211, 
+113, 235, 26, 229, 12, 18, 14, 0, 
+113, 65, 63, 98, 49, 0, 224, 15, 
+120, 218, 237, 212, 49, 1, 0, 32, 
+12, 4, 177, 226, 183, 206, 176, 
+130, 144, 186, 104, 55, 68, 64, 126, 
+203, 250, 195, 117, 220, 157, 106, 
+0, 0, 0, 128, 111, 176, 34, 183, 
+71, 0, 0, 36, 246, 25, 12, 16, 56, 
+74, 29, 52, 0, 224, 15, 120, 218, 
+237, 212, 49, 17, 0, 32, 16, 3, 193, 
+224, 23, 103, 88, 65, 8, 46, 120, 
+42, 68, 252, 108, 186, 109, 83, 92, 
+242, 182, 207, 205, 31, 0, 180, 196, 
+200, 92, 30, 1, 0, 144, 88, 0, 0, 
+137, 109, 139, 2, 181, 28, 72, 130, 
+51, 0, 224, 15, 120, 218, 237, 212, 
+161, 1, 0, 32, 12, 4, 177, 118, 95, 
+54, 99, 149, 14, 210, 45, 168, 195, 
+98, 17, 121, 23, 251, 226, 170, 79, 
+220, 21, 0, 192, 11, 25, 107, 123, 
+4, 0, 64, 98, 1, 0, 36, 246, 55, 
+12, 233, 134, 75, 53, 79, 0, 224, 
+15, 120, 218, 99, 96, 128, 128, 51, 
+47, 254, 51, 192, 193, 40, 103, 
+148, 51, 202, 25, 229, 140, 114, 
+134, 38, 135, 41, 0, 206, 115, 209, 
+31, 96, 222, 104, 124, 140, 166, 
+188, 209, 84, 50, 88, 56, 140, 12, 
+57, 171, 7, 93, 154, 41, 128, 243, 
+142, 181, 16, 45, 53, 232, 146, 247, 
+104, 58, 27, 229, 12, 198, 66, 120, 
+52, 68, 70, 114, 57, 11, 0, 206, 
+234, 54, 156, 95, 0, 224, 15, 120, 
+218, 99, 96, 128, 128, 51, 47, 254, 
+51, 192, 193, 40, 103, 148, 51, 
+202, 25, 229, 12, 105, 14, 35, 67, 
+206, 234, 193, 230, 56, 166, 2, 56, 
+239, 88, 11, 209, 82, 131, 218, 221, 
+163, 156, 145, 149, 20, 70, 57, 163, 
+156, 65, 95, 206, 142, 114, 70, 57, 
+163, 28, 106, 213, 84, 1, 160, 92, 
+110, 0, 230, 174, 223, 1, 225, 66, 
+128, 139, 254, 176, 45, 149, 56, 
+129, 56, 110, 5, 169, 82, 52, 181, 
+137, 44, 123, 1, 40, 28, 66, 5, 181, 
+0, 248, 12, 120, 218, 99, 96, 96, 
+56, 243, 226, 63, 3, 28, 140, 114, 
+70, 57, 163, 156, 81, 206, 40, 103, 
+148, 51, 202, 25, 229, 140, 114, 70, 
+57, 131, 138, 51, 193, 65, 136, 
+131, 201, 145, 193, 67, 129, 147, 
+133, 81, 161, 65, 137, 179, 197, 
+209, 224, 131, 8, 154, 26, 63, 101, 
+206, 35, 137, 22, 61, 234, 130, 45, 
+143, 12, 230, 184, 9, 117, 56, 5, 
+114, 236, 80, 71, 83, 51, 195, 69, 
+152, 163, 41, 81, 192, 7, 108, 66, 
+135, 138, 0, 75, 19, 195, 131, 127, 
+104, 106, 90, 84, 5, 90, 22, 9, 76, 
+113, 2, 155, 224, 37, 220, 113, 168, 
+80, 66, 77, 117, 168, 135, 162, 
+208, 33, 134, 229, 210, 52, 48, 156, 
+17, 194, 203, 222, 141, 47, 220, 
+144, 20, 17, 19, 1, 176, 136, 84, 
+128, 196, 37, 200, 68, 7, 27, 49, 
+136, 73, 5, 96, 85, 175, 207, 227, 
+74, 18, 200, 224, 80, 3, 196, 204, 
+142, 142, 56, 32, 9, 18, 1, 0, 0, 
+31, 207, 228
+};
+int selftest_bitstream_size = sizeof(selftest_bitstream);
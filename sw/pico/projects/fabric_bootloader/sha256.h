@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+/** Constants
+*/
+#define SHA256_HASH_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+
+/** Incremental SHA-256 state.
+*/
+struct sha256_ctx
+{
+	uint32_t state[8];
+	uint64_t bitCount;
+	uint8_t buffer[SHA256_BLOCK_SIZE];
+	uint32_t bufferSz;
+};
+
+
+/** Reset hash state.
+@param sha256_ctx ctx 	Hash state to initialize.
+*/
+void sha256_init( struct sha256_ctx* ctx );
+
+
+/** Add data to hash.
+@param sha256_ctx ctx 	Hash state.
+@param uint8_t* data   Data to hash.
+@param uint32_t len   Size of data.
+*/
+void sha256_update( struct sha256_ctx* ctx, const uint8_t* data, uint32_t len );
+
+
+/** Finish hash and write digest.
+@param sha256_ctx ctx 	Hash state.
+@param uint8_t* hash   Output digest, SHA256_HASH_SIZE bytes.
+*/
+void sha256_final( struct sha256_ctx* ctx, uint8_t* hash );
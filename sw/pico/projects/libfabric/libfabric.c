@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
 #include "libfabric.h"
 
 /** Debug uart
@@ -15,6 +19,128 @@
 #endif
 
 
+/** LSC_CHECK_BUSY poll program, side-set drives sck, out mosi, in miso & set csn. The command word
+* is pulled once into y, each poll clocks it out MSB first & reads the busy byte, irq 0 rel is raised
+* once it reads zero. Pre-assembled so libfabric stays a drop in .c/.h pair without pioasm.
+*/
+static const uint16_t fpga_busy_poll_instructions[] = {
+	0x80a0, //  0: pull   block           side 0
+	0xa047, //  1: mov    y, osr          side 0
+	0xe000, //  2: set    pins, 0         side 0	; poll: csn low
+	0xa0e2, //  3: mov    osr, y          side 0
+	0xe03f, //  4: set    x, 31           side 0
+	0x6101, //  5: out    pins, 1         side 0 [1]
+	0x1145, //  6: jmp    x--, 5          side 1 [1]
+	0xe027, //  7: set    x, 7            side 0
+	0xa142, //  8: nop                    side 0 [1]
+	0x5001, //  9: in     pins, 1         side 1
+	0x1048, // 10: jmp    x--, 8          side 1
+	0xe001, // 11: set    pins, 1         side 0	; csn high
+	0xa026, // 12: mov    x, isr          side 0
+	0xa0c3, // 13: mov    isr, null       side 0
+	0x0030, // 14: jmp    !x, 16          side 0
+	0x0f02, // 15: jmp    2               side 0 [15]
+	0xc010, // 16: irq    nowait 0 rel    side 0
+	0x0011, // 17: jmp    17              side 0	; halt until disabled
+};
+
+static const struct pio_program fpga_busy_poll_program = {
+	.instructions = fpga_busy_poll_instructions,
+	.length = sizeof(fpga_busy_poll_instructions) / sizeof(uint16_t),
+	.origin = -1,
+};
+
+#define FPGA_PIO pio0
+#define FPGA_PIO_IRQ PIO0_IRQ_0
+#define FPGA_PIO_CYCLES_PER_BIT 4
+
+
+/** Config port master program, shares pio0 & its pins with the busy poll program. Each frame is two
+* header words, tx bits - 1 & rx bits - 1 ( all ones for none ), then tx bytes a fifo entry each. The
+* first frame takes csn low & it stays low over later frames until the cpu sets it high with the state
+* machine idle on the next header. mosi changes with sck low & miso is sampled as sck falls, 4 cycles
+* per bit. Autopull & autopush take 8 bits so DMA byte writes & byte reads map to fifo entries.
+*/
+static const uint16_t fpga_spi_instructions[] = {
+	0x6020, //  0: out    x, 32           side 0	; tx bits - 1, stalls here when idle
+	0xe000, //  1: set    pins, 0         side 0	; csn low
+	0x6040, //  2: out    y, 32           side 0	; rx bits - 1
+	0x6101, //  3: out    pins, 1         side 0 [1]
+	0x1143, //  4: jmp    x--, 3          side 1 [1]
+	0xa003, //  5: mov    pins, null      side 0	; mosi low while reading, x all ones
+	0x00a8, //  6: jmp    x!=y, 8         side 0
+	0x0000, //  7: jmp    0               side 0	; write only
+	0xb142, //  8: nop                    side 1 [1]
+	0x4001, //  9: in     pins, 1         side 0
+	0x0088, // 10: jmp    y--, 8          side 0
+};
+
+static const struct pio_program fpga_spi_program = {
+	.instructions = fpga_spi_instructions,
+	.length = sizeof(fpga_spi_instructions) / sizeof(uint16_t),
+	.origin = -1,
+};
+
+
+/** SPI flash emulator program, the design is master. in reads its command line, out & set drive the
+* answer line. The address is shifted in under 0x10 so the pushed word is its XIP address, a DMA channel
+* writes it to the data channel's read address trigger & the data channel feeds the tx fifo a byte per
+* entry. wait gpio 0 & 1 stand for csn & sck, the configured pins are patched in when loaded.
+*/
+static const uint16_t fpga_flash_emu_instructions[] = {
+	0xe080, //  0: set    pindirs, 0		; answer line released
+	0x2080, //  1: wait   1 gpio, 0			; deselected
+	0x2000, //  2: wait   0 gpio, 0			; selected
+	0xa0c3, //  3: mov    isr, null
+	0xe027, //  4: set    x, 7
+	0x2001, //  5: wait   0 gpio, 1			; command, sampled on sck rise
+	0x2081, //  6: wait   1 gpio, 1
+	0x4001, //  7: in     pins, 1
+	0x0045, //  8: jmp    x--, 5
+	0xa026, //  9: mov    x, isr
+	0xe04b, // 10: set    y, 11
+	0x00a0, // 11: jmp    x!=y, 0			; only FAST_READ, READ has no dummy clocks to cover an XIP miss
+	0xe03f, // 12: set    x, 31				; address & 8 dummy clocks
+	0xe050, // 13: set    y, 16
+	0xa0c2, // 14: mov    isr, y			; XIP_BASE >> 24
+	0x2001, // 15: wait   0 gpio, 1
+	0x2081, // 16: wait   1 gpio, 1
+	0x4001, // 17: in     pins, 1
+	0x8040, // 18: push   iffull noblock	; after the 24th address bit only
+	0x004f, // 19: jmp    x--, 15
+	0xe081, // 20: set    pindirs, 1
+	0x6060, // 21: out    null, 32			; drop what the last read left in osr
+	0x2001, // 22: wait   0 gpio, 1			; data, shifted out on sck fall
+	0x6001, // 23: out    pins, 1
+	0x2081, // 24: wait   1 gpio, 1
+};
+
+#define FPGA_EMU_PIO pio1
+#define FPGA_EMU_WRAP_TARGET 22
+#define FPGA_EMU_PROGRAM_SZ (sizeof(fpga_flash_emu_instructions) / sizeof(uint16_t))
+#define FPGA_EMU_DATA_COUNT (1u << 24)		// Reads run to the end of the XIP window
+#define FPGA_EMU_CTRL_COUNT 0x0fffffff		// Addresses taken before fpga_flash_emu_start re-arms
+
+
+/** Emulator program with the configured pins.
+*/
+static uint16_t _emu_instructions[FPGA_EMU_PROGRAM_SZ];
+static struct FPGA_config_t* _emu_config = 0;
+
+
+/** Config being waited on, completion interrupts update its wait_state.
+*/
+static struct FPGA_config_t* _wait_config = 0;
+static enum FPGAWaitMode _wait_mode = FPGA_WAIT_BUSY;
+static int _wait_uses_pio = 0;
+
+
+/** Chained DMA control blocks, transfer count & read address pairs written to the data channel's
+* alias 3 registers. A zero pair ends the chain.
+*/
+static uint32_t _iov_blocks[(FPGA_IOV_CHAIN_MAX + 1) * 2];
+
+
 static spi_inst_t * select_spi(int spiId) 
 {
 	switch(spiId)	
@@ -28,6 +154,208 @@ static spi_inst_t * select_spi(int spiId)
 }
 
 
+/** Pio master on the config port pins, csn high & sck low until the next frame.
+*/
+static void fpga_pio_spi_init_pins( struct FPGA_config_t* config )
+{
+	uint32_t pinMask = (1u << config->csn) | (1u << config->sck) | (1u << config->mosi);
+	
+	pio_sm_set_enabled(FPGA_PIO, config->spi_pio_sm, false);
+	pio_sm_set_pins_with_mask(FPGA_PIO, config->spi_pio_sm, 1u << config->csn, pinMask);
+	pio_sm_set_pindirs_with_mask(FPGA_PIO, config->spi_pio_sm, pinMask, pinMask | (1u << config->miso));
+	pio_gpio_init(FPGA_PIO, config->csn);
+	pio_gpio_init(FPGA_PIO, config->sck);
+	pio_gpio_init(FPGA_PIO, config->mosi);
+	gpio_init(config->miso);
+	pio_sm_set_enabled(FPGA_PIO, config->spi_pio_sm, true);
+}
+
+
+/** Pico as spi master on the config port.
+*/
+static void fpga_init_spi_pins( struct FPGA_config_t* config )
+{
+	if(config->spi_pio_sm >= 0)
+	{
+		fpga_pio_spi_init_pins( config );
+		return;
+	}
+	
+    gpio_set_function(config->miso, GPIO_FUNC_SPI);
+    gpio_set_function(config->sck, GPIO_FUNC_SPI);
+    gpio_set_function(config->mosi, GPIO_FUNC_SPI);
+
+    gpio_init(config->csn);
+    gpio_put(config->csn, 1);
+    gpio_set_dir(config->csn, GPIO_OUT);   
+}
+
+
+/** Claim a pio0 state machine & program space for the config port master.
+*/
+static int fpga_pio_spi_claim( struct FPGA_config_t* config )
+{
+	if(!pio_can_add_program(FPGA_PIO, &fpga_spi_program))
+		return 0;
+	config->spi_pio_sm = pio_claim_unused_sm(FPGA_PIO, false);
+	if(config->spi_pio_sm < 0)
+		return 0;
+	config->spi_pio_offset = pio_add_program(FPGA_PIO, &fpga_spi_program);
+	return 1;
+}
+
+
+/** Configure the master for the config pins & clock, then start it idle.
+*/
+static void fpga_pio_spi_configure( struct FPGA_config_t* config, uint32_t baudrate )
+{
+	float div = (float)clock_get_hz(clk_sys) / (FPGA_PIO_CYCLES_PER_BIT * (float)baudrate);
+	if(div < 1.0f)
+		div = 1.0f;
+	config->spi_pio_hz = (uint32_t)((float)clock_get_hz(clk_sys) / (FPGA_PIO_CYCLES_PER_BIT * div));
+	
+	pio_sm_config c = pio_get_default_sm_config();
+	sm_config_set_wrap(&c, config->spi_pio_offset, config->spi_pio_offset + fpga_spi_program.length - 1);
+	sm_config_set_sideset(&c, 1, false, false);
+	sm_config_set_sideset_pins(&c, config->sck);
+	sm_config_set_out_pins(&c, config->mosi, 1);
+	sm_config_set_in_pins(&c, config->miso);
+	sm_config_set_set_pins(&c, config->csn, 1);
+	sm_config_set_out_shift(&c, false, true, 8);
+	sm_config_set_in_shift(&c, false, true, 8);
+	sm_config_set_clkdiv(&c, div);
+	pio_sm_init(FPGA_PIO, config->spi_pio_sm, config->spi_pio_offset, &c);
+	fpga_pio_spi_init_pins( config );
+}
+
+
+/** Queue a frame header, tx bytes follow in the fifo & rxLen bytes come back after them.
+*/
+static void fpga_pio_spi_frame( struct FPGA_config_t* config, uint32_t txLen, uint32_t rxLen )
+{
+	pio_sm_put_blocking(FPGA_PIO, config->spi_pio_sm, txLen * 8 - 1);
+	pio_sm_put_blocking(FPGA_PIO, config->spi_pio_sm, rxLen * 8 - 1);
+}
+
+
+/** Wait until every queued frame is clocked out, the master then stalls on the next header.
+*/
+static void fpga_pio_spi_wait_idle( struct FPGA_config_t* config )
+{
+	uint32_t stallMask = 1u << (PIO_FDEBUG_TXSTALL_LSB + config->spi_pio_sm);
+	while(!pio_sm_is_tx_fifo_empty(FPGA_PIO, config->spi_pio_sm))
+		tight_loop_contents();
+	FPGA_PIO->fdebug = stallMask;
+	while(!(FPGA_PIO->fdebug & stallMask))
+		tight_loop_contents();
+}
+
+
+/** Write bytes without DMA, csn low for the spi block or inside a pio frame.
+*/
+static void fpga_spi_write_blocking( struct FPGA_config_t* config, const uint8_t* buf, uint32_t len )
+{
+	if(config->spi_pio_sm < 0)
+	{
+		spi_write_blocking(select_spi(config->spiId), buf, len);
+		return;
+	}
+	for(uint32_t i=0;i<len;i++)
+		pio_sm_put_blocking(FPGA_PIO, config->spi_pio_sm, (uint32_t)buf[i] << 24);
+}
+
+
+/** End a transaction, csn high once the master is idle.
+*/
+static void fpga_spi_deselect( struct FPGA_config_t* config )
+{
+	if(config->spi_pio_sm < 0)
+	{
+		gpio_put(config->csn, 1);
+		return;
+	}
+	
+	fpga_pio_spi_wait_idle( config );
+	pio_sm_set_enabled(FPGA_PIO, config->spi_pio_sm, false);
+	pio_sm_exec(FPGA_PIO, config->spi_pio_sm, pio_encode_set(pio_pins, 1));
+	pio_sm_set_enabled(FPGA_PIO, config->spi_pio_sm, true);
+}
+
+
+/** Point the tx DMA channel at the config port master.
+*/
+static void fpga_init_tx_dma( struct FPGA_config_t* config )
+{
+	if(config->dma_chan < 0)
+		return;
+	
+	dma_channel_config c = dma_channel_get_default_config(config->dma_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	if(config->spi_pio_sm >= 0)
+	{
+		channel_config_set_dreq(&c, pio_get_dreq(FPGA_PIO, config->spi_pio_sm, true));
+		dma_channel_configure(config->dma_chan, &c, &FPGA_PIO->txf[config->spi_pio_sm], 0, 0, false);
+		return;
+	}
+	channel_config_set_dreq(&c, spi_get_dreq(select_spi(config->spiId), true));
+	dma_channel_configure(config->dma_chan, &c, &spi_get_hw(select_spi(config->spiId))->dr, 0, 0, false);
+}
+
+
+static void fpga_pio_irq_handler( void )
+{
+	struct FPGA_config_t* config = _wait_config;
+	if(!config || config->pio_sm < 0 || !pio_interrupt_get(FPGA_PIO, config->pio_sm))
+		return;
+	
+	pio_interrupt_clear(FPGA_PIO, config->pio_sm);
+	if(config->wait_state == FPGA_WAIT_Pending)
+		config->wait_state = FPGA_WAIT_Complete;
+}
+
+
+static void fpga_gpio_irq_handler( void )
+{
+	struct FPGA_config_t* config = _wait_config;
+	if(!config)
+		return;
+	
+	if(config->done_pin >= 0 && (gpio_get_irq_event_mask(config->done_pin) & GPIO_IRQ_EDGE_RISE))
+	{
+		gpio_acknowledge_irq(config->done_pin, GPIO_IRQ_EDGE_RISE);
+		if(config->wait_state == FPGA_WAIT_Pending)
+			config->wait_state = FPGA_WAIT_Complete;
+	}
+	if(config->initn_pin >= 0 && (gpio_get_irq_event_mask(config->initn_pin) & GPIO_IRQ_EDGE_FALL))
+	{
+		gpio_acknowledge_irq(config->initn_pin, GPIO_IRQ_EDGE_FALL);
+		if(config->wait_state == FPGA_WAIT_Pending)
+			config->wait_state = FPGA_WAIT_Error;
+	}
+}
+
+
+/** Claim a PIO state machine for busy polling.
+*/
+static void fpga_init_wait_events( struct FPGA_config_t* config )
+{
+#if FPGA_PIO_BUSY_POLL
+	if(!pio_can_add_program(FPGA_PIO, &fpga_busy_poll_program))
+		return;
+	config->pio_sm = pio_claim_unused_sm(FPGA_PIO, false);
+	if(config->pio_sm < 0)
+		return;
+	config->pio_offset = pio_add_program(FPGA_PIO, &fpga_busy_poll_program);
+	
+	irq_add_shared_handler(FPGA_PIO_IRQ, fpga_pio_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+	pio_set_irq0_source_enabled(FPGA_PIO, pis_interrupt0 + config->pio_sm, true);
+	irq_set_enabled(FPGA_PIO_IRQ, true);
+#endif
+}
+
+
 int fpga_init_config( struct FPGA_config_t* config, enum FPGABoardId board_id )
 {
 	if(!config)
@@ -47,28 +375,154 @@ int fpga_init_config( struct FPGA_config_t* config, enum FPGABoardId board_id )
 	gpio_init(config->programn);	
     gpio_set_dir(config->programn, GPIO_OUT);
 	gpio_put(config->programn, 1);
-	sleep_ms(100);
 	
-    // Spi configured at 1 MHz
-    spi_init(select_spi(config->spiId), 1000000);
-    gpio_set_function(config->miso, GPIO_FUNC_SPI);
-    gpio_set_function(config->sck, GPIO_FUNC_SPI);
-    gpio_set_function(config->mosi, GPIO_FUNC_SPI);
-
-    gpio_init(config->csn);
-    gpio_put(config->csn, 1);
-    gpio_set_dir(config->csn, GPIO_OUT);   
+	// Pio master when enabled & free, else spi configured at 1 MHz
+	config->spi_pio_sm = -1;
+#if FPGA_PIO_SPI
+	if(fpga_pio_spi_claim( config ))
+		fpga_pio_spi_configure( config, FPGA_PIO_SPI_HZ );
+#endif
+	if(config->spi_pio_sm < 0)
+	{
+	    spi_init(select_spi(config->spiId), 1000000);
+	    fpga_init_spi_pins( config );
+	}
+	
+	// Tx DMA for bitstream blocks
+	config->dma_chan = -1;
+#if FPGA_SPI_DMA
+	config->dma_chan = dma_claim_unused_channel(false);
+	fpga_init_tx_dma( config );
+#endif
+	
+	// Segment list DMA, each pair written into the data channel triggers it
+	config->dma_ctrl_chan = -1;
+	if(config->dma_chan >= 0)
+		config->dma_ctrl_chan = dma_claim_unused_channel(false);
+	if(config->dma_ctrl_chan >= 0)
+	{
+		dma_channel_config c = dma_channel_get_default_config(config->dma_ctrl_chan);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+		channel_config_set_read_increment(&c, true);
+		channel_config_set_write_increment(&c, true);
+		channel_config_set_ring(&c, true, 3); // wrap on al3_transfer_count & al3_read_addr_trig
+		dma_channel_configure(config->dma_ctrl_chan, &c, &dma_hw->ch[config->dma_chan].al3_transfer_count, _iov_blocks, 2, false);
+	}
     
-	sleep_ms(50);
+	// Completion events, DONE & INITN edges when routed else PIO busy polling
+	config->done_pin = FPGA_DEFAULT_DONE;
+	config->initn_pin = FPGA_DEFAULT_INITN;
+	config->pio_sm = -1;
+	config->wait_state = FPGA_WAIT_Idle;
+	fpga_init_wait_events( config );
+	
+	// Flash emulator resources are claimed on first use
+	config->emu_sm = -1;
+	config->emu_state = FPGA_EMU_Off;
+	
+	// Settle time waited on first spi access
+	config->release_at_us = 0;
+	config->ready_at_us = time_us_64() + (FPGA_INIT_READY_MS * 1000);
 
 	return 1;
 }
 
 
+int fpga_init_pio_spi( struct FPGA_config_t* config, int csn, int sck, int mosi, int miso, uint32_t baudrate )
+{
+	fpga_write_bitstream_wait( config );
+	if(config->spi_pio_sm < 0)
+	{
+		if(!fpga_pio_spi_claim( config ))
+			return 0;
+		
+		// Spi block goes back to the application
+		spi_deinit(select_spi(config->spiId));
+	}
+	
+	int pins[] = { config->csn, config->sck, config->mosi, config->miso };
+	for(int i=0;i<4;i++)
+		gpio_init(pins[i]);
+	config->csn = csn;
+	config->sck = sck;
+	config->mosi = mosi;
+	config->miso = miso;
+	
+	fpga_pio_spi_configure( config, baudrate );
+	fpga_init_tx_dma( config );
+	return 1;
+}
+
+
+void fpga_reset_begin( struct FPGA_config_t* config )
+{
+	gpio_put(config->programn, 0);
+	config->release_at_us = time_us_64() + (FPGA_PROGRAMN_LOW_MS * 1000);
+	config->ready_at_us = config->release_at_us + (FPGA_PROGRAMN_READY_MS * 1000);
+}
+
+
+/** Take the spi pins back from the design, it tristates them while PROGRAMN is low.
+*/
+static void fpga_flash_emu_end( struct FPGA_config_t* config )
+{
+	fpga_flash_emu_stop( config );
+	fpga_reset_begin( config );
+	fpga_init_spi_pins( config );
+	config->emu_state = FPGA_EMU_Off;
+}
+
+
+void fpga_wait_ready( struct FPGA_config_t* config )
+{
+	if(config->emu_state != FPGA_EMU_Off)
+		fpga_flash_emu_end( config );
+	
+	if(config->release_at_us)
+	{
+		sleep_until( from_us_since_boot(config->release_at_us) );
+		gpio_put(config->programn, 1);
+		config->release_at_us = 0;
+	}
+	if(config->ready_at_us)
+	{
+		sleep_until( from_us_since_boot(config->ready_at_us) );
+		config->ready_at_us = 0;
+	}
+}
+
+
+/** Warm the XIP cache with the start of a bitstream stored in flash.
+*/
+static void fpga_prefetch_bitstream( uint8_t* buf, uint32_t len )
+{
+	if((uintptr_t)buf < XIP_BASE || (uintptr_t)buf >= XIP_BASE + PICO_FLASH_SIZE_BYTES)
+		return;
+	
+	if(len > FPGA_PREFETCH_BYTES)
+		len = FPGA_PREFETCH_BYTES;
+	
+	volatile uint8_t* addr = buf;
+	for(uint32_t i=0;i<len;i+=8) // cache line
+		(void)addr[i];
+}
+
+
 void fpga_read_spi( struct FPGA_config_t* config, uint8_t cmd, uint8_t *buf, uint32_t len) {
     uint8_t dataout[] = {
 		cmd
     };
+	fpga_wait_ready( config );
+	fpga_write_bitstream_wait( config );
+	if(config->spi_pio_sm >= 0)
+	{
+		fpga_pio_spi_frame( config, 1, len );
+		fpga_spi_write_blocking( config, dataout, 1 );
+		for(uint32_t i=0;i<len;i++)
+			buf[i] = (uint8_t)pio_sm_get_blocking(FPGA_PIO, config->spi_pio_sm);
+		fpga_spi_deselect( config );
+		return;
+	}
     gpio_put(config->csn, 0);
     spi_write_blocking(select_spi(config->spiId), dataout, 1);
     spi_read_blocking(select_spi(config->spiId), 0, buf, len);
@@ -76,6 +530,14 @@ void fpga_read_spi( struct FPGA_config_t* config, uint8_t cmd, uint8_t *buf, uin
 }
 
 
+uint32_t fpga_get_spi_baudrate( struct FPGA_config_t* config )
+{
+	if(config->spi_pio_sm >= 0)
+		return config->spi_pio_hz;
+	return spi_get_baudrate(select_spi(config->spiId));
+}
+
+
 uint32_t fpga_read_id( struct FPGA_config_t* config )
 {	  
 	uint8_t buf[8];
@@ -120,50 +582,336 @@ uint8_t fpga_poll_busy( struct FPGA_config_t* config )
 }
 
 
+/** Hand the spi pins to the busy poll state machine & start it.
+*/
+static void fpga_pio_poll_start( struct FPGA_config_t* config )
+{
+	uint32_t pinMask = (1u << config->csn) | (1u << config->sck) | (1u << config->mosi);
+	
+	pio_sm_config c = pio_get_default_sm_config();
+	sm_config_set_wrap(&c, config->pio_offset, config->pio_offset + fpga_busy_poll_program.length - 1);
+	sm_config_set_sideset(&c, 1, false, false);
+	sm_config_set_sideset_pins(&c, config->sck);
+	sm_config_set_out_pins(&c, config->mosi, 1);
+	sm_config_set_in_pins(&c, config->miso);
+	sm_config_set_set_pins(&c, config->csn, 1);
+	sm_config_set_out_shift(&c, false, false, 32);
+	sm_config_set_in_shift(&c, false, false, 32);
+	sm_config_set_clkdiv(&c, (float)clock_get_hz(clk_sys) / (FPGA_PIO_CYCLES_PER_BIT * (float)fpga_get_spi_baudrate( config )));
+	pio_sm_init(FPGA_PIO, config->pio_sm, config->pio_offset, &c);
+	
+	// Idle levels before the pins switch over, csn high & sck low
+	pio_sm_set_pins_with_mask(FPGA_PIO, config->pio_sm, 1u << config->csn, pinMask);
+	pio_sm_set_pindirs_with_mask(FPGA_PIO, config->pio_sm, pinMask, pinMask);
+	pio_gpio_init(FPGA_PIO, config->csn);
+	pio_gpio_init(FPGA_PIO, config->sck);
+	pio_gpio_init(FPGA_PIO, config->mosi);
+	
+	pio_interrupt_clear(FPGA_PIO, config->pio_sm);
+	pio_sm_put(FPGA_PIO, config->pio_sm, (uint32_t)FPGA_CMD_LSC_CHECK_BUSY << 24);
+	pio_sm_set_enabled(FPGA_PIO, config->pio_sm, true);
+}
+
+
+/** Stop busy polling & return the pins to spi, csn is driven high by sio before the switch. The pio
+* master takes them back with csn high as the poll may have stopped mid read.
+*/
+static void fpga_pio_poll_stop( struct FPGA_config_t* config )
+{
+	pio_sm_set_enabled(FPGA_PIO, config->pio_sm, false);
+	pio_sm_clear_fifos(FPGA_PIO, config->pio_sm);
+	
+	if(config->spi_pio_sm >= 0)
+	{
+		fpga_pio_spi_init_pins( config );
+		return;
+	}
+	gpio_put(config->csn, 1);
+	gpio_set_function(config->csn, GPIO_FUNC_SIO);
+	gpio_set_function(config->sck, GPIO_FUNC_SPI);
+	gpio_set_function(config->mosi, GPIO_FUNC_SPI);
+}
+
+
+void fpga_set_done_pins( struct FPGA_config_t* config, int done_pin, int initn_pin )
+{
+	config->done_pin = done_pin;
+	config->initn_pin = initn_pin;
+	
+	int pins[] = { done_pin, initn_pin };
+	for(int i=0;i<2;i++)
+	{
+		if(pins[i] < 0)
+			continue;
+		gpio_init(pins[i]);
+		gpio_set_dir(pins[i], GPIO_IN);
+		gpio_add_raw_irq_handler(pins[i], fpga_gpio_irq_handler);
+		irq_set_enabled(IO_IRQ_BANK0, true);
+	}
+}
+
+
+void fpga_wait_begin( struct FPGA_config_t* config, enum FPGAWaitMode mode )
+{
+	// Spi idle before the pins are shared
+	fpga_wait_ready( config );
+	fpga_write_bitstream_wait( config );
+	
+	_wait_config = config;
+	_wait_mode = mode;
+	_wait_uses_pio = 0;
+	config->wait_state = FPGA_WAIT_Pending;
+	
+	if(mode == FPGA_WAIT_DONE && config->done_pin >= 0)
+	{
+		gpio_acknowledge_irq(config->done_pin, GPIO_IRQ_EDGE_RISE);
+		gpio_set_irq_enabled(config->done_pin, GPIO_IRQ_EDGE_RISE, true);
+		if(config->initn_pin >= 0)
+		{
+			gpio_acknowledge_irq(config->initn_pin, GPIO_IRQ_EDGE_FALL);
+			gpio_set_irq_enabled(config->initn_pin, GPIO_IRQ_EDGE_FALL, true);
+		}
+		
+		// Edge may have passed before the irq was armed
+		if(gpio_get(config->done_pin))
+			config->wait_state = FPGA_WAIT_Complete;
+		return;
+	}
+	
+	if(config->pio_sm >= 0)
+	{
+		fpga_pio_poll_start( config );
+		_wait_uses_pio = 1;
+		return;
+	}
+	
+	config->wait_state = FPGA_WAIT_Polled;
+}
+
+
+int fpga_wait_poll( struct FPGA_config_t* config )
+{
+	return config->wait_state;
+}
+
+
+int fpga_wait_end( struct FPGA_config_t* config, uint32_t timeout_ms )
+{
+	absolute_time_t timeout = make_timeout_time_ms(timeout_ms);
+	
+	// No event source, bursts get the full settle time & DONE waits poll once as before
+	if(config->wait_state == FPGA_WAIT_Polled)
+	{
+		if(_wait_mode == FPGA_WAIT_BUSY)
+			sleep_until(timeout);
+		config->wait_state = FPGA_WAIT_Idle;
+		_wait_config = 0;
+		return fpga_poll_busy( config ) == 0;
+	}
+	
+	// Core sleeps until an interrupt completes the wait
+	while(config->wait_state == FPGA_WAIT_Pending)
+	{
+		if(best_effort_wfe_or_timeout(timeout))
+			break;
+	}
+	
+	int isComplete = config->wait_state == FPGA_WAIT_Complete;
+	DEBUG_PRINT("fpga_wait_end state: %d\r\n", config->wait_state);
+	
+	// Release event sources
+	if(config->done_pin >= 0)
+		gpio_set_irq_enabled(config->done_pin, GPIO_IRQ_EDGE_RISE, false);
+	if(config->initn_pin >= 0)
+		gpio_set_irq_enabled(config->initn_pin, GPIO_IRQ_EDGE_FALL, false);
+	if(_wait_uses_pio)
+		fpga_pio_poll_stop( config );
+	
+	config->wait_state = FPGA_WAIT_Idle;
+	_wait_config = 0;
+	return isComplete;
+}
+
+
+int fpga_wait_configured( struct FPGA_config_t* config )
+{
+	fpga_wait_begin( config, FPGA_WAIT_DONE );
+	return fpga_wait_end( config, FPGA_DONE_TIMEOUT_MS );
+}
+
+
 void fpga_write_bitstream_begin( struct FPGA_config_t* config )
 {	 
 	uint8_t burstCmd[] = { FPGA_CMD_LSC_BITSTREAM_BURST, 0, 0, 0 };		
-	gpio_put(config->csn, 0);
-	spi_write_blocking(select_spi(config->spiId), burstCmd, 4);
+	fpga_wait_ready( config );
+	fpga_write_bitstream_wait( config );
+	if(config->spi_pio_sm >= 0)
+		fpga_pio_spi_frame( config, 4, 0 );
+	else
+		gpio_put(config->csn, 0);
+	fpga_spi_write_blocking( config, burstCmd, 4 );
 }
 
 
 void fpga_write_bitstream_block( struct FPGA_config_t* config, uint8_t* data, uint32_t size )
 {	 
-	spi_write_blocking(select_spi(config->spiId), data, size);	
+	fpga_write_bitstream_block_async( config, data, size );
+	fpga_write_bitstream_wait( config );
+}
+
+
+void fpga_write_bitstream_block_async( struct FPGA_config_t* config, uint8_t* data, uint32_t size )
+{	 
+	// Previous block must finish first
+	fpga_write_bitstream_wait( config );
+	
+	// Pio frames carry their length, an empty one would read as the end of the header
+	if(config->spi_pio_sm >= 0)
+	{
+		if(!size)
+			return;
+		fpga_pio_spi_frame( config, size, 0 );
+	}
+	
+	if(config->dma_chan < 0)
+	{
+		fpga_spi_write_blocking( config, data, size );
+		return;
+	}
+	
+	dma_channel_set_read_addr(config->dma_chan, data, false);
+	dma_channel_set_trans_count(config->dma_chan, size, true);
+}
+
+
+void fpga_write_bitstream_wait( struct FPGA_config_t* config )
+{	 
+	if(config->spi_pio_sm >= 0)
+	{
+		if(config->dma_chan >= 0)
+			dma_channel_wait_for_finish_blocking(config->dma_chan);
+		fpga_pio_spi_wait_idle( config );
+		return;
+	}
+	if(config->dma_chan < 0)
+		return;
+	
+	spi_inst_t* spi = select_spi(config->spiId);
+	dma_channel_wait_for_finish_blocking(config->dma_chan);
+	
+	// Drain rx & clear overrun as spi_write_blocking does
+	while(spi_is_busy(spi))
+		tight_loop_contents();
+	while(spi_is_readable(spi))
+		(void)spi_get_hw(spi)->dr;
+	spi_get_hw(spi)->icr = SPI_SSPICR_RORIC_BITS;
+}
+
+
+void fpga_write_bitstream_iov( struct FPGA_config_t* config, const struct FPGA_iovec_t* iov, uint32_t cnt )
+{
+	fpga_write_bitstream_wait( config );
+	
+	if(config->dma_ctrl_chan < 0)
+	{
+		for(uint32_t i=0;i<cnt;i++)
+		{
+			if(iov[i].len)
+				fpga_write_bitstream_block_async( config, (uint8_t*)iov[i].buf, iov[i].len );
+		}
+		fpga_write_bitstream_wait( config );
+		return;
+	}
+	
+	// Data channel reloads from the control channel after each segment
+	dma_channel_config c = dma_get_channel_config(config->dma_chan);
+	channel_config_set_chain_to(&c, config->dma_ctrl_chan);
+	dma_channel_set_config(config->dma_chan, &c, false);
+	
+	while(cnt)
+	{
+		uint32_t blockCnt = 0;
+		uint32_t runLen = 0;
+		for(;cnt && blockCnt < FPGA_IOV_CHAIN_MAX;iov++, cnt--)
+		{
+			if(!iov->len)
+				continue;
+			_iov_blocks[blockCnt * 2] = iov->len;
+			_iov_blocks[blockCnt * 2 + 1] = (uint32_t)(uintptr_t)iov->buf;
+			runLen += iov->len;
+			blockCnt++;
+		}
+		if(!blockCnt)
+			break;
+		
+		// One pio frame for the whole run
+		if(config->spi_pio_sm >= 0)
+			fpga_pio_spi_frame( config, runLen, 0 );
+		
+		// Null trigger ends the chain
+		_iov_blocks[blockCnt * 2] = 0;
+		_iov_blocks[blockCnt * 2 + 1] = 0;
+		
+		dma_channel_set_read_addr(config->dma_ctrl_chan, _iov_blocks, true);
+		
+		// Done once the null pair is loaded & the last segment is out
+		uintptr_t end = (uintptr_t)&_iov_blocks[(blockCnt + 1) * 2];
+		while(dma_hw->ch[config->dma_ctrl_chan].read_addr != end || dma_channel_is_busy(config->dma_ctrl_chan) || dma_channel_is_busy(config->dma_chan))
+			tight_loop_contents();
+	}
+	
+	// Chaining to itself disables it
+	channel_config_set_chain_to(&c, config->dma_chan);
+	dma_channel_set_config(config->dma_chan, &c, false);
+	
+	fpga_write_bitstream_wait( config );
 }
 
 
 void fpga_write_bitstream_end( struct FPGA_config_t* config )
 {	 	
-	gpio_put(config->csn, 1);
-	sleep_ms(100);
+	fpga_write_bitstream_wait( config );
+	fpga_spi_deselect( config );
+	
+	// Wait for the burst to be processed
+	fpga_wait_begin( config, FPGA_WAIT_BUSY );
+	fpga_wait_end( config, FPGA_BUSY_TIMEOUT_MS );
 }
 
 
 void fpga_write_bitstream( struct FPGA_config_t* config, uint8_t* buf, uint32_t len )
 {	 
 	// Burst write bitstream
-	uint8_t burstCmd[] = { FPGA_CMD_LSC_BITSTREAM_BURST, 0, 0, 0 };		
-	gpio_put(config->csn, 0);
-	spi_write_blocking(select_spi(config->spiId), burstCmd, 4); // Write cmd
-	spi_write_blocking(select_spi(config->spiId), buf, len); // Write bitstream payload	in burst
-	gpio_put(config->csn, 1);
-
-	sleep_ms(100);
+	fpga_write_bitstream_begin( config );
+	fpga_write_bitstream_block( config, buf, len );
+	fpga_write_bitstream_end( config );
 }
 
 
 int fpga_program_device( struct FPGA_config_t* config, uint8_t* buf, uint32_t len )
+{
+	struct FPGA_iovec_t iov = { buf, len };
+	return fpga_program_device_iov( config, &iov, 1 );
+}
+
+
+int fpga_program_device_iov( struct FPGA_config_t* config, const struct FPGA_iovec_t* iov, uint32_t cnt )
 {
 	uint8_t isBusy;
 
 	// Enter programming mode
 	DEBUG_PRINT("Toggle FPGA_PROGRAMN_PIN (Enter init mode)\r\n");
-	gpio_put(config->programn, 0);
-	sleep_ms(100);		
-	gpio_put(config->programn, 1);
-	sleep_ms(100);
+	fpga_reset_begin( config );
+	
+	// Prefetch while in reset, flash segments up to FPGA_PREFETCH_BYTES in total
+	uint32_t prefetchLen = FPGA_PREFETCH_BYTES;
+	for(uint32_t i=0;i<cnt && prefetchLen;i++)
+	{
+		uint32_t len = iov[i].len < prefetchLen ? iov[i].len : prefetchLen;
+		fpga_prefetch_bitstream( (uint8_t*)iov[i].buf, len );
+		prefetchLen -= len;
+	}
+	fpga_wait_ready( config );
 
 	// Validate device id
 	uint32_t deviceId = fpga_read_id( config );
@@ -198,15 +946,16 @@ int fpga_program_device( struct FPGA_config_t* config, uint8_t* buf, uint32_t le
 	// Enter ISC mode	
 	fpga_isc_enable( config );
 	
-	// Write bitstream
-	fpga_write_bitstream( config, buf, len );
+	// Write bitstream segments as one burst
+	fpga_write_bitstream_begin( config );
+	fpga_write_bitstream_iov( config, iov, cnt );
+	fpga_write_bitstream_end( config );
 	
 	// Disable ISB mode
 	fpga_isc_disable( config );
 
 	// Check complete
-	isBusy = fpga_poll_busy( config );	
-	if(isBusy)
+	if(!fpga_wait_configured( config ))
 	{
 		DEBUG_PRINT("Device busy\r\n"); 
 		return 0;
@@ -216,6 +965,152 @@ int fpga_program_device( struct FPGA_config_t* config, uint8_t* buf, uint32_t le
 }
 
 
+/** Back to waiting for the next select, drops whatever the last read left in the fifos.
+*/
+static void __not_in_flash_func(fpga_flash_emu_restart)( struct FPGA_config_t* config )
+{
+	pio_sm_set_enabled(FPGA_EMU_PIO, config->emu_sm, false);
+	pio_sm_exec(FPGA_EMU_PIO, config->emu_sm, pio_encode_set(pio_pindirs, 0));
+	dma_channel_abort(config->emu_dma_chan);
+	pio_sm_clear_fifos(FPGA_EMU_PIO, config->emu_sm);
+	pio_sm_restart(FPGA_EMU_PIO, config->emu_sm);
+	pio_sm_exec(FPGA_EMU_PIO, config->emu_sm, pio_encode_jmp(config->emu_offset));
+	pio_sm_set_enabled(FPGA_EMU_PIO, config->emu_sm, true);
+}
+
+
+/** csn rise ends a read, the state machine can't see it while waiting on sck.
+*/
+static void __not_in_flash_func(fpga_flash_emu_irq_handler)( void )
+{
+	struct FPGA_config_t* config = _emu_config;
+	if(!config || !(gpio_get_irq_event_mask(config->csn) & GPIO_IRQ_EDGE_RISE))
+		return;
+	
+	gpio_acknowledge_irq(config->csn, GPIO_IRQ_EDGE_RISE);
+	if(config->emu_state == FPGA_EMU_Serving)
+		fpga_flash_emu_restart( config );
+}
+
+
+/** Claim a pio1 state machine, load the program with the configured pins & claim the DMA channels.
+*/
+static int fpga_flash_emu_claim( struct FPGA_config_t* config )
+{
+	for(int i=0;i<FPGA_EMU_PROGRAM_SZ;i++)
+	{
+		uint16_t instr = fpga_flash_emu_instructions[i];
+		if((instr & 0xe060) == 0x2000) // wait gpio
+			instr = (instr & ~0x1f) | ((instr & 1) ? config->sck : config->csn);
+		_emu_instructions[i] = instr;
+	}
+	struct pio_program program = {
+		.instructions = _emu_instructions,
+		.length = FPGA_EMU_PROGRAM_SZ,
+		.origin = -1,
+	};
+	
+	if(!pio_can_add_program(FPGA_EMU_PIO, &program))
+		return 0;
+	int sm = pio_claim_unused_sm(FPGA_EMU_PIO, false);
+	if(sm < 0)
+		return 0;
+	int dmaChan = dma_claim_unused_channel(false);
+	int dmaCtrlChan = dma_claim_unused_channel(false);
+	if(dmaChan < 0 || dmaCtrlChan < 0)
+	{
+		if(dmaChan >= 0)
+			dma_channel_unclaim(dmaChan);
+		if(dmaCtrlChan >= 0)
+			dma_channel_unclaim(dmaCtrlChan);
+		pio_sm_unclaim(FPGA_EMU_PIO, sm);
+		return 0;
+	}
+	config->emu_sm = sm;
+	config->emu_dma_chan = dmaChan;
+	config->emu_dma_ctrl_chan = dmaCtrlChan;
+	config->emu_offset = pio_add_program(FPGA_EMU_PIO, &program);
+	
+	// Address pushed after 24 bits, answer bytes pulled one per fifo entry MSB first
+	pio_sm_config c = pio_get_default_sm_config();
+	sm_config_set_wrap(&c, config->emu_offset + FPGA_EMU_WRAP_TARGET, config->emu_offset + FPGA_EMU_PROGRAM_SZ - 1);
+	sm_config_set_in_pins(&c, config->miso);
+	sm_config_set_out_pins(&c, config->mosi, 1);
+	sm_config_set_set_pins(&c, config->mosi, 1);
+	sm_config_set_in_shift(&c, false, false, 24);
+	sm_config_set_out_shift(&c, false, true, 8);
+	pio_sm_init(FPGA_EMU_PIO, sm, config->emu_offset, &c);
+	
+	// Data channel, byte writes fill every lane of the fifo entry
+	dma_channel_config dc = dma_channel_get_default_config(dmaChan);
+	channel_config_set_transfer_data_size(&dc, DMA_SIZE_8);
+	channel_config_set_read_increment(&dc, true);
+	channel_config_set_write_increment(&dc, false);
+	channel_config_set_dreq(&dc, pio_get_dreq(FPGA_EMU_PIO, sm, true));
+	dma_channel_configure(dmaChan, &dc, &FPGA_EMU_PIO->txf[sm], (const void*)XIP_BASE, FPGA_EMU_DATA_COUNT, false);
+	
+	// Control channel, each address triggers the data channel
+	dma_channel_config cc = dma_channel_get_default_config(dmaCtrlChan);
+	channel_config_set_transfer_data_size(&cc, DMA_SIZE_32);
+	channel_config_set_read_increment(&cc, false);
+	channel_config_set_write_increment(&cc, false);
+	channel_config_set_dreq(&cc, pio_get_dreq(FPGA_EMU_PIO, sm, false));
+	dma_channel_configure(dmaCtrlChan, &cc, &dma_hw->ch[dmaChan].al3_read_addr_trig, &FPGA_EMU_PIO->rxf[sm], FPGA_EMU_CTRL_COUNT, false);
+	
+	_emu_config = config;
+	gpio_add_raw_irq_handler(config->csn, fpga_flash_emu_irq_handler);
+	irq_set_enabled(IO_IRQ_BANK0, true);
+	return 1;
+}
+
+
+int fpga_flash_emu_start( struct FPGA_config_t* config )
+{
+	if(config->emu_state == FPGA_EMU_Serving)
+		return 1;
+	if(config->emu_sm < 0 && !fpga_flash_emu_claim( config ))
+		return 0;
+	
+	// Finish spi work, then the design drives csn, sck & the command line
+	fpga_write_bitstream_wait( config );
+	gpio_init(config->csn);
+	gpio_init(config->sck);
+	gpio_init(config->miso);
+	pio_sm_set_consecutive_pindirs(FPGA_EMU_PIO, config->emu_sm, config->mosi, 1, false);
+	pio_gpio_init(FPGA_EMU_PIO, config->mosi);
+	config->emu_state = FPGA_EMU_Serving;
+	
+	dma_channel_set_trans_count(config->emu_dma_ctrl_chan, FPGA_EMU_CTRL_COUNT, true);
+	fpga_flash_emu_restart( config );
+	gpio_acknowledge_irq(config->csn, GPIO_IRQ_EDGE_RISE);
+	gpio_set_irq_enabled(config->csn, GPIO_IRQ_EDGE_RISE, true);
+	return 1;
+}
+
+
+void fpga_flash_emu_stop( struct FPGA_config_t* config )
+{
+	if(config->emu_state != FPGA_EMU_Serving)
+		return;
+	
+	gpio_set_irq_enabled(config->csn, GPIO_IRQ_EDGE_RISE, false);
+	pio_sm_set_enabled(FPGA_EMU_PIO, config->emu_sm, false);
+	pio_sm_exec(FPGA_EMU_PIO, config->emu_sm, pio_encode_set(pio_pindirs, 0));
+	dma_channel_abort(config->emu_dma_ctrl_chan);
+	dma_channel_abort(config->emu_dma_chan);
+	pio_sm_clear_fifos(FPGA_EMU_PIO, config->emu_sm);
+	config->emu_state = FPGA_EMU_Released;
+}
+
+
+uint32_t fpga_flash_emu_read_count( struct FPGA_config_t* config )
+{
+	if(config->emu_sm < 0)
+		return 0;
+	return FPGA_EMU_CTRL_COUNT - dma_channel_hw_addr(config->emu_dma_ctrl_chan)->transfer_count;
+}
+
+
 int libfabric_debug_init( int uartId, int txPin )
 {
 #if FABRIC_DEBUG	
@@ -5,6 +5,33 @@
 //#define FABRIC_DEBUG 1
 
 
+/** Stream bitstream blocks to spi with DMA, enabled by default on RP2350 which has channels to spare.
+*/
+#ifndef FPGA_SPI_DMA
+#if PICO_RP2350
+#define FPGA_SPI_DMA 1
+#else
+#define FPGA_SPI_DMA 0
+#endif
+#endif
+
+
+/** Detect configuration completion with a PIO state machine polling LSC_CHECK_BUSY when DONE isn't
+* routed to a gpio. Disable to keep all PIO state machines free, waits then fall back to fixed sleeps.
+*/
+#ifndef FPGA_PIO_BUSY_POLL
+#define FPGA_PIO_BUSY_POLL 1
+#endif
+
+
+/** Drive the config port from a pio0 state machine instead of the hardware spi block, on any pins &
+* at up to clk_sys / 4, see fpga_init_pio_spi. Falls back to the spi block when pio0 is full.
+*/
+#ifndef FPGA_PIO_SPI
+#define FPGA_PIO_SPI 0
+#endif
+
+
 /** Supported board Ids
 */
 enum FPGABoardId {
@@ -49,10 +76,64 @@ typedef struct FPGA_config_t
     int programn;
     int spiId;
     int is_initialized;
+    int spi_pio_sm;            // Config port master state machine on pio0, -1 when the hardware spi block is master
+    int spi_pio_offset;        // Master program offset
+    uint32_t spi_pio_hz;       // Master sck
     enum FPGABoardId board_id;
+    uint64_t release_at_us;    // PROGRAMN released at this time when set, see fpga_reset_begin
+    uint64_t ready_at_us;      // Spi access waits until this time when set, see fpga_wait_ready
+    int dma_chan;              // Spi tx DMA channel, -1 when blocks are written by the cpu
+    int dma_ctrl_chan;         // Reloads dma_chan from a segment list, -1 when segments are started one by one
+    int done_pin;              // DONE gpio, -1 when not routed to the Pico
+    int initn_pin;             // INITN gpio, -1 when not routed to the Pico
+    int pio_sm;                // LSC_CHECK_BUSY poll state machine on pio0, -1 when none free
+    int pio_offset;            // Poll program offset
+    volatile int wait_state;   // FPGAWaitState, set from interrupt
+    int emu_sm;                // Flash emulator state machine on pio1, -1 until fpga_flash_emu_start claims one
+    int emu_offset;            // Flash emulator program offset
+    int emu_dma_chan;          // Flash to emulator tx fifo
+    int emu_dma_ctrl_chan;     // Read address from emulator rx fifo into emu_dma_chan
+    int emu_state;             // FPGAFlashEmuState
 } FPGA_config;
 
 
+/** Completion wait, see fpga_wait_begin.
+*/
+enum FPGAWaitMode
+{
+    FPGA_WAIT_BUSY = 0,         // Bitstream burst processed, LSC_CHECK_BUSY clear
+    FPGA_WAIT_DONE = 1          // Configured after ISC_DISABLE, DONE high when routed
+};
+
+enum FPGAWaitState
+{
+    FPGA_WAIT_Idle = 0,
+    FPGA_WAIT_Pending,          // Waiting on an interrupt
+    FPGA_WAIT_Polled,           // No event source, fpga_wait_end sleeps & polls once
+    FPGA_WAIT_Complete,
+    FPGA_WAIT_Error             // INITN fell
+};
+
+
+/** Who owns the spi pins, see fpga_flash_emu_start.
+*/
+enum FPGAFlashEmuState
+{
+    FPGA_EMU_Off = 0,           // Pico is spi master, the config port
+    FPGA_EMU_Serving,           // Design drives csn & sck, reads are answered from Pico flash
+    FPGA_EMU_Released           // Design still owns the pins, reads go unanswered
+};
+
+
+/** Bitstream segment, see fpga_program_device_iov. buf may point to RAM or XIP flash.
+*/
+struct FPGA_iovec_t
+{
+    const uint8_t* buf;
+    uint32_t len;
+};
+
+
 /** Default FPGA HW pin mapping
 */
 #define FPGA_DEFAULT_CSN 13
@@ -61,15 +142,61 @@ typedef struct FPGA_config_t
 #define FPGA_DEFAULT_MISO 12
 #define FPGA_DEFAULT_PROGRAMN 15
 #define FPGA_DEFAULT_SPIID 1
+#define FPGA_DEFAULT_DONE -1
+#define FPGA_DEFAULT_INITN -1
 
 
-/** Initialise the FPGA default configuration object.
+/** Reset & power up timings
+*/
+#define FPGA_INIT_READY_MS 150      // Settle time after init before first spi access
+#define FPGA_PROGRAMN_LOW_MS 100    // PROGRAMN low pulse
+#define FPGA_PROGRAMN_READY_MS 100  // Wait after PROGRAMN release before spi access
+#define FPGA_PREFETCH_BYTES (16 * 1024) // Bitstream bytes warmed in the XIP cache during reset
+#define FPGA_BUSY_TIMEOUT_MS 100    // Max wait for a burst to be processed, the old fixed sleep
+#define FPGA_DONE_TIMEOUT_MS 100    // Max wait for DONE after ISC_DISABLE
+#define FPGA_IOV_CHAIN_MAX 16       // Segments per chained DMA run, longer lists run back to back
+#define FPGA_EMU_FAST_READ_CMD 0x0B // Flash emulator FAST_READ, 8 dummy clocks after the address, READ isn't answered
+#ifndef FPGA_PIO_SPI_HZ
+#define FPGA_PIO_SPI_HZ 24000000    // Pio master sck with FPGA_PIO_SPI, the ECP5 takes more but board wiring sets the limit
+#endif
+
+
+/** Initialise the FPGA default configuration object. Does not block, the power up settle time
+* is waited for on first spi access so callers can do other work in the meantime.
 @param FPGA_config_t config 	Configuration struct to initialize.
 @returns int    Configuration success.
 */
 int fpga_init_config( struct FPGA_config_t* config, enum FPGABoardId board_id );
 
 
+/** Make a pio0 state machine the config port master on the given pins, csn is sequenced by the state
+* machine & bitstream blocks stream to its fifo by DMA. The hardware spi block is released for the
+* application. Call between spi accesses, again to move pins or change the clock.
+@param FPGA_config_t config 	Configuration object.
+@param int csn   Chip select gpio.
+@param int sck   Clock gpio.
+@param int mosi   FPGA data in gpio.
+@param int miso   FPGA data out gpio.
+@param uint32_t baudrate   Requested sck in Hz, rounded down to a divider of clk_sys / 4.
+@returns int    1 when switched, 0 when no pio0 state machine or program space is free.
+*/
+int fpga_init_pio_spi( struct FPGA_config_t* config, int csn, int sck, int mosi, int miso, uint32_t baudrate );
+
+
+/** Begin FPGA reset by pulling PROGRAMN low, returns without waiting. The release and ready wait
+* happen in fpga_wait_ready which every spi access calls, so work done between the two overlaps the reset window.
+@param FPGA_config_t config 	Configuration object.
+*/
+void fpga_reset_begin( struct FPGA_config_t* config );
+
+
+/** Wait for a pending init or reset to complete, releases PROGRAMN when due. Ends flash emulation
+* first, the FPGA is reset so the design lets go of the spi pins.
+@param FPGA_config_t config 	Configuration object.
+*/
+void fpga_wait_ready( struct FPGA_config_t* config );
+
+
 /** Read data from the FPGA over spi.
 @param FPGA_config_t config 	Configuration object.
 @param uint8_t config   Command to execute. see FPGACommands.
@@ -79,6 +206,13 @@ int fpga_init_config( struct FPGA_config_t* config, enum FPGABoardId board_id );
 void fpga_read_spi( struct FPGA_config_t* config, uint8_t cmd, uint8_t *buf, uint32_t len);
 
 
+/** Get current FPGA spi clock.
+@param FPGA_config_t config 	Configuration object.
+@returns uint32_t    Returns spi clock in Hz.
+*/
+uint32_t fpga_get_spi_baudrate( struct FPGA_config_t* config );
+
+
 /** Read FPGA device ID. 
 @param FPGA_config_t config 	Configuration object.
 @returns uint32_t    Returns read device id eg. FPGA_DEVID_LFE5U_12
@@ -112,6 +246,46 @@ void fpga_isc_disable( struct FPGA_config_t* config );
 uint8_t fpga_poll_busy( struct FPGA_config_t* config );
 
 
+/** Route DONE & INITN gpios, completion waits then use their edges instead of busy polling.
+@param FPGA_config_t config 	Configuration object.
+@param int done_pin   DONE gpio or -1.
+@param int initn_pin   INITN gpio or -1.
+*/
+void fpga_set_done_pins( struct FPGA_config_t* config, int done_pin, int initn_pin );
+
+
+/** Start waiting for the FPGA without using the cpu. DONE & INITN gpio edges raise interrupts when
+* routed, otherwise a PIO state machine polls LSC_CHECK_BUSY & interrupts once clear. The spi pins
+* belong to the PIO until fpga_wait_end.
+@param FPGA_config_t config 	Configuration object.
+@param FPGAWaitMode mode   What to wait for.
+*/
+void fpga_wait_begin( struct FPGA_config_t* config, enum FPGAWaitMode mode );
+
+
+/** Check a wait started by fpga_wait_begin without blocking.
+@param FPGA_config_t config 	Configuration object.
+@returns int    FPGAWaitState.
+*/
+int fpga_wait_poll( struct FPGA_config_t* config );
+
+
+/** Sleep until the wait completes or times out & return the spi pins. Without an event source this
+* sleeps the full timeout then polls busy once.
+@param FPGA_config_t config 	Configuration object.
+@param uint32_t timeout_ms   Max wait.
+@returns int    1 when complete, 0 on timeout or INITN error.
+*/
+int fpga_wait_end( struct FPGA_config_t* config, uint32_t timeout_ms );
+
+
+/** Wait for configuration to complete after ISC_DISABLE, replaces a single fpga_poll_busy.
+@param FPGA_config_t config 	Configuration object.
+@returns int    1 when configured.
+*/
+int fpga_wait_configured( struct FPGA_config_t* config );
+
+
 /** Being writing bitstream, device must be in ISC mode before calling. 
 * Used in combination with fpga_write_bitstream_block & fpga_write_bitstream_end.
 @param FPGA_config_t config 	Configuration object.
@@ -128,6 +302,30 @@ void fpga_write_bitstream_begin( struct FPGA_config_t* config );
 void fpga_write_bitstream_block( struct FPGA_config_t* config, uint8_t* buf, uint32_t len );
 
 
+/** Start writing bitstream block to fpga and return while DMA streams it, the buffer must stay valid
+* until the next spi access or fpga_write_bitstream_wait. Falls back to a blocking write without DMA.
+@param FPGA_config_t config 	Configuration object.
+@param uint8_t* buf   Buffer block to write.
+@param uint32_t len   Size of buffer block to write.
+*/
+void fpga_write_bitstream_block_async( struct FPGA_config_t* config, uint8_t* buf, uint32_t len );
+
+
+/** Wait for an async bitstream block write to finish.
+@param FPGA_config_t config 	Configuration object.
+*/
+void fpga_write_bitstream_wait( struct FPGA_config_t* config );
+
+
+/** Write bitstream segments in order as one burst, called between fpga_write_bitstream_begin &
+* fpga_write_bitstream_end. With DMA a control channel chains the segments without cpu involvement.
+@param FPGA_config_t config 	Configuration object.
+@param FPGA_iovec_t iov   Segments to write, empty segments are skipped.
+@param uint32_t cnt   Number of segments.
+*/
+void fpga_write_bitstream_iov( struct FPGA_config_t* config, const struct FPGA_iovec_t* iov, uint32_t cnt );
+
+
 /** End writing bitstream.
 @param FPGA_config_t config 	Configuration object.
 */
@@ -150,6 +348,42 @@ void fpga_write_bitstream( struct FPGA_config_t* config, uint8_t* buf, uint32_t
 int fpga_program_device( struct FPGA_config_t* config, uint8_t* buf, uint32_t len );
 
 
+/** Program the FPGA with a bitstream split over several buffers, e.g. a header in RAM followed by
+* the body in XIP flash. Segments are streamed in one burst without being copied together.
+@param FPGA_config_t config 	Configuration object.
+@param FPGA_iovec_t iov   Bitstream segments in order.
+@param uint32_t cnt   Number of segments.
+*/
+int fpga_program_device_iov( struct FPGA_config_t* config, const struct FPGA_iovec_t* iov, uint32_t cnt );
+
+
+/** Serve a configured design's soft core as its SPI flash. The design becomes spi master on the config
+* port: it drives csn, sck & commands on the miso pin, the Pico answers on the mosi pin. FAST_READ
+* (mode 0 or 3, 24 bit address) returns Pico flash from that flash offset, other commands are ignored.
+* The address goes from PIO to DMA to the XIP read without the cpu, so the first data bit is limited
+* by the XIP fetch: FAST_READ's dummy clocks cover a cache miss up to ~12MHz sck. READ has no dummy
+* clocks and was corrupt at every sck from 1MHz on a cold cache, so it isn't answered. Reads run to
+* any length, csn high restarts the state machine from an interrupt & bounds the gap between reads.
+* Any later spi access from the Pico resets the FPGA to take the pins back, see fpga_wait_ready.
+@param FPGA_config_t config 	Configuration object.
+@returns int    1 when serving, 0 when no pio1 state machine, program space or DMA channels are free.
+*/
+int fpga_flash_emu_start( struct FPGA_config_t* config );
+
+
+/** Stop answering reads, the pins stay with the design. Flash writes must stop the emulator first as
+* XIP is down while they run.
+@param FPGA_config_t config 	Configuration object.
+*/
+void fpga_flash_emu_stop( struct FPGA_config_t* config );
+
+
+/** Reads answered since fpga_flash_emu_start.
+@param FPGA_config_t config 	Configuration object.
+*/
+uint32_t fpga_flash_emu_read_count( struct FPGA_config_t* config );
+
+
 /** [internal] Init debug log port
 */
 int libfabric_debug_init( int uartId, int txPin );
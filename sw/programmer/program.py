@@ -18,9 +18,42 @@ Options:
     to determin the port if auto detection fails or multiple devices used.
     $ program.py --port=COM6 bitstream.bit
 
-    Option to save the bitstream to flash
+    Option to save the bitstream to flash, the upload is skipped when flash
+    already holds the same image (use --force to always upload)
     $ program.py --save=1 bitstream.bit
 
+    Benchmark device pipeline stages against a per board baseline
+    $ program.py --selftest-perf --perfbaseline=baseline.json
+
+    Share attached boards between jobs, each job goes to a board already
+    holding its image when one is free enough
+    $ program.py --farm-daemon
+
+    Farm daemon with an OpenMetrics endpoint at http://host:9464/metrics
+    $ program.py --farm-daemon --farm-metrics-port=9464
+    $ program.py --farm=farmhost --farm-exec="run_tests.sh" bitstream.bit
+
+    Clone the stored image of one board onto others, targets are programmed
+    in parallel & keep the image in flash
+    $ program.py clone --from=e6614103e7452d2f --to=e6614103e7452d30 --to=e6614103e7452d31
+
+    Personalize a design while it programs, e.g. USERCODE & BRAM contents. Stored
+    images are patched by the device as they stream from flash
+    $ program.py --cache --patch=board7.json bitstream.bit
+    board7.json: [ { "usercode": "0x00000007" }, { "ebr": 2, "offset": 0, "data": "0a0b" } ]
+
+    Update the bootloader of every attached board over the protocol, boards
+    running a known earlier build only get the difference
+    $ program.py --selfupdate=fabric_bootloader.uf2 --update-base=previous.uf2
+
+    Configure a design with a soft core & serve its firmware as spi flash from
+    the programmer, the core boots from the flash offset that is logged
+    $ program.py soc.bit --flash-emu=firmware.bin
+
+    Reboot the programmer & carry on once it has re-enumerated, the port is
+    found again from usb hotplug events by the board uid
+    $ program.py -r bitstream.bit
+
 Dependencies:
     pyserial
     
@@ -33,9 +66,65 @@ IGNORE_PORTS = ['COM1']
 PREFERRED_PROBE_PORTS = { 'Linux': ['/dev/ttyACM*'], 'Darwin': ['/dev/cu.usbmodem*'] } # auto probe check ports first
 SERIAL_FAST_TIMEOUT = 0.1
 SERIAL_NORMAL_TIMEOUT = 2.5
+DEFAULT_MAX_BLOCK_SZ = 4096 - 32 # block size taken by programmers that don't report one
+FEATURE_EARLY_ACK = 0x01 # device acks blocks on receipt & reports errors later
+FEATURE_BLOCK_STORE = 0x02 # device dedups blocks in flash & takes blocks by key
+BLOCK_KEY_SIZE = 24 # leading sha256 bytes identifying a block
+MAX_QUERY_KEYS = 128 # keys per QueryBlockKeys
+FEATURE_IMAGE_CACHE = 0x04 # device programs stored images by hash & replaces the least recently used
+FEATURE_IMAGE_LIST = 0x08 # device reports stored & configured image hashes
+FEATURE_BATCH = 0x10 # device runs several commands from one frame
+FEATURE_SELFTEST = 0x20 # device configures a self test design built into the bootloader
+FEATURE_PATCH = 0x40 # device patches images it programs from flash
+FEATURE_FLASH_STATUS = 0x80 # device chunks flash writes & reports their stalls
+FEATURE_READBACK = 0x0100 # device reads back stored images, extended flags sit above the first byte
+FEATURE_SELF_UPDATE = 0x0200 # device stages & swaps in a new bootloader streamed over the protocol
+FEATURE_FLASH_EMU = 0x0400 # device serves an image in its flash to the configured design as spi flash
+FLASH_EMU_MODE_QUERY = 0
+FLASH_EMU_MODE_START = 1
+FLASH_EMU_MODE_STOP = 2
+FLASH_EMU_FAST_READ_CMD = 0x0B # spi flash command the emulator answers, 24 bit address & 8 dummy clocks
+FLASH_EMU_READ_CMD = 0x03 # not answered, without dummy clocks an XIP miss corrupts the first bits
+FLASH_EMU_ERRORS = { 1: 'image larger than the emulated region', 2: 'block failed to inflate', 3: 'region failed to program', 4: 'region holds another image', 5: 'no pio state machine or dma channel free' }
+UPDATE_ERRORS = { 1: 'bad image size', 2: 'block out of order', 3: 'block failed to inflate', 4: 'bad dictionary', 5: 'staging flash failed', 6: 'image hash mismatch', 7: 'image not bootable' }
+UPDATE_ANCHOR_SZ = 16 # block slices looked up in the running image to place delta dictionaries
+UPDATE_REATTACH_TIMEOUT = 30.0 # seconds for the image swap & reboot
+FLASH_PAGE_SIZE = 256
+FLASH_XIP_BASE = 0x10000000
+UF2_MAGIC_START0 = 0x0A324655
+UF2_MAGIC_START1 = 0x9E5D5157
+UF2_MAGIC_END = 0x0AB16F30
+UF2_FLAG_NOT_MAIN_FLASH = 0x01
+READBACK_WINDOW = 8 # blocks per ReadImage request, each comes back in its own frame
+READ_FLAG_COMPRESS = 0x01
+PATCH_LIST_SZ = 1024 # device patch list bytes, entries & data
+ECP5_FRAME_SIZES = { 0x01111043: (74, 80, 7562), 0x01112043: (106, 112, 9470), 0x01113043: (142, 144, 13294) } # uncompressed frame bytes, compressed frame codes & frames, by idcode without the variant bits
+ECP5_PART_NAMES = { 0x21111043: 'LFE5U-12', 0x41111043: 'LFE5U-25', 0x41112043: 'LFE5U-45', 0x41113043: 'LFE5U-85',
+                    0x01111043: 'LFE5UM-25', 0x01112043: 'LFE5UM-45', 0x01113043: 'LFE5UM-85',
+                    0x81111043: 'LFE5UM5G-25', 0x81112043: 'LFE5UM5G-45', 0x81113043: 'LFE5UM5G-85' }
+ECP5_DICT_SZ = 8 # LSC_WRITE_COMP_DIC entries
+ECP5_ONE_HOT_ORDER = None # bit the one hot code index counts from, 'lsb' or 'msb' once tools/ecp5pair.py matched an ecppack --compress pair. None refuses to compress, decoding assumes 'lsb'
+BATCH_ERRORS = { 1: 'command failed', 2: 'bad format', 3: 'reply overflow' }
+MAX_DEVICE_IMAGES = 8 # image records in device flash
+FARM_FLASH_COST = 0.25 # farm scheduling cost of programming from flash, in queued jobs
+FARM_UPLOAD_COST = 1.0 # farm scheduling cost of a full upload, in queued jobs
+FARM_SCAN_INTERVAL = 30 # seconds between farm board rescans
+FARM_UPLOAD_RETRIES = 1 # farm job uploads retried on the same board, link glitches on degraded hubs
+FARM_LINK_PROBE_COUNT = 4 # echo round trips per idle board refresh for the link rate metric
+METRICS_SECONDS_BUCKETS = ( 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 25.0, 60.0 )
+PROGRAM_FLAG_EARLY_ACK = 0x01
+PERF_ECHO_SIZE = 2048 # usb link test payload
+PERF_ECHO_COUNT = 16
+PERF_BASELINE_TOLERANCE = 0.75 # report stages slower than this fraction of baseline
+REATTACH_TIMEOUT = 10.0 # seconds for a rebooted programmer to re-enumerate & send its startup frame
+STARTUP_FRAME_TIMEOUT = 1.0 # seconds to wait for the startup frame once the port is open, older bootloaders are queried instead
+HOTPLUG_POLL_INTERVAL = 0.05 # port list poll where no hotplug events are available
+NETLINK_KOBJECT_UEVENT = 15
+PERF_BASELINE_DEFAULT = { 'usb': 40.0, 'inflate': 2000.0, 'spi': 110.0, 'flashErase': 80.0, 'flashProgram': 400.0, 'xip': 3000.0 } # KB/s, nominal RP2040 @ 125MHz & 1MHz spi
 
 # imports
-import os, sys, io, time, zlib, random, math, json, fnmatch, platform, traceback, base64
+import os, sys, io, time, zlib, random, math, json, fnmatch, platform, traceback, base64, hashlib, threading, socketserver, socket, subprocess, select
+import http.server
 from optparse import OptionParser
 
 try:
@@ -843,6 +932,70 @@ def compressData( data ):
     return szBytes + cdata
 
     
+def imageHash( data ):
+    """
+        Strong whole image hash, matches the hash stored in device flash.
+    """
+    return hashlib.sha256( bytes(data) ).digest()
+
+    
+def deflateRaw( data, zdict=None ):
+    """
+        Raw deflate stream, optionally against a preset dictionary, as taken by FCMD_UpdateBlock.
+    """
+    compressor = zlib.compressobj( 9, zlib.DEFLATED, -15, zdict=zdict ) if zdict else zlib.compressobj( 9, zlib.DEFLATED, -15 )
+    return compressor.compress( bytes( data ) ) + compressor.flush()
+
+
+def bootloaderImage( data ):
+    """
+        Flat flash image of a bootloader UF2 or raw binary, padded to whole flash pages.
+    """
+    data = bytes( data )
+    if len(data) >= 512 and FEncoding.getInt32( data, 0 ) == UF2_MAGIC_START0:
+        image = bytearray()
+        for i in range( 0, len(data) - 511, 512 ):
+            if FEncoding.getInt32( data, i ) != UF2_MAGIC_START0 or FEncoding.getInt32( data, i + 4 ) != UF2_MAGIC_START1 or FEncoding.getInt32( data, i + 508 ) != UF2_MAGIC_END:
+                raise Exception("Bad UF2 block at %d" % i)
+            flags, targetAddr, payloadSz = FEncoding.getInt32( data, i + 8 ), FEncoding.getInt32( data, i + 12 ), FEncoding.getInt32( data, i + 16 )
+            if flags & UF2_FLAG_NOT_MAIN_FLASH:
+                continue
+            offset = targetAddr - FLASH_XIP_BASE
+            if offset < 0 or payloadSz > 476:
+                raise Exception("UF2 block at %d outside flash" % i)
+            if len(image) < offset + payloadSz:
+                image += bytes( offset + payloadSz - len(image) )
+            image[ offset : offset + payloadSz ] = data[ i + 32 : i + 32 + payloadSz ]
+        data = bytes( image )
+    return data + bytes( -len(data) % FLASH_PAGE_SIZE )
+
+
+def baseShift( block, base, offset, shift ):
+    """
+        Where a block of the new image sits in the running one, relative to its own offset. Slices of the block
+        vote for the shifts they are found at, ties go to the shift of the previous block.
+    """
+    votes = {}
+    for i in range( 0, len(block) - UPDATE_ANCHOR_SZ + 1, UPDATE_ANCHOR_SZ * 4 ):
+        anchor = block[ i : i + UPDATE_ANCHOR_SZ ]
+        if len( set( anchor ) ) < UPDATE_ANCHOR_SZ // 2: # fill & padding match everywhere
+            continue
+        pos = base.find( anchor )
+        while pos >= 0:
+            votes[ pos - offset - i ] = votes.get( pos - offset - i, 0 ) + 1
+            pos = base.find( anchor, pos + 1 )
+    if not votes:
+        return shift
+    return max( votes, key=lambda k: (votes[ k ], -abs( k - shift )) )
+
+
+def blockKey( data ):
+    """
+        Key of a bitstream block in the device block store.
+    """
+    return hashlib.sha256( bytes(data) ).digest()[ :BLOCK_KEY_SIZE ]
+
+
 def decompressData( data ):
     """
         Decompress with size header
@@ -851,6 +1004,389 @@ def decompressData( data ):
     return zlib.decompress( bytes( data[2:] ) )
 
 
+def _ecp5CrcEntry( i ):
+    crc = i << 8
+    for j in range(8):
+        crc = ((crc << 1) ^ 0x8005) & 0xffff if crc & 0x8000 else (crc << 1) & 0xffff
+    return crc
+
+ECP5_CRC_TABLE = [ _ecp5CrcEntry( i ) for i in range(256) ]
+
+
+def ecp5Crc16( data, crc=0 ):
+    """
+        ECP5 bitstream crc16, poly 0x8005 msb first.
+    """
+    for b in data:
+        crc = ((crc << 8) & 0xffff) ^ ECP5_CRC_TABLE[ (crc >> 8) ^ b ]
+    return crc
+
+
+class Ecp5Bitstream:
+    """
+        ECP5 command stream map used to resolve & apply patch lists, mirrors the bootloader stream patcher.
+        Every crc check is verified while parsing. Fields are ( kind, offset, size, info ), crc runs over
+        every kind but 'raw' & restarts after each 'crc' & LSC_RESET_CRC.
+    """
+    OperandSizes = { 0x3b: 0, 0xe2: 4, 0x02: 8, 0x22: 4, 0x46: 0, 0xb4: 4, 0xf6: 4, 0xc2: 4, 0x5e: 0 } # frame & ebr writes are sized from params
+    RESET_CRC = 0x3b
+    VERIFY_ID = 0xe2
+    WRITE_COMP_DIC = 0x02
+    PROG_INCR_RTI = 0x82
+    PROG_INCR_CMP = 0xb8
+    EBR_ADDRESS = 0xf6
+    EBR_WRITE = 0xb2
+    USERCODE = 0xc2
+    PROGRAM_DONE = 0x5e
+    EBR_FRAME_SZ = 9
+
+    def __init__( s, data ):
+        s.data = bytes( data )
+        s.fields = []
+        s.deviceId = None # VERIFY_ID idcode
+        s.dictionary = None # LSC_WRITE_COMP_DIC bytes of compressed frames
+        s.isCompressed = False
+        s.frameCnt = 0
+        s.parse()
+
+    def parse( s ):
+        d = s.data
+        p = d.find( b'\xbd\xb3' )
+        if p < 0:
+            raise Exception("Bitstream has no ECP5 preamble")
+        p += 2
+        s.fields.append( ( 'raw', 0, p, None ) )
+
+        crc = 0
+        s.frameSz = None
+        frameIdx = 0
+        ebrAddress = None
+        while p < len(d):
+            op = d[ p ]
+            if op == 0xff:
+                s.fields.append( ( 'raw', p, 1, None ) )
+                p += 1
+                continue
+            if p + 4 > len(d):
+                raise Exception("Bitstream truncated at %d" % p)
+
+            params = d[ p + 1 : p + 4 ]
+            cnt = (params[1] << 8) | params[2]
+            isCrc = params[0] & 0x80
+            fields = [ ( 'cmd', p, 4, op ) ]
+            p += 4
+
+            if op in ( s.PROG_INCR_RTI, s.PROG_INCR_CMP ):
+                if not s.frameSz:
+                    raise Exception("Bitstream frames before VERIFY_ID of a known device")
+                if op == s.PROG_INCR_CMP:
+                    if not s.dictionary:
+                        raise Exception("Bitstream compressed frames before LSC_WRITE_COMP_DIC")
+                    s.isCompressed = True
+                for i in range( cnt ):
+                    sz = s.frameSz[0] if op == s.PROG_INCR_RTI else s.compressedFrameSize( p, s.frameSz[1] )
+                    fields.append( ( 'frame' if op == s.PROG_INCR_RTI else 'cframe', p, sz, frameIdx ) )
+                    frameIdx += 1
+                    p += sz
+                    if isCrc and (not params[0] & 0x40 or i == cnt - 1):
+                        fields.append( ( 'crc', p, 2, None ) )
+                        p += 2
+                    if params[0] & 0x0f:
+                        fields.append( ( 'dummy', p, params[0] & 0x0f, None ) )
+                        p += params[0] & 0x0f
+            else:
+                if op == s.EBR_WRITE:
+                    sz = cnt * s.EBR_FRAME_SZ
+                elif op in s.OperandSizes:
+                    sz = s.OperandSizes[ op ]
+                else:
+                    raise Exception("Unknown bitstream command 0x%02x at %d" % (op, p - 4))
+                operand = d[ p : p + sz ]
+                if op == s.VERIFY_ID:
+                    s.deviceId = int.from_bytes( operand, 'big' )
+                    s.frameSz = ECP5_FRAME_SIZES.get( s.deviceId & 0x0fffffff )
+                elif op == s.WRITE_COMP_DIC:
+                    s.dictionary = bytes( operand )
+                elif op == s.EBR_ADDRESS:
+                    ebrAddress = int.from_bytes( operand, 'big' )
+                if sz:
+                    fields.append( ( 'operand', p, sz, ( op, ebrAddress ) ) )
+                    p += sz
+                if isCrc:
+                    fields.append( ( 'crc', p, 2, None ) )
+                    p += 2
+
+            # verify original crcs
+            for field in fields:
+                kind, offset, sz, info = field
+                if kind == 'crc':
+                    if d[ offset : offset + 2 ] != crc.to_bytes( 2, 'big' ):
+                        raise Exception("Bitstream crc mismatch at %d" % offset)
+                    crc = 0
+                else:
+                    crc = ecp5Crc16( d[ offset : offset + sz ], crc )
+                if kind == 'cmd' and info == s.RESET_CRC:
+                    crc = 0
+                s.fields.append( field )
+
+            if op == s.PROGRAM_DONE:
+                s.fields.append( ( 'raw', p, len(d) - p, None ) )
+                break
+        s.frameCnt = frameIdx
+
+    def compressedFrameSize( s, p, codes ):
+        """
+            Bytes taken by a compressed frame, 0 is a zero byte, 100/101 take 3 bits & 11 a literal byte.
+        """
+        return len( s.frameCodes( p, codes )[ 0 ] )
+
+    def frameCodes( s, p, codeCnt ):
+        """
+            Split compressed frame at p into one code bit string per frame byte, returns frame data & codes.
+        """
+        codes = []
+        bit = p * 8
+        while len(codes) < codeCnt:
+            # zero bytes are 8 zero codes
+            if bit % 8 == 0 and s.data[ bit >> 3 ] == 0 and codeCnt - len(codes) >= 8:
+                codes.extend( [ '0' ] * 8 )
+                bit += 8
+                continue
+            code = ''
+            codeSz = 1
+            while len(code) < codeSz:
+                code += str( (s.data[ bit >> 3 ] >> (7 - (bit & 7))) & 1 )
+                bit += 1
+                if code == '1':
+                    codeSz = 2
+                elif len(code) == 2:
+                    codeSz = 10 if code == '11' else 6
+            codes.append( code )
+        return s.data[ p : (bit + 7) // 8 ], codes
+
+    def patch( s, patches ):
+        """
+            Returns bitstream with patch list applied & crcs recomputed.
+        """
+        raw, codes = s.resolvePatches( patches )
+        return s.applyPatches( raw, codes )
+
+    def applyPatches( s, raw, codes ):
+        data = bytearray( s.data )
+        for offset, patchData in raw:
+            data[ offset : offset + len(patchData) ] = patchData
+
+        def chunks( field ):
+            kind, offset, sz, info = field
+            if kind == 'cframe' and info in codes:
+                return [ ( kind, s.recodeFrame( offset, codes[ info ] ), info ) ]
+            return [ ( kind, data[ offset : offset + sz ], info ) ]
+        out = s.rebuild( chunks )
+
+        # recoded frames have to decode to the patched bytes
+        if codes:
+            patched = Ecp5Bitstream( out )
+            for field in patched.fields:
+                if field[0] == 'cframe' and field[3] in codes:
+                    frame = patched.decodeFrame( field[1] )
+                    if any( frame[ i ] != b for i, b in codes[ field[3] ].items() ):
+                        raise Exception("Patched frame %d doesn't decode to the patch" % field[3])
+        return out
+
+    def rebuild( s, chunks ):
+        """
+            Bitstream from ( kind, bytes, info ) chunks of each field, crc checks recomputed over the new bytes.
+        """
+        out = bytearray()
+        crc = 0
+        for field in s.fields:
+            for kind, chunk, info in chunks( field ):
+                if kind == 'crc':
+                    chunk = crc.to_bytes( 2, 'big' )
+                    crc = 0
+                if kind not in ( 'raw', 'crc' ):
+                    crc = ecp5Crc16( chunk, crc )
+                if kind == 'cmd' and info == s.RESET_CRC:
+                    crc = 0
+                out += chunk
+        return bytes( out )
+
+    def partName( s ):
+        return ECP5_PART_NAMES.get( s.deviceId, '0x%08x' % s.deviceId if s.deviceId is not None else 'unknown part' )
+
+    def decodeFrame( s, p ):
+        """
+            Frame bytes of the compressed frame at p, the leading pad to the 64 bit code count removed.
+        """
+        data, codes = s.frameCodes( p, s.frameSz[1] )
+        frame = bytearray()
+        for code in codes:
+            if code == '0':
+                frame.append( 0 )
+            elif code.startswith( '11' ):
+                frame.append( int( code[ 2: ], 2 ) )
+            elif code.startswith( '100' ):
+                frame.append( 0x80 >> int( code[ 3: ], 2 ) if ECP5_ONE_HOT_ORDER == 'msb' else 1 << int( code[ 3: ], 2 ) )
+            else:
+                frame.append( s.dictionary[ int( code[ 3: ], 2 ) ] )
+        return bytes( frame[ s.frameSz[1] - s.frameSz[0] : ] )
+
+    @staticmethod
+    def encodeFrame( frame, padSz, dictionary ):
+        """
+            Compressed frame, 0 for zero bytes, 100 & the bit index for one hot bytes, 101 & the index of
+            dictionary bytes, 11 & the byte otherwise. Leading zero pad to the code count, bits byte padded.
+        """
+        bits = '0' * padSz
+        for b in frame:
+            if b == 0:
+                bits += '0'
+            elif b & (b - 1) == 0:
+                bits += '100' + format( 8 - b.bit_length() if ECP5_ONE_HOT_ORDER == 'msb' else b.bit_length() - 1, '03b' )
+            elif b in dictionary:
+                bits += '101' + format( dictionary.index( b ), '03b' )
+            else:
+                bits += '11' + format( b, '08b' )
+        bits += '0' * (-len(bits) % 8)
+        return int( bits, 2 ).to_bytes( len(bits) // 8, 'big' )
+
+    def frames( s ):
+        """
+            Config frame bytes in stream order.
+        """
+        return [ s.data[ f[1] : f[1] + f[2] ] if f[0] == 'frame' else s.decodeFrame( f[1] ) for f in s.fields if f[0] in ( 'frame', 'cframe' ) ]
+
+    def compress( s ):
+        """
+            Bitstream with config frames in the ECP5 compressed format ecppack --compress writes, the FPGA
+            expands them so spi, flash store & usb carry fewer bytes. Compressed images come back unchanged.
+        """
+        if s.isCompressed:
+            return s.data
+        if not s.frameSz:
+            raise Exception("Bitstream frames of an unknown device can't be compressed")
+        if ECP5_ONE_HOT_ORDER is None:
+            raise Exception("ECP5 one hot code order isn't pinned, set ECP5_ONE_HOT_ORDER from tools/ecp5pair.py on an ecppack --compress pair")
+
+        # Dictionary holds the most frequent bytes the other codes don't cover
+        counts = {}
+        for frame in s.frames():
+            for b in frame:
+                if b & (b - 1):
+                    counts[ b ] = counts.get( b, 0 ) + 1
+        dictionary = sorted( counts, key=lambda b: (-counts[ b ], b) )[ :ECP5_DICT_SZ ]
+        dictionary += [ 0 ] * (ECP5_DICT_SZ - len(dictionary))
+        padSz = s.frameSz[1] - s.frameSz[0]
+
+        def chunks( field ):
+            kind, offset, sz, info = field
+            chunk = s.data[ offset : offset + sz ]
+            if kind == 'cmd' and info == s.PROG_INCR_RTI:
+                return [ ( 'cmd', bytes( [ s.WRITE_COMP_DIC, 0, 0, 0 ] ), s.WRITE_COMP_DIC ), ( 'operand', bytes( dictionary ), None ),
+                         ( 'cmd', bytes( [ s.PROG_INCR_CMP ] ) + chunk[ 1: ], s.PROG_INCR_CMP ) ]
+            if kind == 'frame':
+                return [ ( 'cframe', s.encodeFrame( chunk, padSz, dictionary ), info ) ]
+            return [ ( kind, chunk, info ) ]
+        return s.rebuild( chunks )
+
+    def decompress( s ):
+        """
+            Bitstream with compressed frames expanded, for tools & devices that only take PROG_INCR_RTI.
+        """
+        if not s.isCompressed:
+            return s.data
+
+        def chunks( field ):
+            kind, offset, sz, info = field
+            chunk = s.data[ offset : offset + sz ]
+            if kind == 'cmd' and info == s.WRITE_COMP_DIC:
+                return []
+            if kind == 'operand' and info[0] == s.WRITE_COMP_DIC:
+                return []
+            if kind == 'cmd' and info == s.PROG_INCR_CMP:
+                return [ ( 'cmd', bytes( [ s.PROG_INCR_RTI ] ) + chunk[ 1: ], s.PROG_INCR_RTI ) ]
+            if kind == 'cframe':
+                return [ ( 'frame', s.decodeFrame( offset ), info ) ]
+            return [ ( kind, chunk, info ) ]
+        return s.rebuild( chunks )
+
+    def checkTarget( s, fpgaDeviceId ):
+        """
+            Raise when the image won't configure the FPGA, VERIFY_ID has to match its idcode & a part's
+            frames all have to be written.
+        """
+        if s.deviceId is None:
+            return
+        if fpgaDeviceId and s.deviceId != fpgaDeviceId:
+            raise Exception("Bitstream is for %s (0x%08x), the board has %s (0x%08x)" % (s.partName(), s.deviceId, ECP5_PART_NAMES.get( fpgaDeviceId, 'an unknown part' ), fpgaDeviceId))
+        if s.frameSz and s.frameCnt != s.frameSz[2]:
+            raise Exception("Bitstream writes %d of the %d config frames of %s" % (s.frameCnt, s.frameSz[2], s.partName()))
+
+    def recodeFrame( s, p, patch ):
+        """
+            Compressed frame with patched bytes stored as zero or literal codes, the frame may change size.
+            Patch indexes are frame bytes, the codes start with the pad to the code count.
+        """
+        data, codes = s.frameCodes( p, s.frameSz[1] )
+        padSz = s.frameSz[1] - s.frameSz[0]
+        for i, b in patch.items():
+            codes[ padSz + i ] = '0' if b == 0 else '11' + format( b, '08b' )
+        bits = ''.join( codes )
+        bits += '0' * (-len(bits) % 8)
+        return int( bits, 2 ).to_bytes( len(bits) // 8, 'big' )
+
+    def findField( s, kind, test ):
+        for field in s.fields:
+            if field[0] == kind and test( field ):
+                return field
+        return None
+
+    def resolvePatches( s, patches ):
+        """
+            Patch list entries are { offset, data } in the bitstream, { frame, offset, data } in a config frame,
+            { ebr, offset, data } in the init data written after LSC_EBR_ADDRESS ebr, or { usercode }.
+            Returns sorted ( offset, bytes ) patches & { frame: { byteIdx: value } } for compressed frames.
+        """
+        raw = []
+        codes = {}
+        for patch in patches:
+            data = bytes.fromhex( patch.get( 'data', '' ) )
+            offset = int( str( patch.get( 'offset', 0 ) ), 0 )
+            if 'usercode' in patch:
+                field = s.findField( 'operand', lambda f: f[3][0] == s.USERCODE )
+                data = int( str( patch[ 'usercode' ] ), 0 ).to_bytes( 4, 'big' )
+                offset = 0
+            elif 'ebr' in patch:
+                ebr = int( str( patch[ 'ebr' ] ), 0 )
+                field = s.findField( 'operand', lambda f: f[3][0] == s.EBR_WRITE and f[3][1] == ebr )
+            elif 'frame' in patch:
+                frame = int( str( patch[ 'frame' ] ), 0 )
+                field = s.findField( 'frame', lambda f: f[3] == frame ) or s.findField( 'cframe', lambda f: f[3] == frame )
+                if field and field[0] == 'cframe':
+                    if offset + len(data) > s.frameSz[0]:
+                        raise Exception("Patch %s outside frame" % str(patch))
+                    for i, b in enumerate( data ):
+                        codes.setdefault( frame, {} )[ offset + i ] = b
+                    continue
+            else:
+                field = None
+                for f in s.fields:
+                    if f[0] in ( 'operand', 'frame' ) and f[1] <= offset < f[1] + f[2]:
+                        field = f
+                        offset -= f[1]
+                        break
+
+            if not field or not data or offset + len(data) > field[2]:
+                raise Exception("Patch %s outside command operands & uncompressed frame data" % str(patch))
+            raw.append( ( field[1] + offset, data ) )
+
+        raw.sort()
+        for (a, da), (b, db) in zip( raw, raw[1:] ):
+            if a + len(da) > b:
+                raise Exception("Patches overlap at %d" % b)
+        return raw, codes
+
+
 class DeviceStatus:
     Unkown = 'unkown'
     StatusNoResponse = 'noresponse'    
@@ -866,9 +1402,12 @@ class FabricDeviceInfo:
         s.fpgaDeviceId = None # fpga device id
         s.uri = None # connection uri
         s.uid = None # pico uid
+        s.maxBlockSz = DEFAULT_MAX_BLOCK_SZ # largest uncompressed block the programmer takes
+        s.maxPacketSz = None # largest frame payload the programmer takes
+        s.features = 0 # FEATURE_ flags
 
     def __repr__( s ):
-        return "DeviceInfo( %s, %s, %s, %s )" % (str(s.status), str(s.fpgaDeviceId), str(s.uri), str(s.uid))
+        return "DeviceInfo( %s, %s, %s, %s, %s )" % (str(s.status), str(s.fpgaDeviceId), str(s.uri), str(s.uid), str(s.maxBlockSz))
 
 
 class FabricCommands:
@@ -882,6 +1421,22 @@ class FabricCommands:
     ProgramBitstreamFromFlash = 0x06
     ClearBitstreamFlash = 0x07
     RebootProgrammer = 0x08
+    SelfTestPerf = 0x09
+    QueryBlockKeys = 0x0A
+    ProgramBlockRef = 0x0B
+    ConfigureImage = 0x0C
+    QueryImages = 0x0D
+    Batch = 0x0E
+    SelfTestConfigure = 0x0F
+    SetPatches = 0x10
+    QueryFlashStatus = 0x11
+    ReadImage = 0x12
+    UpdateBegin = 0x13
+    UpdateBlock = 0x14
+    UpdateCommit = 0x15
+    FlashEmuWrite = 0x16
+    FlashEmu = 0x17
+    DeviceStartup = 0xFE
     
     
 def _adduint8( a, b ):
@@ -939,12 +1494,13 @@ class FProgramDevicePacket(FCmdBase):
         s.totalSize = 0
         s.blockCount = 0
         s.bitstreamCrc = 0
+        s.flags = 0
         
     def toBytes( s ):
-        return bytes( [ s.saveToFlash ] ) + FEncoding.encodeInt32(s.totalSize) + FEncoding.encodeInt32(s.blockCount) + FEncoding.encodeInt16(s.bitstreamCrc)
+        return bytes( [ s.saveToFlash ] ) + FEncoding.encodeInt32(s.totalSize) + FEncoding.encodeInt32(s.blockCount) + FEncoding.encodeInt16(s.bitstreamCrc) + bytes( [ s.flags ] )
     
     def __repr__( s ):
-        return "FProgramDevicePacket( %s, %s, %s, %s )" % (str(s.saveToFlash), str(s.totalSize), str(s.blockCount), str(s.bitstreamCrc))
+        return "FProgramDevicePacket( %s, %s, %s, %s, %s )" % (str(s.saveToFlash), str(s.totalSize), str(s.blockCount), str(s.bitstreamCrc), str(s.flags))
 
 
 class FProgramCompletePacket(FCmdBase):
@@ -980,6 +1536,17 @@ class RebootProgrammer(FCmdBase):
         return "ClearBitstreamFlash( )"
 
 
+class ProgramBitstreamFromFlash(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.ProgramBitstreamFromFlash )
+        
+    def toBytes( s ):
+        return bytes( [] )
+    
+    def __repr__( s ):
+        return "ProgramBitstreamFromFlash( )"
+
+
 class QueryBitstreamFlash(FCmdBase):
     def __init__( s ):
         FCmdBase.__init__( s, FabricCommands.QueryBitstreamFlash )
@@ -991,6 +1558,78 @@ class QueryBitstreamFlash(FCmdBase):
         return "QueryBitstreamFlash( )"
 
     
+class SelfTestPerf(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.SelfTestPerf )
+        
+    def toBytes( s ):
+        return bytes( [] )
+    
+    def __repr__( s ):
+        return "SelfTestPerf( )"
+
+
+class SelfTestConfigure(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.SelfTestConfigure )
+        
+    def toBytes( s ):
+        return bytes( [] )
+    
+    def __repr__( s ):
+        return "SelfTestConfigure( )"
+
+
+class QueryFlashStatus(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.QueryFlashStatus )
+        
+    def toBytes( s ):
+        return bytes( [] )
+    
+    def __repr__( s ):
+        return "QueryFlashStatus( )"
+
+
+class ReadImage(FCmdBase):
+    def __init__( s, bitStreamHash=None, firstBlockId=0, blockCnt=READBACK_WINDOW, flags=READ_FLAG_COMPRESS ):
+        FCmdBase.__init__( s, FabricCommands.ReadImage )
+        s.bitStreamHash = bitStreamHash # None reads the startup image
+        s.firstBlockId = firstBlockId
+        s.blockCnt = blockCnt
+        s.flags = flags
+        
+    def toBytes( s ):
+        return (s.bitStreamHash or bytes( 32 )) + FEncoding.encodeInt16( s.firstBlockId ) + FEncoding.encodeInt16( s.blockCnt ) + bytes( [ s.flags ] )
+    
+    def __repr__( s ):
+        return "ReadImage( %s, %d, %d )" % (s.bitStreamHash.hex() if s.bitStreamHash else None, s.firstBlockId, s.blockCnt)
+
+
+class SetPatches(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.SetPatches )
+        s.patches = [] # ( offset, data )
+        
+    def toBytes( s ):
+        return bytes( [ len(s.patches) ] ) + b''.join( FEncoding.encodeInt32( offset ) + FEncoding.encodeInt16( len(data) ) + bytes( data ) for offset, data in s.patches )
+    
+    def __repr__( s ):
+        return "SetPatches( %s )" % str(len(s.patches))
+
+
+class FEchoPacket(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.Echo )
+        s.data = bytes([])
+        
+    def toBytes( s ):
+        return bytes( s.data )
+    
+    def __repr__( s ):
+        return "FEchoPacket( %s )" % str(len(s.data))
+
+    
 class FQueryProgramBlock(FCmdBase):
     def __init__( s ):
         FCmdBase.__init__( s, FabricCommands.ProgramBlock )        
@@ -1007,6 +1646,138 @@ class FQueryProgramBlock(FCmdBase):
         return "FProgramDevicePacket( blockId: %s, blockSz: %s )" % (str(s.blockId), str(s.blockSz))
 
 
+class FProgramBlockRef(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.ProgramBlockRef )        
+        s.blockId = 0
+        s.blockSz = 0
+        s.blockCrc = 0
+        s.blockKey = bytes([])
+
+    def toBytes( s ):
+        return FEncoding.encodeInt16(s.blockId) + FEncoding.encodeInt16(s.blockSz) + bytes([s.blockCrc]) + s.blockKey
+    
+    def __repr__( s ):
+        return "FProgramBlockRef( blockId: %s, blockSz: %s, blockKey: %s )" % (str(s.blockId), str(s.blockSz), s.blockKey.hex())
+
+
+class ConfigureImage(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.ConfigureImage )
+        s.bitStreamHash = bytes( 32 )
+        
+    def toBytes( s ):
+        return bytes( s.bitStreamHash )
+    
+    def __repr__( s ):
+        return "ConfigureImage( %s )" % s.bitStreamHash.hex()
+
+
+class ConfigureImage_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.isResident = False
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.isResident = data[4] != 0
+
+    def __repr__( s ):
+        return "ConfigureImage_Response( errorCode: %s, isResident: %s )" % (str(s.errorCode), str(s.isResident))
+
+
+class QueryImages(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.QueryImages )
+        
+    def toBytes( s ):
+        return bytes( [] )
+    
+    def __repr__( s ):
+        return "QueryImages()"
+
+
+class QueryImages_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.configuredHash = None
+        s.imageHashes = [] # most recently used first
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.configuredHash = bytes( data[5:5+32] ) if data[4] else None
+        imageCnt = min( data[37], MAX_DEVICE_IMAGES )
+        s.imageHashes = [ bytes( data[38 + i*32 : 38 + (i+1)*32] ) for i in range(imageCnt) ]
+
+    def __repr__( s ):
+        return "QueryImages_Response( errorCode: %s, configuredHash: %s, imageCnt: %s )" % (str(s.errorCode), s.configuredHash.hex() if s.configuredHash else None, str(len(s.imageHashes)))
+
+
+class Batch(FCmdBase):
+    """
+        Sub commands run in order by the device, each sent as size & payload.
+    """
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.Batch )
+        s.cmds = []
+        
+    def toBytes( s ):
+        data = bytes( [ len(s.cmds) ] )
+        for i, cmd in enumerate( s.cmds ):
+            payload = bytes( [ cmd.cmd, (i + 1) & 0xff ] ) + cmd.toBytes()
+            data += FEncoding.encodeInt16( len(payload) ) + payload
+        return data
+    
+    def __repr__( s ):
+        return "Batch( %s )" % ", ".join( str(c) for c in s.cmds )
+
+
+class Batch_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.responses = [] # cmd, counter, data of each sub command run
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.responses = []
+        offset = 5
+        for i in range(data[4]):
+            sz = FEncoding.decodeInt16( data, offset )
+            payload = data[ offset + 2 : offset + 2 + sz ]
+            s.responses.append( (payload[0], payload[1], payload[2:]) )
+            offset += 2 + sz
+
+    def __repr__( s ):
+        return "Batch_Response( errorCode: %s, cmdCnt: %s )" % (str(s.errorCode), str(len(s.responses)))
+
+
+class QueryBlockKeys(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.QueryBlockKeys )
+        s.keys = []
+        
+    def toBytes( s ):
+        return FEncoding.encodeInt16( len(s.keys) ) + b''.join( s.keys )
+    
+    def __repr__( s ):
+        return "QueryBlockKeys( %s )" % str(len(s.keys))
+
+
+class QueryBlockKeys_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.isStored = []
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        keyCnt = FEncoding.decodeInt16( data, 4 )
+        s.isStored = [ (data[6 + i // 8] >> (i % 8)) & 1 == 1 for i in range(keyCnt) ]
+
+
 class FGeneric_Response(FResponseBase):
     def __init__( s ):
         FResponseBase.__init__( s )
@@ -1016,12 +1787,41 @@ class FGeneric_Response(FResponseBase):
         s.errorCode = FEncoding.getInt32( data, 0 )
 
 
+class FProgramBlock_Response(FResponseBase):
+    """
+        Program block & complete ack, in early-ack mode carries the first latched error.
+    """
+    Stages = [ 'none', 'inflate', 'blockSize', 'blockCrc', 'flash', 'complete', 'blockRef' ]
+
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.failedBlockId = None
+        s.failedStage = None
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.failedBlockId = FEncoding.decodeInt16( data, 4 )
+        s.failedStage = data[6]
+
+    def stageName( s ):
+        if s.failedStage is not None and s.failedStage < len(s.Stages):
+            return s.Stages[ s.failedStage ]
+        return str(s.failedStage)
+
+    def __repr__( s ):
+        return "FProgramBlock_Response( errorCode: %s, failedBlockId: %s, failedStage: %s )" % (str(s.errorCode), str(s.failedBlockId), s.stageName())
+
+
 class FQueryDevicePacket_Response(FResponseBase):
     def __init__( s ):
         FResponseBase.__init__( s )
         s.deviceState = 0
         s.fpgaDeviceId = 0
         s.progDeviceId = []
+        s.maxBlockSz = DEFAULT_MAX_BLOCK_SZ
+        s.maxPacketSz = None
+        s.features = 0
         
     def fromBytes( s, data ):        
         s.deviceState = data[0]        
@@ -1029,6 +1829,13 @@ class FQueryDevicePacket_Response(FResponseBase):
         s.progDeviceId = []
         for i in range(8):
             s.progDeviceId.append( data[ i + 1 + 4] )
+        if len(data) >= 17: # older bootloaders only take 4KB blocks
+            s.maxBlockSz = FEncoding.decodeInt16( data, 13 )
+            s.maxPacketSz = FEncoding.decodeInt16( data, 15 )
+        if len(data) >= 18:
+            s.features = data[17]
+        if len(data) >= 19:
+            s.features |= data[18] << 8
         
 
 class QueryBitstreamFlash_Response(FResponseBase):
@@ -1039,6 +1846,7 @@ class QueryBitstreamFlash_Response(FResponseBase):
         s.blockCnt = 0
         s.bitStreamSz = 0
         s.crc = 0
+        s.bitStreamHash = None
         
     def fromBytes( s, data ):                
         s.errorCode = FEncoding.getInt32( data, 0 )
@@ -1046,46 +1854,337 @@ class QueryBitstreamFlash_Response(FResponseBase):
         s.blockCnt = FEncoding.getInt32( data, 8 )
         s.bitStreamSz = FEncoding.getInt32( data, 12 )
         s.crc = data[16]
+        s.bitStreamHash = None
+        if len(data) >= 17 + 32 and any( data[17:17+32] ): # older bootloaders & records have no hash
+            s.bitStreamHash = bytes( data[17:17+32] )
 
     def __repr__( s ):
-        return "QueryBitstreamFlash_Response( errorCode: %s, programOnStartup: %s, blockCnt: %s, bitStreamSz: %s, crc: %s )" % (str(s.errorCode), str(s.programOnStartup),
-                                                                                                                          str(s.blockCnt), str(s.bitStreamSz), str(s.crc) )
+        return "QueryBitstreamFlash_Response( errorCode: %s, programOnStartup: %s, blockCnt: %s, bitStreamSz: %s, crc: %s, bitStreamHash: %s )" % (str(s.errorCode), str(s.programOnStartup),
+                                                                                                                          str(s.blockCnt), str(s.bitStreamSz), str(s.crc),
+                                                                                                                          s.bitStreamHash.hex() if s.bitStreamHash else None )
 
 
-class FabricTransport:
-    """
-        Transport base class, provides high level
-        device programming interface.
-    """
-    HeaderMagic = 0x1b
-    MaxWriteBlockSize = 0xffff-16
-    TransportTypeUSBSerial = 'usbserial'
-    TransportTypeIP = 'ip'
+class FEcho_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.data = bytes([])
+        
+    def fromBytes( s, data ):                
+        s.data = bytes( data )
 
-    @staticmethod
-    def createTransportForUri( uri ):
+
+class SelfTestPerf_Response(FResponseBase):
+    Stages = ['usb', 'inflate', 'spi', 'flashErase', 'flashProgram', 'xip']
+
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.sysClockHz = 0
+        s.inflateBytes = 0
+        s.inflateUs = 0
+        s.spiClockHz = 0
+        s.spiBytes = 0
+        s.spiUs = 0
+        s.flashBytes = 0
+        s.flashEraseUs = 0
+        s.flashProgramUs = 0
+        s.xipBytes = 0
+        s.xipUs = 0
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.sysClockHz = FEncoding.getInt32( data, 4 )
+        s.inflateBytes = FEncoding.getInt32( data, 8 )
+        s.inflateUs = FEncoding.getInt32( data, 12 )
+        s.spiClockHz = FEncoding.getInt32( data, 16 )
+        s.spiBytes = FEncoding.getInt32( data, 20 )
+        s.spiUs = FEncoding.getInt32( data, 24 )
+        s.flashBytes = FEncoding.getInt32( data, 28 )
+        s.flashEraseUs = FEncoding.getInt32( data, 32 )
+        s.flashProgramUs = FEncoding.getInt32( data, 36 )
+        s.xipBytes = FEncoding.getInt32( data, 40 )
+        s.xipUs = FEncoding.getInt32( data, 44 )
+
+    def rates( s ):
         """
-            Create transport pipe for a serial or ip.
+            Device stage throughput in KB/s
         """
-        proto,port = uri.split('://')
+        def rate( sz, us ):
+            if not us:
+                return 0.0
+            return (sz / 1024.0) / (us / 1000000.0)
+        
+        return { 'inflate': rate( s.inflateBytes, s.inflateUs ),
+                 'spi': rate( s.spiBytes, s.spiUs ),
+                 'flashErase': rate( s.flashBytes, s.flashEraseUs ),
+                 'flashProgram': rate( s.flashBytes, s.flashProgramUs ),
+                 'xip': rate( s.xipBytes, s.xipUs ) }
 
-        transport = None
-        if proto == FabricTransport.TransportTypeUSBSerial:
-            log( LogLevel.Debug, "Creating serial link for port %s" % port)
-            transport = USBSerialTransport( FabricTransport.TransportTypeUSBSerial, uri, port=port )
+    def __repr__( s ):
+        return "SelfTestPerf_Response( errorCode: %s, sysClockHz: %s, spiClockHz: %s, rates: %s )" % (str(s.errorCode), str(s.sysClockHz), str(s.spiClockHz), str(s.rates()) )
 
-        if not transport:
-            return None
-        
-        transport.initTransport()
-        return transport
-            
 
-    def __init__( s, transportType, uri, port=None, debug=0 ):
-        s.uri = uri
+class SelfTestConfigure_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.failedStage = None
+        s.fpgaDeviceId = 0
+        s.fpgaStatus = 0
+        s.bitStreamSz = 0
+        s.configureUs = 0
+        s.totalUs = 0
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.failedStage = data[4]
+        s.fpgaDeviceId = FEncoding.getInt32( data, 5 )
+        s.fpgaStatus = FEncoding.getInt32( data, 9 )
+        s.bitStreamSz = FEncoding.getInt32( data, 13 )
+        s.configureUs = FEncoding.getInt32( data, 17 )
+        s.totalUs = FEncoding.getInt32( data, 21 )
+
+    def stageName( s ):
+        if s.failedStage is not None and s.failedStage < len(FProgramBlock_Response.Stages):
+            return FProgramBlock_Response.Stages[ s.failedStage ]
+        return str(s.failedStage)
+
+    def __repr__( s ):
+        return "SelfTestConfigure_Response( errorCode: %s, failedStage: %s, fpgaStatus: 0x%x, configureUs: %s, totalUs: %s )" % (str(s.errorCode), s.stageName(), s.fpgaStatus, str(s.configureUs), str(s.totalUs) )
+
+
+class QueryFlashStatus_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.isIrqSafe = 0
+        s.opCnt = 0
+        s.chunkCnt = 0
+        s.eraseBytes = 0
+        s.programBytes = 0
+        s.maxChunkUs = 0
+        s.maxIrqOffUs = 0
+        s.opBytes = 0
+        s.opDoneBytes = 0
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.isIrqSafe = data[4]
+        s.opCnt = FEncoding.getInt32( data, 5 )
+        s.chunkCnt = FEncoding.getInt32( data, 9 )
+        s.eraseBytes = FEncoding.getInt32( data, 13 )
+        s.programBytes = FEncoding.getInt32( data, 17 )
+        s.maxChunkUs = FEncoding.getInt32( data, 21 )
+        s.maxIrqOffUs = FEncoding.getInt32( data, 25 )
+        s.opBytes = FEncoding.getInt32( data, 29 )
+        s.opDoneBytes = FEncoding.getInt32( data, 33 )
+
+    def __repr__( s ):
+        return "QueryFlashStatus_Response( errorCode: %s, isIrqSafe: %s, opCnt: %s, maxChunkUs: %s, maxIrqOffUs: %s, progress: %s/%s )" % (str(s.errorCode), str(s.isIrqSafe), str(s.opCnt),
+                                                                                                                          str(s.maxChunkUs), str(s.maxIrqOffUs), str(s.opDoneBytes), str(s.opBytes) )
+
+
+class ReadImage_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.blockId = 0
+        s.blockCnt = 0
+        s.bitStreamSz = 0
+        s.blockSz = 0
+        s.blockCrc = 0
+        s.isCompressed = 0
+        s.data = bytes([])
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.blockId = FEncoding.decodeInt16( data, 4 )
+        s.blockCnt = FEncoding.decodeInt16( data, 6 )
+        s.bitStreamSz = FEncoding.getInt32( data, 8 )
+        s.blockSz = FEncoding.decodeInt16( data, 12 )
+        s.blockCrc = data[14]
+        s.isCompressed = data[15]
+        dataSz = FEncoding.decodeInt16( data, 16 )
+        s.data = bytes( data[18:18+dataSz] )
+
+    def blockData( s ):
+        """
+            Uncompressed block, raises if it doesn't match the block crc.
+        """
+        block = zlib.decompress( s.data ) if s.isCompressed else s.data
+        if len(block) != s.blockSz or sum( block ) & 0xff != s.blockCrc:
+            raise Exception("Readback block %d failed crc" % s.blockId)
+        return block
+
+    def __repr__( s ):
+        return "ReadImage_Response( errorCode: %s, blockId: %s, blockCnt: %s, blockSz: %s, isCompressed: %s, dataSz: %s )" % (str(s.errorCode), str(s.blockId), str(s.blockCnt),
+                                                                                                                          str(s.blockSz), str(s.isCompressed), str(len(s.data)) )
+
+
+class UpdateBegin(FCmdBase):
+    def __init__( s, imageSz=0, imageHash=bytes( 32 ) ):
+        FCmdBase.__init__( s, FabricCommands.UpdateBegin )
+        s.imageSz = imageSz
+        s.imageHash = imageHash
+        
+    def toBytes( s ):
+        return FEncoding.encodeInt32( s.imageSz ) + s.imageHash
+    
+    def __repr__( s ):
+        return "UpdateBegin( %d, %s )" % (s.imageSz, s.imageHash.hex())
+
+
+class UpdateBegin_Response(FResponseBase):
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.runningSz = 0
+        s.runningHash = None
+        s.maxImageSz = 0
+        s.blockSz = 0
+        s.dictSz = 0
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.runningSz = FEncoding.getInt32( data, 4 )
+        s.runningHash = bytes( data[8:8+32] )
+        s.maxImageSz = FEncoding.getInt32( data, 40 )
+        s.blockSz = FEncoding.decodeInt16( data, 44 )
+        s.dictSz = FEncoding.decodeInt16( data, 46 )
+
+    def __repr__( s ):
+        return "UpdateBegin_Response( errorCode: %s, runningSz: %s, blockSz: %s, dictSz: %s )" % (str(s.errorCode), str(s.runningSz), str(s.blockSz), str(s.dictSz))
+
+
+class UpdateBlock(FCmdBase):
+    def __init__( s, offset=0, blockSz=0 ):
+        FCmdBase.__init__( s, FabricCommands.UpdateBlock )
+        s.offset = offset
+        s.blockSz = blockSz
+        s.dictOffset = 0
+        s.dictSz = 0 # plain block when 0
+        s.data = bytes([]) # raw deflate
+        
+    def toBytes( s ):
+        return FEncoding.encodeInt32( s.offset ) + FEncoding.encodeInt16( s.blockSz ) + FEncoding.encodeInt16( len(s.data) ) + \
+            FEncoding.encodeInt32( s.dictOffset ) + FEncoding.encodeInt16( s.dictSz ) + s.data
+    
+    def __repr__( s ):
+        return "UpdateBlock( %d, %d, %d, %d )" % (s.offset, s.blockSz, len(s.data), s.dictSz)
+
+
+class UpdateCommit(FCmdBase):
+    def __init__( s ):
+        FCmdBase.__init__( s, FabricCommands.UpdateCommit )
+        
+    def toBytes( s ):
+        return bytes( [] )
+    
+    def __repr__( s ):
+        return "UpdateCommit( )"
+
+
+class FlashEmuWrite(FCmdBase):
+    def __init__( s, offset=0, data=bytes([]) ):
+        FCmdBase.__init__( s, FabricCommands.FlashEmuWrite )
+        s.offset = offset
+        s.data = data
+        
+    def toBytes( s ):
+        compressed = zlib.compress( bytes( s.data ), level=9 )
+        return FEncoding.encodeInt32( s.offset ) + FEncoding.encodeInt16( len(s.data) ) + FEncoding.encodeInt16( len(compressed) ) + \
+            bytes( [ sum( s.data ) & 0xff ] ) + compressed
+    
+    def __repr__( s ):
+        return "FlashEmuWrite( %d, %d )" % (s.offset, len(s.data))
+
+
+class FlashEmu(FCmdBase):
+    def __init__( s, mode=FLASH_EMU_MODE_QUERY, imageSz=0, imageHash=bytes( 32 ) ):
+        FCmdBase.__init__( s, FabricCommands.FlashEmu )
+        s.mode = mode
+        s.imageSz = imageSz
+        s.imageHash = imageHash
+        
+    def toBytes( s ):
+        return bytes( [ s.mode ] ) + FEncoding.encodeInt32( s.imageSz ) + s.imageHash
+    
+    def __repr__( s ):
+        return "FlashEmu( %d, %d )" % (s.mode, s.imageSz)
+
+
+class FlashEmu_Response(FResponseBase):
+    States = [ 'off', 'serving', 'released' ]
+
+    def __init__( s ):
+        FResponseBase.__init__( s )
+        s.errorCode = 0
+        s.state = 0
+        s.flashOffset = 0 # design addresses are programmer flash offsets, the image starts here
+        s.regionSz = 0
+        s.blockSz = 0
+        s.readCnt = 0
+        s.imageHash = None
+        
+    def fromBytes( s, data ):                
+        s.errorCode = FEncoding.getInt32( data, 0 )
+        s.state = data[4]
+        s.flashOffset = FEncoding.getInt32( data, 5 )
+        s.regionSz = FEncoding.getInt32( data, 9 )
+        s.blockSz = FEncoding.decodeInt16( data, 13 )
+        s.readCnt = FEncoding.getInt32( data, 15 )
+        s.imageHash = bytes( data[19:19+32] )
+
+    def stateName( s ):
+        return s.States[ s.state ] if s.state < len(s.States) else str(s.state)
+
+    def __repr__( s ):
+        return "FlashEmu_Response( errorCode: %s, state: %s, flashOffset: 0x%x, readCnt: %s )" % (str(s.errorCode), s.stateName(), s.flashOffset, str(s.readCnt))
+
+
+class FabricTransport:
+    """
+        Transport base class, provides high level
+        device programming interface.
+    """
+    HeaderMagic = 0x1b
+    MaxWriteBlockSize = 0xffff-16
+    TransportTypeUSBSerial = 'usbserial'
+    TransportTypeIP = 'ip'
+
+    @staticmethod
+    def createTransportForUri( uri ):
+        """
+            Create transport pipe for a serial or ip.
+        """
+        proto,port = uri.split('://')
+
+        transport = None
+        if proto == FabricTransport.TransportTypeUSBSerial:
+            log( LogLevel.Debug, "Creating serial link for port %s" % port)
+            transport = USBSerialTransport( FabricTransport.TransportTypeUSBSerial, uri, port=port )
+
+        if not transport:
+            return None
+        
+        transport.initTransport()
+        return transport
+            
+
+    def __init__( s, transportType, uri, port=None, debug=0 ):
+        s.uri = uri
         s.port = port
         s.transportType = transportType
         s.debug = debug
+        s.maxBlockSz = None # from queryDevice
+        s.maxPacketSz = None # from queryDevice
+        s.features = 0 # from queryDevice
+        s.txBytes = 0 # framed bytes on the link, both ways
+        s.rxBytes = 0
+        s.rawBytes = 0 # bitstream bytes programmed, sent or by key
+        s.sentBlockCnt = 0
+        s.refBlockCnt = 0
+        s.failedStage = None # stage name of the last failed program, when the device reports it
         s.init()
 
     def init( s ):
@@ -1100,12 +2199,31 @@ class FabricTransport:
         """
         # impl
 
+    def readCommand( s, responseClass=None ):
+        """
+            Wait for a further response frame to the last command.
+        """
+        # impl
+
     def setFastTimeoutMode( s, isFash ):
         """
             Option to use a faster timeout mode when scanning devices
         """
         # impl
 
+    def closeTransport( s ):
+        """
+            Release the link so other processes can open the device.
+        """
+        # impl
+
+    def rebootAndReattach( s, timeout=REATTACH_TIMEOUT, reboot=None ):
+        """
+            Reboot the programmer & return a transport to it once it is back, None when it doesn't come back.
+            reboot replaces FCMD_RebootProgrammer for commands that reboot the device themselves.
+        """
+        # impl
+
     def queryDevice( s, timeout=None ):
         """
             Query device info            
@@ -1113,24 +2231,113 @@ class FabricTransport:
         cmd = FQueryDevicePacket()        
         response = s.writeCommand( cmd, timeout=timeout, responseClass=FQueryDevicePacket_Response )
         if response:
-            info = FabricDeviceInfo()            
-            info.status = DeviceStatus.Unkown
-            if response.deviceState == 1:
-                info.status = DeviceStatus.StatusExistsAndValid
-            info.fpgaDeviceId = response.fpgaDeviceId
-            info.uri = s.uri
-            info.uid = ''
-            for i in response.progDeviceId:
-                info.uid += hex(i)[2:]
+            return s.deviceInfoFromResponse( response )
+
 
-            return info
+    def deviceInfoFromResponse( s, response ):
+        """
+            Device info from a query device response, keeps block size & features for later commands.
+        """
+        info = FabricDeviceInfo()            
+        info.status = DeviceStatus.Unkown
+        if response.deviceState == 1:
+            info.status = DeviceStatus.StatusExistsAndValid
+        info.fpgaDeviceId = response.fpgaDeviceId
+        info.uri = s.uri
+        info.uid = ''
+        for i in response.progDeviceId:
+            info.uid += hex(i)[2:]
+        info.maxBlockSz = response.maxBlockSz
+        info.maxPacketSz = response.maxPacketSz
+        info.features = response.features
+        s.maxBlockSz = response.maxBlockSz
+        s.maxPacketSz = response.maxPacketSz
+        s.features = response.features
+
+        return info
+
+
+    def setDeviceInfo( s, info ):
+        """
+            Reuse block size & features from an earlier query, saves a round trip on new links.
+        """
+        s.maxBlockSz = info.maxBlockSz
+        s.maxPacketSz = info.maxPacketSz
+        s.features = info.features
 
 
-    def programDevice( s, bitstreamData, saveToFlash=False, timeout=None ):
+    def writeBatch( s, cmds, responseClasses, timeout=None ):
         """
-            Program bitstream to device
+            Run commands in order, stopping at the first failure. Devices with FEATURE_BATCH run them from
+            one frame & return all responses in one reply, others get a command per round trip.
+            Returns responses of the commands run.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if not s.features & FEATURE_BATCH:
+            responses = []
+            for cmd, responseClass in zip( cmds, responseClasses ):
+                response = s.writeCommand( cmd, timeout=timeout, responseClass=responseClass )
+                responses.append( response )
+                if response.cmd == FabricCommands.UnkownCmd or getattr( response, 'errorCode', 0 ) != 0:
+                    break
+            return responses
+
+        # split into frames the device takes, later frames only run if earlier ones completed
+        responses = []
+        i = 0
+        while i < len(cmds):
+            cmd = Batch()
+            while i < len(cmds) and len(cmd.cmds) < 0xff:
+                cmd.cmds.append( cmds[ i ] )
+                if len(cmd.cmds) > 1 and len(cmd.toBytes()) + 3 > (s.maxPacketSz or DEFAULT_MAX_BLOCK_SZ):
+                    cmd.cmds.pop()
+                    break
+                i += 1
+
+            response = s.writeCommand( cmd, timeout=timeout, responseClass=Batch_Response )
+            for (rcmd, rcnt, rdata), responseClass in zip( response.responses, responseClasses[ len(responses): ] ):
+                subResponse = responseClass()
+                subResponse.cmd = rcmd
+                subResponse.counter = rcnt
+                subResponse.fromBytes( rdata )
+                responses.append( subResponse )
+
+            if response.errorCode != 0:
+                if response.errorCode != 1:
+                    raise Exception("Device failed batch: %s" % BATCH_ERRORS.get( response.errorCode, str(response.errorCode) ) )
+                break
+        return responses
+
+
+    def queryStatus( s, timeout=None ):
+        """
+            Device info & resident images in one round trip, see queryImages.
+        """
+        if s.maxBlockSz is None or not s.features & FEATURE_IMAGE_LIST:
+            info = s.queryDevice( timeout=timeout )
+            configuredHash, imageHashes = s.queryImages( timeout=timeout )
+            return info, configuredHash, imageHashes
+
+        responses = s.writeBatch( [ FQueryDevicePacket(), QueryImages() ], [ FQueryDevicePacket_Response, QueryImages_Response ], timeout=timeout )
+        info = s.deviceInfoFromResponse( responses[ 0 ] )
+        if len(responses) < 2:
+            return info, None, []
+        return info, responses[ 1 ].configuredHash, responses[ 1 ].imageHashes
+
+
+    def programDevice( s, bitstreamData, saveToFlash=False, timeout=None, earlyAck=True ):
+        """
+            Program bitstream to device. With earlyAck the device acks each block on receipt and
+            processes it while the next one is sent, errors come back on a later ack.
         """        
-        blockSz = 4096-32
+        # block size & features from device, RP2350 builds take larger blocks
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+        blockSz = s.maxBlockSz or DEFAULT_MAX_BLOCK_SZ
+        earlyAck = earlyAck and (s.features & FEATURE_EARLY_ACK) != 0
+        blockResponseClass = FProgramBlock_Response if earlyAck else FGeneric_Response
         blockCnt = math.ceil(len(bitstreamData) / blockSz)
 
         sz = len( bitstreamData )
@@ -1142,6 +2349,8 @@ class FabricTransport:
         cmd.totalSize = sz
         cmd.blockCount = blockCnt
         cmd.bitstreamCrc = 0
+        if earlyAck:
+            cmd.flags = PROGRAM_FLAG_EARLY_ACK
         
         if s.debug > 0:
             log(LogLevel.Debug, "begin program cmd", cmd )
@@ -1151,6 +2360,14 @@ class FabricTransport:
             print("Program Begin Device Response:", response)
             raise Exception("Device failed to program with code: %s" % str(response.errorCode) )
 
+        # blocks the device already holds in flash are sent by key, the device pins them for this save
+        storedKeys = set()
+        savedKey = None
+        if s.features & FEATURE_BLOCK_STORE:
+            keys = [ blockKey( bitstreamData[ i : i + blockSz ] ) for i in range(0, sz, blockSz) ]
+            storedKeys = s.queryStoredBlocks( keys, timeout=timeout )
+            log(LogLevel.Info, "%s / %s blocks already in device flash" % (str(sum( 1 for k in keys if k in storedKeys )), str(blockCnt)) )
+
         # write blocks        
         i = 0
         blockId = 0
@@ -1166,28 +2383,50 @@ class FabricTransport:
                 blockCrc = blockCrc + j
             blockCrc = blockCrc & 0xff
 
-            # compress block
-            compressedBlock = compressData( block )
-            
-            # begin program
-            cmd = FQueryProgramBlock()
-            cmd.blockSz = len(block)
-            cmd.compressedBlockSz = len(compressedBlock)
-            cmd.blockId = blockId
-            cmd.bitStreamBlock = compressedBlock
-            cmd.blockCrc = blockCrc
+            key = blockKey( block ) if s.features & FEATURE_BLOCK_STORE else None
+            if key in storedKeys:
+                cmd = FProgramBlockRef()
+                cmd.blockId = blockId
+                cmd.blockSz = len(block)
+                cmd.blockCrc = blockCrc
+                cmd.blockKey = key
+
+                if s.debug > 0:
+                    log(LogLevel.Debug, str(cmd) )
+            else:
+                # compress block
+                compressedBlock = compressData( block )
+                
+                # begin program
+                cmd = FQueryProgramBlock()
+                cmd.blockSz = len(block)
+                cmd.compressedBlockSz = len(compressedBlock)
+                cmd.blockId = blockId
+                cmd.bitStreamBlock = compressedBlock
+                cmd.blockCrc = blockCrc
 
-            if s.debug > 0:
-                log(LogLevel.Debug, str(cmd) + " %s, %s" % (str(len(block)), str(len(compressedBlock)) ) )
+                if s.debug > 0:
+                    log(LogLevel.Debug, str(cmd) + " %s, %s" % (str(len(block)), str(len(compressedBlock)) ) )
 
             # log progress
             log(LogLevel.Progress, "Chunk %s / %s" % (str(i), str(sz) ) )
             
-            response = s.writeCommand( cmd, timeout=timeout, responseClass=FGeneric_Response )        
+            response = s.writeCommand( cmd, timeout=timeout, responseClass=blockResponseClass )        
             if response.errorCode != 0:
                 print("Write block device Response:", response)
-                raise Exception("Device failed to program with code: %s" % str(response.errorCode) )
+                raise s.programError( response )
+
+            # device saves a block before it handles the next one & latches a failed save, so a clean ack
+            # confirms the previous block is in flash. Later copies in this image go by key from then on.
+            if savedKey is not None:
+                storedKeys.add( savedKey )
+            savedKey = key if saveToFlash and isinstance( cmd, FQueryProgramBlock ) else None
         
+            s.rawBytes += blockSz
+            if isinstance( cmd, FProgramBlockRef ):
+                s.refBlockCnt += 1
+            else:
+                s.sentBlockCnt += 1
             i = i + blockSz
             blockId = blockId + 1
 
@@ -1197,16 +2436,112 @@ class FabricTransport:
         if s.debug > 0:
             print("begin end cmd", cmd )
         
-        response = s.writeCommand( cmd, timeout=timeout, responseClass=FGeneric_Response )        
+        response = s.writeCommand( cmd, timeout=timeout, responseClass=blockResponseClass )        
         if response.errorCode != 0:
             print("Program End Device Response:", response)
-            raise Exception("Device failed to program with code: %s" % str(response.errorCode) )
+            raise s.programError( response )
 
         log(LogLevel.Progress, "Completed %s / %s" % (str(sz), str(sz) ) )            
 
         return True
 
 
+    def programError( s, response ):
+        """
+            Exception for a failed block or complete response, names the failing block when known.
+        """
+        if isinstance( response, FProgramBlock_Response ) and response.failedStage:
+            s.failedStage = response.stageName()
+            return Exception("Device failed to program block %s at stage '%s' with code: %s" % (str(response.failedBlockId), response.stageName(), str(response.errorCode)) )
+        return Exception("Device failed to program with code: %s" % str(response.errorCode) )
+
+
+    def configureImage( s, bitstreamData, timeout=None, earlyAck=True, patches=None ):
+        """
+            Program through the device image cache. Programs from flash when the device holds the image,
+            otherwise uploads & saves it in place of the least recently used image. Returns True on a hit.
+            The cache holds the unpatched image, patches are applied by the device each time it programs.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        devicePatches = s.devicePatchList( bitstreamData, patches, timeout=timeout ) if patches else []
+        if devicePatches is None:
+            log(LogLevel.Info, "Device can't apply the patch list, uploading patched image without saving" )
+            if not s.programDevice( Ecp5Bitstream( bitstreamData ).patch( patches ), saveToFlash=False, timeout=timeout, earlyAck=earlyAck ):
+                raise Exception("Device failed to program patched image")
+            return False
+
+        if s.features & FEATURE_IMAGE_CACHE:
+            cmd = ConfigureImage()
+            cmd.bitStreamHash = imageHash( bitstreamData )
+            response = s.configureResident( cmd, devicePatches, timeout=timeout )
+            if response.isResident and response.errorCode == 0:
+                log(LogLevel.Info, "Image cache hit %s" % cmd.bitStreamHash.hex() )
+                return True
+            log(LogLevel.Info, "Image cache miss %s" % cmd.bitStreamHash.hex() )
+
+        if not s.programDevice( bitstreamData, saveToFlash=True, timeout=timeout, earlyAck=earlyAck ):
+            raise Exception("Device failed to program image %s" % imageHash( bitstreamData ).hex() )
+
+        # now resident, program again from flash with the patches
+        if devicePatches:
+            response = s.configureResident( cmd, devicePatches, timeout=timeout )
+            if not response.isResident or response.errorCode != 0:
+                raise Exception("Device failed to program patched image %s" % cmd.bitStreamHash.hex() )
+        return False
+
+
+    def configureResident( s, cmd, devicePatches, timeout=None ):
+        """
+            Run ConfigureImage, patch list is sent in the same batch.
+        """
+        if not devicePatches:
+            return s.writeCommand( cmd, timeout=timeout, responseClass=ConfigureImage_Response )
+
+        responses = s.writeBatch( [ s.setPatchesCmd( devicePatches ), cmd ], [ FGeneric_Response, ConfigureImage_Response ], timeout=timeout )
+        if len(responses) < 2:
+            raise Exception("Device rejected patch list")
+        return responses[ 1 ]
+
+
+    def queryImages( s, timeout=None ):
+        """
+            Returns hash of the image the FPGA is configured with or None, and the hashes of images stored in
+            flash most recently used first. Older bootloaders only report their startup image.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if s.features & FEATURE_IMAGE_LIST:
+            response = s.writeCommand( QueryImages(), timeout=timeout, responseClass=QueryImages_Response )
+            if response and response.errorCode == 0:
+                return response.configuredHash, response.imageHashes
+            return None, []
+
+        flashInfo = s.queryBitstreamFlash( timeout=timeout )
+        if flashInfo and flashInfo.errorCode == 0 and flashInfo.bitStreamHash:
+            return None, [ flashInfo.bitStreamHash ]
+        return None, []
+
+
+    def queryStoredBlocks( s, keys, timeout=None ):
+        """
+            Returns set of block keys already stored in device flash.
+        """
+        stored = set()
+        for i in range(0, len(keys), MAX_QUERY_KEYS):
+            cmd = QueryBlockKeys()
+            cmd.keys = keys[ i : i + MAX_QUERY_KEYS ]
+            response = s.writeCommand( cmd, timeout=timeout, responseClass=QueryBlockKeys_Response )
+            if not response or response.errorCode != 0:
+                return set()
+            for key, isStored in zip( cmd.keys, response.isStored ):
+                if isStored:
+                    stored.add( key )
+        return stored
+
+
     def clearFlash( s, timeout=None ):
         """
             Clear flash and prevent bitstream boot.
@@ -1217,6 +2552,51 @@ class FabricTransport:
             return response.errorCode == 0
 
 
+    def programFromFlash( s, timeout=None, patches=None ):
+        """
+            Program FPGA with bitstream stored in device flash, patches from devicePatchList are applied
+            by the device as it streams.
+        """        
+        cmd = ProgramBitstreamFromFlash()        
+        if patches:
+            responses = s.writeBatch( [ s.setPatchesCmd( patches ), cmd ], [ FGeneric_Response, FGeneric_Response ], timeout=timeout )
+            return len(responses) == 2 and responses[ 1 ].errorCode == 0
+        response = s.writeCommand( cmd, timeout=timeout, responseClass=FGeneric_Response )
+        if response:
+            return response.errorCode == 0
+
+
+    def devicePatchList( s, bitstreamData, patches, timeout=None ):
+        """
+            Resolve patch list to the ( offset, data ) list the device applies. Returns None when the host has
+            to patch instead: no FEATURE_PATCH, compressed frames are patched or the list is too big.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        raw, codes = Ecp5Bitstream( bitstreamData ).resolvePatches( patches )
+        listSz = sum( 6 + len(data) for offset, data in raw )
+        if not s.features & FEATURE_PATCH or not s.features & FEATURE_IMAGE_CACHE or codes or len(raw) > 0xff or listSz > PATCH_LIST_SZ:
+            return None
+        return raw
+
+
+    def setPatchesCmd( s, patches ):
+        cmd = SetPatches()
+        cmd.patches = patches
+        return cmd
+
+
+    def isImageInFlash( s, bitstreamData, timeout=None ):
+        """
+            Check flash already holds a valid copy of the bitstream.
+        """
+        flashInfo = s.queryBitstreamFlash( timeout=timeout )
+        if not flashInfo or flashInfo.errorCode != 0 or not flashInfo.bitStreamHash:
+            return False
+        return flashInfo.bitStreamSz == len(bitstreamData) and flashInfo.bitStreamHash == imageHash( bitstreamData )
+
+
     def rebootProgrammer( s, timeout=None ):
         """
             Reboot programmer device
@@ -1236,6 +2616,211 @@ class FabricTransport:
         cmd = QueryBitstreamFlash()        
         return s.writeCommand( cmd, timeout=timeout, responseClass=QueryBitstreamFlash_Response )
 
+
+    def selfTestPerf( s, timeout=None ):
+        """
+            Run device pipeline benchmark, returns per stage timings.
+        """
+        cmd = SelfTestPerf()
+        return s.writeCommand( cmd, timeout=timeout, responseClass=SelfTestPerf_Response )
+
+
+    def selfTestConfigure( s, timeout=None ):
+        """
+            Configure the self test design resident in the bootloader, nothing is uploaded or saved.
+            Returns None when the device has no resident design.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if not s.features & FEATURE_SELFTEST:
+            return None
+
+        cmd = SelfTestConfigure()
+        return s.writeCommand( cmd, timeout=timeout, responseClass=SelfTestConfigure_Response )
+
+
+    def readImage( s, bitStreamHash=None, window=READBACK_WINDOW, compress=True, timeout=None ):
+        """
+            Read back a stored image, the startup image when no hash is given. Blocks stream back a window
+            at a time, compressed on the device, and the result is checked against the stored image hash.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if not s.features & FEATURE_READBACK:
+            raise Exception("Device can't read back images, update the bootloader")
+
+        # pin the startup image by hash so a save during readback can't mix images
+        if not bitStreamHash:
+            flashInfo = s.queryBitstreamFlash( timeout=timeout )
+            if not flashInfo or flashInfo.errorCode != 0 or not flashInfo.bitStreamHash:
+                raise Exception("No stored image to read back")
+            bitStreamHash = flashInfo.bitStreamHash
+
+        blocks = []
+        blockCnt = 1
+        transferSz = 0
+        while len(blocks) < blockCnt:
+            cmd = ReadImage( bitStreamHash, len(blocks), window, READ_FLAG_COMPRESS if compress else 0 )
+            response = s.writeCommand( cmd, timeout=timeout, responseClass=ReadImage_Response )
+            for i in range( min( window, (response.blockCnt or blockCnt) - len(blocks) ) ):
+                if i:
+                    response = s.readCommand( ReadImage_Response )
+                if response.errorCode != 0 or response.blockId != len(blocks):
+                    raise Exception("Readback failed at block %d, error: %d" % (len(blocks), response.errorCode))
+                blockCnt = response.blockCnt
+                blocks.append( response.blockData() )
+                transferSz += len(response.data)
+
+        bitstreamData = b''.join( blocks )
+        if imageHash( bitstreamData ) != bitStreamHash:
+            raise Exception("Readback image hash mismatch")
+
+        log( LogLevel.Debug, "Read back %d bytes in %d blocks, %d bytes transferred" % (len(bitstreamData), blockCnt, transferSz) )
+        return bitstreamData
+
+
+    def queryFlashStatus( s, timeout=None ):
+        """
+            Flash erase & program counters and the longest usb stall they caused.
+            Returns None on bootloaders that don't chunk flash writes.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if not s.features & FEATURE_FLASH_STATUS:
+            return None
+
+        cmd = QueryFlashStatus()
+        return s.writeCommand( cmd, timeout=timeout, responseClass=QueryFlashStatus_Response )
+
+
+    def flashEmuCommand( s, mode, image=bytes([]), timeout=None ):
+        """
+            Start, stop or query the spi flash emulator, the response hashes len(image) bytes of the region.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if not s.features & FEATURE_FLASH_EMU:
+            raise Exception("Device doesn't support flash emulation, update the bootloader")
+
+        response = s.writeCommand( FlashEmu( mode, len(image), imageHash( image ) if image else bytes( 32 ) ), timeout=timeout, responseClass=FlashEmu_Response )
+        if response.cmd == FabricCommands.UnkownCmd or response.errorCode != 0:
+            raise Exception("Device flash emulator failed: %s" % FLASH_EMU_ERRORS.get( response.errorCode, str(response.errorCode) ))
+        return response
+
+
+    def flashEmulate( s, image, timeout=None ):
+        """
+            Serve image to the configured design as its spi flash, written to the emulated region unless it
+            already holds it. Returns the FlashEmu_Response, the soft core finds the image at its flashOffset.
+        """
+        response = s.flashEmuCommand( FLASH_EMU_MODE_QUERY, timeout=timeout )
+        if len(image) > response.regionSz:
+            raise Exception("Image of %d bytes doesn't fit the %d byte emulated flash" % (len(image), response.regionSz))
+
+        if s.flashEmuCommand( FLASH_EMU_MODE_QUERY, image, timeout=timeout ).imageHash == imageHash( image ):
+            log( LogLevel.Info, "Emulated flash already holds the image" )
+        else:
+            for offset in range( 0, len(image), response.blockSz ):
+                cmd = FlashEmuWrite( offset, image[ offset : offset + response.blockSz ] )
+                writeResponse = s.writeCommand( cmd, timeout=timeout, responseClass=FGeneric_Response )
+                if writeResponse.cmd == FabricCommands.UnkownCmd or writeResponse.errorCode != 0:
+                    raise Exception("Device failed flash emulator block at %d: %s" % (offset, FLASH_EMU_ERRORS.get( writeResponse.errorCode, str(writeResponse.errorCode) )))
+                log( LogLevel.Progress, "Emulated flash %s / %s" % (str(offset + len(cmd.data)), str(len(image))) )
+
+        return s.flashEmuCommand( FLASH_EMU_MODE_START, image, timeout=timeout )
+
+
+    def selfUpdate( s, image, bases=(), timeout=None ):
+        """
+            Stream a new bootloader image into the device staging region, the device checks its hash, swaps it
+            in & reboots. When one of bases is the running image blocks are deflated against the part of it
+            they most likely came from, so a small change sends little more than the difference.
+            Returns the transport reattached to the updated device, this one when it already runs the image.
+        """
+        if s.maxBlockSz is None:
+            s.queryDevice( timeout=timeout )
+
+        if not s.features & FEATURE_SELF_UPDATE:
+            raise Exception("Device can't update in band, install the bootloader over BOOTSEL once")
+
+        cmd = UpdateBegin( len(image), imageHash( image ) )
+        response = s.writeCommand( cmd, timeout=timeout, responseClass=UpdateBegin_Response )
+        if response.errorCode != 0:
+            raise Exception("Device rejected update: %s" % UPDATE_ERRORS.get( response.errorCode, str(response.errorCode) ))
+        if len(image) - response.runningSz < FLASH_PAGE_SIZE and imageHash( image[ :response.runningSz ] ) == response.runningHash:
+            log( LogLevel.Info, "Device already runs bootloader %s" % cmd.imageHash.hex()[ :16 ] )
+            return s
+
+        base = None
+        for b in bases:
+            if len(b) >= response.runningSz and imageHash( b[ :response.runningSz ] ) == response.runningHash:
+                base = b[ :response.runningSz ]
+                break
+        log( LogLevel.Info, "Updating bootloader, %d bytes %s" % (len(image), "as delta against the running image" if base else "in full, running image unknown") )
+
+        # each block as the smaller of plain or deflated against the running image around where it sits
+        transferSz = 0
+        shift = 0
+        dictSz = min( response.dictSz, response.runningSz )
+        for offset in range( 0, len(image), response.blockSz ):
+            block = image[ offset : offset + response.blockSz ]
+            cmd = UpdateBlock( offset, len(block) )
+            cmd.data = deflateRaw( block )
+            if base:
+                blockShift = baseShift( block, base, offset, shift )
+                for candidate in sorted( set( [ blockShift, shift, 0 ] ) ):
+                    dictOffset = min( max( 0, offset + candidate + len(block) // 2 - dictSz // 2 ), len(base) - dictSz )
+                    data = deflateRaw( block, base[ dictOffset : dictOffset + dictSz ] )
+                    if len(data) < len(cmd.data):
+                        cmd.data, cmd.dictOffset, cmd.dictSz = data, dictOffset, dictSz
+                shift = blockShift
+
+            blockResponse = s.writeCommand( cmd, timeout=timeout, responseClass=FGeneric_Response )
+            if blockResponse.cmd == FabricCommands.UnkownCmd or blockResponse.errorCode != 0:
+                raise Exception("Device failed update block at %d: %s" % (offset, UPDATE_ERRORS.get( blockResponse.errorCode, str(blockResponse.errorCode) )))
+            transferSz += len(cmd.data)
+            log( LogLevel.Progress, "Bootloader %s / %s" % (str(offset + len(block)), str(len(image))) )
+
+        log( LogLevel.Info, "Staged %d bytes in %d bytes transferred, swapping" % (len(image), transferSz) )
+
+        def commit():
+            commitResponse = s.writeCommand( UpdateCommit(), timeout=timeout, responseClass=FGeneric_Response )
+            if commitResponse.errorCode != 0:
+                raise Exception("Device rejected staged bootloader: %s" % UPDATE_ERRORS.get( commitResponse.errorCode, str(commitResponse.errorCode) ))
+
+        transport = s.rebootAndReattach( timeout=UPDATE_REATTACH_TIMEOUT, reboot=commit )
+        if not transport:
+            raise Exception("Device didn't come back after the bootloader swap")
+
+        # new bootloader reports what it runs, an older one without self update can't
+        if transport.features & FEATURE_SELF_UPDATE:
+            response = transport.writeCommand( UpdateBegin(), timeout=timeout, responseClass=UpdateBegin_Response )
+            if imageHash( image[ :response.runningSz ] ) != response.runningHash:
+                raise Exception("Device runs another bootloader after the swap")
+        return transport
+
+
+    def measureLinkRate( s, payloadSz=PERF_ECHO_SIZE, count=PERF_ECHO_COUNT, timeout=None ):
+        """
+            Echo payloads to measure link round trip throughput in KB/s.
+        """
+        cmd = FEchoPacket()
+        cmd.data = bytes( [ i & 0xff for i in range(payloadSz) ] )
+
+        start = time.time()
+        for i in range(count):
+            response = s.writeCommand( cmd, timeout=timeout, responseClass=FEcho_Response )
+            if response.data != cmd.data:
+                raise Exception("Echo payload mismatch")
+        elapsed = time.time() - start
+
+        # payload travels both ways
+        return (2 * payloadSz * count / 1024.0) / elapsed
+
     
 
 class USBSerialTransport(FabricTransport):
@@ -1247,13 +2832,14 @@ class USBSerialTransport(FabricTransport):
         s.baudrate = DEFAULT_BAUD        
         s.counter = 0
 
-    def initTransport( s ):
+    def initTransport( s, flush=True ):
         """
             Low level re-init transport eg. recreate serial port etc.
         """
         s.ser = serial.Serial(port=s.port, baudrate=s.baudrate, timeout=s.timeout, write_timeout=s.timeout)
-        s.ser.flushInput()
-        s.ser.flushOutput()        
+        if flush:
+            s.ser.flushInput()
+            s.ser.flushOutput()        
 
     def setFastTimeoutMode( s, isFash ):
         """
@@ -1261,6 +2847,12 @@ class USBSerialTransport(FabricTransport):
         """
         s.ser.timeout = SERIAL_FAST_TIMEOUT
         s.ser.write_timeout = SERIAL_FAST_TIMEOUT
+
+    def closeTransport( s ):
+        """
+            Close serial port
+        """
+        s.ser.close()
         
     @staticmethod
     def writeBlock( ser, data ):
@@ -1347,6 +2939,7 @@ class USBSerialTransport(FabricTransport):
         # create packet
         packet = bytes( [cmd.cmd, s.counter ] ) + cmd.toBytes() # FPayloadHeader + PayloadStruct
         s.writeBlock( s.ser, packet )
+        s.txBytes += len(packet) + 4 # magic, size & crc
 
         # handle response
         if responseClass:
@@ -1356,8 +2949,13 @@ class USBSerialTransport(FabricTransport):
     def readCommand( s, responseClass=None ):
         rcmd, rcnt, rdata = s.readPacket()
 
+        # startup frame of the port open can land after the flush
+        if rcmd == FabricCommands.DeviceStartup:
+            rcmd, rcnt, rdata = s.readPacket()
+
         if not rdata:
             raise Exception("No response")
+        s.rxBytes += len(rdata) + 6
             
         # instance and parse response
         responseCmd = responseClass()
@@ -1369,6 +2967,171 @@ class USBSerialTransport(FabricTransport):
         return responseCmd
     
     
+    def readStartupFrame( s, timeout ):
+        """
+            Device info the bootloader sends when the port is opened, None when none comes.
+        """
+        s.ser.timeout = timeout
+        try:
+            rcmd, rcnt, rdata = s.readPacket()
+        finally:
+            s.ser.timeout = s.timeout
+
+        if rcmd != FabricCommands.DeviceStartup:
+            return None
+        response = FQueryDevicePacket_Response()
+        response.cmd = rcmd
+        response.counter = rcnt
+        response.fromBytes( rdata )
+        return response
+
+
+    def rebootAndReattach( s, timeout=REATTACH_TIMEOUT, reboot=None ):
+        """
+            Reboot the programmer & return a transport to it once it is back. The re-enumerated port is
+            found from hotplug events by board uid & the session resumes on the device startup frame, so
+            the wait is bound by usb enumeration instead of timeouts & probing.
+        """
+        info = s.writeCommand( FQueryDevicePacket(), responseClass=FQueryDevicePacket_Response )
+        uid = bytes( info.progDeviceId )
+
+        # watch before rebooting so the add event can't be missed
+        watcher = HotplugWatcher()
+        try:
+            start = time.time()
+            deadline = start + timeout
+            (reboot or s.rebootProgrammer)()
+            s.closeTransport()
+
+            while True:
+                added = watcher.next( deadline - time.time() )
+                if not added:
+                    return None
+                port, serialNumber = added
+
+                # pico usb serial number is the board uid
+                if serialNumber and serialNumber.upper() != uid.hex().upper():
+                    log( LogLevel.Debug, "Ignoring port %s of board %s" % (port, serialNumber) )
+                    continue
+
+                transport = s.attach( port, uid, deadline )
+                if transport:
+                    log( LogLevel.Info, "Programmer back on %s after %d ms" % (port, int( 1000 * (time.time() - start) )) )
+                    return transport
+        finally:
+            watcher.close()
+
+
+    def attach( s, port, uid, deadline ):
+        """
+            Open a re-enumerated port & wait for its startup frame, None when another board answers.
+        """
+        uri = FabricTransport.TransportTypeUSBSerial + '://' + port
+        transport = USBSerialTransport( FabricTransport.TransportTypeUSBSerial, uri, port=port )
+
+        # node can lag the event until udev has applied its rules
+        while True:
+            try:
+                transport.initTransport( flush=False )
+                break
+            except serial.SerialException:
+                if time.time() > deadline:
+                    return None
+                time.sleep( HOTPLUG_POLL_INTERVAL )
+
+        try:
+            response = transport.readStartupFrame( STARTUP_FRAME_TIMEOUT )
+            if response is None:
+                response = transport.writeCommand( FQueryDevicePacket(), responseClass=FQueryDevicePacket_Response ) # older bootloaders
+        except Exception as e:
+            log( LogLevel.Debug, "No answer on %s: %s" % (port, str(e)) )
+            response = None
+
+        if not response or bytes( response.progDeviceId ) != uid:
+            transport.closeTransport()
+            return None
+        transport.deviceInfoFromResponse( response )
+        return transport
+
+
+class HotplugWatcher:
+    """
+        Serial ports added after the watcher starts & their usb serial number when known. Listens to udev
+        through pyudev when installed, else to kernel uevents on a netlink socket, else polls the port list.
+    """
+    def __init__( s ):
+        s.monitor = None
+        s.sock = None
+        s.knownPorts = set( p.device for p in comports() )
+
+        try:
+            import pyudev
+            s.monitor = pyudev.Monitor.from_netlink( pyudev.Context() )
+            s.monitor.filter_by( 'tty' )
+            s.monitor.start()
+            return
+        except Exception:
+            s.monitor = None
+
+        if hasattr( socket, 'AF_NETLINK' ):
+            try:
+                s.sock = socket.socket( socket.AF_NETLINK, socket.SOCK_DGRAM, NETLINK_KOBJECT_UEVENT )
+                s.sock.bind( ( 0, 1 ) ) # kernel uevent group
+            except OSError:
+                s.sock = None
+
+    def close( s ):
+        if s.sock:
+            s.sock.close()
+
+    @staticmethod
+    def sysfsSerial( devPath ):
+        """
+            usb serial number of the device a tty sits on.
+        """
+        path = os.path.realpath( '/sys' + devPath )
+        while path.startswith( '/sys/devices/' ):
+            try:
+                with open( os.path.join( path, 'serial' ) ) as f:
+                    return f.read().strip()
+            except OSError:
+                path = os.path.dirname( path )
+        return None
+
+    def next( s, timeout ):
+        """
+            Next added ( port, serialNumber ), None on timeout.
+        """
+        deadline = time.time() + timeout
+        while True:
+            remaining = deadline - time.time()
+            if remaining <= 0:
+                return None
+
+            if s.monitor:
+                device = s.monitor.poll( timeout=remaining )
+                if device and device.action == 'add' and device.device_node:
+                    return device.device_node, device.get( 'ID_SERIAL_SHORT' )
+
+            elif s.sock:
+                if not select.select( [ s.sock ], [], [], remaining )[ 0 ]:
+                    continue
+                fields = s.sock.recv( 8192 ).split( b'\0' )
+                event = dict( f.decode( errors='replace' ).split( '=', 1 ) for f in fields[ 1: ] if b'=' in f )
+                if event.get( 'ACTION' ) == 'add' and event.get( 'SUBSYSTEM' ) == 'tty' and event.get( 'DEVNAME' ):
+                    return '/dev/' + event[ 'DEVNAME' ], s.sysfsSerial( event.get( 'DEVPATH', '' ) )
+
+            else:
+                # ports that went away are reported again when they come back
+                ports = { p.device: p.serial_number for p in comports() }
+                s.knownPorts &= set( ports )
+                added = [ p for p in ports if p not in s.knownPorts ]
+                if added:
+                    s.knownPorts.add( added[ 0 ] )
+                    return added[ 0 ], ports[ added[ 0 ] ]
+                time.sleep( min( HOTPLUG_POLL_INTERVAL, remaining ) )
+
+
 class FabricService:
     """
         Finds fabric devices on USB & IP networks.        
@@ -1376,9 +3139,9 @@ class FabricService:
     def __init__( s ):
         s.deviceCache = {}
         
-    def listDevices( s, returnOnMinCnt=None, transportTypes=[FabricTransport.TransportTypeUSBSerial, FabricTransport.TransportTypeIP], useCache=True ):
+    def listDevices( s, returnOnMinCnt=None, transportTypes=[FabricTransport.TransportTypeUSBSerial, FabricTransport.TransportTypeIP], useCache=True, excludeUris=() ):
         """
-            Search transports like usbserial for valid devices.
+            Search transports like usbserial for valid devices, excludeUris are not probed.
         """
         devices = [];
 
@@ -1394,6 +3157,8 @@ class FabricService:
                 
                 # construct uri with usb serial port
                 uri = FabricTransport.TransportTypeUSBSerial + '://' + port
+                if uri in excludeUris:
+                    continue
                 deviceUris.append( uri )
 
 
@@ -1455,7 +3220,10 @@ class FabricService:
         if fast:
             transport.setFastTimeoutMode( True )
             
-        return transport.queryDevice()
+        try:
+            return transport.queryDevice()
+        finally:
+            transport.closeTransport()
 
 
     def addDeviceCache( s, deviceInfo ):
@@ -1479,6 +3247,531 @@ class FabricService:
         return deviceInfo
 
 
+class FarmMetrics:
+    """
+        Farm counters, gauges & histograms by label set, rendered as OpenMetrics or Prometheus text.
+    """
+    Help = {
+        'fabric_discovery_seconds': 'Board scan time of the farm service',
+        'fabric_boards': 'Boards in the farm',
+        'fabric_board_info': 'Board uid to uri, 1 while the board is in the farm',
+        'fabric_board_load': 'Queued & running jobs on the board',
+        'fabric_jobs': 'Farm jobs by how the image got into the FPGA',
+        'fabric_upload_seconds': 'Time to get a job image into the FPGA',
+        'fabric_upload_raw_bytes': 'Bitstream bytes programmed, sent or by block key',
+        'fabric_upload_wire_bytes': 'Framed bytes on the link while programming, both ways',
+        'fabric_upload_blocks': 'Programmed blocks, sent compressed or by block key',
+        'fabric_upload_retries': 'Job uploads retried after a failure',
+        'fabric_upload_failures': 'Failed job uploads by the stage the device reports',
+        'fabric_link_kbps': 'Echo round trip rate of the link at the last idle refresh',
+        'fabric_refresh_failures': 'Idle refreshes that dropped the board',
+        'fabric_device_flash_ops': 'Device flash erase & program operations since boot',
+        'fabric_device_flash_erase_bytes': 'Device flash bytes erased since boot',
+        'fabric_device_flash_program_bytes': 'Device flash bytes programmed since boot',
+        'fabric_device_flash_max_chunk_us': 'Longest device flash chunk since boot',
+        'fabric_device_flash_max_irq_off_us': 'Longest device time with interrupts off for flash since boot',
+        'fabric_device_flash_emu_reads': 'Spi flash emulator reads answered since it started',
+    }
+
+    def __init__( s ):
+        s.lock = threading.Lock()
+        s.types = {} # name -> counter, gauge or histogram
+        s.values = {} # (name, labels) -> value, or [ bucket counts, sum, count ] for histograms
+
+    @staticmethod
+    def labelKey( labels ):
+        return tuple( sorted( labels.items() ) )
+
+    def inc( s, name, value=1, **labels ):
+        with s.lock:
+            s.types[ name ] = 'counter'
+            key = (name, s.labelKey( labels ))
+            s.values[ key ] = s.values.get( key, 0 ) + value
+
+    def set( s, name, value, isCounter=False, **labels ):
+        """
+            Set a gauge, or a counter kept by the device which resets when it reboots.
+        """
+        with s.lock:
+            s.types[ name ] = 'counter' if isCounter else 'gauge'
+            s.values[ (name, s.labelKey( labels )) ] = value
+
+    def remove( s, **labels ):
+        """
+            Drop series of a board that left the farm.
+        """
+        with s.lock:
+            for key in [ k for k in s.values if all( (n, v) in k[ 1 ] for n, v in labels.items() ) ]:
+                del s.values[ key ]
+
+    def observe( s, name, value, buckets=METRICS_SECONDS_BUCKETS, **labels ):
+        with s.lock:
+            s.types[ name ] = 'histogram'
+            key = (name, s.labelKey( labels ))
+            if key not in s.values:
+                s.values[ key ] = [ [ 0 ] * len(buckets), 0.0, 0, buckets ]
+            h = s.values[ key ]
+            for i, le in enumerate( buckets ):
+                if value <= le:
+                    h[ 0 ][ i ] += 1
+            h[ 1 ] += value
+            h[ 2 ] += 1
+
+    @staticmethod
+    def formatLabels( labels, extra=() ):
+        items = list( labels ) + list( extra )
+        if not items:
+            return ''
+        escape = lambda v: str(v).replace( '\\', '\\\\' ).replace( '"', '\\"' ).replace( '\n', '\\n' )
+        return '{' + ','.join( '%s="%s"' % (n, escape( v )) for n, v in items ) + '}'
+
+    def render( s, isOpenMetrics=True ):
+        """
+            Exposition text, OpenMetrics names counter families without the _total suffix & ends with # EOF.
+        """
+        lines = []
+        with s.lock:
+            for name in sorted( s.types ):
+                kind = s.types[ name ]
+                family = name if isOpenMetrics or kind != 'counter' else name + '_total'
+                lines.append( "# TYPE %s %s" % (family, kind) )
+                if name in s.Help:
+                    lines.append( "# HELP %s %s" % (family, s.Help[ name ]) )
+                for (n, labels), value in sorted( s.values.items(), key=lambda i: (i[ 0 ][ 0 ], i[ 0 ][ 1 ]) ):
+                    if n != name:
+                        continue
+                    if kind == 'histogram':
+                        counts, total, cnt, buckets = value
+                        for le, c in zip( buckets, counts ):
+                            lines.append( "%s_bucket%s %d" % (name, s.formatLabels( labels, [ ('le', repr( float( le ) )) ] ), c) )
+                        lines.append( "%s_bucket%s %d" % (name, s.formatLabels( labels, [ ('le', '+Inf') ] ), cnt) )
+                        lines.append( "%s_count%s %d" % (name, s.formatLabels( labels ), cnt) )
+                        lines.append( "%s_sum%s %s" % (name, s.formatLabels( labels ), repr( float( total ) )) )
+                    elif kind == 'counter':
+                        lines.append( "%s_total%s %s" % (name, s.formatLabels( labels ), str(value)) )
+                    else:
+                        lines.append( "%s%s %s" % (name, s.formatLabels( labels ), str(value)) )
+        if isOpenMetrics:
+            lines.append( "# EOF" )
+        return '\n'.join( lines ) + '\n'
+
+
+class FarmBoard:
+    """
+        Board in a farm, images it holds & jobs queued on it.
+    """
+    def __init__( s, deviceInfo ):
+        s.uri = deviceInfo.uri
+        s.uid = deviceInfo.uid
+        s.deviceInfo = deviceInfo
+        s.configuredHash = None # image in the FPGA
+        s.imageHashes = [] # images in flash, most recently used first
+        s.load = 0 # queued & running jobs
+        s.lock = threading.Lock() # held for the length of a job
+
+    def affinityCost( s, bitStreamHash ):
+        """
+            Cost of getting the image onto this board, in queued jobs.
+        """
+        if bitStreamHash == s.configuredHash:
+            return 0.0
+        if bitStreamHash in s.imageHashes:
+            return FARM_FLASH_COST
+        return FARM_UPLOAD_COST
+
+    def openTransport( s ):
+        transport = FabricTransport.createTransportForUri( s.uri )
+        transport.setDeviceInfo( s.deviceInfo )
+        return transport
+
+    def refresh( s, transport ):
+        """
+            Update device status & resident images, raises if the FPGA stopped responding.
+        """
+        info, configuredHash, imageHashes = transport.queryStatus()
+        if not info or info.status != DeviceStatus.StatusExistsAndValid:
+            raise Exception("FPGA not detected")
+        s.deviceInfo = info
+        if configuredHash or imageHashes:
+            s.configuredHash = configuredHash
+            s.imageHashes = imageHashes
+
+    def toDict( s ):
+        return { 'uri': s.uri,
+                 'uid': s.uid,
+                 'load': s.load,
+                 'configuredHash': s.configuredHash.hex() if s.configuredHash else None,
+                 'imageHashes': [ h.hex() for h in s.imageHashes ] }
+
+    def __repr__( s ):
+        return "FarmBoard( %s, %s, load: %s, images: %s )" % (str(s.uri), str(s.uid), str(s.load), str(len(s.imageHashes)))
+
+
+class FarmScheduler:
+    """
+        Routes programming jobs across a pool of boards. Jobs go to the board where the requested image
+        is cheapest to reach, the configured image then images in flash, weighed against each board's queue
+        so a busy board holding the image doesn't starve idle ones.
+    """
+    def __init__( s, service, metrics=None ):
+        s.service = service
+        s.boards = {} # by uri
+        s.lock = threading.Lock()
+        s.metrics = metrics or FarmMetrics()
+
+    def scanBoards( s ):
+        """
+            Add boards found by the service & refresh idle ones, boards that stop responding are dropped.
+        """
+        with s.lock:
+            knownUris = list( s.boards.keys() )
+
+        t0 = time.time()
+        deviceInfos = s.service.listDevices( excludeUris=knownUris )
+        s.metrics.observe( 'fabric_discovery_seconds', time.time() - t0 )
+
+        for deviceInfo in deviceInfos:
+            if deviceInfo.status != DeviceStatus.StatusExistsAndValid:
+                continue
+            board = FarmBoard( deviceInfo )
+            with board.lock:
+                s.refreshBoard( board )
+            with s.lock:
+                s.boards[ board.uri ] = board
+            s.metrics.set( 'fabric_board_info', 1, uid=board.uid, uri=board.uri )
+            log( LogLevel.Info, "Farm added %s" % str(board) )
+
+        with s.lock:
+            boards = list( s.boards.values() )
+        for board in boards:
+            if board.lock.acquire( blocking=False ):
+                try:
+                    s.refreshBoard( board, isIdle=True )
+                finally:
+                    board.lock.release()
+
+        with s.lock:
+            s.metrics.set( 'fabric_boards', len(s.boards) )
+
+    def refreshBoard( s, board, isIdle=False ):
+        """
+            Query resident images, caller holds board lock. Idle boards also report device counters & link rate.
+        """
+        try:
+            transport = board.openTransport()
+            try:
+                board.refresh( transport )
+                if isIdle:
+                    s.sampleDevice( board, transport )
+            finally:
+                transport.closeTransport()
+        except Exception as e:
+            log( LogLevel.Warn, "Farm dropped '%s': %s" % (board.uri, str(e)) )
+            with s.lock:
+                s.boards.pop( board.uri, None )
+            s.metrics.remove( uid=board.uid )
+            s.metrics.inc( 'fabric_refresh_failures', uid=board.uid )
+
+    def sampleDevice( s, board, transport ):
+        """
+            Device counters the bootloader keeps since boot & the echo rate of the link.
+        """
+        uid = board.uid
+        s.metrics.set( 'fabric_link_kbps', round( transport.measureLinkRate( count=FARM_LINK_PROBE_COUNT ), 1 ), uid=uid )
+
+        flashStatus = transport.queryFlashStatus()
+        if flashStatus:
+            s.metrics.set( 'fabric_device_flash_ops', flashStatus.opCnt, isCounter=True, uid=uid )
+            s.metrics.set( 'fabric_device_flash_erase_bytes', flashStatus.eraseBytes, isCounter=True, uid=uid )
+            s.metrics.set( 'fabric_device_flash_program_bytes', flashStatus.programBytes, isCounter=True, uid=uid )
+            s.metrics.set( 'fabric_device_flash_max_chunk_us', flashStatus.maxChunkUs, uid=uid )
+            s.metrics.set( 'fabric_device_flash_max_irq_off_us', flashStatus.maxIrqOffUs, uid=uid )
+
+        if transport.features & FEATURE_FLASH_EMU:
+            s.metrics.set( 'fabric_device_flash_emu_reads', transport.flashEmuCommand( FLASH_EMU_MODE_QUERY ).readCnt, uid=uid )
+
+    def selectBoard( s, bitStreamHash ):
+        """
+            Pick the lowest cost board & count the job against it.
+        """
+        with s.lock:
+            if not s.boards:
+                return None
+            board = min( s.boards.values(), key=lambda b: (b.load + b.affinityCost( bitStreamHash ), b.load) )
+            board.load += 1
+            s.metrics.set( 'fabric_board_load', board.load, uid=board.uid )
+            return board
+
+    def acquire( s, bitstreamData, earlyAck=True ):
+        """
+            Wait for the selected board, then program it through its image cache. Returns the board held
+            locked for the job, release once done.
+        """
+        bitStreamHash = imageHash( bitstreamData )
+        board = s.selectBoard( bitStreamHash )
+        if not board:
+            raise Exception("No boards in farm")
+
+        log( LogLevel.Info, "Farm job %s -> '%s' (cost %.2f, load %d)" % (bitStreamHash.hex()[:16], board.uri, board.affinityCost( bitStreamHash ), board.load) )
+
+        board.lock.acquire()
+        try:
+            isHit = bitStreamHash == board.configuredHash
+            if isHit:
+                s.metrics.inc( 'fabric_jobs', uid=board.uid, path='configured' )
+            else:
+                isHit = s.configureBoard( board, bitstreamData, earlyAck )
+                board.configuredHash = bitStreamHash
+            return board, isHit
+        except:
+            s.release( board )
+            raise
+
+    def configureBoard( s, board, bitstreamData, earlyAck ):
+        """
+            Program the image through the board's image cache, retried on a new link after a failure.
+            Caller holds board lock, returns True when it came from flash.
+        """
+        for attempt in range( FARM_UPLOAD_RETRIES + 1 ):
+            t0 = time.time()
+            transport = board.openTransport()
+            try:
+                isHit = transport.configureImage( bitstreamData, earlyAck=earlyAck )
+                board.refresh( transport )
+            except Exception as e:
+                s.metrics.inc( 'fabric_upload_failures', uid=board.uid, stage=transport.failedStage or 'link' )
+                if attempt == FARM_UPLOAD_RETRIES:
+                    raise
+                log( LogLevel.Warn, "Farm retrying job on '%s': %s" % (board.uri, str(e)) )
+                s.metrics.inc( 'fabric_upload_retries', uid=board.uid )
+                continue
+            finally:
+                transport.closeTransport()
+                s.metrics.inc( 'fabric_upload_wire_bytes', transport.txBytes + transport.rxBytes, uid=board.uid )
+
+            path = 'flash' if isHit else 'upload'
+            s.metrics.observe( 'fabric_upload_seconds', time.time() - t0, uid=board.uid, path=path )
+            s.metrics.inc( 'fabric_jobs', uid=board.uid, path=path )
+            s.metrics.inc( 'fabric_upload_raw_bytes', transport.rawBytes, uid=board.uid )
+            s.metrics.inc( 'fabric_upload_blocks', transport.sentBlockCnt, uid=board.uid, kind='sent' )
+            s.metrics.inc( 'fabric_upload_blocks', transport.refBlockCnt, uid=board.uid, kind='stored' )
+            return isHit
+
+    def release( s, board ):
+        """
+            Finish job on board.
+        """
+        with s.lock:
+            board.load -= 1
+            s.metrics.set( 'fabric_board_load', board.load, uid=board.uid )
+        board.lock.release()
+
+    def status( s ):
+        with s.lock:
+            return [ b.toDict() for b in s.boards.values() ]
+
+
+class FarmRequestHandler(socketserver.StreamRequestHandler):
+    """
+        Farm daemon connection, json line requests:
+            {"cmd": "program", "data": base64 bitstream} programs a board & holds it until the connection
+            closes or {"cmd": "release"} is sent.
+            {"cmd": "status"} lists boards.
+    """
+    def handle( s ):
+        scheduler = s.server.scheduler
+        board = None
+        try:
+            for line in s.rfile:
+                request = json.loads( line )
+                cmd = request.get( 'cmd' )
+
+                if cmd == 'program' and not board:
+                    board, isHit = scheduler.acquire( base64.b64decode( request[ 'data' ] ), earlyAck=request.get( 'earlyAck', True ) )
+                    s.reply( { 'errorCode': 0, 'uri': board.uri, 'uid': board.uid, 'isHit': isHit } )
+                elif cmd == 'release' and board:
+                    scheduler.release( board )
+                    board = None
+                    s.reply( { 'errorCode': 0 } )
+                elif cmd == 'status':
+                    s.reply( { 'errorCode': 0, 'boards': scheduler.status() } )
+                else:
+                    s.reply( { 'errorCode': 1, 'msg': "Unexpected cmd '%s'" % str(cmd) } )
+        except Exception as e:
+            log( LogLevel.Warn, "Farm request failed: %s" % str(e) )
+            try:
+                s.reply( { 'errorCode': 1, 'msg': str(e) } )
+            except Exception:
+                pass
+        finally:
+            if board:
+                scheduler.release( board )
+
+    def reply( s, msg ):
+        s.wfile.write( (json.dumps( msg ) + '\n').encode() )
+        s.wfile.flush()
+
+
+class FarmServer(socketserver.ThreadingTCPServer):
+    """
+        Farm scheduler daemon, rescans boards in the background.
+    """
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__( s, scheduler, host='', port=DEFAULT_FABRIC_PORT ):
+        socketserver.ThreadingTCPServer.__init__( s, (host, port), FarmRequestHandler )
+        s.scheduler = scheduler
+
+    def scanLoop( s ):
+        while True:
+            try:
+                s.scheduler.scanBoards()
+            except Exception as e:
+                log( LogLevel.Warn, "Farm scan failed: %s" % str(e) )
+            time.sleep( FARM_SCAN_INTERVAL )
+
+    def run( s, metricsPort=None ):
+        scanThread = threading.Thread( target=s.scanLoop, daemon=True )
+        scanThread.start()
+        if metricsPort:
+            metricsServer = FarmMetricsServer( s.scheduler.metrics, port=metricsPort )
+            threading.Thread( target=metricsServer.serve_forever, daemon=True ).start()
+            log( LogLevel.Info, "Farm metrics on http://:%d/metrics" % metricsServer.server_address[1] )
+        log( LogLevel.Info, "Farm listening on port %d" % s.server_address[1] )
+        s.serve_forever()
+
+
+class FarmMetricsHandler(http.server.BaseHTTPRequestHandler):
+    """
+        Scrape endpoint, OpenMetrics when the scraper accepts it & Prometheus text otherwise.
+    """
+    def do_GET( s ):
+        if s.path.split( '?' )[ 0 ] != '/metrics':
+            s.send_error( 404 )
+            return
+        isOpenMetrics = 'application/openmetrics-text' in s.headers.get( 'Accept', '' )
+        body = s.server.metrics.render( isOpenMetrics ).encode()
+        s.send_response( 200 )
+        s.send_header( 'Content-Type', 'application/openmetrics-text; version=1.0.0; charset=utf-8' if isOpenMetrics else 'text/plain; version=0.0.4; charset=utf-8' )
+        s.send_header( 'Content-Length', str(len(body)) )
+        s.end_headers()
+        s.wfile.write( body )
+
+    def log_message( s, format, *args ):
+        pass # scrapes aren't logged
+
+
+class FarmMetricsServer(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__( s, metrics, host='', port=0 ):
+        http.server.ThreadingHTTPServer.__init__( s, (host, port), FarmMetricsHandler )
+        s.metrics = metrics
+
+
+def farmRequest( link, request ):
+    """
+        Send farm daemon request & wait for reply.
+    """
+    link.write( json.dumps( request ) + '\n' )
+    link.flush()
+    line = link.readline()
+    if not line:
+        raise Exception("Farm daemon closed connection")
+    return json.loads( line )
+
+
+def farmConnect( address ):
+    """
+        Connect to farm daemon at host[:port], returns line based link.
+    """
+    host, _, port = address.partition( ':' )
+    sock = socket.create_connection( (host or 'localhost', int(port) if port else DEFAULT_FABRIC_PORT) )
+    return sock.makefile( 'rw' )
+
+
+def gangProgram( devices, bitstreamData, earlyAck=True ):
+    """
+        Program the same image onto several boards at once, each through its image cache so boards already
+        holding it program from flash. Returns failure message by uri, None on success.
+    """
+    results = {}
+
+    def programBoard( deviceInfo ):
+        try:
+            transport = FabricTransport.createTransportForUri( deviceInfo.uri )
+            try:
+                transport.setDeviceInfo( deviceInfo )
+                isHit = transport.configureImage( bitstreamData, earlyAck=earlyAck )
+                flashInfo = transport.queryBitstreamFlash()
+                if not flashInfo or flashInfo.bitStreamHash != imageHash( bitstreamData ):
+                    raise Exception("Image not stored after programming")
+                log( LogLevel.Info, "Programmed '%s', image cache hit: %s" % (deviceInfo.uri, str(isHit)) )
+                results[ deviceInfo.uri ] = None
+            finally:
+                transport.closeTransport()
+        except Exception as e:
+            results[ deviceInfo.uri ] = str(e)
+
+    threads = [ threading.Thread( target=programBoard, args=( d, ) ) for d in devices ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return results
+
+
+def updateBoards( devices, image, bases=() ):
+    """
+        Update the bootloader of several boards at once. Returns failure message by uri, None on success.
+    """
+    results = {}
+
+    def updateBoard( deviceInfo ):
+        try:
+            transport = FabricTransport.createTransportForUri( deviceInfo.uri )
+            try:
+                transport.setDeviceInfo( deviceInfo )
+                transport = transport.selfUpdate( image, bases )
+                log( LogLevel.Info, "Updated bootloader on '%s', now on '%s'" % (deviceInfo.uri, transport.uri) )
+                results[ deviceInfo.uri ] = None
+            finally:
+                transport.closeTransport()
+        except Exception as e:
+            results[ deviceInfo.uri ] = str(e)
+
+    threads = [ threading.Thread( target=updateBoard, args=( d, ) ) for d in devices ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return results
+
+
+def cloneBoards( service, fromUid, toUids, earlyAck=True ):
+    """
+        Read back the startup image of one board & gang program it onto the others.
+    """
+    devices = { d.uid: d for d in service.listDevices() }
+    missing = [ uid for uid in [ fromUid ] + toUids if uid not in devices ]
+    if missing:
+        raise Exception("Boards not found: %s" % ", ".join( missing ))
+
+    source = devices[ fromUid ]
+    transport = FabricTransport.createTransportForUri( source.uri )
+    try:
+        transport.setDeviceInfo( source )
+        t0 = time.time()
+        bitstreamData = transport.readImage()
+        log( LogLevel.Info, "Read %d bytes from '%s' in %.2fs" % (len(bitstreamData), source.uri, time.time() - t0) )
+    finally:
+        transport.closeTransport()
+
+    return imageHash( bitstreamData ), gangProgram( [ devices[ uid ] for uid in toUids ], bitstreamData, earlyAck=earlyAck )
+
+
 def embedBitstreamFromFile( f ):
     data = compressData( open(f,'rb').read() )
     encoded = base64.b64encode(data)
@@ -1509,6 +3802,27 @@ def writeBootloader( targetDir ):
 
     open(destPath, "wb").write( decodeEmbededBits( bootloader_uf2_image ) )
 
+#
+#
+def loadPerfBaseline( filename, uid, rates ):
+    """
+        Load per board baseline keyed by programmer uid, boards without
+        an entry are recorded from the given rates.
+    """
+    if not filename:
+        return PERF_BASELINE_DEFAULT, False
+
+    baselines = {}
+    if os.path.exists( filename ):
+        baselines = json.loads( open( filename, 'r' ).read() )
+
+    if uid in baselines:
+        return baselines[ uid ], False
+
+    baselines[ uid ] = rates
+    open( filename, 'w' ).write( json.dumps( baselines, indent=4, sort_keys=True ) )
+    return rates, True
+
 #
 #
 def main():
@@ -1527,12 +3841,50 @@ def main():
                       help="Program test blinky to device to see if its working.")
     parser.add_option("-s", "--save", action="store_true",
                       help="Save bitstream to flash when programming device")
+    parser.add_option("-f", "--force", action="store_true",
+                      help="Always upload when saving, even if flash already holds the same image")
+    parser.add_option("", "--no-target-check", action="store_true", dest="notargetcheck",
+                      help="Upload without checking the bitstream idcode & config frames against the board's FPGA")
+    parser.add_option("", "--ecp5-compress", action="store_true", dest="ecp5compress",
+                      help="Compress ECP5 bitstream frames before uploading, the FPGA expands them while configuring")
+    parser.add_option("", "--write-bitstream", dest="writebitstream",
+                      help="Write the bitstream as uploaded, after compression & patches, to FILE. Needs no device")
+    parser.add_option("", "--cache", action="store_true",
+                      help="Program through the device image cache, stored images are programmed from flash and new ones replace the least recently used")
+    parser.add_option("", "--patch", dest="patch",
+                      help="JSON patch list applied while programming, entries are { usercode }, { ebr, offset, data }, { frame, offset, data } or { offset, data } with hex data")
+    parser.add_option("", "--from", dest="clonefrom",
+                      help="clone: uid of the board whose stored image is copied")
+    parser.add_option("", "--to", dest="cloneto", action="append", default=[],
+                      help="clone: uid of a board to program, repeat or comma separate for several")
+    parser.add_option("", "--flash-emu", dest="flashemu",
+                      help="After configuring, serve FILE to the design as spi flash from the programmer, 'off' stops & 'status' reports")
+    parser.add_option("", "--selfupdate", dest="selfupdate",
+                      help="Update the bootloader in band from a UF2 or bin file, 'bundled' for the one in this script. Updates every attached board unless --port is given")
+    parser.add_option("", "--update-base", dest="updatebase", action="append", default=[],
+                      help="Earlier bootloader UF2 or bin boards may run, updates are sent as a delta against it")
+    parser.add_option("", "--sync-ack", action="store_true", dest="syncack",
+                      help="Wait for each block to be fully processed before sending the next one")
+    parser.add_option("", "--farm-daemon", action="store_true", dest="farmdaemon",
+                      help="Run farm scheduler daemon, jobs are routed to boards already holding their image")
+    parser.add_option("", "--farm-port", dest="farmport", type="int", default=DEFAULT_FABRIC_PORT,
+                      help="Farm daemon listen port")
+    parser.add_option("", "--farm-metrics-port", dest="farmmetricsport", type="int",
+                      help="Farm daemon serves OpenMetrics for scrapers on this port at /metrics")
+    parser.add_option("", "--farm", dest="farm",
+                      help="Program bitstream on a board picked by the farm daemon at host[:port]")
+    parser.add_option("", "--farm-exec", dest="farmexec",
+                      help="Command run while the farm board is held, FABRIC_URI & FABRIC_UID name the board")
     parser.add_option("-j", "--json", action="store_true",
                       help="Echo output as json for automation parsing")
     parser.add_option("-r", "--rebootprogrammer", action="store_true",
-                      help="Reboot programmer device")
+                      help="Reboot programmer device & reattach once it re-enumerates")
     parser.add_option("-w", "--queryflash", action="store_true",
                       help="Query bitstream flash")
+    parser.add_option("", "--selftest-perf", action="store_true", dest="selftestperf",
+                      help="Benchmark device pipeline stages (usb, inflate, spi, flash, xip) and compare against a baseline")
+    parser.add_option("", "--perfbaseline", dest="perfbaseline",
+                      help="JSON file of per board perf baselines keyed by programmer uid, boards without an entry are recorded")
     parser.add_option("-v", "--bootloader", action="store_true",
                       help="")
     parser.add_option("", "--writebootloader", 
@@ -1556,6 +3908,74 @@ def main():
     if options.json:
         LogLevel.JsonLogMode = True
         
+    # farm daemon owns all boards
+    if options.farmdaemon:
+        FarmServer( FarmScheduler( service ), port=options.farmport ).run( metricsPort=options.farmmetricsport )
+        return 0
+
+    if options.farm:
+        if not args:
+            exitWithError( "No bitstream given for farm job" )
+            return 1
+
+        link = farmConnect( options.farm )
+        response = farmRequest( link, { 'cmd': 'program', 'data': base64.b64encode( open( args[ 0 ], 'rb' ).read() ).decode(), 'earlyAck': not options.syncack } )
+        if response[ 'errorCode' ] != 0:
+            exitWithError( "Farm failed to program '%s': %s" % (args[ 0 ], response.get( 'msg' )) )
+            return 1
+
+        log( LogLevel.Info, "Farm programmed '%s' on '%s', image cache hit: %s" % (args[ 0 ], response[ 'uri' ], str(response[ 'isHit' ])) )
+        log( LogLevel.Data, response )
+
+        # board is held until the link closes
+        result = 0
+        if options.farmexec:
+            env = dict( os.environ, FABRIC_URI=response[ 'uri' ], FABRIC_UID=response[ 'uid' ] )
+            result = subprocess.call( options.farmexec, shell=True, env=env )
+        link.close()
+        if result != 0:
+            exitWithError( "Farm job command failed with code: %d" % result, code=result )
+        return result
+
+    # copy one board's stored image onto others
+    if args and args[ 0 ] == 'clone':
+        toUids = [ uid for to in options.cloneto for uid in to.split( ',' ) if uid ]
+        if not options.clonefrom or not toUids:
+            exitWithError( "clone needs --from & --to board uids" )
+            return 1
+
+        bitStreamHash, results = cloneBoards( service, options.clonefrom, toUids, earlyAck=not options.syncack )
+        failed = { uri: msg for uri, msg in results.items() if msg }
+        log( LogLevel.Data, { 'bitStreamHash': bitStreamHash.hex(), 'boards': results } )
+        if failed:
+            exitWithError( "Clone failed on %s" % ", ".join( "'%s': %s" % (uri, msg) for uri, msg in failed.items() ) )
+            return 1
+
+        log( LogLevel.Info, "Cloned %s onto %d %s" % (bitStreamHash.hex()[:16], len(results), plural('board', len(results))) )
+        return 0
+
+    # in band bootloader update, boards running the bundled bootloader or an --update-base get a delta
+    if options.selfupdate:
+        bundled = bootloaderImage( decodeEmbededBits( bootloader_uf2_image ) )
+        image = bundled if options.selfupdate == 'bundled' else bootloaderImage( open( options.selfupdate, 'rb' ).read() )
+        bases = [ bootloaderImage( open( f, 'rb' ).read() ) for f in options.updatebase ] + [ bundled ]
+
+        devices = [ service.queryDevice( FabricTransport.TransportTypeUSBSerial + '://' + options.port ) ] if options.port else service.listDevices()
+        devices = [ d for d in devices if d ]
+        if not devices:
+            exitWithError( "No device found" )
+            return 1
+
+        results = updateBoards( devices, image, bases )
+        failed = { uri: msg for uri, msg in results.items() if msg }
+        log( LogLevel.Data, { 'imageHash': imageHash( image ).hex(), 'boards': results } )
+        if failed:
+            exitWithError( "Bootloader update failed on %s" % ", ".join( "'%s': %s" % (uri, msg) for uri, msg in failed.items() ) )
+            return 1
+
+        log( LogLevel.Info, "Updated bootloader on %d %s" % (len(results), plural('board', len(results))) )
+        return 0
+
     # device selection
     if options.port:
         uri = FabricTransport.TransportTypeUSBSerial + '://' + options.port
@@ -1618,13 +4038,60 @@ def main():
     if options.rebootprogrammer:
         log( LogLevel.Info, "Resetting programmer device '%s'" %  uri )
         
-        if not transport.rebootProgrammer( True ):
-            exitWithError( "Failed to reset programmer device '%s'" % uri )
+        # port can come back under another name, the rest of the command line runs on the new one
+        transport = transport.rebootAndReattach()
+        if not transport:
+            exitWithError( "Programmer device '%s' didn't come back after reboot" % uri )
+            return 1
+        uri = transport.uri
+        
+        log( LogLevel.Info, "Programmer device rebooted, reattached on '%s'" %  uri )
+        
+    if options.selftestperf:
+        if not transport:
+            exitWithError( "No device found" )
+            return 1
+
+        log( LogLevel.Info, "Running pipeline self test on device '%s'" %  uri )
+
+        deviceInfo = transport.queryDevice()
+        result = transport.selfTestPerf()
+        if not deviceInfo or not result or result.errorCode != 0:
+            exitWithError( "Failed pipeline self test on device '%s'" % uri )
             return 1
+
+        rates = result.rates()
+        rates['usb'] = transport.measureLinkRate()
+
+        baseline, isNewBaseline = loadPerfBaseline( options.perfbaseline, deviceInfo.uid, rates )
+        if isNewBaseline:
+            log( LogLevel.Info, "Recorded new baseline for '%s' in '%s'" % (deviceInfo.uid, options.perfbaseline) )
+
+        log( LogLevel.Info, "sysClockHz: %s, spiClockHz: %s" % (str(result.sysClockHz), str(result.spiClockHz)) )
         
-        log( LogLevel.Info, "Programmer device '%s' rebooted, exiting!" %  uri )
-        return 0 # Cant do anything as transport link will go down
+        slowStages = []
+        for stage in SelfTestPerf_Response.Stages:
+            # stages newer than the baseline have nothing to compare against
+            if not baseline.get( stage ):
+                log( LogLevel.Info, "%s: %.1f KB/s (no baseline)" % (stage, rates[ stage ]) )
+                continue
+            ratio = rates[ stage ] / baseline[ stage ]
+            if ratio < PERF_BASELINE_TOLERANCE:
+                slowStages.append( stage )
+            log( LogLevel.Info, "%s: %.1f KB/s (baseline %.1f KB/s, %d%%)" % (stage, rates[ stage ], baseline[ stage ], int(ratio * 100)) )
         
+        log( LogLevel.Data, { 'uid': deviceInfo.uid,
+                              'sysClockHz': result.sysClockHz,
+                              'spiClockHz': result.spiClockHz,
+                              'rates': rates,
+                              'baseline': baseline,
+                              'slowStages': slowStages
+                            } )
+
+        if slowStages:
+            exitWithError( "Stages below baseline on device '%s': %s" % (uri, ", ".join( slowStages )) )
+            return 1
+
     if options.clearflash:
         log( LogLevel.Info, "Clearing flash on device '%s'" %  uri )
 
@@ -1651,18 +4118,56 @@ def main():
         log( LogLevel.Info, "blockCnt: %s" % str(flashInfo.blockCnt))
         log( LogLevel.Info, "bitStreamSz: %s" % str(flashInfo.bitStreamSz))
         log( LogLevel.Info, "crc: %s" % str(flashInfo.crc))
+        log( LogLevel.Info, "bitStreamHash: %s" % (flashInfo.bitStreamHash.hex() if flashInfo.bitStreamHash else None))
+        
+        # Usb stall flash writes have caused since boot
+        flashStatus = transport.queryFlashStatus()
+        if flashStatus:
+            log( LogLevel.Info, "flashIrqSafe: %s" % str(flashStatus.isIrqSafe))
+            log( LogLevel.Info, "flashMaxChunkUs: %s, flashMaxIrqOffUs: %s" % (str(flashStatus.maxChunkUs), str(flashStatus.maxIrqOffUs)))
+        
         log( LogLevel.Data, { 'hasValidBitstream':hasValidBitstream,
                               'programOnStartup': flashInfo.programOnStartup,
                               'blockCnt': flashInfo.blockCnt,
                               'bitStreamSz': flashInfo.bitStreamSz,
                               'crc': flashInfo.crc,
+                              'bitStreamHash': flashInfo.bitStreamHash.hex() if flashInfo.bitStreamHash else None,
+                              'flashStatus': { 'isIrqSafe': flashStatus.isIrqSafe,
+                                               'opCnt': flashStatus.opCnt,
+                                               'eraseBytes': flashStatus.eraseBytes,
+                                               'programBytes': flashStatus.programBytes,
+                                               'maxChunkUs': flashStatus.maxChunkUs,
+                                               'maxIrqOffUs': flashStatus.maxIrqOffUs,
+                                               'opBytes': flashStatus.opBytes,
+                                               'opDoneBytes': flashStatus.opDoneBytes } if flashStatus else None
                             } )
         
         
-    if options.blinky:
+    # Resident design needs no upload, saving still uploads the embedded copy
+    selfTest = None
+    if options.blinky and not options.save:
+        log( LogLevel.Info, "Configuring resident self test design on '%s'" % uri )
+        selfTest = transport.selfTestConfigure()
+
+    if selfTest:
+        log( LogLevel.Data, { 'selfTestPassed': selfTest.errorCode == 0,
+                              'fpgaDeviceId': selfTest.fpgaDeviceId,
+                              'fpgaStatus': selfTest.fpgaStatus,
+                              'bitStreamSz': selfTest.bitStreamSz,
+                              'configureUs': selfTest.configureUs,
+                              'totalUs': selfTest.totalUs
+                            } )
+        if selfTest.errorCode != 0:
+            exitWithError( "Self test design failed on device '%s', stage: %s, status: 0x%x" % (uri, selfTest.stageName(), selfTest.fpgaStatus) )
+            return 1
+        log( LogLevel.Info, "Self test passed on device '%s', status: 0x%x, configure: %.1fms, total: %.1fms" % (uri, selfTest.fpgaStatus, selfTest.configureUs / 1000.0, selfTest.totalUs / 1000.0) )
+
+    elif options.blinky:
+        if not options.save:
+            log( LogLevel.Info, "No resident self test design on '%s'" % uri )
         log( LogLevel.Info, "Uploading blinky bitstream to '%s', is saving: %s" % (uri, str(options.save)) )
         
-        if not transport.programDevice( decodeEmbededBits( blink_bits ), saveToFlash=options.save ):
+        if not transport.programDevice( decodeEmbededBits( blink_bits ), saveToFlash=options.save, earlyAck=not options.syncack ):
             exitWithError( "Failed program blinky bitstream on device '%s'" % (uri) )
             return 1
         log( LogLevel.Info, "Blink programmed on device '%s'" %  uri )
@@ -1670,19 +4175,95 @@ def main():
         
     if args:
         bitstreamFilename = args[ 0 ]
+        bitstreamData = open( bitstreamFilename, 'rb' ).read()
+
+        patches = None
+        if options.patch:
+            patches = json.loads( open( options.patch, 'r' ).read() )
+            log( LogLevel.Info, "Patching with %d entries from '%s'" % (len(patches), options.patch) )
+
+        if options.ecp5compress:
+            # a wrong one hot order has the FPGA expand other frames than the design's
+            if ECP5_ONE_HOT_ORDER is None:
+                exitWithError( "--ecp5-compress is off until ECP5_ONE_HOT_ORDER is pinned by tools/ecp5pair.py on an ecppack --compress pair" )
+                return 1
+
+            # frame patch offsets are into the frames as given, patch before the frames are recoded
+            if patches:
+                bitstreamData = Ecp5Bitstream( bitstreamData ).patch( patches )
+                patches = None
+            t0 = time.time()
+            compressed = Ecp5Bitstream( bitstreamData ).compress()
+            log( LogLevel.Info, "Compressed '%s' from %d to %d bytes in %.2fs" % (bitstreamFilename, len(bitstreamData), len(compressed), time.time() - t0) )
+            bitstreamData = compressed
+
+        if options.writebitstream:
+            open( options.writebitstream, 'wb' ).write( Ecp5Bitstream( bitstreamData ).patch( patches ) if patches else bitstreamData )
+            log( LogLevel.Info, "Wrote bitstream to '%s'" % options.writebitstream )
+            if not uri:
+                return 0
 
         if not uri:
             exitWithError( "No device found" )
             return 1
-                    
+
+        # wrong part or a partial image leaves the FPGA unconfigured, catch it before the upload
+        if not options.notargetcheck:
+            deviceInfo = transport.queryDevice()
+            try:
+                bitstream = Ecp5Bitstream( bitstreamData )
+            except Exception as e:
+                bitstream = None
+                log( LogLevel.Warn, "Not checking bitstream target, %s" % str(e) )
+            if bitstream:
+                try:
+                    bitstream.checkTarget( deviceInfo.fpgaDeviceId if deviceInfo else None )
+                except Exception as e:
+                    exitWithError( "%s, --no-target-check uploads anyway" % str(e) )
+                    return 1
+
         log( LogLevel.Info, "Uploading bitstream '%s' to '%s', is saving: %s" % (bitstreamFilename, uri, str(options.save)) )
 
-        bitstreamData = open( bitstreamFilename, 'rb' ).read()
+        # skip upload when flash already holds this image, the device patches it as it streams
+        devicePatches = transport.devicePatchList( bitstreamData, patches ) if patches and not options.cache else []
+        if options.cache:
+            transport.configureImage( bitstreamData, earlyAck=not options.syncack, patches=patches )
+
+        elif options.save and not options.force and devicePatches is not None and transport.isImageInFlash( bitstreamData ):
+            log( LogLevel.Info, "Flash on '%s' already holds '%s', programming from flash" % (uri, bitstreamFilename) )
+            if not transport.programFromFlash( patches=devicePatches ):
+                exitWithError( "Failed to program bitstream from flash on device '%s'" % uri )
+                return 1
 
-        if not transport.programDevice( bitstreamData, saveToFlash=options.save ):
-            exitWithError( "Failed to program bitstream on device '%s'" % uri )
+        else:
+            if patches:
+                bitstreamData = Ecp5Bitstream( bitstreamData ).patch( patches )
+
+            if not transport.programDevice( bitstreamData, saveToFlash=options.save, earlyAck=not options.syncack ):
+                exitWithError( "Failed to program bitstream on device '%s'" % uri )
+                return 1
+
+    # soft cores in the configured design read their image from the programmer's flash
+    if options.flashemu:
+        if not transport:
+            exitWithError( "No device found" )
             return 1
 
+        if options.flashemu == 'off':
+            response = transport.flashEmuCommand( FLASH_EMU_MODE_STOP )
+        elif options.flashemu == 'status':
+            response = transport.flashEmuCommand( FLASH_EMU_MODE_QUERY )
+        else:
+            log( LogLevel.Info, "Serving '%s' as spi flash to the design on '%s'" % (options.flashemu, uri) )
+            response = transport.flashEmulate( open( options.flashemu, 'rb' ).read() )
+
+        log( LogLevel.Info, "Flash emulator %s, image at flash offset 0x%x, region %d bytes, %d reads answered" %
+             (response.stateName(), response.flashOffset, response.regionSz, response.readCnt) )
+        log( LogLevel.Data, { 'flashEmu': response.stateName(),
+                              'flashOffset': response.flashOffset,
+                              'regionSz': response.regionSz,
+                              'readCnt': response.readCnt } )
+
 
 if __name__ == '__main__':
     
@@ -0,0 +1,366 @@
+"""
+Bitstream codec benchmark. Compresses a corpus of ECP5 bitstreams with each
+codec, block size, dictionary & pre-filter option and reports compression
+ratio, host encode speed and modelled device decode cost.
+
+The corpus holds the real images in data/ plus synthetic images sized like
+25k, 45k & 85k parts at a few utilisation levels. Decode cost comes from a
+cycle model of the bootloader tinfl inflate loop on a Cortex-M0+, counted
+from the deflate token stream of each block. Pass the inflate rate reported
+by `program.py --selftest-perf` to scale the model to a measured board.
+
+Usage:
+    $ python tools/codecbench.py
+    $ python tools/codecbench.py --blocksizes=4064,16352 --codecs=zlib9 --json
+    $ python tools/codecbench.py --inflatekbps=1850 mydesign.bit
+
+"""
+import os, sys, time, zlib, lzma, bz2, json, random, re
+from optparse import OptionParser
+
+# defaults
+DATA_DIR = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'data' )
+REFERENCE_BLOCK_HEADER = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'sw', 'pico', 'projects', 'fabric_bootloader', 'perf_reference_block.h' )
+DEFAULT_BLOCK_SIZES = [ 1024, 4064, 16352 ] # 4064 RP2040 & 16352 RP2350 bootloader blocks
+DEFAULT_SYS_CLOCK_HZ = 125000000
+DICT_SIZE = 4096 # preset dictionary taken from the reference image
+
+# M0+ cycle model of tinfl, relative token costs from the decode loop, scaled so the reference block
+# decodes at the nominal 2000 KB/s inflate baseline of program.py --selftest-perf
+CYCLES_PER_BLOCK_HEADER = 48000 # dynamic huffman table build
+CYCLES_PER_LITERAL = 76
+CYCLES_PER_MATCH = 140
+CYCLES_PER_MATCH_BYTE = 12 # byte copy in the match loop
+CYCLES_PER_STORED_BYTE = 8
+CYCLES_PER_OUTPUT_BYTE = 6 # adler32
+
+# synthetic ECP5 images, frame count & frame bytes per part
+SYNTHETIC_PARTS = { '25k': (7562, 74), '45k': (9470, 106), '85k': (13294, 142) }
+SYNTHETIC_UTILISATION = { 'sparse': 0.1, 'medium': 0.4, 'dense': 0.8 }
+
+
+#
+# corpus
+#
+def syntheticImage( part, utilisation, seed=1 ):
+    """
+        ECP5 style bitstream, preamble & command stream then crc terminated config frames. Used tiles
+        cover the leading utilisation fraction of each frame & draw their bytes from a small palette so
+        repeated tile configs compress like real designs.
+    """
+    rnd = random.Random( seed )
+    frameCnt, frameSz = SYNTHETIC_PARTS[ part ]
+    palette = [ bytes( rnd.getrandbits(8) if rnd.random() < 0.3 else 0 for i in range(8) ) for j in range(64) ]
+
+    data = bytearray( b'\xff\x00Part: LFE5U-' + part.upper().encode() + b'\x00\xff\xff\xff\xbd\xb3\xff\xff\xff\xff' )
+    data += bytes( [ 0x3b, 0, 0, 0, 0xe2, 0, 0, 0, 0x41, 0x11, 0x30, 0x43, 0x82, 0x91, 0x00, 0x00 ] ) # verify id & LSC_PROG_INCR_RTI
+    usedSz = int( frameSz * utilisation )
+    for i in range( frameCnt ):
+        frame = bytearray( frameSz )
+        j = 0
+        while j < usedSz:
+            tile = palette[ rnd.randrange( len(palette) ) ]
+            frame[ j : min( j + len(tile), usedSz ) ] = tile[ : usedSz - j ]
+            j += len(tile)
+        data += frame + crc16( frame ).to_bytes( 2, 'big' ) + b'\xff'
+    data += bytes( [ 0x5e, 0, 0, 0, 0xff, 0xff, 0xff, 0xff ] ) # ISC_PROGRAM_DONE
+    return bytes( data )
+
+
+def crc16( data ):
+    crc = 0
+    for b in data:
+        crc ^= b << 8
+        for i in range(8):
+            crc = ((crc << 1) ^ 0x8005) & 0xffff if crc & 0x8000 else (crc << 1) & 0xffff
+    return crc
+
+
+def loadCorpus( extraFiles, isQuick ):
+    """
+        Returns list of (name, data).
+    """
+    corpus = []
+    for f in sorted( os.listdir( DATA_DIR ) ):
+        if f.endswith( '.bit' ):
+            corpus.append( ( f, open( os.path.join( DATA_DIR, f ), 'rb' ).read() ) )
+    for f in extraFiles:
+        corpus.append( ( os.path.basename( f ), open( f, 'rb' ).read() ) )
+
+    parts = [ '25k' ] if isQuick else sorted( SYNTHETIC_PARTS.keys() )
+    for part in parts:
+        for name, utilisation in sorted( SYNTHETIC_UTILISATION.items() ):
+            corpus.append( ( 'syn-%s-%s' % (part, name), syntheticImage( part, utilisation ) ) )
+    return corpus
+
+
+#
+# pre-filters, undone on the device after inflate
+#
+def frameStride( data, maxStride=512 ):
+    """
+        Guess frame size from the byte distance that repeats non zero bytes most often.
+    """
+    sample = data[ len(data) // 4 : len(data) // 4 + 65536 ]
+    best, bestCnt = 1, 0
+    for stride in range( 8, maxStride ):
+        cnt = sum( 1 for i in range( stride, len(sample), 7 ) if sample[i] and sample[i] == sample[ i - stride ] )
+        if cnt > bestCnt:
+            best, bestCnt = stride, cnt
+    return best
+
+
+def filterNone( block, stride ):
+    return block
+
+
+def filterXorFrame( block, stride ):
+    """
+        XOR each byte with the byte a frame earlier, identical tiles in neighbouring frames become zeros.
+    """
+    out = bytearray( block )
+    for i in range( len(block) - 1, stride - 1, -1 ):
+        out[i] ^= block[ i - stride ]
+    return bytes( out )
+
+
+FILTERS = { 'none': filterNone, 'xorframe': filterXorFrame }
+
+
+#
+# codecs, decodable ones have a device decode model
+#
+def zlibEncoder( level ):
+    def encode( block, zdict ):
+        c = zlib.compressobj( level, zlib.DEFLATED, 15, 9, zlib.Z_DEFAULT_STRATEGY, zdict ) if zdict else zlib.compressobj( level )
+        return c.compress( block ) + c.flush()
+    return encode
+
+
+CODECS = {
+    'zlib1': ( zlibEncoder( 1 ), True ),
+    'zlib6': ( zlibEncoder( 6 ), True ),
+    'zlib9': ( zlibEncoder( 9 ), True ),
+    'lzma': ( lambda block, zdict: lzma.compress( block, preset=9 ), False ), # host reference only, no device decoder
+    'bz2': ( lambda block, zdict: bz2.compress( block, 9 ), False ),
+}
+
+
+#
+# deflate token counter for the decode model
+#
+class BitReader:
+    def __init__( s, data ):
+        s.data = data
+        s.pos = 0
+        s.bit = 0
+
+    def bits( s, n ):
+        v = 0
+        for i in range(n):
+            v |= ((s.data[ s.pos ] >> s.bit) & 1) << i
+            s.bit += 1
+            if s.bit == 8:
+                s.bit = 0
+                s.pos += 1
+        return v
+
+    def align( s ):
+        if s.bit:
+            s.bit = 0
+            s.pos += 1
+
+
+class Huffman:
+    def __init__( s, lengths ):
+        s.table = {}
+        code = 0
+        for bitLen in range( 1, 16 ):
+            for sym, l in enumerate( lengths ):
+                if l == bitLen:
+                    s.table[ (bitLen, code) ] = sym
+                    code += 1
+            code <<= 1
+
+    def decode( s, reader ):
+        code = 0
+        for bitLen in range( 1, 16 ):
+            code = (code << 1) | reader.bits(1)
+            sym = s.table.get( (bitLen, code) )
+            if sym is not None:
+                return sym
+        raise Exception("Bad huffman code")
+
+
+LENGTH_BASE = [ 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 ]
+LENGTH_EXTRA = [ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 ]
+DIST_EXTRA = [ 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 ]
+CODE_LENGTH_ORDER = [ 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 ]
+FIXED_LITERALS = Huffman( [8] * 144 + [9] * 112 + [7] * 24 + [8] * 8 )
+FIXED_DISTANCES = Huffman( [5] * 30 )
+
+
+def countTokens( zdata ):
+    """
+        Walk a zlib stream & count what the inflate loop does.
+    """
+    counts = { 'blocks': 0, 'literals': 0, 'matches': 0, 'matchBytes': 0, 'storedBytes': 0 }
+    reader = BitReader( zdata )
+    reader.bits( 16 ) # zlib header, preset dictionary id follows if set
+    if zdata[1] & 0x20:
+        reader.bits( 32 )
+
+    isFinal = 0
+    while not isFinal:
+        isFinal = reader.bits(1)
+        blockType = reader.bits(2)
+        if blockType == 0:
+            reader.align()
+            sz = reader.data[ reader.pos ] | (reader.data[ reader.pos + 1 ] << 8)
+            reader.pos += 4 + sz
+            counts[ 'storedBytes' ] += sz
+            continue
+
+        if blockType == 1:
+            literals, distances = FIXED_LITERALS, FIXED_DISTANCES
+        else:
+            counts[ 'blocks' ] += 1
+            literalCnt = reader.bits(5) + 257
+            distCnt = reader.bits(5) + 1
+            codeLenCnt = reader.bits(4) + 4
+            codeLengths = [0] * 19
+            for i in range( codeLenCnt ):
+                codeLengths[ CODE_LENGTH_ORDER[i] ] = reader.bits(3)
+            codeLenHuffman = Huffman( codeLengths )
+            lengths = []
+            while len(lengths) < literalCnt + distCnt:
+                sym = codeLenHuffman.decode( reader )
+                if sym < 16:
+                    lengths.append( sym )
+                elif sym == 16:
+                    lengths += [ lengths[-1] ] * (3 + reader.bits(2))
+                elif sym == 17:
+                    lengths += [0] * (3 + reader.bits(3))
+                else:
+                    lengths += [0] * (11 + reader.bits(7))
+            literals = Huffman( lengths[ : literalCnt ] )
+            distances = Huffman( lengths[ literalCnt : ] )
+
+        while True:
+            sym = literals.decode( reader )
+            if sym < 256:
+                counts[ 'literals' ] += 1
+            elif sym == 256:
+                break
+            else:
+                length = LENGTH_BASE[ sym - 257 ] + reader.bits( LENGTH_EXTRA[ sym - 257 ] )
+                reader.bits( DIST_EXTRA[ distances.decode( reader ) ] )
+                counts[ 'matches' ] += 1
+                counts[ 'matchBytes' ] += length
+    return counts
+
+
+def decodeCycles( counts, outputSz ):
+    return ( counts[ 'blocks' ] * CYCLES_PER_BLOCK_HEADER + counts[ 'literals' ] * CYCLES_PER_LITERAL +
+             counts[ 'matches' ] * CYCLES_PER_MATCH + counts[ 'matchBytes' ] * CYCLES_PER_MATCH_BYTE +
+             counts[ 'storedBytes' ] * CYCLES_PER_STORED_BYTE + outputSz * CYCLES_PER_OUTPUT_BYTE )
+
+
+def loadReferenceBlock():
+    """
+        FCMD_SelfTestPerf reference block from the bootloader source, size header then zlib stream.
+    """
+    src = open( REFERENCE_BLOCK_HEADER, 'r' ).read()
+    body = src[ src.index( '{' ) + 1 : src.index( '}' ) ]
+    return bytes( int(v) for v in re.findall( r'\d+', body ) )[ 2: ]
+
+
+def modelScale( inflateKBps, sysClockHz ):
+    """
+        Scale so the reference block decodes at the measured rate.
+    """
+    if not inflateKBps:
+        return 1.0
+    zdata = loadReferenceBlock()
+    outputSz = len( zlib.decompress( zdata ) )
+    measuredCycles = sysClockHz * (outputSz / 1024.0) / inflateKBps
+    return measuredCycles / decodeCycles( countTokens( zdata ), outputSz )
+
+
+#
+# benchmark
+#
+def benchImage( data, codec, blockSz, useDict, filterName, zdict, cycleScale, sysClockHz ):
+    encode, isDecodable = CODECS[ codec ]
+    stride = frameStride( data ) if filterName != 'none' else 0
+    compressedSz = 0
+    encodeTime = 0.0
+    cycles = 0
+    for i in range( 0, len(data), blockSz ):
+        block = FILTERS[ filterName ]( data[ i : i + blockSz ], stride )
+        start = time.perf_counter()
+        cblock = encode( block, zdict if useDict else None )
+        encodeTime += time.perf_counter() - start
+        compressedSz += len(cblock) + 2 # bootloader block size header
+        if isDecodable:
+            cycles += decodeCycles( countTokens( cblock ), len(block) )
+
+    result = { 'ratio': len(data) / compressedSz,
+               'compressedSz': compressedSz,
+               'encodeMBps': len(data) / (1024.0 * 1024.0) / max( encodeTime, 1e-9 ),
+               'decodeKBps': None,
+               'decodeMs': None }
+    if isDecodable:
+        seconds = cycles * cycleScale / sysClockHz
+        result[ 'decodeMs' ] = seconds * 1000.0
+        result[ 'decodeKBps' ] = len(data) / 1024.0 / seconds
+    return result
+
+
+def main():
+    parser = OptionParser( usage="%prog [options] [bitstream.bit ...]" )
+    parser.add_option("", "--codecs", default="zlib1,zlib6,zlib9,lzma",
+                      help="Codecs to run, from: " + ", ".join( sorted( CODECS.keys() ) ))
+    parser.add_option("", "--blocksizes", default=",".join( str(b) for b in DEFAULT_BLOCK_SIZES ),
+                      help="Block sizes in bytes")
+    parser.add_option("", "--filters", default="none,xorframe",
+                      help="Pre-filters to run, from: " + ", ".join( sorted( FILTERS.keys() ) ))
+    parser.add_option("", "--nodict", action="store_true",
+                      help="Skip preset dictionary runs")
+    parser.add_option("", "--quick", action="store_true",
+                      help="Only the 25k synthetic images")
+    parser.add_option("", "--inflatekbps", type="float",
+                      help="Measured device inflate rate from program.py --selftest-perf, scales the cycle model")
+    parser.add_option("", "--sysclockhz", type="int", default=DEFAULT_SYS_CLOCK_HZ,
+                      help="Device core clock")
+    parser.add_option("-j", "--json", action="store_true",
+                      help="Print results as json")
+    (options, args) = parser.parse_args()
+
+    corpus = loadCorpus( args, options.quick )
+    cycleScale = modelScale( options.inflatekbps, options.sysclockhz )
+
+    # dictionary from the start of the first real image, header & early frames are common to all designs
+    zdict = corpus[0][1][ : DICT_SIZE ]
+
+    results = []
+    for name, data in corpus:
+        for codec in options.codecs.split(','):
+            for blockSz in [ int(b) for b in options.blocksizes.split(',') ]:
+                for filterName in options.filters.split(','):
+                    for useDict in ( [False] if options.nodict or not codec.startswith( 'zlib' ) else [False, True] ):
+                        result = benchImage( data, codec, blockSz, useDict, filterName, zdict, cycleScale, options.sysclockhz )
+                        result.update( { 'image': name, 'imageSz': len(data), 'codec': codec, 'blockSz': blockSz,
+                                         'filter': filterName, 'dict': useDict } )
+                        results.append( result )
+                        if not options.json:
+                            print( "%-18s %-6s %6d %-9s %-5s ratio %6.2f  encode %7.2f MB/s  decode %s" % (
+                                name, codec, blockSz, filterName, 'dict' if useDict else '-', result[ 'ratio' ], result[ 'encodeMBps' ],
+                                "%8.1f KB/s %8.1f ms" % (result[ 'decodeKBps' ], result[ 'decodeMs' ]) if result[ 'decodeKBps' ] else "n/a" ) )
+
+    if options.json:
+        print( json.dumps( { 'cycleScale': cycleScale, 'sysClockHz': options.sysclockhz, 'results': results }, indent=4 ) )
+
+
+if __name__ == '__main__':
+    main()
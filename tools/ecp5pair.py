@@ -0,0 +1,109 @@
+"""
+ECP5 frame codec check. Compares program.py's compressed frame codec with
+an image pair written by ecppack, the same design packed with and without
+--compress, so the code order the FPGA expects is pinned by real output.
+
+Every compressed frame of the --compress twin is decoded and compared to
+the frame of the plain twin, with the one hot code index counted from the
+lsb and from the msb. Plain frames are also encoded with the twin's
+dictionary and compared byte for byte, ecppack may pick other codes for
+bytes with more than one so those mismatches are reported, not failed.
+
+Set ECP5_ONE_HOT_ORDER in program.py to the order reported. The exit code
+is 0 when the order program.py uses decodes every frame, 1 when it doesn't
+& 2 when there is no pair to check.
+
+Pairs are given as arguments in either order or found in data/ as NAME.bit
+next to NAME.uncompressed.bit. data/blinky.bit is already an ecppack
+--compress image, its uncompressed twin next to it is enough, e.g. from
+    $ ecppack --compress --input blinky.config --bit data/blinky.bit
+    $ ecppack --input blinky.config --bit data/blinky.uncompressed.bit
+
+Usage:
+    $ python tools/ecp5pair.py
+    $ python tools/ecp5pair.py design.bit design.uncompressed.bit
+
+"""
+import os, sys, glob
+from optparse import OptionParser
+
+sys.path.insert( 0, os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'sw', 'programmer' ) )
+import program
+
+# defaults
+DATA_DIR = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'data' )
+UNCOMPRESSED_SUFFIX = '.uncompressed.bit'
+ORDERS = [ 'lsb', 'msb' ]
+
+
+def findPairs( dataDir ):
+    """
+        ( compressed, plain ) file pairs in a directory.
+    """
+    pairs = []
+    for plain in sorted( glob.glob( os.path.join( dataDir, '*' + UNCOMPRESSED_SUFFIX ) ) ):
+        compressed = plain[ :-len(UNCOMPRESSED_SUFFIX) ] + '.bit'
+        if os.path.exists( compressed ):
+            pairs.append( ( compressed, plain ) )
+    return pairs
+
+
+def checkPair( data, twinData, order ):
+    """
+        Frames decoded & encoded differently from the twin with one hot order, ( decoded, encoded, frames ).
+    """
+    program.ECP5_ONE_HOT_ORDER = order
+    plain = program.Ecp5Bitstream( data )
+    compressed = program.Ecp5Bitstream( twinData )
+    if plain.isCompressed:
+        plain, compressed = compressed, plain
+    if plain.isCompressed or not compressed.isCompressed:
+        raise Exception("Pair needs an uncompressed image & its --compress twin")
+    if plain.deviceId != compressed.deviceId or plain.frameCnt != compressed.frameCnt:
+        raise Exception("Pair images are for different parts or frame counts")
+
+    plainFrames = plain.frames()
+    decoded = sum( 1 for a, b in zip( plainFrames, compressed.frames() ) if a != b )
+
+    padSz = compressed.frameSz[1] - compressed.frameSz[0]
+    dictionary = list( compressed.dictionary )
+    cframes = [ compressed.data[ f[1] : f[1] + f[2] ] for f in compressed.fields if f[0] == 'cframe' ]
+    encoded = sum( 1 for frame, cframe in zip( plainFrames, cframes ) if program.Ecp5Bitstream.encodeFrame( frame, padSz, dictionary ) != cframe )
+    return decoded, encoded, len(plainFrames)
+
+
+def main():
+    parser = OptionParser( usage="usage: %prog [options] [compressed.bit uncompressed.bit ...]" )
+    parser.add_option("", "--data", dest="data", default=DATA_DIR,
+                      help="Directory searched for NAME.bit & NAME%s pairs when none are given" % UNCOMPRESSED_SUFFIX)
+    (options, args) = parser.parse_args()
+
+    if len(args) % 2:
+        parser.error( "Pairs take a compressed & an uncompressed image" )
+    pairs = [ ( args[ i ], args[ i + 1 ] ) for i in range( 0, len(args), 2 ) ] or findPairs( options.data )
+    if not pairs:
+        print( "No ecppack pairs in '%s', ECP5_ONE_HOT_ORDER stays unchecked" % options.data )
+        return 2
+
+    codecOrder = program.ECP5_ONE_HOT_ORDER or 'lsb'
+    matched = set( ORDERS )
+    for imageFile, twinFile in pairs:
+        data = open( imageFile, 'rb' ).read()
+        twinData = open( twinFile, 'rb' ).read()
+        for order in ORDERS:
+            decoded, encoded, frameCnt = checkPair( data, twinData, order )
+            print( "%-40s %s  decode %6d / %d frames differ, encode %6d differ" % (os.path.basename( imageFile ), order, decoded, frameCnt, encoded) )
+            if decoded:
+                matched.discard( order )
+
+    if len(matched) == 1:
+        print( "One hot order is '%s', program.py uses '%s'" % (list( matched )[ 0 ], codecOrder) )
+    elif not matched:
+        print( "Neither one hot order decodes the pairs" )
+    else:
+        print( "Pairs hold no one hot bytes, order not pinned" )
+    return 0 if matched == { codecOrder } else 1
+
+
+if __name__ == '__main__':
+    sys.exit( main() )
@@ -0,0 +1,633 @@
+"""
+Host simulator of the fabric bootloader. Models the serial protocol, the
+content addressed flash store & its image cache closely enough to run the
+program.py transport flows without a board, and keeps per sector erase and
+program counts so flash wear can be measured over long runs.
+
+Device time is modelled from the nominal stage rates used by
+`program.py --selftest-perf` and accumulates on a simulated clock, so
+latency from the simulator is comparable between runs but not to a board.
+Early acked blocks are answered on arrival while the device works through
+the queue, the next command waits for the last block to finish.
+
+SimFlashEmulator models the spi flash emulator from the design's side of the
+config port, with the PIO & DMA timing that decides which sck rates and read
+commands a soft core can boot with. `python3 fabricsim.py` prints the table.
+
+Usage:
+    import fabricsim
+    transport = fabricsim.SimTransport( fabricsim.SimDevice() )
+    transport.programDevice( data, saveToFlash=True )
+
+"""
+import os, sys, zlib, struct, hashlib
+
+sys.path.insert( 0, os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'sw', 'programmer' ) )
+import program
+
+# defaults, RP2040 bootloader layout
+SECTOR_SIZE = 4096
+PAGE_SIZE = 256
+MAX_SECTOR = 256
+MAX_IMAGES = 8
+MAX_BLOCK_SZ = 4096 - 32
+BLOCK_HEADER_SZ = 32
+BLOCK_SLOT_CNT = MAX_SECTOR - MAX_IMAGES - 1
+LRU_ENTRY_CNT = SECTOR_SIZE // 8
+LRU_SECTOR = MAX_IMAGES # record sectors come first
+BLOCK_KEY_SIZE = 24
+DEFAULT_ENDURANCE = 100000 # erase cycles before a sector stops holding data
+SIM_DEVICE_ID = 0x41111043 # LFE5U-25
+FEATURES = program.FEATURE_EARLY_ACK | program.FEATURE_BLOCK_STORE | program.FEATURE_IMAGE_CACHE | program.FEATURE_IMAGE_LIST | program.FEATURE_FLASH_STATUS | program.FEATURE_FLASH_EMU
+FLASH_EMU_OFFSET = 0x40000 # below the update staging region, aligned to its size
+FLASH_EMU_SZ = 256 * 1024
+FLASH_EMU_BLOCK_SZ = 2048
+EMU_OFF, EMU_SERVING, EMU_RELEASED = range( 3 )
+
+# modelled device costs, KB/s
+RATES = dict( program.PERF_BASELINE_DEFAULT )
+SECTOR_ERASE_US = SECTOR_SIZE / 1024.0 / RATES[ 'flashErase' ] * 1000000.0
+STAGE_NONE, STAGE_INFLATE, STAGE_BLOCK_SIZE, STAGE_BLOCK_CRC, STAGE_FLASH, STAGE_COMPLETE, STAGE_BLOCK_REF = range( 7 )
+
+
+class SimFlash:
+    """
+        Wear of each sector, sectors erased past their endurance no longer hold what is written.
+    """
+    def __init__( s, endurance=DEFAULT_ENDURANCE ):
+        s.endurance = endurance
+        s.eraseCnt = [ 0 ] * MAX_SECTOR
+        s.programCnt = [ 0 ] * MAX_SECTOR
+        s.eraseBytes = 0
+        s.programBytes = 0
+        s.opCnt = 0
+        s.chunkCnt = 0
+        s.maxChunkUs = 0
+
+    def erase( s, sector, cnt=1 ):
+        s.opCnt += 1
+        for i in range( sector, sector + cnt ):
+            s.eraseCnt[ i ] += 1
+            s.chunkCnt += 1
+        s.eraseBytes += cnt * SECTOR_SIZE
+        s.maxChunkUs = max( s.maxChunkUs, int( SECTOR_ERASE_US ) )
+        return cnt * SECTOR_ERASE_US
+
+    def program( s, sector, size ):
+        s.opCnt += 1
+        s.chunkCnt += (size + PAGE_SIZE - 1) // PAGE_SIZE
+        s.programCnt[ sector ] += 1
+        s.programBytes += size
+        return size / 1024.0 / RATES[ 'flashProgram' ] * 1000000.0
+
+    def isWorn( s, sector ):
+        return s.eraseCnt[ sector ] > s.endurance
+
+
+class SimDevice:
+    """
+        Bootloader model, dispatches request payloads & returns the response payloads.
+    """
+    def __init__( s, endurance=DEFAULT_ENDURANCE, uid=b'\x51\x10\x5a\x11\x00\x00\x00\x01' ):
+        s.flash = SimFlash( endurance )
+        s.uid = uid
+        s.clockUs = 0.0 # simulated device time
+        s.busyUntilUs = 0.0 # end of early acked block work
+        s.blocks = {} # slot -> (key, data)
+        s.records = [ None ] * MAX_IMAGES # imageId -> dict
+        s.useLog = [] # LRU log entries (saveSeq, useSeq)
+        s.emuRegion = bytearray( b'\xff' * FLASH_EMU_SZ )
+        s.reboot()
+
+    def reboot( s ):
+        """
+            Drop RAM state & rebuild it from flash, like store_init.
+        """
+        s.isProgramming = False
+        s.isEarlyAck = False
+        s.writer = None
+        s.pinned = set()
+        s.programError = (0, 0, STAGE_NONE)
+        s.configuredHash = None
+        s.emuState = EMU_OFF
+        s.emuReadCnt = 0
+        s.lastSeq = 0
+        s.imageLastUse = [ 0 ] * MAX_IMAGES
+        for imageId, record in enumerate( s.records ):
+            if record:
+                s.imageLastUse[ imageId ] = record[ 'saveSeq' ]
+                s.lastSeq = max( s.lastSeq, record[ 'saveSeq' ] )
+        for saveSeq, useSeq in s.useLog:
+            for imageId, record in enumerate( s.records ):
+                if record and record[ 'saveSeq' ] == saveSeq and useSeq > s.imageLastUse[ imageId ]:
+                    s.imageLastUse[ imageId ] = useSeq
+            s.lastSeq = max( s.lastSeq, useSeq )
+
+        # boot programs the startup image
+        startup = s.findImage( None )
+        if startup is not None and s.verifyImage( startup ):
+            s.configuredHash = s.records[ startup ][ 'hash' ]
+
+    # store
+    def refCounts( s ):
+        refs = {}
+        for record in s.records:
+            for slot in (record[ 'slots' ] if record else []):
+                refs[ slot ] = refs.get( slot, 0 ) + 1
+        for slot in (s.writer[ 'slots' ] if s.writer else []):
+            refs[ slot ] = refs.get( slot, 0 ) + 1
+        return refs
+
+    def findBlock( s, key ):
+        for slot, (k, data) in s.blocks.items():
+            if k == key:
+                return slot
+        return None
+
+    def findImage( s, bitStreamHash ):
+        found = None
+        for imageId, record in enumerate( s.records ):
+            if not record:
+                continue
+            if bitStreamHash:
+                if record[ 'hash' ] == bitStreamHash:
+                    return imageId
+            elif found is None or s.imageLastUse[ imageId ] > s.imageLastUse[ found ]:
+                found = imageId
+        return found
+
+    def lruImage( s ):
+        # startup image is only replaced once the new record is written
+        mruId = s.findImage( None )
+        ids = [ i for i, r in enumerate( s.records ) if r and i != mruId ]
+        return min( ids, key=lambda i: s.imageLastUse[ i ] ) if ids else None
+
+    def verifyImage( s, imageId ):
+        record = s.records[ imageId ]
+        data = b''.join( s.blocks[ slot ][ 1 ] if slot in s.blocks else b'' for slot in record[ 'slots' ] )
+        s.clockUs += len(data) / 1024.0 / RATES[ 'xip' ] * 1000000.0
+        return hashlib.sha256( data ).digest() == record[ 'hash' ]
+
+    def eraseRecord( s, imageId ):
+        s.clockUs += s.flash.erase( imageId )
+        s.records[ imageId ] = None
+        s.imageLastUse[ imageId ] = 0
+
+    def writeBlockSlot( s, slot, data, key ):
+        sector = LRU_SECTOR + 1 + slot
+        s.blocks.pop( slot, None )
+        s.clockUs += s.flash.erase( sector )
+        s.clockUs += s.flash.program( sector, BLOCK_HEADER_SZ + len(data) )
+        if s.flash.isWorn( sector ):
+            return False
+        s.blocks[ slot ] = (key, bytes( data ))
+        return True
+
+    def addBlock( s, data ):
+        key = hashlib.sha256( data ).digest()[ :BLOCK_KEY_SIZE ]
+        slot = s.findBlock( key )
+        if slot is None:
+            while True:
+                refs = s.refCounts()
+                free = [ i for i in range( BLOCK_SLOT_CNT ) if not refs.get( i ) and i not in s.pinned ]
+                erased = [ i for i in free if i not in s.blocks ]
+                if erased or free:
+                    slot = (erased or free)[ 0 ]
+                    break
+                lruId = s.lruImage()
+                if lruId is None:
+                    return False
+                s.eraseRecord( lruId )
+            if not s.writeBlockSlot( slot, data, key ):
+                return False
+        s.writer[ 'slots' ].append( slot )
+        s.writer[ 'hash' ].update( data )
+        return True
+
+    def commitImage( s ):
+        writer = s.writer
+        s.writer = None
+        s.pinned = set()
+        if not writer or len(writer[ 'slots' ]) != writer[ 'blockCnt' ]:
+            return False
+        record = { 'saveSeq': s.lastSeq + 1, 'slots': writer[ 'slots' ], 'hash': writer[ 'hash' ].digest(), 'bitStreamSz': writer[ 'bitStreamSz' ] }
+        same = [ i for i, r in enumerate( s.records ) if r and r[ 'hash' ] == record[ 'hash' ] ]
+        free = [ i for i, r in enumerate( s.records ) if not r ]
+        mruId = s.findImage( None )
+        imageId = free[ 0 ] if free else (same[ 0 ] if same and same[ 0 ] != mruId else s.lruImage())
+        if imageId is None:
+            imageId = same[ 0 ] if same else mruId
+
+        # record sector rewritten on every save, table pages then the header page
+        s.clockUs += s.flash.erase( imageId )
+        s.clockUs += s.flash.program( imageId, PAGE_SIZE + len(record[ 'slots' ]) * 2 )
+        s.lastSeq = record[ 'saveSeq' ]
+        if s.flash.isWorn( imageId ):
+            s.records[ imageId ] = None
+            s.imageLastUse[ imageId ] = 0
+            return False
+        s.records[ imageId ] = record
+        s.imageLastUse[ imageId ] = record[ 'saveSeq' ]
+        if same and same[ 0 ] != imageId:
+            s.eraseRecord( same[ 0 ] )
+        return True
+
+    def touchImage( s, imageId ):
+        if s.imageLastUse[ imageId ] == s.lastSeq:
+            return True
+        if len(s.useLog) >= LRU_ENTRY_CNT:
+            s.clockUs += s.flash.erase( LRU_SECTOR )
+            s.useLog = [ (r[ 'saveSeq' ], s.imageLastUse[ i ]) for i, r in enumerate( s.records ) if r ]
+            s.clockUs += s.flash.program( LRU_SECTOR, PAGE_SIZE )
+        s.clockUs += s.flash.program( LRU_SECTOR, PAGE_SIZE )
+        if s.flash.isWorn( LRU_SECTOR ):
+            return False
+        s.lastSeq += 1
+        s.useLog.append( (s.records[ imageId ][ 'saveSeq' ], s.lastSeq) )
+        s.imageLastUse[ imageId ] = s.lastSeq
+        return True
+
+    def programFromFlash( s, bitStreamHash ):
+        imageId = s.findImage( bitStreamHash )
+        if imageId is None or not s.verifyImage( imageId ):
+            return False
+        record = s.records[ imageId ]
+        s.clockUs += record[ 'bitStreamSz' ] / 1024.0 / RATES[ 'spi' ] * 1000000.0
+        s.configuredHash = record[ 'hash' ]
+        return True
+
+    # protocol
+    def latch( s, blockId, stage ):
+        if not s.programError[ 0 ]:
+            s.programError = (1, blockId, stage)
+
+    def programResponse( s, header, isErrorCmd=False ):
+        if isErrorCmd:
+            header = bytes( [ program.FabricCommands.UnkownCmd, header[ 1 ] ] )
+        return header + struct.pack( '<IHB', *s.programError )
+
+    def endProgram( s ):
+        if s.isProgramming:
+            s.isProgramming = False
+
+    def endFlashEmu( s ):
+        """
+            Pico spi access resets the design & takes the pins back, like fpga_wait_ready.
+        """
+        s.emuState = EMU_OFF
+
+    def flashEmuResponse( s, header, errorCode, imageSz ):
+        regionHash = hashlib.sha256( bytes( s.emuRegion[ :imageSz ] ) ).digest()
+        return header + struct.pack( '<IBIIHI32s', errorCode, s.emuState, FLASH_EMU_OFFSET, FLASH_EMU_SZ, FLASH_EMU_BLOCK_SZ, s.emuReadCnt, regionHash )
+
+    def programBlock( s, packet, header, body ):
+        """
+            ProgramBlock & ProgramBlockRef, inflate, spi & flash save advance the clock.
+        """
+        cmd = program.FabricCommands
+        responses = []
+        if s.isEarlyAck:
+            responses.append( s.programResponse( header ) )
+            if s.programError[ 0 ]:
+                return responses
+
+        if packet[ 0 ] == cmd.ProgramBlock:
+            blockId, compressedBlockSz, blockSz, blockCrc = struct.unpack_from( '<HHHB', body )
+            try:
+                data = zlib.decompress( body[ 7 + 2 : 7 + compressedBlockSz ] )
+                stage = STAGE_BLOCK_SIZE if len(data) != blockSz else (STAGE_BLOCK_CRC if sum( data ) & 0xff != blockCrc else STAGE_NONE)
+            except zlib.error:
+                data, stage = None, STAGE_INFLATE
+            s.clockUs += blockSz / 1024.0 / RATES[ 'inflate' ] * 1000000.0
+        else:
+            blockId, blockSz, blockCrc, key = struct.unpack_from( '<HHB24s', body )
+            slot = s.findBlock( key )
+            data = s.blocks[ slot ][ 1 ] if slot is not None else None
+            stage = STAGE_BLOCK_REF if data is None else (STAGE_BLOCK_SIZE if len(data) != blockSz else (STAGE_BLOCK_CRC if sum( data ) & 0xff != blockCrc else STAGE_NONE))
+
+        if stage != STAGE_NONE:
+            s.latch( blockId, stage )
+            if not s.isEarlyAck:
+                responses.append( s.programResponse( header, True ) )
+            return responses
+
+        s.clockUs += blockSz / 1024.0 / RATES[ 'spi' ] * 1000000.0
+        if not s.isEarlyAck:
+            responses.append( s.programResponse( header ) )
+        if s.writer is not None and not s.addBlock( data ):
+            s.writer = None
+            s.latch( blockId, STAGE_FLASH )
+        return responses
+
+    def dispatch( s, packet ):
+        """
+            Run one request payload, returns the response payloads.
+        """
+        cmd = program.FabricCommands
+        header, body = bytes( packet[ :2 ] ), bytes( packet[ 2: ] )
+        s.clockUs += (len(packet) + 4) / 1024.0 / RATES[ 'usb' ] * 1000000.0
+        if packet[ 0 ] not in ( cmd.ProgramBlock, cmd.ProgramBlockRef ):
+            s.clockUs = max( s.clockUs, s.busyUntilUs ) # waits for blocks still being worked on
+        generic = lambda errorCode: header + struct.pack( '<I', errorCode )
+
+        if packet[ 0 ] == cmd.Echo:
+            return [ bytes( packet ) ]
+
+        if packet[ 0 ] == cmd.QueryDevice:
+            s.endProgram()
+            return [ header + struct.pack( '<BI8sHHBB', 1, SIM_DEVICE_ID, s.uid, MAX_BLOCK_SZ, 4090, FEATURES & 0xff, FEATURES >> 8 ) ]
+
+        if packet[ 0 ] == cmd.ProgramDevice:
+            saveToFlash, totalSize, blockCount, bitstreamCrc = struct.unpack_from( '<BIIH', body )
+            flags = body[ 11 ] if len(body) > 11 else 0
+            s.isEarlyAck = (flags & program.PROGRAM_FLAG_EARLY_ACK) != 0
+            s.endFlashEmu()
+            s.programError = (0, 0, STAGE_NONE)
+            s.configuredHash = None
+            s.writer = None
+            s.pinned = set()
+            if saveToFlash:
+                if blockCount > (SECTOR_SIZE - PAGE_SIZE) // 2:
+                    s.latch( 0, STAGE_FLASH )
+                else:
+                    s.writer = { 'blockCnt': blockCount, 'bitStreamSz': totalSize, 'slots': [], 'hash': hashlib.sha256() }
+            s.isProgramming = True
+            return [ generic( 0 ) ]
+
+        if packet[ 0 ] in ( cmd.ProgramBlock, cmd.ProgramBlockRef ):
+            if not s.isEarlyAck:
+                return s.programBlock( packet, header, body )
+
+            # Early ack returns on receipt, the block's work queues behind the last one & overlaps the next transfer
+            arrivalUs = s.clockUs
+            s.clockUs = max( s.clockUs, s.busyUntilUs )
+            responses = s.programBlock( packet, header, body )
+            s.busyUntilUs = s.clockUs
+            s.clockUs = arrivalUs
+            return responses
+
+        if packet[ 0 ] == cmd.QueryBlockKeys:
+            keyCnt = struct.unpack_from( '<H', body )[ 0 ]
+            isStored = bytearray( program.MAX_QUERY_KEYS // 8 )
+            for i in range( keyCnt ):
+                slot = s.findBlock( body[ 2 + i * BLOCK_KEY_SIZE : 2 + (i + 1) * BLOCK_KEY_SIZE ] )
+                if slot is not None:
+                    if s.writer is not None:
+                        s.pinned.add( slot )
+                    isStored[ i // 8 ] |= 1 << (i % 8)
+            return [ header + struct.pack( '<IH', 0, keyCnt ) + bytes( isStored ) ]
+
+        if packet[ 0 ] == cmd.ProgramComplete:
+            s.isProgramming = False
+            if s.writer is not None and not s.programError[ 0 ]:
+                bitStreamHash = s.writer[ 'hash' ].copy().digest()
+                if s.commitImage():
+                    s.configuredHash = bitStreamHash
+                else:
+                    s.latch( 0xffff, STAGE_FLASH )
+            s.writer = None
+            s.isEarlyAck = False
+            return [ s.programResponse( header ) ]
+
+        if packet[ 0 ] == cmd.QueryBitstreamFlash:
+            s.endProgram()
+            imageId = s.findImage( None )
+            if imageId is None or not s.verifyImage( imageId ):
+                return [ header + struct.pack( '<IIIIB32s', 1, 0, 0, 0, 0, bytes( 32 ) ) ]
+            record = s.records[ imageId ]
+            return [ header + struct.pack( '<IIIIB32s', 0, 1, len(record[ 'slots' ]), record[ 'bitStreamSz' ], 0, record[ 'hash' ] ) ]
+
+        if packet[ 0 ] == cmd.ProgramBitstreamFromFlash:
+            s.endProgram()
+            s.endFlashEmu()
+            return [ generic( 0 if s.programFromFlash( None ) else 1 ) ]
+
+        if packet[ 0 ] == cmd.ClearBitstreamFlash:
+            s.endProgram()
+            s.writer = None
+            for imageId, record in enumerate( s.records ):
+                if record:
+                    s.eraseRecord( imageId )
+            return [ generic( 0 if s.findImage( None ) is None else 1 ) ]
+
+        if packet[ 0 ] == cmd.RebootProgrammer:
+            s.reboot()
+            return []
+
+        if packet[ 0 ] == cmd.ConfigureImage:
+            s.endProgram()
+            imageId = s.findImage( body[ :32 ] )
+            if imageId is None:
+                return [ header + struct.pack( '<IB', 0, 0 ) ]
+            s.endFlashEmu()
+            isOk = s.programFromFlash( body[ :32 ] ) and s.touchImage( imageId )
+            return [ header + struct.pack( '<IB', 0 if isOk else 1, 1 ) ]
+
+        if packet[ 0 ] == cmd.QueryImages:
+            ids = sorted( [ i for i, r in enumerate( s.records ) if r ], key=lambda i: -s.imageLastUse[ i ] )
+            hashes = b''.join( s.records[ i ][ 'hash' ] for i in ids ).ljust( MAX_IMAGES * 32, b'\0' )
+            return [ header + struct.pack( '<IB32sB', 0, 1 if s.configuredHash else 0, s.configuredHash or bytes( 32 ), len(ids) ) + hashes ]
+
+        if packet[ 0 ] == cmd.QueryFlashStatus:
+            f = s.flash
+            return [ header + struct.pack( '<IB8I', 0, 1, f.opCnt, f.chunkCnt, f.eraseBytes, f.programBytes, f.maxChunkUs, 0, 0, 0 ) ]
+
+        if packet[ 0 ] == cmd.FlashEmuWrite:
+            s.endProgram()
+            offset, blockSz, compressedBlockSz, blockCrc = struct.unpack_from( '<IHHB', body )
+            try:
+                data = zlib.decompress( body[ 9 : 9 + compressedBlockSz ] )
+            except zlib.error:
+                data = None
+            if data is None or len(data) != blockSz or sum( data ) & 0xff != blockCrc:
+                return [ generic( 2 ) ]
+            if offset % FLASH_EMU_BLOCK_SZ or blockSz == 0 or blockSz > FLASH_EMU_BLOCK_SZ or offset + blockSz > FLASH_EMU_SZ:
+                return [ generic( 1 ) ]
+            if s.emuState == EMU_SERVING:
+                s.emuState = EMU_RELEASED
+            s.clockUs += blockSz / 1024.0 / RATES[ 'inflate' ] * 1000000.0
+            if offset % SECTOR_SIZE == 0:
+                s.clockUs += SECTOR_ERASE_US
+                s.emuRegion[ offset : offset + SECTOR_SIZE ] = b'\xff' * SECTOR_SIZE
+            s.clockUs += blockSz / 1024.0 / RATES[ 'flashProgram' ] * 1000000.0
+            s.emuRegion[ offset : offset + blockSz ] = data
+            return [ generic( 0 ) ]
+
+        if packet[ 0 ] == cmd.FlashEmu:
+            mode, imageSz = struct.unpack_from( '<BI', body )
+            imageHash = body[ 5 : 5 + 32 ]
+            if imageSz > FLASH_EMU_SZ:
+                return [ s.flashEmuResponse( header, 1, 0 ) ]
+            errorCode = 0
+            if mode == program.FLASH_EMU_MODE_START:
+                s.endProgram()
+                if imageSz and hashlib.sha256( bytes( s.emuRegion[ :imageSz ] ) ).digest() != imageHash:
+                    errorCode = 4
+                elif s.emuState != EMU_SERVING:
+                    s.emuState = EMU_SERVING
+                    s.emuReadCnt = 0
+            elif mode == program.FLASH_EMU_MODE_STOP and s.emuState == EMU_SERVING:
+                s.emuState = EMU_RELEASED
+            return [ s.flashEmuResponse( header, errorCode, imageSz ) ]
+
+        return [ generic( 1 ) ]
+
+
+class SimFlashEmulator:
+    """
+        The emulator seen from the design, which is spi master on the config port. Reads return
+        what the PIO would shift out, late or missed edges show up as corrupt or 0xff data the way a
+        soft core would see them. Cycle costs are estimates for the RP2040 at its default clock.
+    """
+    SYS_HZ = 125000000
+    SYNC_CYCLES = 2             # gpio input synchroniser
+    EDGE_CYCLES = 4             # shortest sck half period the wait / out / wait loop follows, with the synchroniser
+    PUSH_CYCLES = 2             # in, push
+    DMA_CTRL_CYCLES = 5         # address word to the data channel's trigger
+    XIP_HIT_CYCLES = 3
+    XIP_MISS_CYCLES = 60        # continuous read of an 8 byte line at clkdiv 2
+    DATA_DMA_CYCLES = 3         # byte into the tx fifo
+    OUT_CYCLES = 3              # set pindirs, out null, out pins after autopull
+    RESTART_CYCLES = 250        # csn rise irq, sm & dma reset, from RAM
+    XIP_CACHE_LINE = 8
+    XIP_CACHE_LINES = 16 * 1024 // 8
+    TX_FIFO_DEPTH = 4
+
+    def __init__( s, device ):
+        s.device = device
+        s.cache = []            # line addresses, most recently used last
+
+    def maxSckHz( s ):
+        return s.SYS_HZ / (2 * s.EDGE_CYCLES)
+
+    def fetchCycles( s, addr ):
+        line = addr // s.XIP_CACHE_LINE
+        if line in s.cache:
+            s.cache.remove( line )
+            s.cache.append( line )
+            return s.XIP_HIT_CYCLES
+        s.cache.append( line )
+        if len(s.cache) > s.XIP_CACHE_LINES:
+            s.cache.pop( 0 )
+        return s.XIP_MISS_CYCLES
+
+    def firstByteCycles( s, addr ):
+        """
+            Last address bit sampled to the first data bit driven.
+        """
+        return s.SYNC_CYCLES + s.PUSH_CYCLES + s.DMA_CTRL_CYCLES + s.fetchCycles( addr ) + s.DATA_DMA_CYCLES + s.OUT_CYCLES
+
+    def transfer( s, mosi, sckHz, csHighUs=10.0 ):
+        """
+            One csn low transfer, mosi holds the command, address & dummy bytes then anything for the
+            data clocks. Returns the bytes on the answer line, 0xff where it is released.
+        """
+        mosi = bytes( mosi )
+        idle = b'\xff' * len(mosi)
+        if s.device.emuState != EMU_SERVING or csHighUs * 1e-6 * s.SYS_HZ < s.RESTART_CYCLES:
+            return idle
+        if sckHz > s.maxSckHz():
+            return idle             # edges missed, the command isn't recognised
+
+        # READ isn't answered, only FAST_READ's dummy clocks cover an XIP miss
+        if len(mosi) < 5 or mosi[ 0 ] != program.FLASH_EMU_FAST_READ_CMD:
+            return idle
+        headerSz = 5
+        addr = (mosi[ 1 ] << 16) | (mosi[ 2 ] << 8) | mosi[ 3 ]
+        s.device.emuReadCnt += 1
+
+        # First bit is driven on the fall after the 8 dummy clocks
+        periodCycles = s.SYS_HZ / float( sckHz )
+        deadline = periodCycles / 2 + 8 * periodCycles
+        lateBits = 0
+        latency = s.firstByteCycles( addr )
+        if latency > deadline:
+            lateBits = int( (latency - deadline + periodCycles - 1) // periodCycles )
+
+        # Following bytes stream while the fifo covers the fetch, misses every line
+        dataSz = max( 0, len(mosi) - headerSz )
+        data = bytearray()
+        for i in range( dataSz ):
+            flashOffset = (addr + i) & 0xffffff
+            if i and flashOffset % s.XIP_CACHE_LINE == 0:
+                stall = s.fetchCycles( flashOffset ) - s.TX_FIFO_DEPTH * 8 * periodCycles
+                if stall > 0:
+                    lateBits += int( (stall + periodCycles - 1) // periodCycles )
+            regionOffset = flashOffset - FLASH_EMU_OFFSET
+            data.append( s.device.emuRegion[ regionOffset ] if 0 <= regionOffset < FLASH_EMU_SZ else 0xff )
+
+        # Late bits leave the line released, the design samples 1s & the data slides
+        bits = '1' * lateBits + ''.join( format( b, '08b' ) for b in data )
+        data = bytes( int( bits[ i * 8 : i * 8 + 8 ], 2 ) for i in range( dataSz ) )
+        return idle[ :headerSz ] + data
+
+    def read( s, offset, size, sckHz, isFast=True ):
+        """
+            Design read of size bytes at a flash offset.
+        """
+        cmd = program.FLASH_EMU_FAST_READ_CMD if isFast else program.FLASH_EMU_READ_CMD
+        header = bytes( [ cmd, (offset >> 16) & 0xff, (offset >> 8) & 0xff, offset & 0xff ] ) + (b'\0' if isFast else b'')
+        return s.transfer( header + bytes( size ), sckHz )[ len(header): ]
+
+
+class SimTransport(program.FabricTransport):
+    """
+        Transport to a SimDevice, responses are decoded by the same classes as on a serial link.
+    """
+    def __init__( s, device, uri='sim://0' ):
+        s.device = device
+        s.responses = []
+        program.FabricTransport.__init__( s, 'sim', uri )
+
+    def init( s ):
+        s.counter = 0
+
+    def setFastTimeoutMode( s, isFash ):
+        pass
+
+    def closeTransport( s ):
+        pass
+
+    def clock( s ):
+        """
+            Simulated device time in seconds.
+        """
+        return s.device.clockUs / 1000000.0
+
+    def writeCommand( s, cmd, timeout=None, responseClass=None ):
+        s.counter = program._adduint8( s.counter, 1 )
+        packet = bytes( [ cmd.cmd, s.counter ] ) + cmd.toBytes()
+        s.txBytes += len(packet) + 4
+        s.responses = s.device.dispatch( packet )
+        if responseClass:
+            return s.readCommand( responseClass )
+
+    def readCommand( s, responseClass=None ):
+        if not s.responses:
+            raise Exception("No response")
+        data = s.responses.pop( 0 )
+        s.rxBytes += len(data) + 4
+        response = responseClass()
+        response.cmd = data[ 0 ]
+        response.counter = data[ 1 ]
+        response.fromBytes( list( data[ 2: ] ) )
+        return response
+
+
+if __name__ == '__main__':
+    # Which sck rates & read commands a soft core can boot with, cold & warm XIP cache
+    device = SimDevice()
+    transport = SimTransport( device )
+    image = bytes( (i * 7 + 3) & 0xff for i in range( 64 * 1024 ) )
+    transport.flashEmulate( image )
+    print( "%10s %8s %10s %10s" % ("sck MHz", "command", "cold", "warm") )
+    for sckMHz in ( 1, 4, 8, 12, 15, 16, 20 ):
+        for isFast in ( False, True ):
+            results = []
+            for isWarm in ( False, True ):
+                emulator = SimFlashEmulator( device )
+                if isWarm:
+                    emulator.read( FLASH_EMU_OFFSET, 256, 1000000 )
+                data = emulator.read( FLASH_EMU_OFFSET, 256, sckMHz * 1000000, isFast )
+                results.append( 'ok' if data == image[ :256 ] else ('ignored' if data == b'\xff' * 256 else 'corrupt') )
+            print( "%10s %8s %10s %10s" % (sckMHz, 'FAST' if isFast else 'READ', results[ 0 ], results[ 1 ]) )
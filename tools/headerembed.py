@@ -1,13 +1,28 @@
-import sys
+import sys, zlib
 
-def generateCppEmbedFile( inputDataFilename, varname ):
+def compressBlocks( dataStr, blockSz ):
+    """
+        Split into zlib compressed blocks, each stored as uint16 compressed size, uint16 block size
+        then the zlib stream. Matches FCMD_ProgramBlock so the bootloader inflates them the same way.
+    """
+    res = b''
+    for i in range( 0, len(dataStr), blockSz ):
+        block = dataStr[ i : i + blockSz ]
+        cblock = zlib.compress( block, level=9 )
+        res += len(cblock).to_bytes( 2, 'little' ) + len(block).to_bytes( 2, 'little' ) + cblock
+    return res
+
+
+def generateCppEmbedFile( inputDataFilename, varname, blockSz=None, section="" ):
     """
         Convert file to c include.
     """
     dataStr = open( inputDataFilename, "rb" ).read()
     assert(len(dataStr))
+    if blockSz:
+        dataStr = compressBlocks( dataStr, blockSz )
 
-    codeStr = "#include <pico/platform.h>\nuint8_t __in_flash() %s[] = {\n" % varname
+    codeStr = "#include <pico/platform.h>\nuint8_t __in_flash(%s) %s[] = {\n" % (section, varname)
 
     bufferStr = ""
     maxCol = 32
@@ -28,16 +43,17 @@ def generateCppEmbedFile( inputDataFilename, varname ):
     return codeStr
 
 
-def generateEmbededFileHeader( inputFilename, outputEmbedCppFilename, varname="embdedData" ):
+def generateEmbededFileHeader( inputFilename, outputEmbedCppFilename, varname="embdedData", blockSz=None ):
     """
-        generateEmbededFileHeader
+        generateEmbededFileHeader, with blockSz the data is stored as compressed blocks in its own
+        flash section named after varname.
     """   
     codeStr = ''    
-    codeStr = codeStr + generateCppEmbedFile( inputFilename, varname ) 
+    codeStr = codeStr + generateCppEmbedFile( inputFilename, varname, blockSz, '"%s"' % varname if blockSz else "" ) 
     open(outputEmbedCppFilename,"w").write(codeStr)
 
 
-generateEmbededFileHeader(sys.argv[1], sys.argv[2], sys.argv[3])
+generateEmbededFileHeader(sys.argv[1], sys.argv[2], sys.argv[3], int(sys.argv[4]) if len(sys.argv) > 4 else None)
 
     
 
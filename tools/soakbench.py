@@ -0,0 +1,301 @@
+"""
+Soak & throughput drift benchmark. Runs a long randomized sequence of program,
+save, clear, program from flash & reboot cycles against a board or the host
+simulator and reports what only shows up over time: latency percentiles per
+operation, throughput drift across the run, flash erase counts & errors.
+
+Cycles go through the same FabricTransport calls as program.py, so a save is
+ProgramDevice / ProgramBlock / ProgramComplete with saveToFlash. Saves and
+clears are verified with QueryBitstreamFlash. Images are USERCODE variants of
+the reference image so saves exercise the image cache & block dedup.
+
+Latency on a board is wall time. On the simulator it is modelled device time
+(see tools/fabricsim.py), so simulator runs are deterministic for a seed and
+drift there comes from the store, e.g. LRU evictions & log sector rewrites.
+Board erase counts come from QueryFlashStatus, the simulator also reports the
+most erased sector, which is where a board without wear leveling fails first.
+
+Exits with 1 when any cycle failed or throughput drifted past the tolerance.
+
+Usage:
+    $ python tools/soakbench.py --sim --cycles=5000
+    $ python tools/soakbench.py --port=/dev/ttyACM0 --cycles=2000 --report=soak.json
+    $ python tools/soakbench.py --sim --endurance=200 --mix=save:8,flash:1
+
+"""
+import os, sys, io, time, json, random, hashlib, contextlib
+from optparse import OptionParser
+
+sys.path.insert( 0, os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'sw', 'programmer' ) )
+import program
+import fabricsim
+
+# defaults
+REFERENCE_IMAGE = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'data', 'blinky.bit' )
+DEFAULT_MIX = 'program:3,save:3,flash:3,clear:1,reboot:1'
+DEFAULT_CYCLES = 1000
+DEFAULT_IMAGES = 4
+DEFAULT_WINDOW = 50 # cycles per drift window
+DEFAULT_DRIFT_TOLERANCE = 0.10 # allowed drop of last window throughput against the first
+REBOOT_WAIT = 10.0 # seconds to reconnect a board that didn't reattach after a reboot
+OPS = [ 'program', 'save', 'clear', 'flash', 'reboot' ]
+
+
+def percentile( values, p ):
+    if not values:
+        return 0.0
+    values = sorted( values )
+    return values[ min( len(values) - 1, int( p / 100.0 * len(values) ) ) ]
+
+
+def slope( values ):
+    """
+        Least squares slope of values against their index.
+    """
+    n = len(values)
+    if n < 2:
+        return 0.0
+    mx = (n - 1) / 2.0
+    my = sum( values ) / n
+    return sum( (i - mx) * (v - my) for i, v in enumerate( values ) ) / sum( (i - mx) ** 2 for i in range( n ) )
+
+
+def parseMix( mix ):
+    weights = {}
+    for item in mix.split(','):
+        op, weight = item.split(':')
+        if op not in OPS:
+            raise Exception("Unknown op '%s', expected one of %s" % (op, ', '.join( OPS )))
+        weights[ op ] = float( weight )
+    return weights
+
+
+def loadImages( files, count ):
+    """
+        Image files as given, or USERCODE variants of the reference image.
+    """
+    if files:
+        return [ open( f, 'rb' ).read() for f in files ]
+    data = open( REFERENCE_IMAGE, 'rb' ).read()
+    bitstream = program.Ecp5Bitstream( data )
+    return [ data ] + [ bitstream.patch( [ { 'usercode': i } ] ) for i in range( 1, count ) ]
+
+
+class Soak:
+    """
+        Runs the cycles & collects per cycle samples.
+    """
+    def __init__( s, options, images ):
+        s.options = options
+        s.images = images
+        s.rnd = random.Random( options.seed )
+        s.weights = parseMix( options.mix )
+        s.samples = [] # ( cycle, op, seconds, bytes )
+        s.errors = []
+        s.eraseCnt = 0
+        s.lastEraseBytes = None
+        s.storedHash = None # startup image expected in flash
+        s.device = None
+        s.transport = s.connect()
+
+    def connect( s ):
+        if s.options.sim:
+            if not s.device:
+                s.device = fabricsim.SimDevice( endurance=s.options.endurance )
+            return fabricsim.SimTransport( s.device )
+
+        deadline = time.time() + REBOOT_WAIT
+        while True:
+            try:
+                transport = program.FabricTransport.createTransportForUri( 'usbserial://' + s.options.port )
+                if transport:
+                    transport.queryDevice()
+                    return transport
+            except Exception as e:
+                if time.time() > deadline:
+                    raise
+            time.sleep( 0.5 )
+
+    def clock( s ):
+        if s.options.sim:
+            return s.transport.clock()
+        return time.time()
+
+    def pickOp( s ):
+        ops = [ op for op in OPS if s.weights.get( op ) and (op != 'flash' or s.storedHash) ]
+        return s.rnd.choices( ops, [ s.weights[ op ] for op in ops ] )[ 0 ]
+
+    def verifyStored( s ):
+        flashInfo = s.transport.queryBitstreamFlash()
+        storedHash = flashInfo.bitStreamHash if flashInfo and flashInfo.errorCode == 0 else None
+        if storedHash != s.storedHash:
+            raise Exception("Startup image %s, expected %s" % (storedHash.hex() if storedHash else None, s.storedHash.hex() if s.storedHash else None))
+
+    def runOp( s, op ):
+        """
+            Run one op, returns bytes programmed.
+        """
+        t = s.transport
+        if op in ( 'program', 'save' ):
+            data = s.rnd.choice( s.images )
+            t.programDevice( data, saveToFlash=(op == 'save'), earlyAck=not s.options.syncack )
+            if op == 'save':
+                s.storedHash = program.imageHash( data )
+            return len(data)
+
+        if op == 'clear':
+            if not t.clearFlash():
+                raise Exception("Clear failed")
+            s.storedHash = None
+            return 0
+
+        if op == 'flash':
+            if not t.programFromFlash():
+                raise Exception("Program from flash failed")
+            return 0
+
+        if op == 'reboot':
+            if s.options.sim:
+                t.rebootProgrammer()
+                return 0
+            # board can come back on another port
+            s.transport = t.rebootAndReattach()
+            if not s.transport:
+                s.transport = s.connect()
+                raise Exception("Board didn't reattach after reboot")
+            s.options.port = s.transport.port
+            return 0
+
+    def updateEraseCnt( s ):
+        status = s.transport.queryFlashStatus()
+        if not status or status.errorCode != 0:
+            return
+        # device counters restart on reboot
+        if s.lastEraseBytes is None or status.eraseBytes < s.lastEraseBytes:
+            s.lastEraseBytes = 0 if s.lastEraseBytes is not None else status.eraseBytes
+        s.eraseCnt += (status.eraseBytes - s.lastEraseBytes) // fabricsim.SECTOR_SIZE
+        s.lastEraseBytes = status.eraseBytes
+
+    def run( s ):
+        s.updateEraseCnt()
+        for cycle in range( s.options.cycles ):
+            op = s.pickOp()
+            out = io.StringIO()
+            try:
+                with contextlib.redirect_stdout( out if not s.options.verbose else sys.stdout ):
+                    start = s.clock()
+                    sz = s.runOp( op )
+                    elapsed = s.clock() - start
+                    if op in ( 'save', 'clear' ):
+                        s.verifyStored()
+                    s.updateEraseCnt()
+                s.samples.append( ( cycle, op, elapsed, sz ) )
+            except Exception as e:
+                s.errors.append( { 'cycle': cycle, 'op': op, 'error': str(e) } )
+                program.log( program.LogLevel.Warn, "Cycle %d %s failed: %s" % (cycle, op, str(e)) )
+                # resync the store state we expect
+                try:
+                    flashInfo = s.transport.queryBitstreamFlash()
+                    s.storedHash = flashInfo.bitStreamHash if flashInfo and flashInfo.errorCode == 0 else None
+                except Exception as e:
+                    s.errors.append( { 'cycle': cycle, 'op': 'resync', 'error': str(e) } )
+            if (cycle + 1) % s.options.window == 0:
+                program.log( program.LogLevel.Progress, "Cycle %d / %d, %d errors" % (cycle + 1, s.options.cycles, len(s.errors)) )
+
+    def report( s ):
+        o = s.options
+        ops = {}
+        for op in OPS:
+            lat = [ t for c, sop, t, sz in s.samples if sop == op ]
+            if lat:
+                ops[ op ] = { 'count': len(lat), 'p50': percentile( lat, 50 ), 'p95': percentile( lat, 95 ), 'p99': percentile( lat, 99 ), 'max': max( lat ) }
+
+        # programmed throughput & worst op latency per window of cycles
+        windows = []
+        for w in range( 0, o.cycles, o.window ):
+            inWindow = [ x for x in s.samples if w <= x[ 0 ] < w + o.window ]
+            sz = sum( x[ 3 ] for x in inWindow if x[ 3 ] )
+            t = sum( x[ 2 ] for x in inWindow if x[ 3 ] )
+            windows.append( { 'firstCycle': w, 'kbps': (sz / 1024.0 / t) if t else 0.0, 'p95': percentile( [ x[ 2 ] for x in inWindow ], 95 ) } )
+        rates = [ w[ 'kbps' ] for w in windows if w[ 'kbps' ] ]
+        ratio = rates[ -1 ] / rates[ 0 ] if len(rates) > 1 else 1.0
+        drift = { 'slopePct': 100.0 * slope( rates ) / rates[ 0 ] if rates else 0.0, 'lastToFirst': ratio, 'tolerance': o.drifttolerance, 'isDrifting': ratio < 1.0 - o.drifttolerance }
+
+        flash = { 'eraseCnt': s.eraseCnt }
+        if s.device:
+            f = s.device.flash
+            worst = max( range( fabricsim.MAX_SECTOR ), key=lambda i: f.eraseCnt[ i ] )
+            region = 'image record' if worst < fabricsim.LRU_SECTOR else ('lru log' if worst == fabricsim.LRU_SECTOR else 'block slot')
+            flash.update( { 'eraseCnt': sum( f.eraseCnt ), 'maxSector': worst, 'maxSectorRegion': region, 'maxSectorEraseCnt': f.eraseCnt[ worst ],
+                'wornSectors': sum( 1 for i in range( fabricsim.MAX_SECTOR ) if f.isWorn( i ) ) } )
+
+        return { 'target': 'sim' if o.sim else o.port, 'seed': o.seed, 'cycles': o.cycles, 'mix': s.weights, 'images': len(s.images),
+                 'latency': ops, 'windows': windows, 'drift': drift, 'flash': flash, 'errors': s.errors }
+
+
+def printReport( report ):
+    print("Soak %s, %d cycles, seed %d, %d images" % (report[ 'target' ], report[ 'cycles' ], report[ 'seed' ], report[ 'images' ]) )
+    print("%-8s %6s %10s %10s %10s %10s" % ('op', 'count', 'p50 ms', 'p95 ms', 'p99 ms', 'max ms') )
+    for op, l in report[ 'latency' ].items():
+        print("%-8s %6d %10.1f %10.1f %10.1f %10.1f" % (op, l[ 'count' ], 1000 * l[ 'p50' ], 1000 * l[ 'p95' ], 1000 * l[ 'p99' ], 1000 * l[ 'max' ]) )
+
+    d = report[ 'drift' ]
+    print("Throughput drift: %+.2f%% per window, last / first window %.3f%s" % (d[ 'slopePct' ], d[ 'lastToFirst' ], ' DRIFTING' if d[ 'isDrifting' ] else '') )
+
+    f = report[ 'flash' ]
+    line = "Flash: %d sector erases" % f[ 'eraseCnt' ]
+    if 'maxSector' in f:
+        line += ", most erased sector %d (%s) %d times, %d worn" % (f[ 'maxSector' ], f[ 'maxSectorRegion' ], f[ 'maxSectorEraseCnt' ], f[ 'wornSectors' ])
+    print(line)
+
+    print("Errors: %d" % len(report[ 'errors' ]) )
+    for e in report[ 'errors' ][ :10 ]:
+        print("  cycle %d %s: %s" % (e[ 'cycle' ], e[ 'op' ], e[ 'error' ]) )
+
+
+def main():
+    parser = OptionParser( usage="usage: %prog [options] [image.bit ...]" )
+    parser.add_option("-p", "--port", dest="port",
+                      help="COM port of the board to soak")
+    parser.add_option("", "--sim", action="store_true", default=False,
+                      help="Soak the host simulator instead of a board")
+    parser.add_option("-n", "--cycles", dest="cycles", type="int", default=DEFAULT_CYCLES,
+                      help="Cycles to run")
+    parser.add_option("", "--seed", dest="seed", type="int", default=1,
+                      help="Random seed of the op sequence")
+    parser.add_option("", "--mix", dest="mix", default=DEFAULT_MIX,
+                      help="Op weights, e.g. 'program:3,save:3,flash:3,clear:1,reboot:1'")
+    parser.add_option("", "--images", dest="images", type="int", default=DEFAULT_IMAGES,
+                      help="USERCODE variants of the reference image to cycle through")
+    parser.add_option("", "--window", dest="window", type="int", default=DEFAULT_WINDOW,
+                      help="Cycles per throughput drift window")
+    parser.add_option("", "--drift-tolerance", dest="drifttolerance", type="float", default=DEFAULT_DRIFT_TOLERANCE,
+                      help="Allowed throughput drop of the last window against the first")
+    parser.add_option("", "--endurance", dest="endurance", type="int", default=fabricsim.DEFAULT_ENDURANCE,
+                      help="Simulated erase cycles before a sector fails")
+    parser.add_option("", "--sync-ack", action="store_true", dest="syncack", default=False,
+                      help="Wait for each block to be processed before sending the next")
+    parser.add_option("", "--report", dest="report",
+                      help="Write the report as JSON to this file")
+    parser.add_option("-v", "--verbose", action="store_true", default=False,
+                      help="Show programmer output of each cycle")
+    (options, args) = parser.parse_args()
+
+    if not options.sim and not options.port:
+        parser.error("Pass --port or --sim")
+
+    program.LogLevel.GlobalLevel = program.LogLevel.Info if options.verbose else program.LogLevel.Warn
+    soak = Soak( options, loadImages( args, options.images ) )
+    soak.run()
+    report = soak.report()
+
+    printReport( report )
+    if options.report:
+        with open( options.report, 'w' ) as f:
+            json.dump( report, f, indent=2 )
+
+    return 1 if report[ 'errors' ] or report[ 'drift' ][ 'isDrifting' ] else 0
+
+
+if __name__ == "__main__":
+    sys.exit( main() )
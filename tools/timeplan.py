@@ -0,0 +1,348 @@
+"""
+Programming time predictor & capacity planner. Splits a bitstream into the
+blocks program.py would send, measures how each compresses and predicts the
+time of each protocol mode from calibrated stage rates, so station layouts
+and boot budgets can be sized for a part before any board runs it.
+
+Modes:
+    upload-sync   ProgramDevice & blocks, each block processed before its ack
+    upload        the same with early ack, the link overlaps device work
+    save          early ack upload stored in the block store, erase & program
+                  per new block plus the image record
+    flash         ProgramBitstreamFromFlash, image verified over XIP then
+                  streamed to the FPGA
+    boot          startup configure from the store, flash without the host
+
+Stage rates are KB/s like `program.py --selftest-perf` reports them, plus the
+link round trip. They come from the nominal baseline, a --perfbaseline file,
+a live board (--port runs the self test & splits the echo rate into link
+bandwidth & round trip) or the host simulator (--sim, which also runs each
+mode in tools/fabricsim.py & reports its modelled time next to the
+prediction). The simulator overlaps early ack blocks with the device work
+of the last one like the prediction does but doesn't model the round trip.
+Modes whose prediction & simulator time differ by more than --sim-tolerance
+are marked & the exit code is 1.
+
+Images with more distinct blocks than the store has slots can't be saved,
+their save, flash & boot modes are reported as not fitting.
+
+--target picks the bootloader flash layout, RP2040 stores a block per
+4KB sector & RP2350 per 16KB slot of 4 sectors, each new block erases its
+whole slot. It follows --blocksz when not given. The simulator always runs
+the RP2040 layout.
+
+--boards & --hub-kbps size a station: boards programmed together share the
+hub's bandwidth, the cycle time & boards per hour follow from the slowest.
+
+Usage:
+    $ python tools/timeplan.py data/blinky.bit
+    $ python tools/timeplan.py --part=85k:dense --rates=baseline.json --uid=E6614103E7452D2F
+    $ python tools/timeplan.py --port=/dev/ttyACM0 mydesign.bit
+    $ python tools/timeplan.py --sim --part=45k:medium --part=85k:medium
+    $ python tools/timeplan.py --target=rp2350 --part=85k:dense
+    $ python tools/timeplan.py --boards=8 --hub-kbps=900 --base=release.bit mydesign.bit
+
+"""
+import os, sys, io, json, contextlib
+from optparse import OptionParser
+
+sys.path.insert( 0, os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'sw', 'programmer' ) )
+import program
+import fabricsim
+import codecbench
+
+# defaults
+REFERENCE_IMAGE = os.path.join( os.path.dirname( os.path.abspath( __file__ ) ), '..', 'data', 'blinky.bit' )
+DEFAULT_RTT_MS = 1.0 # usb full speed, request & response each wait for a 1ms frame at worst
+FRAME_OVERHEAD = 4 # magic, size & crc around each payload
+HEADER_SZ = 2 # cmd & counter
+GENERIC_RESPONSE_SZ = HEADER_SZ + 4
+BLOCK_RESPONSE_SZ = HEADER_SZ + 7 # early ack carries the latched error
+BLOCK_SLOT_HEADER_SZ = 32
+SECTOR_SIZE = 4096
+TARGETS = { 'rp2040': (256, 1), 'rp2350': (512, 4) } # store sectors & sectors per block slot, bitstream_store.h
+RTT_PROBE_COUNT = 32
+STORED_MODES = [ 'save', 'flash', 'boot' ]
+MODES = [ 'upload-sync', 'upload', 'save', 'flash', 'boot' ]
+SIM_TOLERANCE = 0.1 # relative difference of prediction & simulator that marks a mode
+
+
+def framed( payloadSz ):
+    return payloadSz + HEADER_SZ + FRAME_OVERHEAD
+
+
+def analyseImage( data, blockSz, baseKeys=() ):
+    """
+        Blocks as programDevice sends them, (rawSz, compressedWireSz, refWireSz, isStored). isStored blocks are
+        already in the store when saving, from the base image or an earlier block of this one.
+    """
+    blocks = []
+    storedKeys = set( baseKeys )
+    for i in range( 0, len(data), blockSz ):
+        block = data[ i : i + blockSz ]
+        key = program.blockKey( block )
+        cmd = program.FQueryProgramBlock()
+        cmd.bitStreamBlock = program.compressData( block )
+        ref = program.FProgramBlockRef()
+        ref.blockKey = key
+        blocks.append( (len(block), framed( len(cmd.toBytes()) ), framed( len(ref.toBytes()) ), key in storedKeys) )
+        storedKeys.add( key )
+    return blocks
+
+
+def kbSeconds( sz, kbps ):
+    return (sz / 1024.0) / kbps if kbps else float('inf')
+
+
+def storeLayout( target ):
+    """
+        ( block slot bytes, block slots, largest block ) of a target's flash store.
+    """
+    sectorCnt, slotSectors = TARGETS[ target ]
+    slotSz = slotSectors * SECTOR_SIZE
+    return slotSz, (sectorCnt - program.MAX_DEVICE_IMAGES - 1) * SECTOR_SIZE // slotSz, slotSz - BLOCK_SLOT_HEADER_SZ
+
+
+def predict( blocks, rates, mode, linkKBps=None, slotSz=SECTOR_SIZE ):
+    """
+        Seconds for mode with the stage totals & the stage that bounds it. linkKBps overrides the link rate,
+        for boards sharing a hub.
+    """
+    usb = linkKBps or rates[ 'usb' ]
+    rtt = rates[ 'rttMs' ] / 1000.0
+    imageSz = sum( b[ 0 ] for b in blocks )
+    stages = dict( link=0.0, rtt=0.0, inflate=0.0, spi=0.0, flash=0.0, xip=0.0 )
+
+    if mode in ( 'flash', 'boot' ):
+        stages[ 'xip' ] = kbSeconds( imageSz, rates[ 'xip' ] )
+        stages[ 'spi' ] = kbSeconds( imageSz, rates[ 'spi' ] )
+        if mode == 'flash':
+            stages[ 'link' ] = kbSeconds( framed( 0 ) + framed( GENERIC_RESPONSE_SZ - HEADER_SZ ), usb )
+            stages[ 'rtt' ] = rtt
+        total = sum( stages.values() )
+        return total, stages, max( stages, key=stages.get )
+
+    isSave = mode == 'save'
+    isEarlyAck = mode != 'upload-sync'
+    responseSz = framed( (BLOCK_RESPONSE_SZ if isEarlyAck else GENERIC_RESPONSE_SZ) - HEADER_SZ )
+
+    # ProgramDevice, then QueryBlockKeys when saving
+    total = kbSeconds( framed( len(program.FProgramDevicePacket().toBytes()) ) + framed( GENERIC_RESPONSE_SZ - HEADER_SZ ), usb ) + rtt
+    stages[ 'rtt' ] += rtt
+    if isSave:
+        keyQueries = (len(blocks) + program.MAX_QUERY_KEYS - 1) // program.MAX_QUERY_KEYS
+        total += keyQueries * rtt
+        stages[ 'rtt' ] += keyQueries * rtt
+
+    lastDevice = 0.0
+    for rawSz, wireSz, refWireSz, isStored in blocks:
+        isRef = isSave and isStored
+        host = kbSeconds( (refWireSz if isRef else wireSz) + responseSz, usb )
+        inflate = 0.0 if isRef else kbSeconds( rawSz, rates[ 'inflate' ] )
+        spi = kbSeconds( rawSz, rates[ 'spi' ] )
+        flash = 0.0
+        if isSave and not isRef:
+            flash = kbSeconds( slotSz, rates[ 'flashErase' ] ) + kbSeconds( BLOCK_SLOT_HEADER_SZ + rawSz, rates[ 'flashProgram' ] )
+        device = inflate + spi + flash
+
+        stages[ 'link' ] += host
+        stages[ 'rtt' ] += rtt
+        stages[ 'inflate' ] += inflate
+        stages[ 'spi' ] += spi
+        stages[ 'flash' ] += flash
+
+        # Early ack sends this block while the device works on the last one
+        if isEarlyAck:
+            total += max( host + rtt, lastDevice )
+            lastDevice = device
+        else:
+            total += host + rtt + device
+
+    # ProgramComplete waits for the last block, saves write the image record
+    record = 0.0
+    if isSave:
+        record = kbSeconds( SECTOR_SIZE, rates[ 'flashErase' ] ) + kbSeconds( fabricsim.PAGE_SIZE, rates[ 'flashProgram' ] )
+        stages[ 'flash' ] += record
+    total += lastDevice + record + kbSeconds( framed( 0 ) + responseSz, usb ) + rtt
+    stages[ 'rtt' ] += rtt
+    return total, stages, max( stages, key=stages.get )
+
+
+def loadRates( options ):
+    """
+        Stage rates & where they came from.
+    """
+    if options.sim:
+        return dict( fabricsim.RATES, rttMs=0.0 ), 'simulator'
+
+    if options.port:
+        transport = program.FabricTransport.createTransportForUri( 'usbserial://' + options.port )
+        try:
+            result = transport.selfTestPerf()
+            if not result or result.errorCode != 0:
+                raise Exception("Pipeline self test failed on '%s'" % options.port)
+            rates = result.rates()
+
+            # echo time of a tiny payload is the round trip, the rest of a full payload is bandwidth
+            rttKBps = transport.measureLinkRate( payloadSz=1, count=RTT_PROBE_COUNT )
+            rtt = (2 / 1024.0) / rttKBps
+            perEcho = (2 * program.PERF_ECHO_SIZE / 1024.0) / transport.measureLinkRate()
+            rates[ 'usb' ] = (2 * program.PERF_ECHO_SIZE / 1024.0) / max( perEcho - rtt, 1e-6 )
+            rates[ 'rttMs' ] = rtt * 1000.0
+            return rates, "board on '%s', %dMHz spi" % (options.port, result.spiClockHz // 1000000)
+        finally:
+            transport.closeTransport()
+
+    if options.rates:
+        baselines = json.loads( open( options.rates, 'r' ).read() )
+        uid = options.uid or (list( baselines.keys() )[ 0 ] if len(baselines) == 1 else None)
+        if uid not in baselines:
+            raise Exception("Pass --uid, '%s' holds %s" % (options.rates, ', '.join( baselines.keys() )))
+        return dict( baselines[ uid ], rttMs=options.rttms ), "baseline of '%s' in '%s'" % (uid, options.rates)
+
+    return dict( program.PERF_BASELINE_DEFAULT, rttMs=options.rttms ), 'nominal baseline'
+
+
+def simulate( data, mode, baseImage=None ):
+    """
+        Modelled device seconds of mode in the host simulator, None where it has no equivalent.
+    """
+    device = fabricsim.SimDevice()
+    transport = fabricsim.SimTransport( device )
+    with contextlib.redirect_stdout( io.StringIO() ):
+        if baseImage:
+            transport.programDevice( baseImage, saveToFlash=True )
+        if mode in ( 'flash', 'boot' ):
+            transport.programDevice( data, saveToFlash=True )
+        t0 = device.clockUs
+        if mode == 'upload-sync':
+            transport.programDevice( data, earlyAck=False )
+        elif mode == 'upload':
+            transport.programDevice( data )
+        elif mode == 'save':
+            transport.programDevice( data, saveToFlash=True )
+        elif mode == 'flash':
+            transport.programFromFlash()
+        else:
+            return None
+    return (device.clockUs - t0) / 1000000.0
+
+
+def loadImages( args, parts ):
+    images = [ (os.path.basename( f ), open( f, 'rb' ).read()) for f in args ]
+    for part in parts:
+        name, _, utilisation = part.partition( ':' )
+        if name not in codecbench.SYNTHETIC_PARTS or (utilisation or 'medium') not in codecbench.SYNTHETIC_UTILISATION:
+            raise Exception("Unknown part '%s', expected one of %s with :%s" % (part, ', '.join( codecbench.SYNTHETIC_PARTS ), '|'.join( codecbench.SYNTHETIC_UTILISATION )))
+        utilisation = utilisation or 'medium'
+        images.append( ('%s:%s' % (name, utilisation), codecbench.syntheticImage( name, codecbench.SYNTHETIC_UTILISATION[ utilisation ] )) )
+    return images
+
+
+def main():
+    parser = OptionParser( usage="usage: %prog [options] [bitstream.bit ...]" )
+    parser.add_option("", "--part", dest="parts", action="append", default=[],
+                      help="Synthetic image of a part not at hand, e.g. 85k:dense, utilisation sparse, medium or dense")
+    parser.add_option("", "--rates", dest="rates",
+                      help="Stage rates from a program.py --perfbaseline file")
+    parser.add_option("", "--uid", dest="uid",
+                      help="Board uid in the --rates file")
+    parser.add_option("-p", "--port", dest="port",
+                      help="Measure stage rates & link round trip on this board")
+    parser.add_option("", "--sim", action="store_true", default=False,
+                      help="Use the simulator rates & check predictions against it")
+    parser.add_option("", "--sim-tolerance", dest="simtolerance", type="float", default=SIM_TOLERANCE,
+                      help="Relative difference of prediction & simulator that marks a mode with --sim")
+    parser.add_option("", "--rtt-ms", dest="rttms", type="float", default=DEFAULT_RTT_MS,
+                      help="Link round trip where rates don't come from a board")
+    parser.add_option("", "--target", dest="target", choices=sorted( TARGETS ),
+                      help="Bootloader flash layout, rp2040 or rp2350. Follows --blocksz by default")
+    parser.add_option("", "--blocksz", dest="blocksz", type="int",
+                      help="Device block size, the largest a --target slot takes by default")
+    parser.add_option("", "--store-slots", dest="storeslots", type="int",
+                      help="Block slots of the device store, from --target by default")
+    parser.add_option("", "--base", dest="base",
+                      help="Image already in the store, its blocks are sent by key when saving")
+    parser.add_option("", "--boards", dest="boards", type="int", default=1,
+                      help="Boards a station programs at once")
+    parser.add_option("", "--hub-kbps", dest="hubkbps", type="float",
+                      help="Bandwidth the station's boards share, KB/s")
+    parser.add_option("-j", "--json", action="store_true",
+                      help="Print results as json")
+    (options, args) = parser.parse_args()
+
+    if not options.target:
+        options.target = 'rp2350' if options.blocksz and options.blocksz + BLOCK_SLOT_HEADER_SZ > SECTOR_SIZE else 'rp2040'
+    slotSz, slotCnt, maxBlockSz = storeLayout( options.target )
+    options.blocksz = options.blocksz or maxBlockSz
+    options.storeslots = options.storeslots or slotCnt
+    if options.blocksz > maxBlockSz:
+        parser.error( "%d byte blocks don't fit a %d byte %s block slot" % (options.blocksz, slotSz, options.target) )
+
+    images = loadImages( args, options.parts )
+    if not images:
+        images = [ (os.path.basename( REFERENCE_IMAGE ), open( REFERENCE_IMAGE, 'rb' ).read()) ]
+
+    program.LogLevel.GlobalLevel = program.LogLevel.Warn
+    rates, source = loadRates( options )
+    baseImage = open( options.base, 'rb' ).read() if options.base else None
+    baseKeys = []
+    if baseImage:
+        baseKeys = [ program.blockKey( baseImage[ i : i + options.blocksz ] ) for i in range( 0, len(baseImage), options.blocksz ) ]
+
+    # boards on one hub split its bandwidth while they upload together
+    linkKBps = None
+    if options.hubkbps:
+        linkKBps = min( rates[ 'usb' ], options.hubkbps / max( 1, options.boards ) )
+
+    results = []
+    mismatchCnt = 0
+    for name, data in images:
+        blocks = analyseImage( data, options.blocksz, baseKeys )
+        wireSz = sum( b[ 1 ] for b in blocks )
+        distinctBlocks = len(blocks) - sum( 1 for b in blocks if b[ 3 ] ) + len(set( baseKeys ))
+        result = { 'image': name, 'size': len(data), 'blocks': len(blocks), 'compressedWireSz': wireSz,
+                   'ratio': round( len(data) / float( wireSz ), 2 ), 'storedBlocks': sum( 1 for b in blocks if b[ 3 ] ),
+                   'fitsStore': distinctBlocks <= options.storeslots, 'modes': {} }
+        for mode in MODES:
+            if mode in STORED_MODES and not result[ 'fitsStore' ]:
+                result[ 'modes' ][ mode ] = None
+                continue
+            seconds, stages, bound = predict( blocks, rates, mode, linkKBps, slotSz )
+            entry = { 'seconds': round( seconds, 4 ), 'bound': bound, 'stages': { k: round( v, 4 ) for k, v in stages.items() },
+                      'boardsPerHour': int( options.boards * 3600 / seconds ) if seconds else 0 }
+            if options.sim:
+                simSeconds = simulate( data, mode, baseImage )
+                entry[ 'simSeconds' ] = round( simSeconds, 4 ) if simSeconds is not None else None
+                entry[ 'simMismatch' ] = simSeconds is not None and abs( simSeconds - seconds ) > options.simtolerance * seconds
+                mismatchCnt += entry[ 'simMismatch' ]
+            result[ 'modes' ][ mode ] = entry
+        results.append( result )
+
+    if options.json:
+        print( json.dumps( { 'rates': rates, 'source': source, 'target': options.target, 'blockSz': options.blocksz, 'storeSlots': options.storeslots, 'boards': options.boards,
+                             'linkKBps': linkKBps or rates[ 'usb' ], 'results': results }, indent=4 ) )
+        return 1 if mismatchCnt else 0
+
+    print( "Rates from %s: %s, rtt %.2fms" % (source, ', '.join( "%s %.0f KB/s" % (k, rates[ k ]) for k in program.SelfTestPerf_Response.Stages ), rates[ 'rttMs' ]) )
+    print( "Store layout %s: %d block slots of %dKB, %d byte blocks" % (options.target, options.storeslots, slotSz // 1024, options.blocksz) )
+    if linkKBps:
+        print( "Station of %d boards sharing %.0f KB/s, %.0f KB/s each" % (options.boards, options.hubkbps, linkKBps) )
+    for result in results:
+        print( "\n%s: %d bytes, %d blocks, %.2fx on the wire, %d blocks already stored" % (result[ 'image' ], result[ 'size' ], result[ 'blocks' ], result[ 'ratio' ], result[ 'storedBlocks' ]) )
+        print( "  %-12s %9s %9s %9s %11s" % ('mode', 'seconds', 'bound', 'sim', 'boards/h') )
+        for mode in MODES:
+            entry = result[ 'modes' ][ mode ]
+            if not entry:
+                print( "  %-12s %9s, more distinct blocks than %d store slots" % (mode, "no fit", options.storeslots) )
+                continue
+            sim = '%.3f%s' % (entry[ 'simSeconds' ], '*' if entry[ 'simMismatch' ] else ' ') if entry.get( 'simSeconds' ) is not None else '- '
+            print( "  %-12s %9.3f %9s %10s %10d" % (mode, entry[ 'seconds' ], entry[ 'bound' ], sim, entry[ 'boardsPerHour' ]) )
+    if mismatchCnt:
+        print( "\n* %d modes differ from the simulator by more than %g%%" % (mismatchCnt, options.simtolerance * 100) )
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit( main() )